@@ -440,6 +440,13 @@ namespace objl
 			if (!file.is_open())
 				return false;
 
+			return LoadStream(file, Path);
+		}
+
+		// Load already read file contents, Path is only used to find material files
+		// (ToyEngine modification: split from LoadFile, so files can be read asynchronously)
+		bool LoadStream(std::istream& file, std::string Path)
+		{
 			LoadedMeshes.clear();
 			LoadedVertices.clear();
 			LoadedIndices.clear();
@@ -683,8 +690,6 @@ namespace objl
 				LoadedMeshes.push_back(tempMesh);
 			}
 
-			file.close();
-
 			// Set Materials for each Mesh
 			for (int i = 0; i < MeshMatNames.size(); i++)
 			{
@@ -7,10 +7,13 @@
 #include <3rdParty/imgui/implot.h>
 #include <3rdParty/cxxopts/cxxopts.hpp>
 #include <Driver/IDriver.h>
+#include <Renderer/WorldRenderer.h>
+#include <Util/AllocationCounter.h>
 #include <Util/AutoImGui.h>
 
 IDriver* drv;
 ThreadPool* tp;
+IoService* io;
 AssetManager* am;
 WorldRenderer* wr;
 IFullscreenExperiment* fe;
@@ -70,6 +73,8 @@ void init_cmdline_opts()
 		("d,driver", "Select graphics API to run with. Default is D3D11.", cxxopts::value<std::string>()->default_value(driverDefault), "d3d11|d3d12")
 		("debug-device", "Initialize debug D3D Device with Debug Layer enabled. Enabled by default in debug builds, disabled by default otherwise", cxxopts::value<bool>()->default_value(ddDefault))
 		("s,scene", "Load given scene by default.", cxxopts::value<std::string>()->default_value(sceneDefault)->implicit_value(""))
+		("io-backend", "Select how asset files are read. Overlapped keeps many reads in flight, thread reads one file at a time.", cxxopts::value<std::string>()->default_value("overlapped"), "overlapped|thread")
+		("render-thread", "Render on a dedicated thread, while the main thread simulates the next frame.", cxxopts::value<bool>()->default_value("false"))
 		;
 
 	parsed_cmdline = options.parse(__argc, __argv);
@@ -112,6 +117,9 @@ static void stats_window()
 	ImGuiIO io = ImGui::GetIO();
 	ImGui::Text("Average FPS:           %.1f", io.Framerate);
 	ImGui::Text("Average frame time:    %.3f ms", 1000.0f / io.Framerate);
+	ImGui::Text("Heap allocations:      %llu last frame", allocation_counter::get_num_allocations_last_frame());
+	if (wr != nullptr)
+		wr->statsGui();
 
 	if (ImGui::CollapsingHeader("Frame time graph"))
 	{
@@ -22,6 +22,7 @@ typedef unsigned long long uint64;
 
 extern class IDriver* drv;
 extern class ThreadPool* tp;
+extern class IoService* io;
 extern class AssetManager* am;
 extern class WorldRenderer* wr;
 extern class IFullscreenExperiment* fe;
@@ -0,0 +1,447 @@
+#include "CommandBuffer.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <Util/AutoImGui.h>
+
+// Params are recorded without padding, so the same commands always give the same bytes
+struct ResParams { ResId resId; };
+struct StageSlotParams { ShaderStage stage; unsigned int slot; ResId resId; };
+struct SlotParams { unsigned int slot; ResId resId; };
+struct TargetParams { ResId resId; unsigned int slice; unsigned int mip; };
+struct RenderTargetsParams { unsigned int numTargets; TargetParams depth; }; // Followed by numTargets TargetParams
+struct ShaderParams { ResId resId; unsigned int variantIndex; };
+struct DrawParams { unsigned int vertexCount; unsigned int startVertex; };
+struct DrawIndexedParams { unsigned int indexCount; unsigned int startIndex; int baseVertex; };
+struct DrawIndexedInstancedParams { unsigned int indexCount; unsigned int instanceCount; unsigned int startIndex; int baseVertex; unsigned int startInstance; };
+struct DispatchParams { unsigned int x; unsigned int y; unsigned int z; };
+struct ClearParams { unsigned int clearFlags; unsigned int colorTargetMask; float color[4]; float depth; unsigned int stencil; };
+struct EventParams { unsigned int labelSize; }; // Followed by the label, with the terminating zero
+
+void CommandBuffer::recordCommand(Command command)
+{
+	data.push_back((uint8)command);
+	numCommands++;
+}
+
+template <typename T>
+void CommandBuffer::recordParams(const T& params)
+{
+	const size_t offset = data.size();
+	data.resize(offset + sizeof(T));
+	memcpy(data.data() + offset, &params, sizeof(T));
+}
+
+void CommandBuffer::setInputLayout(ResId res_id)
+{
+	recordCommand(Command::SET_INPUT_LAYOUT);
+	recordParams(ResParams{ res_id });
+}
+
+void CommandBuffer::setIndexBuffer(ResId res_id)
+{
+	recordCommand(Command::SET_INDEX_BUFFER);
+	recordParams(ResParams{ res_id });
+}
+
+void CommandBuffer::setVertexBuffer(ResId res_id)
+{
+	recordCommand(Command::SET_VERTEX_BUFFER);
+	recordParams(ResParams{ res_id });
+}
+
+void CommandBuffer::setConstantBuffer(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	recordCommand(Command::SET_CONSTANT_BUFFER);
+	recordParams(StageSlotParams{ stage, slot, res_id });
+}
+
+void CommandBuffer::setBuffer(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	recordCommand(Command::SET_BUFFER);
+	recordParams(StageSlotParams{ stage, slot, res_id });
+}
+
+void CommandBuffer::setRwBuffer(unsigned int slot, ResId res_id)
+{
+	recordCommand(Command::SET_RW_BUFFER);
+	recordParams(SlotParams{ slot, res_id });
+}
+
+void CommandBuffer::setTexture(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	recordCommand(Command::SET_TEXTURE);
+	recordParams(StageSlotParams{ stage, slot, res_id });
+}
+
+void CommandBuffer::setRwTexture(unsigned int slot, ResId res_id)
+{
+	recordCommand(Command::SET_RW_TEXTURE);
+	recordParams(SlotParams{ slot, res_id });
+}
+
+void CommandBuffer::setSampler(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	recordCommand(Command::SET_SAMPLER);
+	recordParams(StageSlotParams{ stage, slot, res_id });
+}
+
+void CommandBuffer::setRenderTarget(ResId target_id, ResId depth_id,
+	unsigned int target_slice, unsigned int depth_slice, unsigned int target_mip, unsigned int depth_mip)
+{
+	recordCommand(Command::SET_RENDER_TARGET);
+	recordParams(TargetParams{ target_id, target_slice, target_mip });
+	recordParams(TargetParams{ depth_id, depth_slice, depth_mip });
+}
+
+void CommandBuffer::setRenderTargets(unsigned int num_targets, ResId* target_ids, ResId depth_id,
+	unsigned int* target_slices, unsigned int depth_slice, unsigned int* target_mips, unsigned int depth_mip)
+{
+	assert(num_targets <= MAX_RENDER_TARGETS);
+	recordCommand(Command::SET_RENDER_TARGETS);
+	recordParams(RenderTargetsParams{ num_targets, { depth_id, depth_slice, depth_mip } });
+	for (unsigned int i = 0; i < num_targets; i++)
+		recordParams(TargetParams{ target_ids[i], target_slices != nullptr ? target_slices[i] : 0, target_mips != nullptr ? target_mips[i] : 0 });
+}
+
+void CommandBuffer::setRenderState(ResId res_id)
+{
+	recordCommand(Command::SET_RENDER_STATE);
+	recordParams(ResParams{ res_id });
+}
+
+void CommandBuffer::setShader(ResId res_id, unsigned int variant_index)
+{
+	recordCommand(Command::SET_SHADER);
+	recordParams(ShaderParams{ res_id, variant_index });
+}
+
+void CommandBuffer::setView(float x, float y, float w, float h, float z_min, float z_max)
+{
+	setView(ViewportParams{ x, y, w, h, z_min, z_max });
+}
+
+void CommandBuffer::setView(const ViewportParams& vp)
+{
+	recordCommand(Command::SET_VIEW);
+	recordParams(vp);
+}
+
+void CommandBuffer::draw(unsigned int vertex_count, unsigned int start_vertex)
+{
+	recordCommand(Command::DRAW);
+	recordParams(DrawParams{ vertex_count, start_vertex });
+}
+
+void CommandBuffer::drawIndexed(unsigned int index_count, unsigned int start_index, int base_vertex)
+{
+	recordCommand(Command::DRAW_INDEXED);
+	recordParams(DrawIndexedParams{ index_count, start_index, base_vertex });
+}
+
+void CommandBuffer::drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance)
+{
+	recordCommand(Command::DRAW_INDEXED_INSTANCED);
+	recordParams(DrawIndexedInstancedParams{ index_count, instance_count, start_index, base_vertex, start_instance });
+}
+
+void CommandBuffer::dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z)
+{
+	recordCommand(Command::DISPATCH);
+	recordParams(DispatchParams{ num_threadgroups_x, num_threadgroups_y, num_threadgroups_z });
+}
+
+void CommandBuffer::clearRenderTargets(const RenderTargetClearParams clear_params)
+{
+	recordCommand(Command::CLEAR_RENDER_TARGETS);
+	ClearParams params;
+	params.clearFlags = clear_params.clearFlags;
+	params.colorTargetMask = clear_params.colorTargetMask;
+	memcpy(params.color, clear_params.color, sizeof(params.color));
+	params.depth = clear_params.depth;
+	params.stencil = clear_params.stencil;
+	recordParams(params);
+}
+
+void CommandBuffer::beginEvent(const char* label)
+{
+	recordCommand(Command::BEGIN_EVENT);
+	const unsigned int labelSize = (unsigned int)strlen(label) + 1;
+	recordParams(EventParams{ labelSize });
+	data.insert(data.end(), (const uint8*)label, (const uint8*)label + labelSize);
+}
+
+void CommandBuffer::endEvent()
+{
+	recordCommand(Command::END_EVENT);
+}
+
+template <typename T>
+static void read_params(const uint8*& read, T& out_params)
+{
+	memcpy(&out_params, read, sizeof(T));
+	read += sizeof(T);
+}
+
+void CommandBuffer::execute(ICommandBuffer& target) const
+{
+	const uint8* read = data.data();
+	const uint8* end = read + data.size();
+
+	while (read < end)
+	{
+		const Command command = (Command)*read++;
+		switch (command)
+		{
+		case Command::SET_INPUT_LAYOUT:
+		case Command::SET_INDEX_BUFFER:
+		case Command::SET_VERTEX_BUFFER:
+		case Command::SET_RENDER_STATE:
+		{
+			ResParams params;
+			read_params(read, params);
+			if (command == Command::SET_INPUT_LAYOUT)
+				target.setInputLayout(params.resId);
+			else if (command == Command::SET_INDEX_BUFFER)
+				target.setIndexBuffer(params.resId);
+			else if (command == Command::SET_VERTEX_BUFFER)
+				target.setVertexBuffer(params.resId);
+			else
+				target.setRenderState(params.resId);
+			break;
+		}
+		case Command::SET_CONSTANT_BUFFER:
+		case Command::SET_BUFFER:
+		case Command::SET_TEXTURE:
+		case Command::SET_SAMPLER:
+		{
+			StageSlotParams params;
+			read_params(read, params);
+			if (command == Command::SET_CONSTANT_BUFFER)
+				target.setConstantBuffer(params.stage, params.slot, params.resId);
+			else if (command == Command::SET_BUFFER)
+				target.setBuffer(params.stage, params.slot, params.resId);
+			else if (command == Command::SET_TEXTURE)
+				target.setTexture(params.stage, params.slot, params.resId);
+			else
+				target.setSampler(params.stage, params.slot, params.resId);
+			break;
+		}
+		case Command::SET_RW_BUFFER:
+		case Command::SET_RW_TEXTURE:
+		{
+			SlotParams params;
+			read_params(read, params);
+			if (command == Command::SET_RW_BUFFER)
+				target.setRwBuffer(params.slot, params.resId);
+			else
+				target.setRwTexture(params.slot, params.resId);
+			break;
+		}
+		case Command::SET_RENDER_TARGET:
+		{
+			TargetParams colorParams, depthParams;
+			read_params(read, colorParams);
+			read_params(read, depthParams);
+			target.setRenderTarget(colorParams.resId, depthParams.resId, colorParams.slice, depthParams.slice, colorParams.mip, depthParams.mip);
+			break;
+		}
+		case Command::SET_RENDER_TARGETS:
+		{
+			RenderTargetsParams params;
+			read_params(read, params);
+			ResId ids[MAX_RENDER_TARGETS];
+			unsigned int slices[MAX_RENDER_TARGETS];
+			unsigned int mips[MAX_RENDER_TARGETS];
+			for (unsigned int i = 0; i < params.numTargets; i++)
+			{
+				TargetParams targetParams;
+				read_params(read, targetParams);
+				ids[i] = targetParams.resId;
+				slices[i] = targetParams.slice;
+				mips[i] = targetParams.mip;
+			}
+			target.setRenderTargets(params.numTargets, ids, params.depth.resId, slices, params.depth.slice, mips, params.depth.mip);
+			break;
+		}
+		case Command::SET_SHADER:
+		{
+			ShaderParams params;
+			read_params(read, params);
+			target.setShader(params.resId, params.variantIndex);
+			break;
+		}
+		case Command::SET_VIEW:
+		{
+			ViewportParams params;
+			read_params(read, params);
+			target.setView(params);
+			break;
+		}
+		case Command::DRAW:
+		{
+			DrawParams params;
+			read_params(read, params);
+			target.draw(params.vertexCount, params.startVertex);
+			break;
+		}
+		case Command::DRAW_INDEXED:
+		{
+			DrawIndexedParams params;
+			read_params(read, params);
+			target.drawIndexed(params.indexCount, params.startIndex, params.baseVertex);
+			break;
+		}
+		case Command::DRAW_INDEXED_INSTANCED:
+		{
+			DrawIndexedInstancedParams params;
+			read_params(read, params);
+			target.drawIndexedInstanced(params.indexCount, params.instanceCount, params.startIndex, params.baseVertex, params.startInstance);
+			break;
+		}
+		case Command::DISPATCH:
+		{
+			DispatchParams params;
+			read_params(read, params);
+			target.dispatch(params.x, params.y, params.z);
+			break;
+		}
+		case Command::CLEAR_RENDER_TARGETS:
+		{
+			ClearParams params;
+			read_params(read, params);
+			RenderTargetClearParams clearParams(params.clearFlags, (unsigned char)params.colorTargetMask, params.depth, (unsigned char)params.stencil);
+			memcpy(clearParams.color, params.color, sizeof(clearParams.color));
+			target.clearRenderTargets(clearParams);
+			break;
+		}
+		case Command::BEGIN_EVENT:
+		{
+			EventParams params;
+			read_params(read, params);
+			target.beginEvent((const char*)read);
+			read += params.labelSize;
+			break;
+		}
+		case Command::END_EVENT:
+			target.endEvent();
+			break;
+		default:
+			assert(false);
+			return;
+		}
+	}
+	assert(read == end);
+}
+
+void CommandBuffer::reset()
+{
+	data.clear();
+	numCommands = 0;
+}
+
+// Same random commands for the same seed, every kind of command and param is covered
+static void record_random_commands(ICommandBuffer& cmd, uint32 seed, int num_commands)
+{
+	std::mt19937 rng(seed);
+	auto resId = [&rng] { return rng() % 8 == 0 ? BAD_RESID : (ResId)(rng() % 1000); };
+	auto stage = [&rng] { return (ShaderStage)(rng() % (int)ShaderStage::GRAPHICS_STAGE_COUNT); };
+	for (int i = 0; i < num_commands; i++)
+	{
+		switch (rng() % 21)
+		{
+		case 0: cmd.setInputLayout(resId()); break;
+		case 1: cmd.setIndexBuffer(resId()); break;
+		case 2: cmd.setVertexBuffer(resId()); break;
+		case 3: cmd.setConstantBuffer(stage(), rng() % 14, resId()); break;
+		case 4: cmd.setBuffer(stage(), rng() % 16, resId()); break;
+		case 5: cmd.setRwBuffer(rng() % 8, resId()); break;
+		case 6: cmd.setTexture(stage(), rng() % 16, resId()); break;
+		case 7: cmd.setRwTexture(rng() % 8, resId()); break;
+		case 8: cmd.setSampler(stage(), rng() % 16, resId()); break;
+		case 9: cmd.setRenderTarget(resId(), resId(), rng() % 6, rng() % 6, rng() % 4, rng() % 4); break;
+		case 10:
+		{
+			ResId ids[CommandBuffer::MAX_RENDER_TARGETS];
+			unsigned int slices[CommandBuffer::MAX_RENDER_TARGETS];
+			unsigned int mips[CommandBuffer::MAX_RENDER_TARGETS];
+			const unsigned int numTargets = rng() % (CommandBuffer::MAX_RENDER_TARGETS + 1);
+			for (unsigned int t = 0; t < numTargets; t++)
+			{
+				ids[t] = resId();
+				slices[t] = rng() % 6;
+				mips[t] = rng() % 4;
+			}
+			cmd.setRenderTargets(numTargets, ids, resId(), rng() % 2 ? slices : nullptr, rng() % 6, rng() % 2 ? mips : nullptr, rng() % 4);
+			break;
+		}
+		case 11: cmd.setRenderState(resId()); break;
+		case 12: cmd.setShader(resId(), rng() % 64); break;
+		case 13: cmd.setView((float)(rng() % 100), (float)(rng() % 100), (float)(rng() % 4096), (float)(rng() % 4096), 0.0f, 1.0f); break;
+		case 14: cmd.draw(rng() % 100000, rng() % 100000); break;
+		case 15: cmd.drawIndexed(rng() % 100000, rng() % 100000, (int)(rng() % 2000) - 1000); break;
+		case 16: cmd.dispatch(rng() % 64 + 1, rng() % 64 + 1, rng() % 4 + 1); break;
+		case 17:
+		{
+			RenderTargetClearParams clearParams(rng() % 8, (unsigned char)(rng() % 256), (rng() % 1000) / 1000.0f, (unsigned char)(rng() % 256));
+			for (float& c : clearParams.color)
+				c = (rng() % 1000) / 1000.0f;
+			cmd.clearRenderTargets(clearParams);
+			break;
+		}
+		case 18: cmd.beginEvent(("Event" + std::to_string(rng() % 100)).c_str()); break;
+		case 19: cmd.endEvent(); break;
+		case 20: cmd.drawIndexedInstanced(rng() % 100000, rng() % 1000 + 1, rng() % 100000, (int)(rng() % 2000) - 1000, rng() % 1000); break;
+		}
+	}
+}
+
+// Threads record random commands to their own command buffers, then replay them by recording to another one. Replaying
+// has to give the same bytes, and so does recording the same commands on the main thread. Nothing reaches the driver.
+static void test_command_buffers()
+{
+	constexpr int NUM_THREADS = 8;
+	constexpr int NUM_COMMANDS_PER_THREAD = 200000;
+
+	std::vector<CommandBuffer> recorded(NUM_THREADS);
+	std::vector<CommandBuffer> replayed(NUM_THREADS);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < NUM_THREADS; t++)
+		threads.emplace_back([&recorded, t] { record_random_commands(recorded[t], t + 1, NUM_COMMANDS_PER_THREAD); });
+	for (std::thread& t : threads)
+		t.join();
+	auto finishTime = std::chrono::high_resolution_clock::now();
+	threads.clear();
+	for (int t = 0; t < NUM_THREADS; t++)
+		threads.emplace_back([&recorded, &replayed, t] { recorded[t].execute(replayed[t]); });
+	for (std::thread& t : threads)
+		t.join();
+
+	int numFailures = 0;
+	size_t numBytes = 0;
+	CommandBuffer reference;
+	for (int t = 0; t < NUM_THREADS; t++)
+	{
+		reference.reset();
+		record_random_commands(reference, t + 1, NUM_COMMANDS_PER_THREAD);
+		if (recorded[t].getNumCommands() != NUM_COMMANDS_PER_THREAD || replayed[t].getNumCommands() != NUM_COMMANDS_PER_THREAD)
+			numFailures++;
+		if (replayed[t].getData() != recorded[t].getData() || reference.getData() != recorded[t].getData())
+			numFailures++;
+		numBytes += recorded[t].getData().size();
+	}
+
+	const double seconds = (finishTime - startTime).count() / 1e9;
+	if (numFailures == 0)
+		PLOG_INFO << "Command buffer test passed. " << NUM_THREADS << " threads recorded " << NUM_THREADS * NUM_COMMANDS_PER_THREAD / seconds / 1e6
+			<< " million commands per second, " << (double)numBytes / (NUM_THREADS * NUM_COMMANDS_PER_THREAD) << " bytes per command.";
+	else
+		PLOG_ERROR << "Command buffer test failed with " << numFailures << " failures.";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Command buffer record and replay test", test_command_buffers);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include <Common.h>
+
+#include "ICommandBuffer.h"
+
+// Records commands to compact memory, to execute them later on the driver, or on any other ICommandBuffer. Recording
+// doesn't touch the driver, so separate command buffers can be recorded on separate threads at the same time. Executing
+// on the driver replays the commands on the D3D11 immediate context, or records them to the frame command list on D3D12.
+class CommandBuffer : public ICommandBuffer
+{
+public:
+	static constexpr unsigned int MAX_RENDER_TARGETS = 8;
+
+	void setInputLayout(ResId res_id) override;
+	void setIndexBuffer(ResId res_id) override;
+	void setVertexBuffer(ResId res_id) override;
+	void setConstantBuffer(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setBuffer(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setRwBuffer(unsigned int slot, ResId res_id) override;
+	void setTexture(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setRwTexture(unsigned int slot, ResId res_id) override;
+	void setSampler(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setRenderTarget(ResId target_id, ResId depth_id,
+		unsigned int target_slice = 0, unsigned int depth_slice = 0, unsigned int target_mip = 0, unsigned int depth_mip = 0) override;
+	void setRenderTargets(unsigned int num_targets, ResId* target_ids, ResId depth_id,
+		unsigned int* target_slices = nullptr, unsigned int depth_slice = 0, unsigned int* target_mips = nullptr, unsigned int depth_mip = 0) override;
+	void setRenderState(ResId res_id) override;
+	void setShader(ResId res_id, unsigned int variant_index) override;
+	void setView(float x, float y, float w, float h, float z_min, float z_max) override;
+	void setView(const ViewportParams& vp) override;
+
+	void draw(unsigned int vertex_count, unsigned int start_vertex) override;
+	void drawIndexed(unsigned int index_count, unsigned int start_index, int base_vertex) override;
+	void drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance) override;
+	void dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z) override;
+
+	void clearRenderTargets(const RenderTargetClearParams clear_params) override;
+
+	void beginEvent(const char* label) override; // The label is copied
+	void endEvent() override;
+
+	void execute(ICommandBuffer& target) const; // Commands are kept, so they can be executed again
+	void reset(); // Keeps the memory for recording again
+
+	bool isEmpty() const { return numCommands == 0; }
+	uint32 getNumCommands() const { return numCommands; }
+	const std::vector<uint8>& getData() const { return data; } // Recorded commands, e.g. for comparing buffers
+
+private:
+	enum class Command : uint8
+	{
+		SET_INPUT_LAYOUT, SET_INDEX_BUFFER, SET_VERTEX_BUFFER, SET_CONSTANT_BUFFER, SET_BUFFER, SET_RW_BUFFER, SET_TEXTURE,
+		SET_RW_TEXTURE, SET_SAMPLER, SET_RENDER_TARGET, SET_RENDER_TARGETS, SET_RENDER_STATE, SET_SHADER, SET_VIEW,
+		DRAW, DRAW_INDEXED, DRAW_INDEXED_INSTANCED, DISPATCH, CLEAR_RENDER_TARGETS, BEGIN_EVENT, END_EVENT,
+	};
+
+	void recordCommand(Command command);
+	template <typename T> void recordParams(const T& params);
+
+	std::vector<uint8> data; // Commands followed by their params, unaligned
+	uint32 numCommands = 0;
+};
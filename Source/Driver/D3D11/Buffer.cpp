@@ -54,6 +54,20 @@ void Buffer::updateData(const void* src_data)
 	// TODO: use Map for dynamic buffers
 }
 
+void Buffer::updateData(const void* src_data, unsigned int first_element, unsigned int num_elements)
+{
+	assert(first_element + num_elements <= desc.numElements);
+	// Constant buffers can only be updated whole
+	assert(!(desc.bindFlags & BIND_CONSTANT_BUFFER));
+	D3D11_BOX box{};
+	box.left = first_element * desc.elementByteSize;
+	box.right = (first_element + num_elements) * desc.elementByteSize;
+	box.bottom = 1;
+	box.back = 1;
+	CONTEXT_LOCK_GUARD
+	Driver::get().getContext().UpdateSubresource(resource, 0, &box, src_data, 0, 0);
+}
+
 void Buffer::createViews()
 {
 	if (desc.bindFlags & BIND_SHADER_RESOURCE)
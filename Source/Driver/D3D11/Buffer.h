@@ -14,6 +14,7 @@ namespace drv_d3d11
 		const BufferDesc& getDesc() const override { return desc; }
 		const ResId& getId() const override { return id; };
 		void updateData(const void* src_data) override;
+		void updateData(const void* src_data, unsigned int first_element, unsigned int num_elements) override;
 
 		ID3D11Buffer* getResource() const { return resource; }
 		ID3D11ShaderResourceView* getSrv() const { return srv; }
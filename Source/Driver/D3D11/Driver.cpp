@@ -518,6 +518,12 @@ void Driver::drawIndexed(unsigned int index_count, unsigned int start_index, int
 	context->DrawIndexed(index_count, start_index, base_vertex);
 }
 
+void Driver::drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance)
+{
+	CONTEXT_LOCK_GUARD
+	context->DrawIndexedInstanced(index_count, instance_count, start_index, base_vertex, start_instance);
+}
+
 void Driver::dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z)
 {
 	CONTEXT_LOCK_GUARD
@@ -68,6 +68,7 @@ namespace drv_d3d11
 
 		void draw(unsigned int vertex_count, unsigned int start_vertex) override;
 		void drawIndexed(unsigned int index_count, unsigned int start_index, int base_vertex) override;
+		void drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance) override;
 		void dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z) override;
 
 		void clearRenderTargets(const RenderTargetClearParams clear_params) override;
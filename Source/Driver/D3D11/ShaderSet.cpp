@@ -4,6 +4,7 @@
 #pragma comment(lib,"d3dcompiler.lib")
 
 #include <Common.h>
+#include <Util/LinearArena.h>
 
 #include <fstream>
 #include <system_error>
@@ -40,13 +41,16 @@ bool ShaderSet::recompile()
 unsigned int ShaderSet::getVariantIndexForKeywords(const char** keywords, unsigned int num_keywords)
 {
 	unsigned int result = 0;
-	std::vector<const char*> relevantKeywords;
+	LinearArena& scratch = get_thread_scratch_arena();
+	ArenaScope scope(scratch);
+	ScratchVector<const char*> relevantKeywords(scratch);
+	relevantKeywords.reserve(num_keywords);
 	for (unsigned int i = 0; i < num_keywords; i++)
 	{
 		if (std::find(supportedKeywords.begin(), supportedKeywords.end(), keywords[i]) != supportedKeywords.end())
 			relevantKeywords.push_back(keywords[i]);
 	}
-	std::vector<unsigned int> candidates(variants.size());
+	ScratchVector<unsigned int> candidates(variants.size(), scratch);
 	std::iota(candidates.begin(), candidates.end(), 0);
 	for (unsigned int i = 0; i < relevantKeywords.size(); i++)
 	{
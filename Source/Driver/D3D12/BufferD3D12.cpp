@@ -1,5 +1,7 @@
 #include "BufferD3D12.h"
 
+#include <cstring>
+
 namespace drv_d3d12
 {
 
@@ -72,6 +74,41 @@ void Buffer::updateData(const void* src_data)
 	uploadFenceValue = copyQueue->ExecuteCommandList(cmdList.Get());
 }
 
+void Buffer::updateData(const void* src_data, unsigned int first_element, unsigned int num_elements)
+{
+	assert(first_element + num_elements <= desc.numElements);
+	if (uploadBuffer == nullptr)
+	{
+		const CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_UPLOAD);
+		const CD3DX12_RESOURCE_DESC resourceDesc = CD3DX12_RESOURCE_DESC::Buffer((uint64)desc.numElements * (uint64)desc.elementByteSize);
+		verify(DriverD3D12::get().getDevice().CreateCommittedResource(
+			&heapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&resourceDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&uploadBuffer)));
+	}
+
+	// The upload buffer is written from the CPU, so the previous copy from it has to be done
+	CommandQueue* copyQueue = DriverD3D12::get().getCopyCommandQueue();
+	copyQueue->WaitForFenceValue(uploadFenceValue);
+
+	const uint64 offset = (uint64)first_element * (uint64)desc.elementByteSize;
+	const uint64 size = (uint64)num_elements * (uint64)desc.elementByteSize;
+	void* mapped = nullptr;
+	const D3D12_RANGE noRead = { 0, 0 };
+	verify(uploadBuffer->Map(0, &noRead, &mapped));
+	memcpy((uint8*)mapped + offset, src_data, size);
+	const D3D12_RANGE written = { (SIZE_T)offset, (SIZE_T)(offset + size) };
+	uploadBuffer->Unmap(0, &written);
+
+	ComPtr<ID3D12GraphicsCommandList2> cmdList = copyQueue->GetCommandList();
+	transition(D3D12_RESOURCE_STATE_COPY_DEST, cmdList.Get());
+	cmdList->CopyBufferRegion(resource, offset, uploadBuffer, offset, size);
+	uploadFenceValue = copyQueue->ExecuteCommandList(cmdList.Get());
+}
+
 void Buffer::transition(D3D12_RESOURCE_STATES dest_state, ID3D12GraphicsCommandList2* cmd_list)
 {
 	if (dest_state == resourceState)
@@ -550,6 +550,12 @@ void DriverD3D12::drawIndexed(unsigned int index_count, unsigned int start_index
 	frameCmdList->DrawIndexedInstanced(index_count, 1, start_index, base_vertex, 0);
 }
 
+void DriverD3D12::drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance)
+{
+	flushGraphicsPipeline();
+	frameCmdList->DrawIndexedInstanced(index_count, instance_count, start_index, base_vertex, start_instance);
+}
+
 void DriverD3D12::dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z)
 {
 	ASSERT_NOT_IMPLEMENTED;
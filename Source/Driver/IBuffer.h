@@ -9,4 +9,5 @@ public:
 	virtual const BufferDesc& getDesc() const = 0;
 	virtual const ResId& getId() const = 0;
 	virtual void updateData(const void* src_data) = 0;
+	virtual void updateData(const void* src_data, unsigned int first_element, unsigned int num_elements) = 0; // Data of the range only
 };
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "DriverCommon.h"
+
+// State, draw and dispatch commands. The driver executes them right away, a CommandBuffer records them to be executed
+// later, so code that only issues these commands can target either.
+class ICommandBuffer
+{
+public:
+	virtual void setInputLayout(ResId res_id) = 0;
+	virtual void setIndexBuffer(ResId res_id) = 0;
+	virtual void setVertexBuffer(ResId res_id) = 0;
+	virtual void setConstantBuffer(ShaderStage stage, unsigned int slot, ResId res_id) = 0;
+	virtual void setBuffer(ShaderStage stage, unsigned int slot, ResId res_id) = 0;
+	virtual void setRwBuffer(unsigned int slot, ResId res_id) = 0;
+	virtual void setTexture(ShaderStage stage, unsigned int slot, ResId res_id) = 0;
+	virtual void setRwTexture(unsigned int slot, ResId res_id) = 0;
+	virtual void setSampler(ShaderStage stage, unsigned int slot, ResId res_id) = 0;
+	virtual void setRenderTarget(ResId target_id, ResId depth_id,
+		unsigned int target_slice = 0, unsigned int depth_slice = 0, unsigned int target_mip = 0, unsigned int depth_mip = 0) = 0;
+	virtual void setRenderTargets(unsigned int num_targets, ResId* target_ids, ResId depth_id,
+		unsigned int* target_slices = nullptr, unsigned int depth_slice = 0, unsigned int* target_mips = nullptr, unsigned int depth_mip = 0) = 0;
+	virtual void setRenderState(ResId res_id) = 0;
+	virtual void setShader(ResId res_id, unsigned int variant_index) = 0;
+	virtual void setView(float x, float y, float w, float h, float z_min, float z_max) = 0;
+	virtual void setView(const ViewportParams& vp) = 0;
+
+	virtual void draw(unsigned int vertex_count, unsigned int start_vertex) = 0;
+	virtual void drawIndexed(unsigned int index_count, unsigned int start_index, int base_vertex) = 0;
+	virtual void drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance) = 0;
+	virtual void dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z) = 0;
+
+	virtual void clearRenderTargets(const RenderTargetClearParams clear_params) = 0;
+
+	virtual void beginEvent(const char* label) = 0;
+	virtual void endEvent() = 0;
+};
@@ -1,6 +1,8 @@
 #include "AssetManager.h"
 
 #include <filesystem>
+#include <istream>
+#include <streambuf>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <3rdParty/stb/stb_image.h>
@@ -11,6 +13,7 @@
 
 #include <Driver/ITexture.h>
 #include <Driver/IBuffer.h>
+#include <Util/JobTelemetry.h>
 #include <Util/ThreadPool.h>
 #include <Renderer/WorldRenderer.h>
 #include <Renderer/Light.h>
@@ -19,11 +22,105 @@
 #include <Renderer/Experiments/D3D12Test.h>
 
 #include "Material.h"
+#include "MeshCodec.h"
 #include "MeshRenderer.h"
 #include "VertexData.h"
 
 static constexpr bool ASYNC_LOADING_ENABLED = true;
 
+// Lets text parsers read a file that's already in memory, without copying it into a string first
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+	MemoryStreamBuf(const std::vector<uint8>& data)
+	{
+		char* begin = (char*)data.data();
+		setg(begin, begin, begin + data.size());
+	}
+};
+
+struct DecodedImage
+{
+	std::vector<unsigned char> data;
+	int width = 0;
+	int height = 0;
+};
+
+// Reads the file without holding a worker, then decodes it on a worker
+static Task<bool> read_and_decode_image(std::string path, DecodedImage& out_image, std::atomic<uint64>& decode_ns)
+{
+	PLOG_DEBUG << "Loading texture from file: " << path;
+
+	FileReadResult file = co_await io->readFile(path, JobPriority::BACKGROUND);
+	if (!file.success)
+	{
+		PLOG_ERROR << "Error loading texture." << std::endl
+			<< "\tFile: " << path << std::endl
+			<< "\tError: couldn't read file";
+		co_return false;
+	}
+
+	JOB_SPAN("Decode image");
+	auto startDecodeTime = std::chrono::high_resolution_clock::now();
+	int channels;
+	const int requiredChannels = 4;
+	unsigned char* data = stbi_load_from_memory(file.data.data(), (int)file.data.size(), &out_image.width, &out_image.height, &channels, requiredChannels); // TODO: handle different number of channels
+	if (data == nullptr)
+	{
+		PLOG_ERROR << "Error loading texture." << std::endl
+			<< "\tFile: " << path << std::endl
+			<< "\tError: " << stbi_failure_reason();
+		co_return false;
+	}
+
+	// TODO: optimize by using data loaded by stbi directly and avoid copying it into a vector
+	out_image.data.assign(data, data + out_image.width * out_image.height * requiredChannels);
+	stbi_image_free(data);
+	decode_ns += (std::chrono::high_resolution_clock::now() - startDecodeTime).count();
+
+	co_return true;
+}
+
+AssetManager::PendingLoad::PendingLoad(AssetManager& asset_manager) : owner(&asset_manager)
+{
+	LoadStats& stats = owner->loadStats;
+	std::lock_guard<std::mutex> lock(stats.mutex);
+	if (stats.numPendingLoads++ == 0)
+	{
+		stats.numLoads = 0;
+		stats.startTime = std::chrono::high_resolution_clock::now();
+		stats.ioStatsAtStart = io->getStats();
+		stats.poolStatsAtStart = tp->getTotalStats();
+		stats.decodeNs = 0;
+	}
+	stats.numLoads++;
+}
+
+AssetManager::PendingLoad::~PendingLoad()
+{
+	if (owner == nullptr)
+		return;
+	LoadStats& stats = owner->loadStats;
+	std::lock_guard<std::mutex> lock(stats.mutex);
+	if (--stats.numPendingLoads > 0)
+		return;
+
+	const double seconds = (std::chrono::high_resolution_clock::now() - stats.startTime).count() / 1e9;
+	const IoService::Stats ioStats = io->getStats();
+	const double ioSeconds = (ioStats.busyNs - stats.ioStatsAtStart.busyNs) / 1e9;
+	const double decodeSeconds = stats.decodeNs / 1e9;
+	const double megabytes = (ioStats.numBytesRead - stats.ioStatsAtStart.numBytesRead) / (1024.0 * 1024.0);
+	const uint64 numPrefetchHits = ioStats.numPrefetchHits - stats.ioStatsAtStart.numPrefetchHits;
+	const ThreadPool::ThreadStats poolStats = tp->getTotalStats();
+	const uint64 numJobs = poolStats.numJobs - stats.poolStatsAtStart.numJobs;
+	const double avgQueuedMs = (poolStats.queuedNs - stats.poolStatsAtStart.queuedNs) / 1e6 / std::max(numJobs, 1ull);
+	const double lockWaitSeconds = (poolStats.lockWaitNs - stats.poolStatsAtStart.lockWaitNs) / 1e9;
+	PLOG_INFO << "Finished loading " << stats.numLoads << " assets in " << seconds << " seconds. Reading " << megabytes << " MB (" << numPrefetchHits
+		<< " files were prefetched) kept the IO thread busy for " << ioSeconds << " seconds, decoding took " << decodeSeconds << " seconds of worker time. Reading and decoding one after the other would take "
+		<< ioSeconds + decodeSeconds << " seconds, overlap factor: " << (ioSeconds + decodeSeconds) / std::max(seconds, 1e-9) << ". The thread pool ran "
+		<< numJobs << " jobs, queued for " << avgQueuedMs << " ms on average, threads waited " << lockWaitSeconds << " seconds for contended queue locks.";
+}
+
 AssetManager::AssetManager()
 {
 	initInis();
@@ -58,51 +155,63 @@ AssetManager::~AssetManager()
 ITexture* AssetManager::loadTexture(const std::string& path, bool srgb, bool need_mips, bool hdr, std::function<void(ITexture*, bool)> callback, LoadExecutionMode lem)
 {
 	ITexture* texture = drv->createTextureStub();
+	Task<> task = loadTextureTask(path, srgb, need_mips, hdr, callback, texture, PendingLoad(*this));
+	if (lem == LoadExecutionMode::ASYNC && ASYNC_LOADING_ENABLED)
+		spawn(std::move(task), JobPriority::BACKGROUND);
+	else
+		sync_wait(std::move(task));
+	return texture;
+}
 
-	auto load = [path, srgb, need_mips, hdr, callback, texture]
-	{
-		PLOG_DEBUG << "Loading texture from file: " << path;
+// Async loads decode on workers, but upload and notify the renderer on the main thread, so they never contend with
+// rendering for the immediate context
+Task<> AssetManager::loadTextureTask(std::string path, bool srgb, bool need_mips, bool hdr, std::function<void(ITexture*, bool)> callback, ITexture* texture, PendingLoad pending_load)
+{
+	PLOG_DEBUG << "Loading texture from file: " << path;
 
-		int width, height, channels;
-		const int requiredChannels = 4; // TODO: handle different number of channels
-		void* data;
-		if (hdr)
-			data = stbi_loadf(path.c_str(), &width, &height, &channels, requiredChannels);
-		else
-			data = stbi_load(path.c_str(), &width, &height, &channels, requiredChannels);
-		if (data == nullptr)
-		{
-			PLOG_ERROR << "Error loading texture." << std::endl
-				<< "\tFile: " << path << std::endl
-				<< "\tError: " << stbi_failure_reason();
-			callback(texture, false);
-			return;
-		}
+	FileReadResult file = co_await io->readFile(path, JobPriority::BACKGROUND);
 
-		TexFmt fmt = hdr ? TexFmt::R32G32B32A32_FLOAT : (srgb ? TexFmt::R8G8B8A8_UNORM_SRGB : TexFmt::R8G8B8A8_UNORM);
-		TextureDesc tDesc(path, width, height, fmt, need_mips ? 0 : 1);
-		tDesc.bindFlags = BIND_SHADER_RESOURCE;
-		if (need_mips)
-		{
-			tDesc.bindFlags |= BIND_RENDER_TARGET;
-			tDesc.miscFlags = RESOURCE_MISC_GENERATE_MIPS;
-		}
-		texture->recreate(tDesc);
-		texture->updateData(0, nullptr, data);
-		if (need_mips)
-			texture->generateMips();
+	int width, height, channels;
+	const int requiredChannels = 4; // TODO: handle different number of channels
+	void* data = nullptr;
+	{
+		JOB_SPAN("Decode texture");
+		auto startDecodeTime = std::chrono::high_resolution_clock::now();
+		if (file.success && hdr)
+			data = stbi_loadf_from_memory(file.data.data(), (int)file.data.size(), &width, &height, &channels, requiredChannels);
+		else if (file.success)
+			data = stbi_load_from_memory(file.data.data(), (int)file.data.size(), &width, &height, &channels, requiredChannels);
+		loadStats.decodeNs += (std::chrono::high_resolution_clock::now() - startDecodeTime).count();
+	}
 
-		stbi_image_free(data);
+	if (data == nullptr)
+	{
+		PLOG_ERROR << "Error loading texture." << std::endl
+			<< "\tFile: " << path << std::endl
+			<< "\tError: " << (file.success ? stbi_failure_reason() : "couldn't read file");
+		co_await resume_on_main_thread();
+		callback(texture, false);
+		co_return;
+	}
 
-		callback(texture, true);
-	};
+	co_await resume_on_main_thread();
 
-	if (lem == LoadExecutionMode::ASYNC && ASYNC_LOADING_ENABLED)
-		tp->enqueue(load);
-	else
-		load();
+	TexFmt fmt = hdr ? TexFmt::R32G32B32A32_FLOAT : (srgb ? TexFmt::R8G8B8A8_UNORM_SRGB : TexFmt::R8G8B8A8_UNORM);
+	TextureDesc tDesc(path, width, height, fmt, need_mips ? 0 : 1);
+	tDesc.bindFlags = BIND_SHADER_RESOURCE;
+	if (need_mips)
+	{
+		tDesc.bindFlags |= BIND_RENDER_TARGET;
+		tDesc.miscFlags = RESOURCE_MISC_GENERATE_MIPS;
+	}
+	texture->recreate(tDesc);
+	texture->updateData(0, nullptr, data);
+	if (need_mips)
+		texture->generateMips();
 
-	return texture;
+	stbi_image_free(data);
+
+	callback(texture, true);
 }
 
 bool AssetManager::loadTexturesToStandardMaterial(const MaterialTexturePaths& paths, Material* material, bool flip_normal_green, LoadExecutionMode lem)
@@ -112,79 +221,92 @@ bool AssetManager::loadTexturesToStandardMaterial(const MaterialTexturePaths& pa
 	material->setTexture(ShaderStage::PS, 0, baseTexture, MaterialTexture::Purpose::COLOR);
 	material->setTexture(ShaderStage::PS, 1, normalRoughMetalTexture, MaterialTexture::Purpose::NORMAL);
 	material->setKeyword("ALPHA_TEST_ON", !paths.opacity.empty());
+	material->texturePaths = paths;
 
-	auto load = [paths, material, flip_normal_green, baseTexture, normalRoughMetalTexture]
-	{
-		auto loadTex = [&](const std::string& path, std::vector<unsigned char>& out_data, int& width, int& height)
-		{
-			PLOG_DEBUG << "Loading texture from file: " << path;
-			
-			int channels;
-			const int requiredChannels = 4;
-			unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, requiredChannels); // TODO: handle different number of channels
-
-			if (data == nullptr)
-			{
-				PLOG_ERROR << "Error loading texture." << std::endl
-					<< "\tFile: " << path << std::endl
-					<< "\tError: " << stbi_failure_reason();
-				return false;
-			}
-
-			// TODO: optimize by using data loaded by stbi directly and avoid copying it into a vector
-			out_data.assign(data, data + width * height * requiredChannels);
-
-			stbi_image_free(data);
-			
-			return true;
-		};
-
-		static constexpr int NUM_CHANNELS = 4;
+	Task<> task = loadMaterialTexturesTask(paths, material, flip_normal_green, baseTexture, normalRoughMetalTexture, PendingLoad(*this));
+	if (lem == LoadExecutionMode::ASYNC && ASYNC_LOADING_ENABLED)
+		spawn(std::move(task), JobPriority::BACKGROUND);
+	else
+		sync_wait(std::move(task));
 
-		bool hasAlbedo = !paths.albedo.empty();
-		bool hasOpacity = !paths.opacity.empty();
-		bool hasSeparateOpacity = hasOpacity && paths.albedo != paths.opacity;
+	return true;
+}
 
-		if (hasAlbedo || hasOpacity)
+Task<> AssetManager::loadMaterialTexturesTask(MaterialTexturePaths paths, Material* material, bool flip_normal_green,
+	ITexture* base_texture, ITexture* normal_rough_metal_texture, PendingLoad pending_load)
+{
+	static constexpr int NUM_CHANNELS = 4;
+
+	bool hasAlbedo = !paths.albedo.empty();
+	bool hasOpacity = !paths.opacity.empty();
+	bool hasSeparateOpacity = hasOpacity && paths.albedo != paths.opacity;
+	bool hasNormal = !paths.normal.empty();
+	bool hasRoughness = !paths.roughness.empty();
+	bool hasMetalness = !paths.metalness.empty();
+
+	// All source textures are read and decoded in parallel
+	DecodedImage albedo, opacity, normal, roughness, metalness;
+	std::vector<Task<bool>> albedoOpacityTasks, normalRoughMetalTasks;
+	if (hasAlbedo)
+		albedoOpacityTasks.push_back(read_and_decode_image(paths.albedo, albedo, loadStats.decodeNs));
+	if (hasSeparateOpacity)
+		albedoOpacityTasks.push_back(read_and_decode_image(paths.opacity, opacity, loadStats.decodeNs));
+	if (hasNormal)
+		normalRoughMetalTasks.push_back(read_and_decode_image(paths.normal, normal, loadStats.decodeNs));
+	if (hasRoughness)
+		normalRoughMetalTasks.push_back(read_and_decode_image(paths.roughness, roughness, loadStats.decodeNs));
+	if (hasMetalness)
+		normalRoughMetalTasks.push_back(read_and_decode_image(paths.metalness, metalness, loadStats.decodeNs));
+	std::vector<Task<bool>> decodeTasks;
+	for (Task<bool>& t : albedoOpacityTasks)
+		decodeTasks.push_back(std::move(t));
+	const size_t numAlbedoOpacityTasks = albedoOpacityTasks.size();
+	for (Task<bool>& t : normalRoughMetalTasks)
+		decodeTasks.push_back(std::move(t));
+	co_await when_all(decodeTasks, JobPriority::BACKGROUND);
+
+	bool albedoOpacityDecoded = true, normalRoughMetalDecoded = true;
+	for (size_t i = 0; i < decodeTasks.size(); i++)
+		if (!decodeTasks[i].result())
+			(i < numAlbedoOpacityTasks ? albedoOpacityDecoded : normalRoughMetalDecoded) = false;
+
+	auto startCombineTime = std::chrono::high_resolution_clock::now();
+
+	bool uploadBase = false;
+	unsigned int albedoOpacityWidth = 0, albedoOpacityHeight = 0;
+	std::vector<unsigned char> albedoOpacityData;
+	if ((hasAlbedo || hasOpacity) && albedoOpacityDecoded)
+	{
+		uploadBase = true;
+		if (hasAlbedo)
 		{
-			unsigned int albedoOpacityWidth = 0, albedoOpacityHeight = 0;
+			albedoOpacityWidth = albedo.width;
+			albedoOpacityHeight = albedo.height;
+		}
 
-			std::vector<unsigned char> albedoData;
-			int albedoWidth = 0, albedoHeight = 0;
-			if (hasAlbedo)
+		if (hasSeparateOpacity)
+		{
+			if (hasAlbedo && (opacity.width != albedoOpacityWidth || opacity.height != albedoOpacityHeight))
 			{
-				if (!loadTex(paths.albedo, albedoData, albedoWidth, albedoHeight))
-					return;
-				albedoOpacityWidth = albedoWidth;
-				albedoOpacityHeight = albedoHeight;
-			}
-
-			std::vector<unsigned char> opacityData;
-			int opacityWidth = 0, opacityHeight = 0;
-			if (hasSeparateOpacity)
-			{
-				if (!loadTex(paths.opacity, opacityData, opacityWidth, opacityHeight))
-					return;
-				if (hasAlbedo && (opacityWidth != albedoOpacityWidth || opacityHeight != albedoOpacityHeight))
-				{
-					PLOG_ERROR << "Mismatching dimensions of albedo and opacity texture." << std::endl
-						<< "\tAlbedo: " << paths.albedo << " (" << albedoOpacityWidth << "x" << albedoOpacityHeight << ")" << std::endl
-						<< "\tOpacity: " << paths.opacity << " (" << opacityWidth << "x" << opacityHeight << ")";
-					return;
-				}
-				albedoOpacityWidth = opacityWidth;
-				albedoOpacityHeight = opacityHeight;
+				PLOG_ERROR << "Mismatching dimensions of albedo and opacity texture." << std::endl
+					<< "\tAlbedo: " << paths.albedo << " (" << albedoOpacityWidth << "x" << albedoOpacityHeight << ")" << std::endl
+					<< "\tOpacity: " << paths.opacity << " (" << opacity.width << "x" << opacity.height << ")";
+				uploadBase = false;
 			}
+			albedoOpacityWidth = opacity.width;
+			albedoOpacityHeight = opacity.height;
+		}
 
-			const int numTexels = albedoOpacityWidth * albedoOpacityHeight;
-			const int numBytes = numTexels * NUM_CHANNELS;
+		const int numTexels = albedoOpacityWidth * albedoOpacityHeight;
+		const int numBytes = numTexels * NUM_CHANNELS;
 
-			if (!hasAlbedo)
-				albedoData.assign(numBytes, 127u);
-			if (!hasOpacity)
-				opacityData.assign(numBytes, 255u);
+		if (!hasAlbedo)
+			albedo.data.assign(numBytes, 127u);
+		if (!hasOpacity)
+			opacity.data.assign(numBytes, 255u);
 
-			std::vector<unsigned char> albedoOpacityData;
+		if (uploadBase)
+		{
 			albedoOpacityData.resize(numBytes);
 			for (int i = 0; i < numTexels; i++)
 			{
@@ -192,88 +314,69 @@ bool AssetManager::loadTexturesToStandardMaterial(const MaterialTexturePaths& pa
 				int g = i * NUM_CHANNELS + 1;
 				int b = i * NUM_CHANNELS + 2;
 				int a = i * NUM_CHANNELS + 3;
-				albedoOpacityData[r] = albedoData[r];
-				albedoOpacityData[g] = albedoData[g];
-				albedoOpacityData[b] = albedoData[b];
-				albedoOpacityData[a] = hasSeparateOpacity ? opacityData[r] : albedoData[a];
+				albedoOpacityData[r] = albedo.data[r];
+				albedoOpacityData[g] = albedo.data[g];
+				albedoOpacityData[b] = albedo.data[b];
+				albedoOpacityData[a] = hasSeparateOpacity ? opacity.data[r] : albedo.data[a];
 			}
-
-			TextureDesc baseTexDesc(material->name + "_base", albedoWidth, albedoHeight, TexFmt::R8G8B8A8_UNORM_SRGB, 0);
-			baseTexDesc.bindFlags = BIND_SHADER_RESOURCE | BIND_RENDER_TARGET;
-			baseTexDesc.miscFlags = RESOURCE_MISC_GENERATE_MIPS;
-			baseTexture->recreate(baseTexDesc);
-			baseTexture->updateData(0, nullptr, (void*)albedoOpacityData.data());
-			baseTexture->generateMips();
 		}
+	}
 
-		bool hasNormal = !paths.normal.empty();
-		bool hasRoughness = !paths.roughness.empty();
-		bool hasMetalness = !paths.metalness.empty();
-
-		if (!hasNormal && !hasRoughness && !hasMetalness)
-			return;
-
-		unsigned int normalRoughMetalWidth = 0, normalRoughMetalHeight = 0;
-
-		std::vector<unsigned char> normalData;
-		int normalWidth = 0, normalHeight = 0;
+	bool uploadNormalRoughMetal = false;
+	unsigned int normalRoughMetalWidth = 0, normalRoughMetalHeight = 0;
+	std::vector<unsigned char> normalRoughMetalData;
+	if ((hasNormal || hasRoughness || hasMetalness) && normalRoughMetalDecoded)
+	{
+		uploadNormalRoughMetal = true;
 		if (hasNormal)
 		{
-			if (!loadTex(paths.normal, normalData, normalWidth, normalHeight))
-				return;
-			normalRoughMetalWidth = normalWidth;
-			normalRoughMetalHeight = normalHeight;
+			normalRoughMetalWidth = normal.width;
+			normalRoughMetalHeight = normal.height;
 		}
 
-		std::vector<unsigned char> roughnessData;
-		int roughnessWidth = 0, roughnessHeight = 0;
 		if (hasRoughness)
 		{
-			if (!loadTex(paths.roughness, roughnessData, roughnessWidth, roughnessHeight))
-				return;
-			if (hasNormal && (roughnessWidth != normalRoughMetalWidth || roughnessHeight != normalRoughMetalHeight))
+			if (hasNormal && (roughness.width != normalRoughMetalWidth || roughness.height != normalRoughMetalHeight))
 			{
 				PLOG_ERROR << "Mismatching dimensions of normal and roughness texture." << std::endl
 					<< "\tNormal: " << paths.normal << " (" << normalRoughMetalWidth << "x" << normalRoughMetalHeight << ")" << std::endl
-					<< "\tRougness: " << paths.roughness << " (" << roughnessWidth << "x" << roughnessHeight << ")";
-				return;
+					<< "\tRougness: " << paths.roughness << " (" << roughness.width << "x" << roughness.height << ")";
+				uploadNormalRoughMetal = false;
 			}
-			normalRoughMetalWidth = roughnessWidth;
-			normalRoughMetalHeight = roughnessHeight;
+			normalRoughMetalWidth = roughness.width;
+			normalRoughMetalHeight = roughness.height;
 		}
 
-		std::vector<unsigned char> metalnessData;
-		int metalnessWidth = 0, metalnessHeight = 0;
-		if (hasMetalness)
+		if (hasMetalness && uploadNormalRoughMetal)
 		{
-			if (!loadTex(paths.metalness, metalnessData, metalnessWidth, metalnessHeight))
-				return;
-			if ((hasNormal || hasRoughness) && (metalnessWidth != normalRoughMetalWidth || metalnessHeight != normalRoughMetalHeight))
+			if ((hasNormal || hasRoughness) && (metalness.width != normalRoughMetalWidth || metalness.height != normalRoughMetalHeight))
 			{
 				PLOG_ERROR << "Mismatching dimensions of metalness and normal or roughness texture." << std::endl
 					<< "\tNormal or roughness: " << paths.normal << " (" << normalRoughMetalWidth << "x" << normalRoughMetalHeight << ")" << std::endl
-					<< "\tMetalness: " << paths.metalness << " (" << metalnessWidth << "x" << metalnessHeight << ")";
-				return;
+					<< "\tMetalness: " << paths.metalness << " (" << metalness.width << "x" << metalness.height << ")";
+				uploadNormalRoughMetal = false;
 			}
-			normalRoughMetalWidth = metalnessWidth;
-			normalRoughMetalHeight = metalnessHeight;
+			normalRoughMetalWidth = metalness.width;
+			normalRoughMetalHeight = metalness.height;
 		}
+	}
 
-		assert(!hasNormal || !hasRoughness || normalData.size() == roughnessData.size());
-		assert(!hasNormal || !hasMetalness || normalData.size() == metalnessData.size());
-		assert(!hasRoughness || !hasMetalness || roughnessData.size() == metalnessData.size());
+	if (uploadNormalRoughMetal)
+	{
+		assert(!hasNormal || !hasRoughness || normal.data.size() == roughness.data.size());
+		assert(!hasNormal || !hasMetalness || normal.data.size() == metalness.data.size());
+		assert(!hasRoughness || !hasMetalness || roughness.data.size() == metalness.data.size());
 
 		const int numTexels = normalRoughMetalWidth * normalRoughMetalHeight;
 		const int numBytes = numTexels * NUM_CHANNELS;
 
 		if (!hasNormal)
-			normalData.assign(numBytes, 127u);
+			normal.data.assign(numBytes, 127u);
 		if (!hasRoughness)
-			roughnessData.assign(numBytes, 127u);
+			roughness.data.assign(numBytes, 127u);
 		if (!hasMetalness)
-			metalnessData.assign(numBytes, 0);
+			metalness.data.assign(numBytes, 0);
 
-		std::vector<unsigned char> normalRoughMetalData;
 		normalRoughMetalData.resize(numBytes);
 		for (int i = 0; i < numTexels; i++)
 		{
@@ -281,28 +384,41 @@ bool AssetManager::loadTexturesToStandardMaterial(const MaterialTexturePaths& pa
 			int g = i * NUM_CHANNELS + 1;
 			int b = i * NUM_CHANNELS + 2;
 			int a = i * NUM_CHANNELS + 3;
-			normalRoughMetalData[r] = normalData[r];
-			normalRoughMetalData[g] = flip_normal_green ? 255u - normalData[g] : normalData[g];
-			normalRoughMetalData[b] = metalnessData[r];
-			normalRoughMetalData[a] = roughnessData[r];
+			normalRoughMetalData[r] = normal.data[r];
+			normalRoughMetalData[g] = flip_normal_green ? 255u - normal.data[g] : normal.data[g];
+			normalRoughMetalData[b] = metalness.data[i * NUM_CHANNELS + paths.metalnessChannel];
+			normalRoughMetalData[a] = roughness.data[i * NUM_CHANNELS + paths.roughnessChannel];
 		}
+	}
+
+	loadStats.decodeNs += (std::chrono::high_resolution_clock::now() - startCombineTime).count();
+
+	if (!uploadBase && !uploadNormalRoughMetal)
+		co_return;
+
+	co_await resume_on_main_thread();
+
+	if (uploadBase)
+	{
+		TextureDesc baseTexDesc(material->name + "_base", albedoOpacityWidth, albedoOpacityHeight, TexFmt::R8G8B8A8_UNORM_SRGB, 0);
+		baseTexDesc.bindFlags = BIND_SHADER_RESOURCE | BIND_RENDER_TARGET;
+		baseTexDesc.miscFlags = RESOURCE_MISC_GENERATE_MIPS;
+		base_texture->recreate(baseTexDesc);
+		base_texture->updateData(0, nullptr, (void*)albedoOpacityData.data());
+		base_texture->generateMips();
+	}
 
-		TextureDesc normalRoughMetalTexDesc(material->name + "_normRoughMetal", normalWidth, normalHeight, TexFmt::R8G8B8A8_UNORM, 0);
+	if (uploadNormalRoughMetal)
+	{
+		TextureDesc normalRoughMetalTexDesc(material->name + "_normRoughMetal", normalRoughMetalWidth, normalRoughMetalHeight, TexFmt::R8G8B8A8_UNORM, 0);
 		normalRoughMetalTexDesc.bindFlags = BIND_SHADER_RESOURCE | BIND_RENDER_TARGET;
 		normalRoughMetalTexDesc.miscFlags = RESOURCE_MISC_GENERATE_MIPS;
-		normalRoughMetalTexture->recreate(normalRoughMetalTexDesc);
-		normalRoughMetalTexture->updateData(0, nullptr, (void*)normalRoughMetalData.data());
-		normalRoughMetalTexture->generateMips();
+		normal_rough_metal_texture->recreate(normalRoughMetalTexDesc);
+		normal_rough_metal_texture->updateData(0, nullptr, (void*)normalRoughMetalData.data());
+		normal_rough_metal_texture->generateMips();
 
 		wr->onMaterialTexturesLoaded();
-	};
-
-	if (lem == LoadExecutionMode::ASYNC && ASYNC_LOADING_ENABLED)
-		tp->enqueue(load);
-	else
-		load();
-
-	return true;
+	}
 }
 
 bool AssetManager::loadMesh(const std::string& name, MeshData& mesh_data)
@@ -363,13 +479,12 @@ bool AssetManager::loadMesh(const std::string& name, MeshData& mesh_data)
 
 		for (const std::vector<MaterialTexture>& stageTextures : material->getTextures())
 			for (const MaterialTexture& matTex : stageTextures)
-				sceneTextures.push_back(matTex.tex);
+				sceneTextures.add(matTex.tex);
 
 		materials.push_back(material);
+		sceneMaterials.add(material, material->name);
 	}
 
-	sceneMaterials.insert(sceneMaterials.end(), materials.begin(), materials.end());
-
 	if (attrib.vertices.size() % 3 != 0)
 	{
 		PLOG_ERROR << "Error loading mesh '" << name << "'. \"attrib.vertices.size() % 3 != 0\"";
@@ -477,7 +592,7 @@ bool AssetManager::loadMesh(const std::string& name, MeshData& mesh_data)
 	return true;
 }
 
-bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
+bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data, const std::vector<uint8>* source_data)
 {
 	if (!modelsIni.has(name))
 	{
@@ -496,7 +611,16 @@ bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
 
 	objl::Loader loader;
 	auto startLoadTime = std::chrono::high_resolution_clock::now();
-	if (!loader.LoadFile(path))
+	bool loaded;
+	if (source_data != nullptr)
+	{
+		MemoryStreamBuf sourceBuf(*source_data);
+		std::istream sourceStream(&sourceBuf);
+		loaded = loader.LoadStream(sourceStream, path);
+	}
+	else
+		loaded = loader.LoadFile(path);
+	if (!loaded)
 	{
 		PLOG_ERROR << "Couldn't load model file at path: " << path;
 		return false;
@@ -508,9 +632,6 @@ bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
 	unsigned int startVertex = 0;
 	out_mesh_data.submeshes.resize(loader.LoadedMeshes.size());
 
-	std::map<std::string, Material*> materialMap;
-	int nextMaterialIndex = (int)sceneMaterials.size();
-
 	// Loop over meshes
 	for (size_t m = 0; m < loader.LoadedMeshes.size(); m++)
 	{
@@ -528,14 +649,10 @@ bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
 		const objl::Material& mtl = mesh.MeshMaterial;
 		if (!mtl.name.empty() && mtl.name != "none")
 		{
-			if (materialMap.find(mtl.name) != materialMap.end())
-			{
-				submesh.material = materialMap[mtl.name];
-			}
-			else
+			const std::string materialName = name + "__" + mtl.name;
+			submesh.material = sceneMaterials.findAsset(materialName);
+			if (submesh.material == nullptr)
 			{
-				Material* material = new Material(name + "__" + mtl.name, standardShaders);
-
 				MaterialTexturePaths paths;
 				if (!mtl.map_Kd.empty())
 					paths.albedo = dir + "/" + mtl.map_Kd;
@@ -548,15 +665,7 @@ bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
 				if (!mtl.map_Ka.empty())
 					paths.metalness = dir + "/" + mtl.map_Ka;
 
-				loadTexturesToStandardMaterial(paths, material, flipUvX != flipUvY);
-
-				for (const std::vector<MaterialTexture>& stageTextures : material->getTextures())
-					for (const MaterialTexture& matTex : stageTextures)
-						sceneTextures.push_back(matTex.tex);
-
-				sceneMaterials.push_back(material);
-				submesh.material = material;
-				materialMap[mtl.name] = material;
+				submesh.material = createMeshMaterial(materialName, paths, flipUvX != flipUvY);
 			}
 		}
 		else if (loader.LoadedMaterials.size() > 0)
@@ -599,8 +708,6 @@ bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
 		startVertex += (unsigned int)mesh.Vertices.size();
 	}
 
-	out_mesh_data.loaded = true;
-
 	auto finishProcessing = std::chrono::high_resolution_clock::now();
 
 	PLOG_INFO << "Processing mesh '" << name << "' successful. It took " << (finishProcessing - finishLoadTime).count() / 1e9 << " seconds.";
@@ -608,45 +715,115 @@ bool AssetManager::loadMesh2(const std::string& name, MeshData& out_mesh_data)
 	return true;
 }
 
-bool AssetManager::loadMeshToMeshRenderer(const std::string& name, MeshRenderer& mesh_renderer, LoadExecutionMode lem)
+std::string AssetManager::getMeshImporter(const std::string& name)
 {
-	bool meshAlreadyStartedLoading = false;
-	MeshData* meshData;
-	if (sceneMeshes.find(name) != sceneMeshes.end())
+	if (modelsIni[name].has("importer"))
+		return modelsIni[name]["importer"];
+	std::string extension = std::filesystem::path(modelsIni[name]["path"]).extension().u8string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".glb" ? "glb" : "obj";
+}
+
+bool AssetManager::importMesh(const std::string& name, MeshData& mesh_data, const std::vector<uint8>* source_data)
+{
+	if (!modelsIni.has(name))
 	{
-		meshData = sceneMeshes[name];
-		meshAlreadyStartedLoading = true;
+		PLOG_ERROR << "No model found with name: " << name;
+		return false;
 	}
-	else
+
+	std::string importer = getMeshImporter(name);
+	if (importer == "glb")
+		return loadMeshGlb(name, mesh_data); // Already binary, no need to cook
+	else if (importer != "obj")
 	{
-		meshData = new MeshData;
-		sceneMeshes[name] = meshData;
+		PLOG_ERROR << "Unknown importer '" << importer << "' for model: " << name;
+		return false;
 	}
 
-	auto load = [&, name, meshData, meshAlreadyStartedLoading]
+	if (!loadMesh2(name, mesh_data, source_data))
+		return false;
+	mesh_codec::optimize_mesh(mesh_data);
+	mesh_data.computeBounds();
+	cookMesh(name, mesh_data);
+	return true;
+}
+
+bool AssetManager::loadMeshToMeshRenderer(const std::string& name, MeshRenderer& mesh_renderer, LoadExecutionMode lem)
+{
+	// Huge meshes can be streamed submesh by submesh instead, they are rendered progressively and never cooked
+	if (modelsIni[name]["streaming"] == "yes")
+		return streamMeshToMeshRenderer(name, mesh_renderer, ASYNC_LOADING_ENABLED ? lem : LoadExecutionMode::SYNC);
+
+	bool meshCreated = false;
+	MeshData* meshData = sceneMeshes.get(sceneMeshes.findOrAdd(name, [] { return new MeshData; }, &meshCreated));
+	bool meshAlreadyStartedLoading = !meshCreated;
+
+	Task<bool> task = loadMeshTask(name, mesh_renderer, meshData, meshAlreadyStartedLoading, PendingLoad(*this));
+	if (lem == LoadExecutionMode::ASYNC && ASYNC_LOADING_ENABLED)
+	{
+		spawn(std::move(task));
+		return true;
+	}
+	else
+		return sync_wait(std::move(task));
+}
+
+Task<bool> AssetManager::loadMeshTask(std::string name, MeshRenderer& mesh_renderer, MeshData* mesh_data, bool already_started_loading, PendingLoad pending_load)
+{
+	if (already_started_loading)
+		co_await mesh_data->loadFinished;
+	else
 	{
-		if (meshAlreadyStartedLoading)
+		FileReadResult cookedFile = co_await io->readFile(getCookedMeshPath(name));
+		auto startDecodeTime = std::chrono::high_resolution_clock::now();
 		{
-			while (!meshData->loaded)
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			JOB_SPAN("Decode mesh"); // Spans must not be open across co_await, the coroutine may continue on another thread
+			mesh_data->loaded = cookedFile.success && decodeCookedMesh(name, cookedFile.data, *mesh_data);
 		}
-		else
+		loadStats.decodeNs += (std::chrono::high_resolution_clock::now() - startDecodeTime).count();
+		if (!mesh_data->loaded)
 		{
-			if (!loadMesh2(name, *meshData))
-				return false;
+			// Obj files are parsed from memory, so the worker doesn't block on reading them
+			FileReadResult sourceFile;
+			if (getMeshImporter(name) == "obj")
+				sourceFile = co_await io->readFile(modelsIni[name]["path"]);
+			startDecodeTime = std::chrono::high_resolution_clock::now();
+			{
+				JOB_SPAN("Import mesh");
+				mesh_data->loaded = importMesh(name, *mesh_data, sourceFile.success ? &sourceFile.data : nullptr);
+			}
+			loadStats.decodeNs += (std::chrono::high_resolution_clock::now() - startDecodeTime).count();
 		}
-		mesh_renderer.load(*meshData);
-		wr->onMeshLoaded();
-		return true;
-	};
+		mesh_data->loadFinished.signal();
+	}
+	if (!mesh_data->loaded)
+		co_return false;
 
-	if (lem == LoadExecutionMode::ASYNC && ASYNC_LOADING_ENABLED)
+	co_await resume_on_main_thread();
+	mesh_renderer.load(*mesh_data); // Not while rendering, that may be on the render thread
+	wr->onMeshLoaded();
+	co_return true;
+}
+
+Material* AssetManager::createMeshMaterial(const std::string& name, const MaterialTexturePaths& paths, bool flip_normal_green,
+	const PerMaterialConstantBufferData* constants)
+{
+	Material* material = new Material(name, standardShaders);
+	if (constants != nullptr)
 	{
-		tp->enqueue(load);
-		return true;
+		// Set before the material is added to the scene, it may be created on a worker thread
+		material->setConstants(*constants);
+		material->uploadConstants(*constants);
 	}
-	else
-		return load();
+	loadTexturesToStandardMaterial(paths, material, flip_normal_green);
+
+	for (const std::vector<MaterialTexture>& stageTextures : material->getTextures())
+		for (const MaterialTexture& matTex : stageTextures)
+			sceneTextures.add(matTex.tex);
+
+	sceneMaterials.add(material, name);
+	return material;
 }
 
 static XMFLOAT4 str_to_XMFLOAT4(std::string s)
@@ -702,6 +879,11 @@ void AssetManager::loadScene(const std::string& scene_file)
 	}
 	currentSceneIniFilePath = scene_file;
 
+	// Start reading everything the scene refers to, the loads below find the files in memory or already in flight
+	PendingLoad sceneLoad(*this);
+	for (const std::string& path : collectSceneFilePaths())
+		io->prefetch(path);
+
 	std::map<std::string, ITexture*> texturePathMap;
 
 	for (auto& sceneElem : currentSceneIni)
@@ -711,11 +893,8 @@ void AssetManager::loadScene(const std::string& scene_file)
 		if (elemProperties["type"] == "model")
 		{
 			std::string materialName = elemProperties["material"];
-			Material* material = nullptr;
-			auto it = std::find_if(sceneMaterials.begin(), sceneMaterials.end(), [&materialName](Material* m) { return materialName == m->name; });
-			if (it != sceneMaterials.end())
-				material = *it;
-			else
+			Material* material = sceneMaterials.findAsset(materialName);
+			if (material == nullptr)
 			{
 				if (!materialsIni.has(materialName))
 				{
@@ -747,13 +926,16 @@ void AssetManager::loadScene(const std::string& scene_file)
 
 					for (const std::vector<MaterialTexture>& stageTextures : material->getTextures())
 						for (const MaterialTexture& matTex : stageTextures)
-							sceneTextures.push_back(matTex.tex);
+							sceneTextures.add(matTex.tex);
 				}
-				sceneMaterials.push_back(material);
+				sceneMaterials.add(material, materialName);
 			}
 
 			MeshRenderer* mr = new MeshRenderer(sceneElem.first.c_str(), material, standardInputLayout);
+			mr->setSceneIndex((uint32)sceneMeshRenderers.size());
 			sceneMeshRenderers.push_back(mr);
+			mr->setTransformSystem(&sceneTransforms);
+			mr->setSceneBvh(&sceneBvh);
 
 			std::string modelName = elemProperties["model"];
 			loadMeshToMeshRenderer(modelName, *mr);
@@ -765,6 +947,7 @@ void AssetManager::loadScene(const std::string& scene_file)
 			mr->setTransform(tr);
 
 			mr->setUvScale(elemProperties.has("uv_scale") ? std::stof(elemProperties["uv_scale"]) : 1.0f);
+			mr->setStatic(elemProperties["static"] == "yes");
 		}
 		else if (elemProperties["type"] == "water")
 		{
@@ -829,25 +1012,43 @@ void AssetManager::loadScene(const std::string& scene_file)
 			fe = new D3D12Test(w, h);
 		}
 	}
+
+	// The first snapshot of the scene already has the matrices of its renderers
+	updateSceneTransforms();
 }
 
 void AssetManager::unloadCurrentScene()
 {
-	for (auto& md : sceneMeshes)
-		delete md.second;
+	// Cancelled stream jobs stop at the next window, wait for them before the materials they use are gone
+	for (auto& smd : streamedMeshes)
+		smd.second->cancelled = true;
+	if (tp != nullptr)
+		tp->wait(streamingJobs);
+
+	// Pending uploads still refer to textures and materials of the current scene
+	if (tp != nullptr)
+		tp->runMainThreadJobs();
+	if (io != nullptr)
+		io->clearPrefetched();
+
 	sceneMeshes.clear();
+	streamedMeshes.clear();
 	for (MeshRenderer* mr : sceneMeshRenderers)
 		delete mr;
 	sceneMeshRenderers.clear();
-	for (Material* m : sceneMaterials)
-		delete m;
+	sceneTransforms.clear();
+	sceneBvh.clear();
 	sceneMaterials.clear();
-	for (ITexture* t : sceneTextures)
-		delete t;
 	sceneTextures.clear();
 }
 
-void AssetManager::setGlobalShaderKeyword(const std::string& keyword, bool enable)
+void AssetManager::updateSceneTransforms()
+{
+	sceneTransforms.update();
+	sceneTransforms.forEachChanged([](void* user_data) { ((MeshRenderer*)user_data)->onTransformUpdated(); });
+}
+
+void AssetManager::setGlobalShaderKeyword(const char* keyword, bool enable)
 {
 	auto it = std::find(globalShaderKeywords.begin(), globalShaderKeywords.end(), keyword);
 	bool keywordCurrentlyEnabled = it != globalShaderKeywords.end();
@@ -860,8 +1061,7 @@ void AssetManager::setGlobalShaderKeyword(const std::string& keyword, bool enabl
 	// This adds unnecessary overhead for toggling global keywords, maybe only record keyword changes and
 	// only flush them if we use the material for rendering
 	if (enable != keywordCurrentlyEnabled)
-		for (Material* mat : sceneMaterials)
-			mat->setKeyword(keyword, enable);
+		sceneMaterials.forEach([&](AssetHandle<Material>, Material* mat) { mat->setKeyword(keyword, enable); });
 
 	if (wr != nullptr)
 		wr->onGlobalShaderKeywordsChanged(); // TODO: make this some event that stuff can subscribe to
@@ -933,6 +1133,8 @@ void AssetManager::initDefaultAssets()
 
 	MeshData defaultMesh;
 	loadMesh2("Box", defaultMesh);
+	defaultMesh.computeBounds();
+	defaultMeshBounds = defaultMesh.bounds;
 	BufferDesc vbDesc("defaultMeshVb", sizeof(defaultMesh.vertexData[0]), (unsigned int)defaultMesh.vertexData.size(), ResourceUsage::DEFAULT, BIND_VERTEX_BUFFER);
 	vbDesc.initialData = defaultMesh.vertexData.data();
 	defaultMeshVb.reset(drv->createBuffer(vbDesc));
@@ -1,17 +1,31 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <functional>
 
+#include <DirectXCollision.h>
+
 #include <Common.h>
 #include <Util/CaseSensitiveIni.h>
+#include <Util/IoService.h>
 #include <Util/ResIdHolder.h>
+#include <Util/Task.h>
+#include <Util/ThreadPool.h>
 #include <Driver/IDriver.h>
 
+#include <Renderer/DynamicBvh.h>
+
+#include "AssetRegistry.h"
 #include "Material.h"
+#include "TransformSystem.h"
 
 struct MeshData;
+struct StreamedMeshData;
 class MeshRenderer;
 
 enum class LoadExecutionMode { ASYNC, SYNC };
@@ -25,37 +39,90 @@ public:
 	ITexture* loadTexture(const std::string& path, bool srgb, bool need_mips = true, bool hdr = false, std::function<void(ITexture*, bool)> callback = [](ITexture*,bool){}, LoadExecutionMode lem = LoadExecutionMode::ASYNC);
 	bool loadTexturesToStandardMaterial(const MaterialTexturePaths& paths, Material* material, bool flip_normal_green, LoadExecutionMode lem = LoadExecutionMode::ASYNC);
 	bool loadMesh(const std::string& name, MeshData& mesh_data);
-	bool loadMesh2(const std::string& name, MeshData& mesh_data);
+	bool loadMesh2(const std::string& name, MeshData& mesh_data, const std::vector<uint8>* source_data = nullptr);
+	bool loadMeshGlb(const std::string& name, MeshData& mesh_data);
+	bool importMesh(const std::string& name, MeshData& mesh_data, const std::vector<uint8>* source_data = nullptr);
 	bool loadMeshToMeshRenderer(const std::string& name, MeshRenderer& mesh_renderer, LoadExecutionMode lem = LoadExecutionMode::ASYNC);
+	bool streamMeshObj(const std::string& name, StreamedMeshData& streamed_mesh_data);
+	bool streamMeshToMeshRenderer(const std::string& name, MeshRenderer& mesh_renderer, LoadExecutionMode lem = LoadExecutionMode::ASYNC);
+	bool loadCookedMesh(const std::string& name, MeshData& mesh_data);
+	bool decodeCookedMesh(const std::string& name, const std::vector<uint8>& file_data, MeshData& mesh_data);
+	bool cookMesh(const std::string& name, const MeshData& mesh_data);
 
 	void loadScene(const std::string& scene_file);
 	void unloadCurrentScene();
 
 	std::vector<MeshRenderer*>& getSceneMeshRenderers() { return sceneMeshRenderers; }
+	DynamicBvh& getSceneBvh() { return sceneBvh; } // Of the scene renderers, main thread only
+	TransformSystem& getSceneTransforms() { return sceneTransforms; } // Of the scene renderers, main thread only
+	void updateSceneTransforms(); // Once per frame, moves the proxies of the changed renderers. Snapshots capture the matrices of the last update.
+	const AssetRegistry<Material>& getSceneMaterials() const { return sceneMaterials; }
 
 	std::vector<std::string>& getGlobalShaderKeywords() { return globalShaderKeywords; }
-	void setGlobalShaderKeyword(const std::string& keyword, bool enable);
+	void setGlobalShaderKeyword(const char* keyword, bool enable);
 
 	ITexture* getDefaultTexture(MaterialTexture::Purpose purpose) const { return defaultTextures[(int)purpose]; }
 	IBuffer* getDefaultMeshIb() const { return defaultMeshIb.get(); }
 	IBuffer* getDefaultMeshVb() const { return defaultMeshVb.get(); }
+	const BoundingBox& getDefaultMeshBounds() const { return defaultMeshBounds; }
 	ResId getDefaultInputLayout() const { return defaultInputLayout; }
 	ResId getDefaultMaterialTextureSampler() const { return defaultMaterialTextureSampler; }
 	void setDefaultMaterialSamplerMipBias(float mip_bias);
 
 	void sceneGui();
+	void benchmarkCookedMeshDecompression();
+	void benchmarkColdFileReads();
 
 private:
+	// Alive while a load is in flight. When the last of the loads running at the same time finishes, it logs how
+	// well reading files overlapped with decoding.
+	class PendingLoad
+	{
+	public:
+		explicit PendingLoad(AssetManager& asset_manager);
+		PendingLoad(PendingLoad&& other) noexcept : owner(std::exchange(other.owner, nullptr)) {}
+		~PendingLoad();
+
+	private:
+		AssetManager* owner;
+	};
+
+	struct LoadStats
+	{
+		std::mutex mutex;
+		int numPendingLoads = 0; // Guarded by mutex, as well as the rest of the non-atomic members
+		int numLoads = 0;
+		std::chrono::high_resolution_clock::time_point startTime;
+		IoService::Stats ioStatsAtStart;
+		ThreadPool::ThreadStats poolStatsAtStart;
+		std::atomic<uint64> decodeNs = 0;
+	};
+
+	Task<> loadTextureTask(std::string path, bool srgb, bool need_mips, bool hdr, std::function<void(ITexture*, bool)> callback, ITexture* texture, PendingLoad pending_load);
+	Task<> loadMaterialTexturesTask(MaterialTexturePaths paths, Material* material, bool flip_normal_green,
+		ITexture* base_texture, ITexture* normal_rough_metal_texture, PendingLoad pending_load);
+	Task<bool> loadMeshTask(std::string name, MeshRenderer& mesh_renderer, MeshData* mesh_data, bool already_started_loading, PendingLoad pending_load);
+
 	void initInis();
 	void initShaders();
 	void initDefaultAssets();
 	void initDefaultMaterialTextureSampler();
+	Material* createMeshMaterial(const std::string& name, const MaterialTexturePaths& paths, bool flip_normal_green,
+		const PerMaterialConstantBufferData* constants = nullptr);
+	std::string getCookedMeshPath(const std::string& name) const;
+	std::string getMeshImportSettings(const std::string& name);
+	std::string getMeshImporter(const std::string& name);
+	std::vector<std::string> collectSceneFilePaths(); // Files read while loading the current scene
 
 	std::vector<ITexture*> engineTextures;
-	std::vector<ITexture*> sceneTextures;
-	std::vector<Material*> sceneMaterials;
+	AssetRegistry<ITexture> sceneTextures;
+	AssetRegistry<Material> sceneMaterials;
 	std::vector<MeshRenderer*> sceneMeshRenderers;
-	std::map<std::string, MeshData*> sceneMeshes;
+	TransformSystem sceneTransforms;
+	DynamicBvh sceneBvh;
+	AssetRegistry<MeshData> sceneMeshes;
+	std::map<std::string, std::shared_ptr<StreamedMeshData>> streamedMeshes;
+	JobCounter streamingJobs; // Stream jobs look up scene materials, the scene has to outlive them
 
 	std::vector<std::string> globalShaderKeywords;
 
@@ -64,6 +131,7 @@ private:
 
 	std::array<ITexture*, (int)MaterialTexture::Purpose::_COUNT> defaultTextures;
 	std::unique_ptr<IBuffer> defaultMeshIb;
+	BoundingBox defaultMeshBounds;
 	std::unique_ptr<IBuffer> defaultMeshVb;
 	ResId defaultInputLayout = BAD_RESID;
 	ResIdHolder defaultMaterialTextureSampler;
@@ -76,4 +144,6 @@ private:
 	std::unique_ptr<mINI::INIFile> currentSceneIniFile;
 	mINI::INIStructure currentSceneIni;
 	std::string currentSceneIniFilePath;
+
+	LoadStats loadStats;
 };
\ No newline at end of file
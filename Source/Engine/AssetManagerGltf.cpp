@@ -0,0 +1,541 @@
+#include "AssetManager.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <cstddef>
+
+#include <Util/Json.h>
+#include <Util/MappedFile.h>
+#include <Renderer/ConstantBuffers.h>
+
+#include "Material.h"
+#include "MeshRenderer.h"
+#include "VertexData.h"
+
+static constexpr uint32 GLB_MAGIC = 0x46546C67; // "glTF"
+static constexpr uint32 GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+static constexpr uint32 GLB_CHUNK_BIN = 0x004E4942; // "BIN\0"
+static constexpr int GLTF_MODE_TRIANGLES = 4;
+static constexpr uint64 MAX_BYTE_STRIDE = 252;
+static const char* EXTRACTED_TEXTURES_DIR = "Cooked/Textures";
+
+enum GltfComponentType
+{
+	GLTF_BYTE = 5120,
+	GLTF_UNSIGNED_BYTE = 5121,
+	GLTF_SHORT = 5122,
+	GLTF_UNSIGNED_SHORT = 5123,
+	GLTF_UNSIGNED_INT = 5125,
+	GLTF_FLOAT = 5126,
+};
+
+struct GltfAccessor
+{
+	const uint8* data = nullptr; // First element
+	uint32 count = 0;
+	uint32 stride = 0;
+	int componentType = 0;
+	int numComponents = 0;
+	bool normalized = false;
+	int bufferView = -1;
+	size_t offset = 0; // Offset of the first element in the binary chunk
+	size_t viewOffset = 0; // Of the buffer view, within the binary chunk
+	size_t viewLength = 0;
+};
+
+static int get_num_components(const std::string& type)
+{
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	if (type == "MAT4") return 16;
+	return 0;
+}
+
+static uint32 get_component_size(int component_type)
+{
+	switch (component_type)
+	{
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE:
+		return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT:
+		return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static bool get_accessor(const json::Value& gltf, int index, const uint8* bin, size_t bin_size, GltfAccessor& out)
+{
+	const json::Value& accessor = gltf["accessors"][index];
+	if (accessor.isNull())
+		return false;
+	out.bufferView = accessor["bufferView"].asInt(-1);
+	const json::Value& view = gltf["bufferViews"][out.bufferView];
+	if (view.isNull() || view["buffer"].asInt(0) != 0 || accessor.has("sparse"))
+		return false; // Only plain accessors into the GLB binary chunk are supported
+
+	out.componentType = accessor["componentType"].asInt();
+	out.numComponents = get_num_components(accessor["type"].asString());
+	out.normalized = accessor["normalized"].asBool();
+	const uint32 elementSize = get_component_size(out.componentType) * out.numComponents;
+	if (elementSize == 0)
+		return false;
+
+	// Sizes and offsets of a file that may be broken, the ranges are compared so nothing can wrap around
+	uint64 count, accessorOffset, viewOffset, viewLength, viewStride;
+	if (!accessor["count"].asUint64(count) || !accessor["byteOffset"].asUint64(accessorOffset) || !view["byteOffset"].asUint64(viewOffset)
+		|| !view["byteLength"].asUint64(viewLength) || !view["byteStride"].asUint64(viewStride))
+		return false;
+	if (count > UINT32_MAX || viewStride > MAX_BYTE_STRIDE || viewOffset > bin_size || viewLength > bin_size - viewOffset || accessorOffset > viewLength)
+		return false;
+	out.count = (uint32)count;
+	out.stride = viewStride > 0 ? (uint32)viewStride : elementSize;
+	if (out.count > 0 && (count - 1) * out.stride + elementSize > viewLength - accessorOffset)
+		return false;
+
+	out.viewOffset = (size_t)viewOffset;
+	out.viewLength = (size_t)viewLength;
+	out.offset = (size_t)(viewOffset + accessorOffset);
+	out.data = bin + out.offset;
+	return true;
+}
+
+static float read_component(const uint8* p, int component_type, bool normalized)
+{
+	switch (component_type)
+	{
+	case GLTF_FLOAT: { float v; memcpy(&v, p, sizeof(v)); return v; }
+	case GLTF_UNSIGNED_BYTE: return normalized ? *p / 255.0f : *p;
+	case GLTF_BYTE: return normalized ? std::max(*(const int8*)p / 127.0f, -1.0f) : *(const int8*)p;
+	case GLTF_UNSIGNED_SHORT: { uint16 v; memcpy(&v, p, sizeof(v)); return normalized ? v / 65535.0f : v; }
+	case GLTF_SHORT: { int16 v; memcpy(&v, p, sizeof(v)); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+	default: return 0.0f;
+	}
+}
+
+static XMFLOAT4 read_element(const GltfAccessor& accessor, uint32 i, XMFLOAT4 default_value)
+{
+	float v[4] = { default_value.x, default_value.y, default_value.z, default_value.w };
+	const uint8* p = accessor.data + (size_t)i * accessor.stride;
+	const uint32 componentSize = get_component_size(accessor.componentType);
+	for (int c = 0; c < std::min(accessor.numComponents, 4); c++)
+		v[c] = read_component(p + c * componentSize, accessor.componentType, accessor.normalized);
+	return XMFLOAT4(v[0], v[1], v[2], v[3]);
+}
+
+static uint32 read_index(const GltfAccessor& accessor, uint32 i)
+{
+	const uint8* p = accessor.data + (size_t)i * accessor.stride;
+	switch (accessor.componentType)
+	{
+	case GLTF_UNSIGNED_BYTE: return *p;
+	case GLTF_UNSIGNED_SHORT: { uint16 v; memcpy(&v, p, sizeof(v)); return v; }
+	case GLTF_UNSIGNED_INT: { uint32 v; memcpy(&v, p, sizeof(v)); return v; }
+	default: return 0;
+	}
+}
+
+static XMMATRIX get_node_matrix(const json::Value& node)
+{
+	const json::Value& m = node["matrix"];
+	if (m.size() == 16)
+	{
+		// Column-major with column vectors in glTF, which is the same memory layout as row-major with row vectors
+		XMFLOAT4X4 f;
+		for (int i = 0; i < 16; i++)
+			(&f._11)[i] = m[i].asFloat();
+		return XMLoadFloat4x4(&f);
+	}
+
+	const json::Value& s = node["scale"];
+	const json::Value& r = node["rotation"];
+	const json::Value& t = node["translation"];
+	return XMMatrixScaling(s[0].asFloat(1), s[1].asFloat(1), s[2].asFloat(1))
+		* XMMatrixRotationQuaternion(XMVectorSet(r[0].asFloat(0), r[1].asFloat(0), r[2].asFloat(0), r[3].asFloat(1)))
+		* XMMatrixTranslation(t[0].asFloat(0), t[1].asFloat(0), t[2].asFloat(0));
+}
+
+static void gather_mesh_instances(const json::Value& gltf, int node_index, FXMMATRIX parent, int depth, std::vector<std::pair<int, XMFLOAT4X4>>& out_instances)
+{
+	const json::Value& node = gltf["nodes"][node_index];
+	if (node.isNull() || depth > 64)
+		return;
+	XMMATRIX world = get_node_matrix(node) * parent;
+	if (node.has("mesh"))
+	{
+		XMFLOAT4X4 f;
+		XMStoreFloat4x4(&f, world);
+		out_instances.emplace_back(node["mesh"].asInt(), f);
+	}
+	const json::Value& children = node["children"];
+	for (size_t i = 0; i < children.size(); i++)
+		gather_mesh_instances(gltf, children[i].asInt(-1), world, depth + 1, out_instances);
+}
+
+static bool is_identity(const XMFLOAT4X4& m)
+{
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	return memcmp(&m, &identity, sizeof(m)) == 0;
+}
+
+bool AssetManager::loadMeshGlb(const std::string& name, MeshData& mesh_data)
+{
+	std::string path = modelsIni[name]["path"];
+	std::string dir = std::filesystem::path(path).parent_path().u8string();
+	float importScale = modelsIni[name]["scale"].length() > 0 ? std::stof(modelsIni[name]["scale"]) : 1.0f;
+	bool flipUvX = modelsIni[name]["flipUvX"] == "yes";
+	bool flipUvY = modelsIni[name]["flipUvY"] == "yes";
+	bool flipHandedness = modelsIni[name]["flipHandedness"] == "yes";
+
+	PLOG_INFO << "Loading mesh '" << name << "' from file: " << path.c_str();
+	auto startLoadTime = std::chrono::high_resolution_clock::now();
+
+	auto file = std::make_shared<MappedFile>();
+	if (!file->open(path))
+		return false;
+
+	// Header and chunks
+	const uint8* fileData = file->getData();
+	const size_t fileSize = file->getSize();
+	uint32 header[3];
+	if (fileSize < sizeof(header) + 8)
+	{
+		PLOG_ERROR << "File is too small to be a GLB: " << path;
+		return false;
+	}
+	memcpy(header, fileData, sizeof(header));
+	if (header[0] != GLB_MAGIC || header[1] != 2 || header[2] > fileSize)
+	{
+		PLOG_ERROR << "Not a glTF 2.0 binary file: " << path;
+		return false;
+	}
+
+	const char* jsonChunk = nullptr;
+	size_t jsonChunkSize = 0;
+	const uint8* bin = nullptr;
+	size_t binSize = 0;
+	for (size_t offset = sizeof(header); offset + 8 <= header[2];)
+	{
+		uint32 chunkHeader[2];
+		memcpy(chunkHeader, fileData + offset, sizeof(chunkHeader));
+		offset += sizeof(chunkHeader);
+		if (offset + chunkHeader[0] > header[2])
+			break;
+		if (chunkHeader[1] == GLB_CHUNK_JSON && jsonChunk == nullptr)
+		{
+			jsonChunk = (const char*)fileData + offset;
+			jsonChunkSize = chunkHeader[0];
+		}
+		else if (chunkHeader[1] == GLB_CHUNK_BIN && bin == nullptr)
+		{
+			bin = fileData + offset;
+			binSize = chunkHeader[0];
+		}
+		offset += (chunkHeader[0] + 3) & ~3u;
+	}
+
+	json::Value gltf;
+	std::string jsonError;
+	if (jsonChunk == nullptr || !json::parse(jsonChunk, jsonChunkSize, gltf, jsonError))
+	{
+		PLOG_ERROR << "Couldn't parse JSON chunk of GLB file: " << path << std::endl << "\tError: " << jsonError;
+		return false;
+	}
+
+	// Mesh instances from the node hierarchy of the default scene, or every mesh as is if there is no scene
+	std::vector<std::pair<int, XMFLOAT4X4>> instances;
+	const json::Value& scene = gltf["scenes"][gltf["scene"].asInt(0)];
+	if (!scene.isNull())
+	{
+		const json::Value& rootNodes = scene["nodes"];
+		for (size_t i = 0; i < rootNodes.size(); i++)
+			gather_mesh_instances(gltf, rootNodes[i].asInt(-1), XMMatrixIdentity(), 0, instances);
+	}
+	else
+	{
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		for (size_t m = 0; m < gltf["meshes"].size(); m++)
+			instances.emplace_back((int)m, identity);
+	}
+
+	struct Primitive
+	{
+		std::string name;
+		int material;
+		XMFLOAT4X4 world;
+		GltfAccessor position, normal, color, uv, indices;
+		bool hasNormal, hasColor, hasUv, hasIndices;
+	};
+	std::vector<Primitive> primitives;
+	for (const auto& instance : instances)
+	{
+		const json::Value& mesh = gltf["meshes"][instance.first];
+		const json::Value& meshPrimitives = mesh["primitives"];
+		for (size_t p = 0; p < meshPrimitives.size(); p++)
+		{
+			const json::Value& prim = meshPrimitives[p];
+			const json::Value& attributes = prim["attributes"];
+			Primitive primitive = {};
+			primitive.name = (mesh.has("name") ? mesh["name"].asString() : "mesh" + std::to_string(instance.first)) + "_" + std::to_string(p);
+			primitive.material = prim["material"].asInt(-1);
+			primitive.world = instance.second;
+			if (prim["mode"].asInt(GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES
+				|| !get_accessor(gltf, attributes["POSITION"].asInt(-1), bin, binSize, primitive.position))
+			{
+				PLOG_WARNING << "Skipping unsupported primitive '" << primitive.name << "' in mesh '" << name << "'. Only triangles with positions are supported.";
+				continue;
+			}
+			primitive.hasNormal = get_accessor(gltf, attributes["NORMAL"].asInt(-1), bin, binSize, primitive.normal);
+			primitive.hasColor = get_accessor(gltf, attributes["COLOR_0"].asInt(-1), bin, binSize, primitive.color);
+			primitive.hasUv = get_accessor(gltf, attributes["TEXCOORD_0"].asInt(-1), bin, binSize, primitive.uv);
+			primitive.hasIndices = get_accessor(gltf, prim["indices"].asInt(-1), bin, binSize, primitive.indices);
+			primitives.push_back(primitive);
+		}
+	}
+
+	if (primitives.empty())
+	{
+		PLOG_ERROR << "No triangle primitives found in mesh: " << name;
+		return false;
+	}
+
+	// Data can be used in place if it's laid out exactly like StandardVertexData, and needs no transformation
+	bool zeroCopy = importScale == 1.0f && !flipUvX && !flipUvY && !flipHandedness;
+	for (const Primitive& p : primitives)
+	{
+		if (!zeroCopy)
+			break;
+		const int vertexView = primitives[0].position.bufferView;
+		const int indexView = primitives[0].indices.bufferView;
+		const size_t vertexViewOffset = primitives[0].position.viewOffset;
+		const size_t indexViewOffset = primitives[0].indices.viewOffset;
+		zeroCopy = is_identity(p.world)
+			&& p.hasNormal && p.hasColor && p.hasUv && p.hasIndices
+			&& p.position.bufferView == vertexView && p.normal.bufferView == vertexView && p.color.bufferView == vertexView && p.uv.bufferView == vertexView
+			&& p.position.stride == sizeof(StandardVertexData) && p.normal.stride == sizeof(StandardVertexData) && p.color.stride == sizeof(StandardVertexData) && p.uv.stride == sizeof(StandardVertexData)
+			&& (p.position.offset - vertexViewOffset) % sizeof(StandardVertexData) == 0
+			&& p.position.componentType == GLTF_FLOAT && p.position.numComponents == 3
+			&& p.normal.componentType == GLTF_FLOAT && p.normal.numComponents == 3 && p.normal.offset == p.position.offset + offsetof(StandardVertexData, normal)
+			&& p.color.componentType == GLTF_UNSIGNED_BYTE && p.color.numComponents == 4 && p.color.offset == p.position.offset + offsetof(StandardVertexData, color)
+			&& p.uv.componentType == GLTF_FLOAT && p.uv.numComponents == 2 && p.uv.offset == p.position.offset + offsetof(StandardVertexData, uv)
+			&& p.indices.bufferView == indexView && p.indices.componentType == GLTF_UNSIGNED_INT && p.indices.stride == sizeof(uint32)
+			&& (p.indices.offset - indexViewOffset) % sizeof(uint32) == 0;
+	}
+
+	// Indices used in place aren't checked by the conversion, so all of them have to be within their primitive's vertices,
+	// and those within the vertex view
+	for (const Primitive& p : primitives)
+	{
+		if (!zeroCopy)
+			break;
+		const size_t numViewVertices = p.position.viewLength / sizeof(StandardVertexData);
+		const size_t startVertex = (p.position.offset - p.position.viewOffset) / sizeof(StandardVertexData);
+		const size_t numViewIndices = p.indices.viewLength / sizeof(uint32);
+		const size_t startIndex = (p.indices.offset - p.indices.viewOffset) / sizeof(uint32);
+		zeroCopy = startVertex + p.position.count <= numViewVertices && startIndex + p.indices.count <= numViewIndices;
+		for (uint32 i = 0; zeroCopy && i < p.indices.count; i++)
+			zeroCopy = read_index(p.indices, i) < p.position.count;
+		if (!zeroCopy)
+			PLOG_WARNING << "Primitive '" << p.name << "' of mesh '" << name << "' has indices out of range, the mesh is converted instead of used in place.";
+	}
+
+	// Materials, created on first use
+	const bool flipNormalGreen = flipUvX != flipUvY;
+	std::vector<Material*> materials(gltf["materials"].size(), nullptr);
+	auto getTexturePath = [&](const json::Value& texture_info) -> std::string
+	{
+		if (texture_info.isNull())
+			return "";
+		const int imageIndex = gltf["textures"][texture_info["index"].asInt(-1)]["source"].asInt(-1);
+		const json::Value& image = gltf["images"][imageIndex];
+		if (image.has("uri"))
+		{
+			const std::string& uri = image["uri"].asString();
+			if (uri.compare(0, 5, "data:") == 0)
+			{
+				PLOG_WARNING << "Data URI images are not supported. Model: '" << name << "', image: " << imageIndex;
+				return "";
+			}
+			return dir + "/" + uri;
+		}
+
+		// Image embedded in the binary chunk. Texture loading works with paths, so extract it next to cooked assets.
+		const json::Value& view = gltf["bufferViews"][image["bufferView"].asInt(-1)];
+		uint64 viewOffset, viewSize;
+		if (view.isNull() || !view["byteOffset"].asUint64(viewOffset) || !view["byteLength"].asUint64(viewSize)
+			|| viewOffset > binSize || viewSize > binSize - viewOffset)
+			return "";
+		const std::string extension = image["mimeType"].asString() == "image/jpeg" ? ".jpg" : ".png";
+		const std::string extractedPath = std::string(EXTRACTED_TEXTURES_DIR) + "/" + name + "_" + std::to_string(imageIndex) + extension;
+		std::error_code ec;
+		if (std::filesystem::file_size(extractedPath, ec) != viewSize)
+		{
+			std::filesystem::create_directories(EXTRACTED_TEXTURES_DIR, ec);
+			std::ofstream out(extractedPath, std::ios::binary | std::ios::trunc);
+			out.write((const char*)bin + viewOffset, (std::streamsize)viewSize);
+			if (!out)
+			{
+				PLOG_ERROR << "Couldn't extract embedded image to: " << extractedPath;
+				return "";
+			}
+		}
+		return extractedPath;
+	};
+	auto getMaterial = [&](int index) -> Material*
+	{
+		if (index < 0 || index >= (int)materials.size())
+			return nullptr;
+		if (materials[index] != nullptr)
+			return materials[index];
+
+		const json::Value& mtl = gltf["materials"][index];
+		const json::Value& pbr = mtl["pbrMetallicRoughness"];
+
+		MaterialTexturePaths paths;
+		paths.albedo = getTexturePath(pbr["baseColorTexture"]);
+		const std::string& alphaMode = mtl["alphaMode"].asString();
+		if (alphaMode == "MASK" || alphaMode == "BLEND")
+			paths.opacity = paths.albedo;
+		paths.normal = getTexturePath(mtl["normalTexture"]);
+		// Metalness and roughness are packed to one texture in glTF
+		std::string metallicRoughness = getTexturePath(pbr["metallicRoughnessTexture"]);
+		paths.roughness = metallicRoughness;
+		paths.roughnessChannel = 1;
+		paths.metalness = metallicRoughness;
+		paths.metalnessChannel = 2;
+
+		PerMaterialConstantBufferData materialCbData;
+		const json::Value& baseColorFactor = pbr["baseColorFactor"];
+		materialCbData.materialColor = XMFLOAT4(baseColorFactor[0].asFloat(1), baseColorFactor[1].asFloat(1), baseColorFactor[2].asFloat(1), baseColorFactor[3].asFloat(1));
+		const float metallicFactor = pbr["metallicFactor"].asFloat(1);
+		const float roughnessFactor = pbr["roughnessFactor"].asFloat(1);
+		if (metallicRoughness.empty())
+			materialCbData.materialParams0 = XMFLOAT4(0, metallicFactor, 0, roughnessFactor);
+		else
+			materialCbData.materialParams0 = XMFLOAT4(metallicFactor, 0, roughnessFactor, 0);
+		materialCbData.materialParams1 = XMFLOAT4(1, 0, 0, 0);
+
+		std::string materialName = mtl.has("name") ? mtl["name"].asString() : "material" + std::to_string(index);
+		Material* material = createMeshMaterial(name + "__" + materialName, paths, flipNormalGreen, &materialCbData);
+
+		materials[index] = material;
+		return material;
+	};
+
+	mesh_data.submeshes.resize(primitives.size());
+	if (zeroCopy)
+	{
+		const size_t vertexViewOffset = primitives[0].position.viewOffset;
+		const size_t indexViewOffset = primitives[0].indices.viewOffset;
+
+		mesh_data.externalVertices = (const StandardVertexData*)(bin + vertexViewOffset);
+		mesh_data.numExternalVertices = primitives[0].position.viewLength / sizeof(StandardVertexData);
+		mesh_data.externalIndices = (const unsigned int*)(bin + indexViewOffset);
+		mesh_data.numExternalIndices = primitives[0].indices.viewLength / sizeof(uint32);
+		mesh_data.externalStorage = file;
+
+		for (size_t i = 0; i < primitives.size(); i++)
+		{
+			const Primitive& p = primitives[i];
+			SubmeshData& submesh = mesh_data.submeshes[i];
+			submesh.name = p.name;
+			submesh.enabled = true;
+			submesh.startVertex = (unsigned int)((p.position.offset - vertexViewOffset) / sizeof(StandardVertexData));
+			submesh.startIndex = (unsigned int)((p.indices.offset - indexViewOffset) / sizeof(uint32));
+			submesh.numIndices = p.indices.count;
+			submesh.material = getMaterial(p.material);
+		}
+	}
+	else
+	{
+		const float zMultiplier = flipHandedness ? -1.0f : 1.0f;
+		for (size_t i = 0; i < primitives.size(); i++)
+		{
+			const Primitive& p = primitives[i];
+			SubmeshData& submesh = mesh_data.submeshes[i];
+			submesh.name = p.name;
+			submesh.enabled = true;
+			submesh.startVertex = (unsigned int)mesh_data.vertexData.size();
+			submesh.startIndex = (unsigned int)mesh_data.indexData.size();
+			submesh.material = getMaterial(p.material);
+
+			XMMATRIX world = XMLoadFloat4x4(&p.world);
+			XMMATRIX normalMatrix = XMMatrixTranspose(XMMatrixInverse(nullptr, world));
+			// Mirroring transforms or handedness flips need the triangle winding flipped
+			const bool flipWinding = flipHandedness != (XMVectorGetX(XMMatrixDeterminant(world)) < 0);
+
+			const size_t numIndices = p.hasIndices ? p.indices.count : p.position.count;
+			for (size_t t = 0; t + 3 <= numIndices; t += 3)
+			{
+				uint32 tri[3];
+				for (int k = 0; k < 3; k++)
+					tri[k] = p.hasIndices ? read_index(p.indices, (uint32)(t + k)) : (uint32)(t + k);
+				if (tri[0] >= p.position.count || tri[1] >= p.position.count || tri[2] >= p.position.count)
+					continue;
+				mesh_data.indexData.push_back(tri[0]);
+				mesh_data.indexData.push_back(flipWinding ? tri[2] : tri[1]);
+				mesh_data.indexData.push_back(flipWinding ? tri[1] : tri[2]);
+			}
+			submesh.numIndices = (unsigned int)mesh_data.indexData.size() - submesh.startIndex;
+
+			mesh_data.vertexData.resize(submesh.startVertex + p.position.count);
+			StandardVertexData* vertices = mesh_data.vertexData.data() + submesh.startVertex;
+			for (uint32 v = 0; v < p.position.count; v++)
+			{
+				StandardVertexData& outVert = vertices[v];
+				XMFLOAT4 position = read_element(p.position, v, XMFLOAT4(0, 0, 0, 1));
+				XMStoreFloat3(&outVert.position, XMVector3TransformCoord(XMLoadFloat4(&position), world) * importScale);
+				outVert.position.z *= zMultiplier;
+				XMFLOAT4 normal = p.hasNormal ? read_element(p.normal, v, XMFLOAT4(0, 0, 0, 0)) : XMFLOAT4(0, 0, 0, 0);
+				XMStoreFloat3(&outVert.normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat4(&normal), normalMatrix)));
+				outVert.normal.z *= zMultiplier;
+				XMFLOAT4 uv = p.hasUv ? read_element(p.uv, v, XMFLOAT4(0, 0, 0, 0)) : XMFLOAT4(0, 0, 0, 0);
+				outVert.uv = XMFLOAT2(flipUvX ? 1.0f - uv.x : uv.x, flipUvY ? 1.0f - uv.y : uv.y);
+				XMFLOAT4 color = p.hasColor ? read_element(p.color, v, XMFLOAT4(1, 1, 1, 1)) : XMFLOAT4(1, 1, 1, 1);
+				outVert.color =
+					(((unsigned int)(color.x * 255u)) & 0xFFu) << 0 |
+					(((unsigned int)(color.y * 255u)) & 0xFFu) << 8 |
+					(((unsigned int)(color.z * 255u)) & 0xFFu) << 16 |
+					(((unsigned int)(color.w * 255u)) & 0xFFu) << 24;
+			}
+
+			// Smooth normals from triangles, if the primitive doesn't have them
+			if (!p.hasNormal)
+			{
+				const unsigned int* indices = mesh_data.indexData.data() + submesh.startIndex;
+				for (unsigned int t = 0; t + 3 <= submesh.numIndices; t += 3)
+				{
+					XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t + 0]].position);
+					XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t + 1]].position);
+					XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t + 2]].position);
+					XMVECTOR faceNormal = XMVector3Cross(p1 - p0, p2 - p0);
+					for (int k = 0; k < 3; k++)
+					{
+						XMFLOAT3& n = vertices[indices[t + k]].normal;
+						XMStoreFloat3(&n, XMLoadFloat3(&n) + faceNormal);
+					}
+				}
+				for (uint32 v = 0; v < p.position.count; v++)
+					XMStoreFloat3(&vertices[v].normal, XMVector3Normalize(XMLoadFloat3(&vertices[v].normal)));
+			}
+		}
+	}
+
+	mesh_data.computeBounds();
+
+	auto finishLoadTime = std::chrono::high_resolution_clock::now();
+	PLOG_INFO << "Loading mesh '" << name << "' successful. It took " << (finishLoadTime - startLoadTime).count() / 1e9 << " seconds. "
+		<< (zeroCopy ? "Vertex and index data is used in place from the mapped file." : "Vertex and index data had to be converted.");
+
+	return true;
+}
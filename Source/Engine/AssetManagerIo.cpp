@@ -0,0 +1,97 @@
+#include "AssetManager.h"
+
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <sstream>
+
+#include <Util/AutoImGui.h>
+
+std::vector<std::string> AssetManager::collectSceneFilePaths()
+{
+	std::set<std::string> paths;
+	auto addPath = [&paths](const std::string& path)
+	{
+		if (!path.empty())
+			paths.insert(path);
+	};
+
+	// Only reads the inis, operator[] would add missing keys
+	for (auto& sceneElem : currentSceneIni)
+	{
+		const mINI::INIMap<std::string>& elemProperties = sceneElem.second;
+		if (elemProperties.get("type") == "model")
+		{
+			const std::string materialName = elemProperties.get("material");
+			if (materialsIni.has(materialName))
+			{
+				const mINI::INIMap<std::string> materialIni = materialsIni.get(materialName);
+				for (const char* key : { "albedo_tex", "opacity_tex", "normal_tex", "roughness_tex", "metalness_tex" })
+					addPath(materialIni.get(key));
+			}
+
+			// Streamed meshes are read in windows, and glb files are mapped instead of read
+			const std::string modelName = elemProperties.get("model");
+			if (!modelsIni.has(modelName) || modelsIni.get(modelName).get("streaming") == "yes")
+				continue;
+			std::string cookedPath = getCookedMeshPath(modelName);
+			if (std::filesystem::exists(cookedPath))
+				addPath(cookedPath);
+			else if (getMeshImporter(modelName) == "obj")
+				addPath(modelsIni.get(modelName).get("path"));
+		}
+		else if (elemProperties.get("type") == "environment")
+			addPath(elemProperties.get("panoramic_environment_map"));
+	}
+
+	return std::vector<std::string>(paths.begin(), paths.end());
+}
+
+static Task<uint64> read_file_uncached(IoService& service, std::string path)
+{
+	FileReadResult file = co_await service.readFile(path, JobPriority::NORMAL, true);
+	co_return file.data.size();
+}
+
+static Task<uint64> read_files_uncached(IoService& service, const std::vector<std::string>& paths)
+{
+	std::vector<Task<uint64>> reads;
+	for (const std::string& path : paths)
+		reads.push_back(read_file_uncached(service, path));
+	co_await when_all(reads);
+
+	uint64 numBytes = 0;
+	for (Task<uint64>& read : reads)
+		numBytes += read.result();
+	co_return numBytes;
+}
+
+void AssetManager::benchmarkColdFileReads()
+{
+	std::vector<std::string> paths = collectSceneFilePaths();
+	if (paths.empty())
+	{
+		PLOG_WARNING << "Cold file read benchmark reads the files of the current scene, load one first.";
+		return;
+	}
+
+	// Reads bypass the file cache of the OS, so every run hits the disk (its own cache aside)
+	auto measure = [&](IoService::Backend backend, std::ostream& report)
+	{
+		IoService service(backend);
+		auto start = std::chrono::high_resolution_clock::now();
+		uint64 numBytes = sync_wait(read_files_uncached(service, paths));
+		double seconds = (std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+		report << "\t" << (service.getBackend() == IoService::Backend::OVERLAPPED ? "Overlapped" : "Thread") << ": "
+			<< numBytes / seconds / (1024.0 * 1024.0) << " MB/s, " << paths.size() / seconds << " files/s";
+	};
+
+	std::ostringstream report;
+	report << "Cold file read benchmark, " << paths.size() << " files of the current scene" << std::endl;
+	measure(IoService::Backend::THREAD, report);
+	report << std::endl;
+	measure(IoService::Backend::OVERLAPPED, report);
+	PLOG_INFO << report.str();
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Cold cache file reads", [] { am->benchmarkColdFileReads(); });
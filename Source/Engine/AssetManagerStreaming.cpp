@@ -0,0 +1,447 @@
+#include "AssetManager.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+#include <Driver/IBuffer.h>
+
+#include "Material.h"
+#include "MeshCodec.h"
+#include "MeshRenderer.h"
+#include "VertexData.h"
+
+// The file is parsed in windows of this size, only the compact attribute arrays and the submesh under construction
+// are kept in memory besides it.
+static constexpr size_t STREAMING_WINDOW_SIZE = 8 * 1024 * 1024;
+
+struct ObjVertexKey
+{
+	int position, uv, normal;
+	bool operator==(const ObjVertexKey& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+};
+
+struct ObjVertexKeyHash
+{
+	size_t operator()(const ObjVertexKey& k) const
+	{
+		return ((size_t)k.position * 73856093u) ^ ((size_t)k.uv * 19349663u) ^ ((size_t)k.normal * 83492791u);
+	}
+};
+
+static bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skip_blanks(const char* p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+	return p;
+}
+
+// Lines always end with '\n' in the parsed window, so parsers can't run past the end
+static const char* parse_float(const char* p, float& out)
+{
+	p = skip_blanks(p);
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+	double value = 0;
+	while (*p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	if (*p == '.')
+	{
+		p++;
+		double scale = 0.1;
+		for (; *p >= '0' && *p <= '9'; scale *= 0.1)
+			value += (*p++ - '0') * scale;
+	}
+	if (*p == 'e' || *p == 'E')
+	{
+		p++;
+		bool negativeExponent = *p == '-';
+		if (*p == '-' || *p == '+')
+			p++;
+		int exponent = 0;
+		while (*p >= '0' && *p <= '9')
+			exponent = exponent * 10 + (*p++ - '0');
+		value *= pow(10.0, negativeExponent ? -exponent : exponent);
+	}
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+static const char* parse_int(const char* p, int& out)
+{
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+	int value = 0;
+	while (*p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	out = negative ? -value : value;
+	return p;
+}
+
+// Converts 1-based or negative relative OBJ index to 0-based, -1 if missing or invalid
+static int resolve_index(int index, size_t count)
+{
+	if (index > 0)
+		return index <= (int)count ? index - 1 : -1;
+	if (index < 0)
+		return (int)count + index >= 0 ? (int)count + index : -1;
+	return -1;
+}
+
+static std::string get_line_rest(const char* p, const char* line_end)
+{
+	p = skip_blanks(p);
+	while (line_end > p && is_blank(line_end[-1]))
+		line_end--;
+	return std::string(p, line_end);
+}
+
+static void load_mtl_texture_paths(const std::string& path, const std::string& dir, std::map<std::string, MaterialTexturePaths>& out_materials)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		PLOG_WARNING << "Couldn't open material library: " << path;
+		return;
+	}
+
+	MaterialTexturePaths* current = nullptr;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line += '\n';
+		const char* p = skip_blanks(line.c_str());
+		const char* lineEnd = line.c_str() + line.length() - 1;
+		auto readKey = [&](const char* key)
+		{
+			size_t len = strlen(key);
+			if (strncmp(p, key, len) != 0 || !is_blank(p[len]))
+				return false;
+			p += len;
+			return true;
+		};
+		if (readKey("newmtl"))
+			current = &out_materials[get_line_rest(p, lineEnd)];
+		else if (current == nullptr)
+			continue;
+		else if (readKey("map_Kd"))
+			current->albedo = dir + "/" + get_line_rest(p, lineEnd);
+		else if (readKey("map_d"))
+			current->opacity = dir + "/" + get_line_rest(p, lineEnd);
+		else if (readKey("map_bump") || readKey("map_Bump") || readKey("bump"))
+			current->normal = dir + "/" + get_line_rest(p, lineEnd);
+		else if (readKey("map_Ns"))
+			current->roughness = dir + "/" + get_line_rest(p, lineEnd);
+		else if (readKey("map_Ka"))
+			current->metalness = dir + "/" + get_line_rest(p, lineEnd);
+	}
+}
+
+bool AssetManager::streamMeshObj(const std::string& name, StreamedMeshData& streamed_mesh_data)
+{
+	std::string path = modelsIni[name]["path"];
+	std::string dir = std::filesystem::path(path).parent_path().u8string();
+	float importScale = modelsIni[name]["scale"].length() > 0 ? std::stof(modelsIni[name]["scale"]) : 1.0f;
+	bool flipUvX = modelsIni[name]["flipUvX"] == "yes";
+	bool flipUvY = modelsIni[name]["flipUvY"] == "yes";
+	bool flipHandedness = modelsIni[name]["flipHandedness"] == "yes";
+	const float zMultiplier = flipHandedness ? -1.0f : 1.0f;
+
+	PLOG_INFO << "Streaming mesh '" << name << "' from file: " << path.c_str();
+	auto startLoadTime = std::chrono::high_resolution_clock::now();
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		PLOG_ERROR << "Couldn't open model file at path: " << path;
+		return false;
+	}
+
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT2> uvs;
+	std::map<std::string, MaterialTexturePaths> materialPaths;
+
+	// Submesh under construction, with its own vertex and index data
+	MeshData submeshData;
+	submeshData.submeshes.resize(1);
+	std::unordered_map<ObjVertexKey, uint32, ObjVertexKeyHash> vertexMap;
+	bool submeshNeedsNormals = false;
+	std::string groupName = "default";
+	Material* currentMaterial = nullptr;
+	int numUploadedSubmeshes = 0;
+	double timeToFirstSubmesh = 0;
+
+	auto flushSubmesh = [&]()
+	{
+		if (submeshData.indexData.empty())
+			return;
+
+		// Smooth normals from triangles, for vertices without one in the file
+		if (submeshNeedsNormals)
+		{
+			std::vector<bool> hasNormal(submeshData.vertexData.size(), true);
+			for (const auto& kv : vertexMap)
+				hasNormal[kv.second] = kv.first.normal >= 0;
+			for (size_t t = 0; t + 3 <= submeshData.indexData.size(); t += 3)
+			{
+				const uint32* tri = &submeshData.indexData[t];
+				XMVECTOR p0 = XMLoadFloat3(&submeshData.vertexData[tri[0]].position);
+				XMVECTOR p1 = XMLoadFloat3(&submeshData.vertexData[tri[1]].position);
+				XMVECTOR p2 = XMLoadFloat3(&submeshData.vertexData[tri[2]].position);
+				XMVECTOR faceNormal = XMVector3Cross(p1 - p0, p2 - p0);
+				for (int k = 0; k < 3; k++)
+				{
+					if (hasNormal[tri[k]])
+						continue;
+					XMFLOAT3& n = submeshData.vertexData[tri[k]].normal;
+					XMStoreFloat3(&n, XMLoadFloat3(&n) + faceNormal);
+				}
+			}
+			for (size_t v = 0; v < submeshData.vertexData.size(); v++)
+				if (!hasNormal[v])
+					XMStoreFloat3(&submeshData.vertexData[v].normal, XMVector3Normalize(XMLoadFloat3(&submeshData.vertexData[v].normal)));
+		}
+
+		SubmeshData& submesh = submeshData.submeshes[0];
+		submesh.name = groupName;
+		submesh.enabled = true;
+		submesh.startIndex = 0;
+		submesh.numIndices = (unsigned int)submeshData.indexData.size();
+		submesh.startVertex = 0;
+		submesh.material = currentMaterial;
+		mesh_codec::optimize_mesh(submeshData);
+		submeshData.computeBounds();
+
+		StreamedSubmeshData streamedSubmesh;
+		streamedSubmesh.submesh = submeshData.submeshes[0];
+
+		std::string bufferName = name + "_" + submesh.name;
+		BufferDesc vbDesc(bufferName, sizeof(StandardVertexData), (unsigned int)submeshData.vertexData.size(), ResourceUsage::DEFAULT, BIND_VERTEX_BUFFER);
+		vbDesc.initialData = submeshData.vertexData.data();
+		streamedSubmesh.vb.reset(drv->createBuffer(vbDesc));
+
+		unsigned int indexByteSize = ::get_byte_size_for_texfmt(drv->getIndexFormat());
+		assert(sizeof(unsigned int) == indexByteSize);
+		BufferDesc ibDesc(bufferName, indexByteSize, (unsigned int)submeshData.indexData.size(), ResourceUsage::DEFAULT, BIND_INDEX_BUFFER);
+		ibDesc.initialData = submeshData.indexData.data();
+		streamedSubmesh.ib.reset(drv->createBuffer(ibDesc));
+
+		{
+			std::lock_guard<std::mutex> lock(streamed_mesh_data.mutex);
+			streamed_mesh_data.readySubmeshes.push_back(streamedSubmesh);
+		}
+
+		if (numUploadedSubmeshes++ == 0)
+			timeToFirstSubmesh = (std::chrono::high_resolution_clock::now() - startLoadTime).count() / 1e9;
+
+		submeshData.vertexData.clear();
+		submeshData.indexData.clear();
+		vertexMap.clear();
+		submeshNeedsNormals = false;
+	};
+
+	auto getMaterial = [&](const std::string& mtl_name) -> Material*
+	{
+		const std::string materialName = name + "__" + mtl_name;
+		if (Material* material = sceneMaterials.findAsset(materialName))
+			return material;
+		auto pathsIt = materialPaths.find(mtl_name);
+		if (pathsIt == materialPaths.end())
+		{
+			PLOG_WARNING << "Material '" << mtl_name << "' isn't defined in material libraries of model '" << name << "', it gets default textures.";
+			pathsIt = materialPaths.emplace(mtl_name, MaterialTexturePaths()).first;
+		}
+		return createMeshMaterial(materialName, pathsIt->second, flipUvX != flipUvY);
+	};
+
+	std::vector<uint32> faceVertices;
+	auto processLine = [&](const char* p, const char* line_end)
+	{
+		p = skip_blanks(p);
+		if (p[0] == 'v' && is_blank(p[1]))
+		{
+			XMFLOAT3 v;
+			p = parse_float(p + 1, v.x);
+			p = parse_float(p, v.y);
+			parse_float(p, v.z);
+			positions.push_back(v);
+		}
+		else if (p[0] == 'v' && p[1] == 'n' && is_blank(p[2]))
+		{
+			XMFLOAT3 n;
+			p = parse_float(p + 2, n.x);
+			p = parse_float(p, n.y);
+			parse_float(p, n.z);
+			normals.push_back(n);
+		}
+		else if (p[0] == 'v' && p[1] == 't' && is_blank(p[2]))
+		{
+			XMFLOAT2 uv;
+			p = parse_float(p + 2, uv.x);
+			parse_float(p, uv.y);
+			uvs.push_back(uv);
+		}
+		else if (p[0] == 'f' && is_blank(p[1]))
+		{
+			faceVertices.clear();
+			for (p = skip_blanks(p + 1); p < line_end && !is_blank(*p) && *p != '#'; p = skip_blanks(p))
+			{
+				ObjVertexKey key = { 0, 0, 0 };
+				p = parse_int(p, key.position);
+				if (*p == '/')
+				{
+					if (*++p != '/')
+						p = parse_int(p, key.uv);
+					if (*p == '/')
+						p = parse_int(p + 1, key.normal);
+				}
+				while (p < line_end && !is_blank(*p))
+					p++; // Skip anything unexpected in the token
+				key.position = resolve_index(key.position, positions.size());
+				key.uv = resolve_index(key.uv, uvs.size());
+				key.normal = resolve_index(key.normal, normals.size());
+				if (key.position < 0)
+					continue;
+
+				auto inserted = vertexMap.emplace(key, (uint32)submeshData.vertexData.size());
+				if (inserted.second)
+				{
+					const XMFLOAT3& pos = positions[key.position];
+					XMFLOAT2 uv = key.uv >= 0 ? uvs[key.uv] : XMFLOAT2(0, 0);
+					StandardVertexData vert;
+					vert.position = XMFLOAT3(pos.x * importScale, pos.y * importScale, pos.z * importScale * zMultiplier);
+					vert.normal = key.normal >= 0 ? normals[key.normal] : XMFLOAT3(0, 0, 0);
+					vert.normal.z *= zMultiplier;
+					vert.uv = XMFLOAT2(flipUvX ? 1.0f - uv.x : uv.x, flipUvY ? 1.0f - uv.y : uv.y);
+					vert.color = 0xFFFFFFFFu;
+					submeshData.vertexData.push_back(vert);
+					submeshNeedsNormals |= key.normal < 0;
+				}
+				faceVertices.push_back(inserted.first->second);
+			}
+
+			// Triangulate polygons as fans
+			for (size_t i = 2; i < faceVertices.size(); i++)
+			{
+				submeshData.indexData.push_back(faceVertices[0]);
+				submeshData.indexData.push_back(faceVertices[flipHandedness ? i : i - 1]);
+				submeshData.indexData.push_back(faceVertices[flipHandedness ? i - 1 : i]);
+			}
+		}
+		else if ((p[0] == 'g' || p[0] == 'o') && is_blank(p[1]))
+		{
+			flushSubmesh();
+			groupName = get_line_rest(p + 1, line_end);
+		}
+		else if (strncmp(p, "usemtl", 6) == 0 && is_blank(p[6]))
+		{
+			Material* material = getMaterial(get_line_rest(p + 6, line_end));
+			if (material != currentMaterial)
+				flushSubmesh();
+			currentMaterial = material;
+		}
+		else if (strncmp(p, "mtllib", 6) == 0 && is_blank(p[6]))
+			load_mtl_texture_paths(dir + "/" + get_line_rest(p + 6, line_end), dir, materialPaths);
+	};
+
+	// Process the file window by window. The incomplete last line of a window is carried over to the next one.
+	std::vector<char> window(STREAMING_WINDOW_SIZE + 1);
+	size_t carriedOver = 0;
+	uint64 bytesRead = 0;
+	bool endOfFile = false;
+	while (!endOfFile && !streamed_mesh_data.cancelled)
+	{
+		if (carriedOver == window.size() - 1)
+			window.resize(window.size() * 2); // Line longer than the window, grow it
+		file.read(window.data() + carriedOver, window.size() - 1 - carriedOver);
+		size_t validSize = carriedOver + (size_t)file.gcount();
+		bytesRead += file.gcount();
+		endOfFile = !file;
+
+		size_t processedSize = validSize;
+		if (endOfFile)
+			window[validSize] = '\n';
+		else
+		{
+			while (processedSize > 0 && window[processedSize - 1] != '\n')
+				processedSize--;
+		}
+
+		const char* lineStart = window.data();
+		const char* windowEnd = window.data() + processedSize;
+		while (lineStart < windowEnd)
+		{
+			const char* lineEnd = (const char*)memchr(lineStart, '\n', windowEnd - lineStart + (endOfFile ? 1 : 0));
+			processLine(lineStart, lineEnd);
+			lineStart = lineEnd + 1;
+		}
+
+		carriedOver = validSize - processedSize;
+		memmove(window.data(), window.data() + processedSize, carriedOver);
+	}
+	flushSubmesh();
+
+	if (streamed_mesh_data.cancelled)
+	{
+		PLOG_INFO << "Streaming mesh '" << name << "' cancelled after " << numUploadedSubmeshes << " submeshes.";
+		return false;
+	}
+
+	auto finishLoadTime = std::chrono::high_resolution_clock::now();
+	size_t attributeBytes = positions.capacity() * sizeof(XMFLOAT3) + normals.capacity() * sizeof(XMFLOAT3) + uvs.capacity() * sizeof(XMFLOAT2);
+	PLOG_INFO << "Streaming mesh '" << name << "' successful. Read " << bytesRead / (1024.0 * 1024.0) << " MB, uploaded " << numUploadedSubmeshes
+		<< " submeshes. First submesh was ready after " << timeToFirstSubmesh << " seconds, all of them after "
+		<< (finishLoadTime - startLoadTime).count() / 1e9 << " seconds. Attribute arrays took " << attributeBytes / (1024.0 * 1024.0) << " MB.";
+
+	return numUploadedSubmeshes > 0;
+}
+
+bool AssetManager::streamMeshToMeshRenderer(const std::string& name, MeshRenderer& mesh_renderer, LoadExecutionMode lem)
+{
+	auto it = streamedMeshes.find(name);
+	if (it != streamedMeshes.end())
+	{
+		mesh_renderer.loadStreamed(it->second);
+		return true;
+	}
+
+	std::shared_ptr<StreamedMeshData> streamedMeshData = std::make_shared<StreamedMeshData>();
+	streamedMeshes[name] = streamedMeshData;
+	mesh_renderer.loadStreamed(streamedMeshData);
+
+	auto stream = [this, name, streamedMeshData, lem]
+	{
+		bool success = streamMeshObj(name, *streamedMeshData);
+		streamedMeshData->finished = true;
+		auto onLoaded = [this, streamedMeshData]
+		{
+			for (MeshRenderer* mr : sceneMeshRenderers)
+				mr->onStreamingFinished(*streamedMeshData);
+			wr->onMeshLoaded();
+		};
+		if (success && lem == LoadExecutionMode::ASYNC)
+			tp->scheduleOnMainThread(onLoaded, nullptr, "Mesh loaded");
+		else if (success)
+			onLoaded();
+		return success;
+	};
+
+	if (lem == LoadExecutionMode::ASYNC)
+	{
+		tp->schedule(stream, &streamingJobs, JobPriority::BACKGROUND, "Stream mesh");
+		return true;
+	}
+	else
+		return stream();
+}
@@ -0,0 +1,164 @@
+#include "AssetRegistry.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+#include <Util/AutoImGui.h>
+
+static constexpr uint32 NUM_NAME_TABLE_SHARDS = 16;
+
+struct NameTableShard
+{
+	std::shared_mutex mutex;
+	std::unordered_set<std::string> names; // Node based, so pointers to elements stay valid
+};
+
+static NameTableShard name_table[NUM_NAME_TABLE_SHARDS];
+
+static NameTableShard& get_name_table_shard(const std::string& name)
+{
+	return name_table[std::hash<std::string>()(name) % NUM_NAME_TABLE_SHARDS];
+}
+
+AssetName intern_asset_name(const std::string& name)
+{
+	NameTableShard& shard = get_name_table_shard(name);
+	{
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		auto it = shard.names.find(name);
+		if (it != shard.names.end())
+			return &*it;
+	}
+	std::unique_lock<std::shared_mutex> lock(shard.mutex);
+	return &*shard.names.insert(name).first;
+}
+
+AssetName find_asset_name(const std::string& name)
+{
+	NameTableShard& shard = get_name_table_shard(name);
+	std::shared_lock<std::shared_mutex> lock(shard.mutex);
+	auto it = shard.names.find(name);
+	return it != shard.names.end() ? &*it : nullptr;
+}
+
+// Threads add, look up, and remove their own assets, while checking that handles of everything they removed stay
+// stale, even after their slots get reused by other threads. One more thread keeps iterating concurrently.
+static void stress_test_asset_registry()
+{
+	constexpr int NUM_THREADS = 8;
+	constexpr int NUM_OPS_PER_THREAD = 200000;
+
+	struct TestAsset
+	{
+		int thread;
+		int serial;
+	};
+
+	AssetRegistry<TestAsset> registry;
+	std::atomic<int> numFailures = 0;
+	std::atomic<bool> workersFinished = false;
+	std::atomic<uint64> numIterated = 0;
+
+	auto worker = [&](int thread_index)
+	{
+		std::mt19937 rng(thread_index);
+		struct LiveAsset
+		{
+			AssetHandle<TestAsset> handle;
+			int serial;
+			int nameId;
+		};
+		std::vector<LiveAsset> live;
+		std::vector<AssetHandle<TestAsset>> removed;
+		std::vector<int> freeNameIds; // Names are reused, interned names are never freed
+		int nextNameId = 0;
+		for (int op = 0; op < NUM_OPS_PER_THREAD; op++)
+		{
+			const uint32 r = rng() % 100;
+			if (r < 25 || live.empty())
+			{
+				int nameId = nextNameId;
+				if (!freeNameIds.empty())
+				{
+					nameId = freeNameIds.back();
+					freeNameIds.pop_back();
+				}
+				else
+					nextNameId++;
+				const std::string name = "stress_" + std::to_string(thread_index) + "_" + std::to_string(nameId);
+				AssetHandle<TestAsset> handle = r < 12
+					? registry.add(new TestAsset{ thread_index, op }, name)
+					: registry.findOrAdd(name, [&] { return new TestAsset{ thread_index, op }; });
+				live.push_back({ handle, op, nameId });
+			}
+			else if (r < 50)
+			{
+				size_t i = rng() % live.size();
+				if (!registry.remove(live[i].handle))
+					numFailures++;
+				if (registry.get(live[i].handle) != nullptr)
+					numFailures++;
+				removed.push_back(live[i].handle);
+				freeNameIds.push_back(live[i].nameId);
+				live[i] = live.back();
+				live.pop_back();
+			}
+			else if (r < 60)
+			{
+				const auto& entry = live[rng() % live.size()];
+				const std::string name = "stress_" + std::to_string(thread_index) + "_" + std::to_string(entry.nameId);
+				if (registry.find(name) != entry.handle)
+					numFailures++;
+			}
+			else if (r < 70 && !removed.empty())
+			{
+				AssetHandle<TestAsset> stale = removed[rng() % removed.size()];
+				if (registry.get(stale) != nullptr || registry.remove(stale))
+					numFailures++;
+			}
+			else
+			{
+				const auto& entry = live[rng() % live.size()];
+				TestAsset* asset = registry.get(entry.handle);
+				if (asset == nullptr || asset->thread != thread_index || asset->serial != entry.serial)
+					numFailures++;
+			}
+		}
+		for (const auto& entry : live)
+			if (!registry.remove(entry.handle))
+				numFailures++;
+	};
+
+	// Only counts, assets may be deleted by their owner threads any time
+	auto iterator = [&]
+	{
+		while (!workersFinished)
+			registry.forEach([&](AssetHandle<TestAsset>, TestAsset*) { numIterated++; });
+	};
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::thread iteratorThread(iterator);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < NUM_THREADS; t++)
+		threads.emplace_back(worker, t);
+	for (std::thread& t : threads)
+		t.join();
+	workersFinished = true;
+	iteratorThread.join();
+	auto finishTime = std::chrono::high_resolution_clock::now();
+
+	if (registry.size() != 0)
+		numFailures++;
+
+	const double seconds = (finishTime - startTime).count() / 1e9;
+	const double opsPerSecond = NUM_THREADS * NUM_OPS_PER_THREAD / seconds;
+	if (numFailures == 0)
+		PLOG_INFO << "Asset registry stress test passed. " << NUM_THREADS << " threads did " << opsPerSecond / 1e6 << " million operations per second, "
+			<< numIterated << " assets were visited by concurrent iteration.";
+	else
+		PLOG_ERROR << "Asset registry stress test failed with " << numFailures << " failures.";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Asset registry stress test", stress_test_asset_registry);
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Common.h>
+
+// Interned asset name, equal names always get the same pointer. Interned names live until the program exits.
+typedef const std::string* AssetName;
+
+AssetName intern_asset_name(const std::string& name);
+AssetName find_asset_name(const std::string& name); // nullptr if the name was never interned
+
+template <typename T>
+struct AssetHandle
+{
+	uint32 index = 0;
+	uint32 generation = 0; // Live slots never have generation 0, so default constructed handles are invalid
+
+	bool isValid() const { return generation != 0; }
+	bool operator==(const AssetHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const AssetHandle& other) const { return !(*this == other); }
+};
+
+// Owns the assets of one type, and hands out generational handles for them. Handles stay cheap to check after
+// their asset is removed: lookups of stale handles return nullptr, even if the slot has been reused since.
+//
+// Handle lookups and iteration are lock-free, slots live in pages that are never moved or freed while the registry
+// exists. Name lookups take a shared lock of one of the name shards. Adding and removing can happen on any thread, but
+// removal deletes the asset, so it must not race with threads still using that particular asset.
+template <typename T>
+class AssetRegistry
+{
+public:
+	AssetRegistry()
+	{
+		for (std::atomic<Slot*>& page : pages)
+			page.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~AssetRegistry()
+	{
+		clear();
+		for (std::atomic<Slot*>& page : pages)
+			delete[] page.load(std::memory_order_relaxed);
+	}
+
+	AssetRegistry(const AssetRegistry&) = delete;
+	AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+	// Takes ownership of asset. If the name is already taken, the asset is still added, but name lookups keep
+	// returning the earlier one.
+	AssetHandle<T> add(T* asset, const std::string& name = "")
+	{
+		AssetName internedName = name.empty() ? nullptr : intern_asset_name(name);
+		if (internedName == nullptr)
+			return addWithName(asset, nullptr);
+
+		NameShard& shard = getNameShard(internedName);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		AssetHandle<T> handle = addWithName(asset, internedName);
+		if (!shard.indices.emplace(internedName, handle.index).second)
+			PLOG_WARNING << "Asset name '" << name << "' is already registered, lookups by name will return the earlier asset.";
+		return handle;
+	}
+
+	// Atomic find-or-add by name. create is called under the lock of the name shard, so it should be cheap.
+	AssetHandle<T> findOrAdd(const std::string& name, const std::function<T*()>& create, bool* out_created = nullptr)
+	{
+		AssetName internedName = intern_asset_name(name);
+		NameShard& shard = getNameShard(internedName);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		auto it = shard.indices.find(internedName);
+		if (out_created != nullptr)
+			*out_created = it == shard.indices.end();
+		if (it != shard.indices.end())
+			return makeHandle(it->second);
+		AssetHandle<T> handle = addWithName(create(), internedName);
+		shard.indices.emplace(internedName, handle.index);
+		return handle;
+	}
+
+	// Deletes the asset, and invalidates all handles pointing to it
+	bool remove(AssetHandle<T> handle)
+	{
+		if (!handle.isValid() || handle.index >= numSlots.load(std::memory_order_acquire))
+			return false;
+		Slot& slot = getSlot(handle.index);
+		AssetName name = slot.name.load(std::memory_order_relaxed);
+		std::unique_lock<std::shared_mutex> nameLock;
+		if (name != nullptr)
+			nameLock = std::unique_lock<std::shared_mutex>(getNameShard(name).mutex);
+
+		T* asset;
+		{
+			std::lock_guard<std::mutex> lock(allocMutex);
+			if (slot.generation.load(std::memory_order_relaxed) != handle.generation)
+				return false;
+			asset = releaseSlot(handle.index);
+		}
+		if (name != nullptr)
+		{
+			auto& indices = getNameShard(name).indices;
+			auto it = indices.find(name);
+			if (it != indices.end() && it->second == handle.index)
+				indices.erase(it);
+		}
+		delete asset;
+		return true;
+	}
+
+	// Deletes all assets
+	void clear()
+	{
+		std::vector<T*> assets;
+		{
+			std::lock_guard<std::mutex> lock(allocMutex);
+			for (uint32 i = 0; i < numSlots.load(std::memory_order_relaxed); i++)
+				if (getSlot(i).generation.load(std::memory_order_relaxed) != 0)
+					assets.push_back(releaseSlot(i));
+		}
+		for (NameShard& shard : nameShards)
+		{
+			std::unique_lock<std::shared_mutex> lock(shard.mutex);
+			shard.indices.clear();
+		}
+		for (T* asset : assets)
+			delete asset;
+	}
+
+	// Lock-free, nullptr for stale or invalid handles
+	T* get(AssetHandle<T> handle) const
+	{
+		if (handle.index >= numSlots.load(std::memory_order_acquire))
+			return nullptr;
+		const Slot& slot = getSlot(handle.index);
+		if (slot.generation.load(std::memory_order_acquire) != handle.generation || !handle.isValid())
+			return nullptr;
+		T* asset = slot.asset.load(std::memory_order_acquire);
+		// Slot could have been released and reused since the generation check
+		if (slot.generation.load(std::memory_order_acquire) != handle.generation)
+			return nullptr;
+		return asset;
+	}
+
+	AssetHandle<T> find(const std::string& name) const
+	{
+		AssetName internedName = find_asset_name(name);
+		if (internedName == nullptr)
+			return AssetHandle<T>();
+		const NameShard& shard = getNameShard(internedName);
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		auto it = shard.indices.find(internedName);
+		return it != shard.indices.end() ? makeHandle(it->second) : AssetHandle<T>();
+	}
+
+	T* findAsset(const std::string& name) const { return get(find(name)); }
+
+	AssetName getName(AssetHandle<T> handle) const { return get(handle) != nullptr ? getSlot(handle.index).name.load(std::memory_order_relaxed) : nullptr; }
+
+	// Lock-free iteration over live assets. Assets added or removed concurrently may or may not be visited.
+	template <typename Func> // void(AssetHandle<T>, T*)
+	void forEach(Func func) const
+	{
+		const uint32 count = numSlots.load(std::memory_order_acquire);
+		for (uint32 i = 0; i < count; i++)
+		{
+			AssetHandle<T> handle = makeHandle(i);
+			if (T* asset = get(handle))
+				func(handle, asset);
+		}
+	}
+
+	uint32 size() const { return numLiveAssets.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr uint32 PAGE_SIZE = 1024;
+	static constexpr uint32 MAX_PAGES = 4096;
+	static constexpr uint32 NUM_NAME_SHARDS = 16;
+
+	struct Slot
+	{
+		std::atomic<uint32> generation { 0 }; // 0 while the slot is free
+		std::atomic<T*> asset { nullptr };
+		std::atomic<AssetName> name { nullptr }; // Written before generation is published
+		uint32 lastGeneration = 0; // Guarded by allocMutex
+	};
+
+	struct NameShard
+	{
+		mutable std::shared_mutex mutex;
+		std::unordered_map<AssetName, uint32> indices;
+	};
+
+	Slot& getSlot(uint32 index) const
+	{
+		return pages[index / PAGE_SIZE].load(std::memory_order_acquire)[index % PAGE_SIZE];
+	}
+
+	NameShard& getNameShard(AssetName name) { return nameShards[(std::hash<const void*>()(name) >> 4) % NUM_NAME_SHARDS]; }
+	const NameShard& getNameShard(AssetName name) const { return nameShards[(std::hash<const void*>()(name) >> 4) % NUM_NAME_SHARDS]; }
+
+	AssetHandle<T> makeHandle(uint32 index) const
+	{
+		AssetHandle<T> handle;
+		handle.index = index;
+		handle.generation = getSlot(index).generation.load(std::memory_order_acquire);
+		return handle;
+	}
+
+	AssetHandle<T> addWithName(T* asset, AssetName name)
+	{
+		std::lock_guard<std::mutex> lock(allocMutex);
+
+		uint32 index;
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			index = numSlots.load(std::memory_order_relaxed);
+			assert(index / PAGE_SIZE < MAX_PAGES);
+			if (index % PAGE_SIZE == 0)
+				pages[index / PAGE_SIZE].store(new Slot[PAGE_SIZE], std::memory_order_release);
+		}
+
+		Slot& slot = getSlot(index);
+		slot.lastGeneration = slot.lastGeneration + 1 != 0 ? slot.lastGeneration + 1 : 1;
+		slot.name.store(name, std::memory_order_relaxed);
+		slot.asset.store(asset, std::memory_order_release);
+		slot.generation.store(slot.lastGeneration, std::memory_order_release);
+		if (index == numSlots.load(std::memory_order_relaxed))
+			numSlots.store(index + 1, std::memory_order_release);
+		numLiveAssets.fetch_add(1, std::memory_order_relaxed);
+
+		AssetHandle<T> handle;
+		handle.index = index;
+		handle.generation = slot.lastGeneration;
+		return handle;
+	}
+
+	T* releaseSlot(uint32 index) // Requires allocMutex
+	{
+		Slot& slot = getSlot(index);
+		slot.generation.store(0, std::memory_order_release);
+		T* asset = slot.asset.exchange(nullptr, std::memory_order_acq_rel);
+		freeSlots.push_back(index);
+		numLiveAssets.fetch_sub(1, std::memory_order_relaxed);
+		return asset;
+	}
+
+	std::atomic<Slot*> pages[MAX_PAGES];
+	std::atomic<uint32> numSlots { 0 };
+	std::atomic<uint32> numLiveAssets { 0 };
+	std::mutex allocMutex;
+	std::vector<uint32> freeSlots;
+	NameShard nameShards[NUM_NAME_SHARDS];
+};
@@ -1,39 +1,50 @@
 #include "Material.h"
 
 #include <assert.h>
+#include <atomic>
+#include <cstring>
 #include <Driver/ITexture.h>
 #include <Driver/IBuffer.h>
 #include <Renderer/WorldRenderer.h>
 #include <Renderer/ConstantBuffers.h>
+#include <Util/LinearArena.h>
 #include "AssetManager.h"
 
+static std::atomic<uint32> next_material_sort_id = 0;
+
 Material::Material(const std::string& name_, const std::array<ResId, (int)RenderPass::_COUNT>& shaders_) : name(name_)
 {
+	sortId = next_material_sort_id++;
 	for (int i = 0; i < (int)RenderPass::_COUNT; i++)
 	{
 		shaders[i] = shaders_[i];
 		currentVariants[i] = 0;
+		instancedVariants[i] = 0;
 	}
 	for (const std::string& kw : am->getGlobalShaderKeywords())
-		setKeyword(kw, true);
+		setKeyword(kw.c_str(), true);
+	updateVariants();
+
+	constants.materialColor = XMFLOAT4(1, 1, 1, 1);
+	constants.materialParams0 = XMFLOAT4(1, 0, 1, 0);
+	constants.materialParams1 = XMFLOAT4(1, 0, 0, 0);
+	uploadedConstants = constants;
 
 	BufferDesc cbDesc;
 	cbDesc.bindFlags = BIND_CONSTANT_BUFFER;
 	cbDesc.numElements = 1;
 	cbDesc.name = "perMaterialCb_" + name_;
 	cbDesc.elementByteSize = sizeof(PerMaterialConstantBufferData);
+	cbDesc.initialData = &uploadedConstants;
 	cb.reset(drv->createBuffer(cbDesc));
-
-	PerMaterialConstantBufferData cbData;
-	cbData.materialColor = XMFLOAT4(1, 1, 1, 1);
-	cbData.materialParams0 = XMFLOAT4(1, 0, 1, 0);
-	cbData.materialParams1 = XMFLOAT4(1, 0, 0, 0);
-	setConstants(cbData);
 }
 
-void Material::setConstants(const PerMaterialConstantBufferData& cb_data)
+void Material::uploadConstants(const PerMaterialConstantBufferData& cb_data)
 {
-	cb->updateData(&cb_data);
+	if (memcmp(&cb_data, &uploadedConstants, sizeof(cb_data)) == 0)
+		return;
+	uploadedConstants = cb_data;
+	cb->updateData(&uploadedConstants);
 }
 
 void Material::setTexture(ShaderStage stage, unsigned int slot, ITexture* tex, MaterialTexture::Purpose purpose)
@@ -45,39 +56,64 @@ void Material::setTexture(ShaderStage stage, unsigned int slot, ITexture* tex, M
 	stageTextures[slot].purpose = purpose;
 }
 
-void Material::setKeyword(const std::string& keyword, bool enable)
+void Material::updateVariants()
 {
-	auto updateCurrentVariants = [&]
-	{
-		std::vector<const char*> keywordCstrs;
-		keywordCstrs.resize(keywords.size());
-		for (int i = 0; i < keywords.size(); i++)
-			keywordCstrs[i] = keywords[i].c_str();
-		for (int i = 0; i < (int)RenderPass::_COUNT; i++)
-			currentVariants[i] = drv->getShaderVariantIndexForKeywords(shaders[i], keywordCstrs.data(), keywordCstrs.size());
-	};
+	// Instanced variants have the keywords of the material and INSTANCING_ON, unless the shader doesn't support it
+	LinearArena& scratch = get_thread_scratch_arena();
+	ArenaScope scope(scratch);
+	ScratchVector<const char*> keywordCstrs(scratch);
+	keywordCstrs.resize(keywords.size());
+	for (int i = 0; i < keywords.size(); i++)
+		keywordCstrs[i] = keywords[i].c_str();
+	for (int i = 0; i < (int)RenderPass::_COUNT; i++)
+		currentVariants[i] = drv->getShaderVariantIndexForKeywords(shaders[i], keywordCstrs.data(), keywordCstrs.size());
+	keywordCstrs.push_back("INSTANCING_ON");
+	for (int i = 0; i < (int)RenderPass::_COUNT; i++)
+		instancedVariants[i] = drv->getShaderVariantIndexForKeywords(shaders[i], keywordCstrs.data(), keywordCstrs.size());
+}
 
+void Material::setKeyword(const char* keyword, bool enable)
+{
 	auto it = std::find(keywords.begin(), keywords.end(), keyword);
 	if (it == keywords.end() && enable)
 	{
 		keywords.push_back(keyword);
-		updateCurrentVariants();
+		updateVariants();
 	}
 	else if (it != keywords.end() && !enable)
 	{
 		keywords.erase(it);
-		updateCurrentVariants();
+		updateVariants();
+	}
+}
+
+bool Material::hasKeyword(const char* keyword) const
+{
+	return std::find(keywords.begin(), keywords.end(), keyword) != keywords.end();
+}
+
+bool Material::hasSameTextures(const Material& other) const
+{
+	for (int stage = 0; stage < (int)ShaderStage::GRAPHICS_STAGE_COUNT; stage++)
+	{
+		if (textures[stage].size() != other.textures[stage].size())
+			return false;
+		for (size_t i = 0; i < textures[stage].size(); i++)
+			if (textures[stage][i].tex != other.textures[stage][i].tex || textures[stage][i].purpose != other.textures[stage][i].purpose)
+				return false;
 	}
+	return true;
 }
 
-void Material::set(RenderPass render_pass)
+void Material::set(RenderPass render_pass, ICommandBuffer& cmd, bool instanced)
 {
 	if (shaders[(int)render_pass] == BAD_RESID)
 		return;
 
-	drv->setShader(shaders[(int)render_pass], currentVariants[(int)render_pass]);
-	drv->setConstantBuffer(ShaderStage::VS, PER_MATERIAL_CONSTANT_BUFFER_SLOT, cb->getId());
-	drv->setConstantBuffer(ShaderStage::PS, PER_MATERIAL_CONSTANT_BUFFER_SLOT, cb->getId());
+	assert(!instanced || supportsInstancing(render_pass));
+	cmd.setShader(shaders[(int)render_pass], instanced ? instancedVariants[(int)render_pass] : currentVariants[(int)render_pass]);
+	cmd.setConstantBuffer(ShaderStage::VS, PER_MATERIAL_CONSTANT_BUFFER_SLOT, cb->getId());
+	cmd.setConstantBuffer(ShaderStage::PS, PER_MATERIAL_CONSTANT_BUFFER_SLOT, cb->getId());
 	for (int stage = 0; stage < (int)ShaderStage::GRAPHICS_STAGE_COUNT; stage++)
 	{
 		for (unsigned int i = 0; i < textures[stage].size(); i++)
@@ -86,8 +122,8 @@ void Material::set(RenderPass render_pass)
 			if (tex != nullptr && tex->isStub())
 				tex = am->getDefaultTexture(textures[stage][i].purpose);
 			ResId texId = tex != nullptr ? tex->getId() : BAD_RESID;
-			drv->setTexture((ShaderStage)stage, i, texId);
-			drv->setSampler((ShaderStage)stage, i, am->getDefaultMaterialTextureSampler());
+			cmd.setTexture((ShaderStage)stage, i, texId);
+			cmd.setSampler((ShaderStage)stage, i, am->getDefaultMaterialTextureSampler());
 		}
 	}
 }
\ No newline at end of file
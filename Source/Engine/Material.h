@@ -1,11 +1,13 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <vector>
 #include <string>
 
 #include <Common.h>
 #include <Driver/IDriver.h>
+#include <Renderer/ConstantBuffers.h>
 
 struct MaterialTexturePaths
 {
@@ -14,6 +16,8 @@ struct MaterialTexturePaths
 	std::string normal;
 	std::string roughness;
 	std::string metalness;
+	int roughnessChannel = 0; // 0: R, 1: G, 2: B, 3: A
+	int metalnessChannel = 0;
 };
 
 struct MaterialTexture
@@ -29,17 +33,41 @@ class Material
 public:
 	Material(const std::string& name_, const std::array<ResId, (int)RenderPass::_COUNT>& shaders_);
 	const std::array<std::vector<MaterialTexture>, (int)ShaderStage::GRAPHICS_STAGE_COUNT>& getTextures() { return textures; }
-	void setConstants(const struct PerMaterialConstantBufferData& cb_data);
+	// Constants are uploaded while rendering, from the snapshot of the frame. Once the material is added to the scene,
+	// they may only be set on the main thread.
+	void setConstants(const PerMaterialConstantBufferData& cb_data) { constants = cb_data; }
+	const PerMaterialConstantBufferData& getConstants() const { return constants; }
+	void uploadConstants(const PerMaterialConstantBufferData& cb_data); // Only if they differ from the last uploaded ones
 	void setTexture(ShaderStage stage, unsigned int slot, ITexture* tex, MaterialTexture::Purpose purpose = MaterialTexture::Purpose::COLOR);
-	void setKeyword(const std::string& keyword, bool enable);
-	void set(RenderPass render_pass);
+	void setKeyword(const char* keyword, bool enable);
+	bool hasKeyword(const char* keyword) const;
+	void set(RenderPass render_pass, ICommandBuffer& cmd, bool instanced = false);
+	ResId getShader(RenderPass render_pass) const { return shaders[(int)render_pass]; }
+	unsigned int getShaderVariant(RenderPass render_pass) const { return currentVariants[(int)render_pass]; }
+	uint32 getSortId() const { return sortId; } // Unique, in the order materials were created
+
+	// Instanced draws use the instanced variant of the shader, and read the constants of their materials from the frame's
+	// buffer of material constants. Materials with the same textures can be drawn by the same instanced draw.
+	bool supportsInstancing(RenderPass render_pass) const { return instancedVariants[(int)render_pass] != currentVariants[(int)render_pass]; }
+	bool hasSameTextures(const Material& other) const;
+	uint32 getInstanceIndex() const { return instanceIndex; } // In the buffer of material constants, NO_INSTANCE_INDEX if not in it
+	void setInstanceIndex(uint32 index) { instanceIndex = index; } // On the rendering thread, before the frame jobs
+	static constexpr uint32 NO_INSTANCE_INDEX = UINT32_MAX;
 
 	std::string name;
+	MaterialTexturePaths texturePaths; // Only set for materials loaded with AssetManager::loadTexturesToStandardMaterial
 
 private:
+	void updateVariants();
+
 	std::array<ResId, (int)RenderPass::_COUNT> shaders;
 	std::array<unsigned int, (int)RenderPass::_COUNT> currentVariants;
+	std::array<unsigned int, (int)RenderPass::_COUNT> instancedVariants;
 	std::array<std::vector<MaterialTexture>, (int)ShaderStage::GRAPHICS_STAGE_COUNT> textures;
 	std::vector<std::string> keywords;
 	std::unique_ptr<IBuffer> cb;
+	PerMaterialConstantBufferData constants;
+	PerMaterialConstantBufferData uploadedConstants;
+	uint32 sortId;
+	uint32 instanceIndex = NO_INSTANCE_INDEX;
 };
@@ -0,0 +1,713 @@
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include <random>
+#include <string>
+
+#include <Util/AutoImGui.h>
+
+#include "MeshRenderer.h"
+#include "VertexData.h"
+
+namespace mesh_codec
+{
+	static constexpr int VERTEX_CACHE_SIZE = 32;
+
+	static constexpr size_t NUM_VERTEX_LANES = 9; // Vertices are coded as 9 independent 32 bit streams
+	static constexpr size_t VERTEX_BLOCK_SIZE = 8192; // Delta coding restarts at each block
+	static_assert(sizeof(StandardVertexData) == NUM_VERTEX_LANES * sizeof(uint32), "Vertex codec expects tightly packed 32 bit attributes");
+
+	static constexpr uint32 FIFO_SIZE = 16;
+	static constexpr uint32 NO_EDGE_CODE = 0xF0;
+	static constexpr uint8 VERTEX_CODE_NEXT = 0;
+	static constexpr uint8 VERTEX_CODE_FIFO_FIRST = 1;
+	static constexpr uint8 VERTEX_CODE_FIFO_LAST = 13;
+	static constexpr uint8 VERTEX_CODE_EXPLICIT = 14;
+
+	// Forsyth: Linear-Speed Vertex Cache Optimisation
+	static float get_vertex_score(int cache_position, uint32 remaining_triangles)
+	{
+		if (remaining_triangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cache_position >= 0)
+		{
+			if (cache_position < 3)
+				score = 0.75f; // Vertices of the last triangle are penalized, so strips don't just go on
+			else
+				score = powf(1.0f - (cache_position - 3) * (1.0f / (VERTEX_CACHE_SIZE - 3)), 1.5f);
+		}
+		score += 2.0f * powf((float)remaining_triangles, -0.5f); // Boost vertices with few remaining triangles
+		return score;
+	}
+
+	static void optimize_vertex_cache(uint32* indices, size_t num_indices, uint32 num_vertices)
+	{
+		const size_t numTriangles = num_indices / 3;
+		if (numTriangles < 2)
+			return;
+
+		std::vector<uint32> remainingTriangles(num_vertices, 0);
+		for (size_t i = 0; i < num_indices; i++)
+			remainingTriangles[indices[i]]++;
+
+		std::vector<uint32> adjacencyOffsets(num_vertices + 1, 0);
+		for (uint32 v = 0; v < num_vertices; v++)
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remainingTriangles[v];
+		std::vector<uint32> adjacency(num_indices);
+		{
+			std::vector<uint32> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < num_indices; i++)
+				adjacency[cursor[indices[i]]++] = (uint32)(i / 3);
+		}
+
+		std::vector<int> cachePositions(num_vertices, -1);
+		std::vector<float> vertexScores(num_vertices);
+		for (uint32 v = 0; v < num_vertices; v++)
+			vertexScores[v] = get_vertex_score(-1, remainingTriangles[v]);
+
+		std::vector<float> triangleScores(numTriangles);
+		std::vector<bool> emitted(numTriangles, false);
+		int bestTriangle = 0;
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			triangleScores[t] = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+			if (triangleScores[t] > triangleScores[bestTriangle])
+				bestTriangle = (int)t;
+		}
+
+		std::vector<uint32> output;
+		output.reserve(num_indices);
+		uint32 cache[VERTEX_CACHE_SIZE + 3];
+		uint32 newCache[VERTEX_CACHE_SIZE + 3];
+		int cacheSize = 0;
+		size_t nextScanTriangle = 0;
+
+		while (bestTriangle >= 0)
+		{
+			const uint32* tri = &indices[bestTriangle * 3];
+			output.insert(output.end(), tri, tri + 3);
+			emitted[bestTriangle] = true;
+
+			// Remove emitted triangle from adjacency of its vertices
+			for (int k = 0; k < 3; k++)
+			{
+				uint32 v = tri[k];
+				uint32* begin = &adjacency[adjacencyOffsets[v]];
+				uint32* end = begin + remainingTriangles[v];
+				uint32* it = std::find(begin, end, (uint32)bestTriangle);
+				std::swap(*it, *(end - 1));
+				remainingTriangles[v]--;
+			}
+
+			// Emitted vertices go to the front of the cache
+			int newCacheSize = 0;
+			for (int k = 0; k < 3; k++)
+				newCache[newCacheSize++] = tri[k];
+			for (int i = 0; i < cacheSize; i++)
+			{
+				uint32 v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					newCache[newCacheSize++] = v;
+			}
+
+			for (int i = 0; i < newCacheSize; i++)
+			{
+				uint32 v = newCache[i];
+				cachePositions[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+				vertexScores[v] = get_vertex_score(cachePositions[v], remainingTriangles[v]);
+			}
+
+			// Best next triangle is likely one which uses vertices from the cache
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (int i = 0; i < newCacheSize; i++)
+			{
+				uint32 v = newCache[i];
+				for (uint32 a = 0; a < remainingTriangles[v]; a++)
+				{
+					uint32 t = adjacency[adjacencyOffsets[v] + a];
+					float score = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+					triangleScores[t] = score;
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = (int)t;
+					}
+				}
+			}
+
+			cacheSize = std::min(newCacheSize, VERTEX_CACHE_SIZE);
+			std::copy(newCache, newCache + cacheSize, cache);
+
+			if (bestTriangle < 0)
+			{
+				while (nextScanTriangle < numTriangles && emitted[nextScanTriangle])
+					nextScanTriangle++;
+				if (nextScanTriangle < numTriangles)
+					bestTriangle = (int)nextScanTriangle;
+			}
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	void optimize_mesh(MeshData& mesh_data)
+	{
+		std::vector<SubmeshData> submeshes = mesh_data.submeshes;
+		if (submeshes.empty())
+		{
+			SubmeshData whole = {};
+			whole.numIndices = (uint32)mesh_data.indexData.size();
+			submeshes.push_back(whole);
+		}
+
+		for (const SubmeshData& submesh : submeshes)
+		{
+			uint32* indices = mesh_data.indexData.data() + submesh.startIndex;
+			const size_t numIndices = submesh.numIndices - submesh.numIndices % 3;
+			if (numIndices == 0)
+				continue;
+			uint32 numVertices = *std::max_element(indices, indices + numIndices) + 1;
+			optimize_vertex_cache(indices, numIndices, numVertices);
+		}
+
+		// Reorder vertices in order of first use, unreferenced vertices are dropped
+		constexpr uint32 UNUSED = 0xFFFFFFFFu;
+		std::vector<uint32> remap(mesh_data.vertexData.size(), UNUSED);
+		std::vector<StandardVertexData> vertices;
+		vertices.reserve(mesh_data.vertexData.size());
+		for (const SubmeshData& submesh : submeshes)
+		{
+			for (uint32 i = submesh.startIndex; i < submesh.startIndex + submesh.numIndices; i++)
+			{
+				uint32& index = mesh_data.indexData[i];
+				uint32 absoluteIndex = index + submesh.startVertex;
+				if (remap[absoluteIndex] == UNUSED)
+				{
+					remap[absoluteIndex] = (uint32)vertices.size();
+					vertices.push_back(mesh_data.vertexData[absoluteIndex]);
+				}
+				index = remap[absoluteIndex];
+			}
+		}
+		mesh_data.vertexData.swap(vertices);
+
+		for (SubmeshData& submesh : mesh_data.submeshes)
+			submesh.startVertex = 0;
+	}
+
+	static inline uint32 zigzag(uint32 v)
+	{
+		return (v << 1) ^ (uint32)((int32)v >> 31);
+	}
+
+	static inline uint32 unzigzag(uint32 v)
+	{
+		return (v >> 1) ^ (0u - (v & 1));
+	}
+
+	void encode_vertices(const StandardVertexData* vertices, size_t num_vertices, std::vector<uint8>& out)
+	{
+		const uint32* src = (const uint32*)vertices;
+		const size_t outStart = out.size();
+		out.resize(outStart + num_vertices * sizeof(StandardVertexData));
+		uint8* dst = out.data() + outStart;
+
+		for (size_t blockStart = 0; blockStart < num_vertices; blockStart += VERTEX_BLOCK_SIZE)
+		{
+			const size_t n = std::min(VERTEX_BLOCK_SIZE, num_vertices - blockStart);
+			for (size_t lane = 0; lane < NUM_VERTEX_LANES; lane++)
+			{
+				uint8* planes = dst + lane * 4 * n;
+				uint32 prev = 0;
+				for (size_t i = 0; i < n; i++)
+				{
+					uint32 v = src[(blockStart + i) * NUM_VERTEX_LANES + lane];
+					uint32 zz = zigzag(v - prev);
+					prev = v;
+					planes[0 * n + i] = (uint8)(zz >> 0);
+					planes[1 * n + i] = (uint8)(zz >> 8);
+					planes[2 * n + i] = (uint8)(zz >> 16);
+					planes[3 * n + i] = (uint8)(zz >> 24);
+				}
+			}
+			dst += n * sizeof(StandardVertexData);
+		}
+	}
+
+	static inline __m128i unzigzag_prefix_sum(__m128i x, __m128i& carry)
+	{
+		const __m128i one = _mm_set1_epi32(1);
+		x = _mm_xor_si128(_mm_srli_epi32(x, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(x, one)));
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi32(x, carry);
+		carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+		return x;
+	}
+
+	bool decode_vertices(const uint8* data, size_t size, StandardVertexData* vertices, size_t num_vertices)
+	{
+		if (size != num_vertices * sizeof(StandardVertexData))
+			return false;
+
+		uint32* dst = (uint32*)vertices;
+		alignas(16) uint32 lanes[NUM_VERTEX_LANES][16];
+
+		for (size_t blockStart = 0; blockStart < num_vertices; blockStart += VERTEX_BLOCK_SIZE)
+		{
+			const size_t n = std::min(VERTEX_BLOCK_SIZE, num_vertices - blockStart);
+			__m128i carry[NUM_VERTEX_LANES];
+			for (size_t lane = 0; lane < NUM_VERTEX_LANES; lane++)
+				carry[lane] = _mm_setzero_si128();
+
+			// 16 vertices at a time, byte planes are interleaved back to 32 bit deltas, then prefix summed
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				for (size_t lane = 0; lane < NUM_VERTEX_LANES; lane++)
+				{
+					const uint8* planes = data + lane * 4 * n + i;
+					__m128i p0 = _mm_loadu_si128((const __m128i*)(planes + 0 * n));
+					__m128i p1 = _mm_loadu_si128((const __m128i*)(planes + 1 * n));
+					__m128i p2 = _mm_loadu_si128((const __m128i*)(planes + 2 * n));
+					__m128i p3 = _mm_loadu_si128((const __m128i*)(planes + 3 * n));
+					__m128i lo01 = _mm_unpacklo_epi8(p0, p1);
+					__m128i hi01 = _mm_unpackhi_epi8(p0, p1);
+					__m128i lo23 = _mm_unpacklo_epi8(p2, p3);
+					__m128i hi23 = _mm_unpackhi_epi8(p2, p3);
+					__m128i* out = (__m128i*)lanes[lane];
+					_mm_store_si128(out + 0, unzigzag_prefix_sum(_mm_unpacklo_epi16(lo01, lo23), carry[lane]));
+					_mm_store_si128(out + 1, unzigzag_prefix_sum(_mm_unpackhi_epi16(lo01, lo23), carry[lane]));
+					_mm_store_si128(out + 2, unzigzag_prefix_sum(_mm_unpacklo_epi16(hi01, hi23), carry[lane]));
+					_mm_store_si128(out + 3, unzigzag_prefix_sum(_mm_unpackhi_epi16(hi01, hi23), carry[lane]));
+				}
+				uint32* out = dst + (blockStart + i) * NUM_VERTEX_LANES;
+				for (size_t v = 0; v < 16; v++)
+					for (size_t lane = 0; lane < NUM_VERTEX_LANES; lane++)
+						*out++ = lanes[lane][v];
+			}
+
+			// Remainder
+			for (size_t lane = 0; lane < NUM_VERTEX_LANES; lane++)
+			{
+				const uint8* planes = data + lane * 4 * n;
+				uint32 prev = (uint32)_mm_cvtsi128_si32(carry[lane]);
+				for (size_t r = i; r < n; r++)
+				{
+					uint32 zz = planes[0 * n + r] | (planes[1 * n + r] << 8) | (planes[2 * n + r] << 16) | ((uint32)planes[3 * n + r] << 24);
+					prev += unzigzag(zz);
+					dst[(blockStart + r) * NUM_VERTEX_LANES + lane] = prev;
+				}
+			}
+
+			data += n * sizeof(StandardVertexData);
+		}
+
+		return true;
+	}
+
+	struct TriangleCodecState
+	{
+		uint32 edgeFifo[FIFO_SIZE][2];
+		uint32 edgeOffset = 0;
+		uint32 vertexFifo[FIFO_SIZE];
+		uint32 vertexOffset = 0;
+		uint32 next = 0; // Next vertex not seen yet, if vertices are in order of first use
+
+		TriangleCodecState()
+		{
+			memset(edgeFifo, 0xFF, sizeof(edgeFifo));
+			memset(vertexFifo, 0xFF, sizeof(vertexFifo));
+		}
+
+		const uint32* edge(uint32 i) const { return edgeFifo[(edgeOffset - 1 - i) & (FIFO_SIZE - 1)]; }
+		uint32 vertex(uint32 i) const { return vertexFifo[(vertexOffset - 1 - i) & (FIFO_SIZE - 1)]; }
+
+		void pushEdge(uint32 a, uint32 b)
+		{
+			edgeFifo[edgeOffset][0] = a;
+			edgeFifo[edgeOffset][1] = b;
+			edgeOffset = (edgeOffset + 1) & (FIFO_SIZE - 1);
+		}
+
+		void pushVertex(uint32 v)
+		{
+			vertexFifo[vertexOffset] = v;
+			vertexOffset = (vertexOffset + 1) & (FIFO_SIZE - 1);
+		}
+
+		// Neighbouring triangles with the same winding use shared edges in reverse order
+		void pushTriangle(uint32 a, uint32 b, uint32 c)
+		{
+			pushEdge(b, a);
+			pushEdge(c, b);
+			pushEdge(a, c);
+		}
+	};
+
+	static void write_varint(std::vector<uint8>& out, uint64 v)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back((uint8)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((uint8)v);
+	}
+
+	static bool read_varint(const uint8*& p, const uint8* end, uint64& v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (p >= end)
+				return false;
+			uint8 b = *p++;
+			v |= (uint64)(b & 0x7F) << shift;
+			if ((b & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	static uint8 encode_vertex(TriangleCodecState& state, uint32 v, std::vector<uint8>& explicit_vertices)
+	{
+		if (v == state.next)
+		{
+			state.next++;
+			state.pushVertex(v);
+			return VERTEX_CODE_NEXT;
+		}
+		for (uint32 i = 0; i <= VERTEX_CODE_FIFO_LAST - VERTEX_CODE_FIFO_FIRST; i++)
+			if (state.vertex(i) == v)
+				return (uint8)(VERTEX_CODE_FIFO_FIRST + i);
+
+		int64 delta = (int64)v - (int64)state.next;
+		write_varint(explicit_vertices, (uint64)((delta << 1) ^ (delta >> 63)));
+		if (v > state.next)
+			state.next = v + 1;
+		state.pushVertex(v);
+		return VERTEX_CODE_EXPLICIT;
+	}
+
+	static bool decode_vertex(TriangleCodecState& state, uint8 code, const uint8*& explicit_vertices, const uint8* explicit_vertices_end, uint32& v)
+	{
+		if (code == VERTEX_CODE_NEXT)
+		{
+			v = state.next++;
+			state.pushVertex(v);
+			return true;
+		}
+		if (code >= VERTEX_CODE_FIFO_FIRST && code <= VERTEX_CODE_FIFO_LAST)
+		{
+			v = state.vertex(code - VERTEX_CODE_FIFO_FIRST);
+			return true;
+		}
+		if (code != VERTEX_CODE_EXPLICIT)
+			return false;
+
+		uint64 zz;
+		if (!read_varint(explicit_vertices, explicit_vertices_end, zz))
+			return false;
+		int64 delta = (int64)(zz >> 1) ^ -(int64)(zz & 1);
+		v = (uint32)((int64)state.next + delta);
+		if (v > state.next)
+			state.next = v + 1;
+		state.pushVertex(v);
+		return true;
+	}
+
+	// Stream layout: [codes size][rotations size][codes][rotations][explicit vertices]
+	// A code byte is either (edge FIFO index << 4 | third vertex code), or NO_EDGE_CODE followed by three vertex codes.
+	// Rotations (2 bits per edge coded triangle) make the round trip bit-exact.
+	void encode_indices(const uint32* indices, size_t num_indices, std::vector<uint8>& out)
+	{
+		TriangleCodecState state;
+		std::vector<uint8> codes, rotations, explicitVertices;
+		codes.reserve(num_indices / 3);
+		uint32 numRotations = 0;
+
+		for (size_t t = 0; t + 3 <= num_indices; t += 3)
+		{
+			const uint32 tri[3] = { indices[t + 0], indices[t + 1], indices[t + 2] };
+
+			int foundEdge = -1, rotation = 0;
+			for (int r = 0; r < 3 && foundEdge < 0; r++)
+			{
+				for (uint32 i = 0; i < FIFO_SIZE - 1; i++)
+				{
+					const uint32* e = state.edge(i);
+					if (e[0] == tri[r] && e[1] == tri[(r + 1) % 3])
+					{
+						foundEdge = (int)i;
+						rotation = r;
+						break;
+					}
+				}
+			}
+
+			if (foundEdge >= 0)
+			{
+				const uint32 a = tri[rotation], b = tri[(rotation + 1) % 3], c = tri[(rotation + 2) % 3];
+				uint8 vertexCode = encode_vertex(state, c, explicitVertices);
+				codes.push_back((uint8)(foundEdge << 4) | vertexCode);
+				if (numRotations % 4 == 0)
+					rotations.push_back(0);
+				rotations.back() |= (uint8)(rotation << ((numRotations % 4) * 2));
+				numRotations++;
+				state.pushTriangle(a, b, c);
+			}
+			else
+			{
+				codes.push_back(NO_EDGE_CODE);
+				for (int k = 0; k < 3; k++)
+					codes.push_back(encode_vertex(state, tri[k], explicitVertices));
+				state.pushTriangle(tri[0], tri[1], tri[2]);
+			}
+		}
+
+		const uint32 codesSize = (uint32)codes.size();
+		const uint32 rotationsSize = (uint32)rotations.size();
+		const size_t outStart = out.size();
+		out.resize(outStart + 2 * sizeof(uint32));
+		memcpy(out.data() + outStart, &codesSize, sizeof(uint32));
+		memcpy(out.data() + outStart + sizeof(uint32), &rotationsSize, sizeof(uint32));
+		out.insert(out.end(), codes.begin(), codes.end());
+		out.insert(out.end(), rotations.begin(), rotations.end());
+		out.insert(out.end(), explicitVertices.begin(), explicitVertices.end());
+	}
+
+	bool decode_indices(const uint8* data, size_t size, uint32* indices, size_t num_indices, size_t num_vertices)
+	{
+		if (size < 2 * sizeof(uint32) || num_indices % 3 != 0)
+			return false;
+		uint32 codesSize, rotationsSize;
+		memcpy(&codesSize, data, sizeof(uint32));
+		memcpy(&rotationsSize, data + sizeof(uint32), sizeof(uint32));
+		if ((uint64)codesSize + rotationsSize > size - 2 * sizeof(uint32))
+			return false;
+
+		const uint8* codes = data + 2 * sizeof(uint32);
+		const uint8* codesEnd = codes + codesSize;
+		const uint8* rotations = codesEnd;
+		const uint8* explicitVertices = rotations + rotationsSize;
+		const uint8* explicitVerticesEnd = data + size;
+		uint32 numRotations = 0;
+
+		TriangleCodecState state;
+		for (size_t t = 0; t < num_indices; t += 3)
+		{
+			if (codes >= codesEnd)
+				return false;
+			uint8 code = *codes++;
+			if (code == NO_EDGE_CODE)
+			{
+				if (codesEnd - codes < 3)
+					return false;
+				for (int k = 0; k < 3; k++)
+					if (!decode_vertex(state, *codes++, explicitVertices, explicitVerticesEnd, indices[t + k]))
+						return false;
+				state.pushTriangle(indices[t + 0], indices[t + 1], indices[t + 2]);
+			}
+			else
+			{
+				const uint32* e = state.edge(code >> 4);
+				const uint32 a = e[0], b = e[1];
+				uint32 c;
+				if (!decode_vertex(state, code & 0xF, explicitVertices, explicitVerticesEnd, c))
+					return false;
+				if (numRotations / 4 >= rotationsSize)
+					return false;
+				const int rotation = (rotations[numRotations / 4] >> ((numRotations % 4) * 2)) & 3;
+				numRotations++;
+				if (rotation > 2)
+					return false;
+				const uint32 tri[3] = { a, b, c };
+				indices[t + rotation] = tri[0];
+				indices[t + (rotation + 1) % 3] = tri[1];
+				indices[t + (rotation + 2) % 3] = tri[2];
+				state.pushTriangle(a, b, c);
+			}
+			if (indices[t + 0] >= num_vertices || indices[t + 1] >= num_vertices || indices[t + 2] >= num_vertices)
+				return false;
+		}
+
+		return true;
+	}
+
+	size_t get_encoded_vertices_size(size_t num_vertices)
+	{
+		return num_vertices * sizeof(StandardVertexData);
+	}
+
+	size_t get_min_encoded_indices_size(size_t num_indices)
+	{
+		return 2 * sizeof(uint32) + num_indices / 3;
+	}
+
+	size_t get_max_encoded_indices_size(size_t num_indices)
+	{
+		// NO_EDGE_CODE and three vertex codes, then deltas of up to 33 bits zigzagged, 5 bytes as varints
+		constexpr size_t MAX_TRIANGLE_SIZE = 4 + 3 * 5;
+		return 2 * sizeof(uint32) + num_indices / 3 * MAX_TRIANGLE_SIZE;
+	}
+}
+
+// Round trips of generated streams must be bit-exact, and broken streams must be rejected without reading past them. Needs
+// no scene, the streams cover the cases the cooked meshes may not.
+static void test_mesh_codec()
+{
+	using namespace mesh_codec;
+	int numFailures = 0;
+	auto check = [&numFailures](bool passed, const std::string& what)
+	{
+		if (passed)
+			return;
+		PLOG_ERROR << "Mesh codec test: " << what;
+		numFailures++;
+	};
+	std::mt19937 rng(1);
+
+	// Random bits in every attribute, and smooth attributes like those of real meshes. Counts around the block size and
+	// the 16 vertices decoded at a time.
+	static const size_t VERTEX_COUNTS[] = { 0, 1, 2, 15, 16, 17, 33, VERTEX_BLOCK_SIZE - 1, VERTEX_BLOCK_SIZE, VERTEX_BLOCK_SIZE + 1, 2 * VERTEX_BLOCK_SIZE + 37 };
+	uint32 numVertexStreams = 0;
+	for (size_t numVertices : VERTEX_COUNTS)
+	{
+		for (int smooth = 0; smooth < 2; smooth++)
+		{
+			std::vector<StandardVertexData> vertices(numVertices);
+			for (size_t v = 0; v < numVertices; v++)
+			{
+				uint32* lanes = (uint32*)&vertices[v];
+				for (size_t lane = 0; lane < NUM_VERTEX_LANES; lane++)
+				{
+					const float value = (float)v * 0.01f + (float)lane;
+					if (smooth)
+						memcpy(&lanes[lane], &value, sizeof(value));
+					else
+						lanes[lane] = rng();
+				}
+			}
+			const std::string name = std::to_string(numVertices) + (smooth ? " smooth" : " random") + " vertices";
+
+			std::vector<uint8> encoded;
+			encode_vertices(vertices.data(), numVertices, encoded);
+			check(encoded.size() == get_encoded_vertices_size(numVertices), name + " encoded to another size");
+			std::vector<StandardVertexData> decoded(numVertices + 1);
+			memset(decoded.data(), 0xCD, decoded.size() * sizeof(StandardVertexData));
+			const bool decodedOk = decode_vertices(encoded.data(), encoded.size(), decoded.data(), numVertices);
+			check(decodedOk && (numVertices == 0 || memcmp(decoded.data(), vertices.data(), numVertices * sizeof(StandardVertexData)) == 0), name + " round trip");
+			const uint8* pastLast = (const uint8*)&decoded[numVertices];
+			check(std::all_of(pastLast, pastLast + sizeof(StandardVertexData), [](uint8 b) { return b == 0xCD; }), name + " decoded past the last vertex");
+			if (numVertices > 0)
+			{
+				check(!decode_vertices(encoded.data(), encoded.size() - 1, decoded.data(), numVertices), name + " truncated accepted");
+				check(!decode_vertices(encoded.data(), encoded.size(), decoded.data(), numVertices - 1), name + " as one vertex less accepted");
+			}
+			encoded.push_back(0);
+			check(!decode_vertices(encoded.data(), encoded.size(), decoded.data(), numVertices), name + " with a trailing byte accepted");
+			numVertexStreams++;
+		}
+	}
+
+	// Index streams and the number of vertices they use
+	struct IndexCase
+	{
+		std::string name;
+		std::vector<uint32> indices;
+		uint32 numVertices;
+	};
+	std::vector<IndexCase> indexCases;
+	indexCases.push_back({ "Empty index stream", {}, 0 });
+	{
+		// Grid of quads, most triangles share an edge with a recent one
+		IndexCase grid = { "Grid of shared edges", {}, 33 * 33 };
+		for (uint32 y = 0; y < 32; y++)
+		{
+			for (uint32 x = 0; x < 32; x++)
+			{
+				const uint32 v = y * 33 + x;
+				grid.indices.insert(grid.indices.end(), { v, v + 33, v + 1, v + 1, v + 33, v + 34 });
+			}
+		}
+		indexCases.push_back(std::move(grid));
+	}
+	{
+		// Separate triangles of shuffled vertices, nothing is shared and nothing is in order of first use
+		IndexCase separate = { "Triangles without shared edges", {}, 3000 };
+		for (uint32 i = 0; i < separate.numVertices; i++)
+			separate.indices.push_back(i);
+		std::shuffle(separate.indices.begin(), separate.indices.end(), rng);
+		indexCases.push_back(std::move(separate));
+	}
+	{
+		IndexCase degenerate = { "Degenerate triangles", { 0, 0, 0, 0, 0, 1, 1, 0, 0, 2, 1, 1, 2, 2, 2, 0, 1, 2, 2, 1, 0, 1, 2, 1 }, 3 };
+		indexCases.push_back(std::move(degenerate));
+	}
+	{
+		// Largest indices, far from the next vertex in order, and deltas both ways across the whole range
+		constexpr uint32 LAST = 0xFFFFFFFEu;
+		IndexCase high = { "Indices next to the vertex count", { LAST, LAST - 1, 0, 0, LAST - 1, LAST, LAST, 1, LAST - 2, 2, LAST, 3, LAST, LAST, LAST }, LAST + 1 };
+		indexCases.push_back(std::move(high));
+	}
+	{
+		IndexCase random = { "Random triangles", {}, 500 };
+		for (int i = 0; i < 3 * 2000; i++)
+			random.indices.push_back(rng() % random.numVertices);
+		indexCases.push_back(std::move(random));
+	}
+
+	uint32 numCorruptions = 0;
+	for (const IndexCase& indexCase : indexCases)
+	{
+		const size_t numIndices = indexCase.indices.size();
+		std::vector<uint8> encoded;
+		encode_indices(indexCase.indices.data(), numIndices, encoded);
+		check(encoded.size() >= get_min_encoded_indices_size(numIndices) && encoded.size() <= get_max_encoded_indices_size(numIndices),
+			indexCase.name + " encoded to a size out of the bounds");
+		std::vector<uint32> decoded(numIndices + 3, 0xCDCDCDCDu);
+		check(decode_indices(encoded.data(), encoded.size(), decoded.data(), numIndices, indexCase.numVertices)
+			&& std::equal(indexCase.indices.begin(), indexCase.indices.end(), decoded.begin()), indexCase.name + " round trip");
+		check(decoded[numIndices] == 0xCDCDCDCDu, indexCase.name + " decoded past the last index");
+		if (numIndices > 0)
+			check(!decode_indices(encoded.data(), encoded.size(), decoded.data(), numIndices, indexCase.numVertices - 1), indexCase.name + " with an index out of range accepted");
+		check(!decode_indices(encoded.data(), encoded.size(), decoded.data(), numIndices + 1, indexCase.numVertices), indexCase.name + " with a partial triangle accepted");
+
+		// Every truncation, from a copy of its own size so reading past it would be out of bounds for a checker. Trailing
+		// garbage is fine, the stream is followed by other data in a cooked mesh.
+		for (size_t size = 0; size < encoded.size(); size++)
+		{
+			std::vector<uint8> truncated(encoded.begin(), encoded.begin() + size);
+			check(!decode_indices(truncated.data(), size, decoded.data(), numIndices, indexCase.numVertices),
+				indexCase.name + " truncated to " + std::to_string(size) + " bytes accepted");
+		}
+
+		// Random bytes changed, a decode that succeeds still has to give indices in range
+		for (int i = 0; i < 200; i++)
+		{
+			std::vector<uint8> corrupt = encoded;
+			const int numChanges = 1 + (int)(rng() % 4);
+			for (int c = 0; c < numChanges; c++)
+				corrupt[rng() % corrupt.size()] = (uint8)rng();
+			if (decode_indices(corrupt.data(), corrupt.size(), decoded.data(), numIndices, indexCase.numVertices))
+				check(std::all_of(decoded.begin(), decoded.begin() + numIndices, [&](uint32 index) { return index < indexCase.numVertices; }),
+					indexCase.name + " corrupted gave indices out of range");
+			numCorruptions++;
+		}
+	}
+
+	if (numFailures == 0)
+		PLOG_INFO << "Mesh codec test passed. " << numVertexStreams << " vertex streams and " << indexCases.size() << " index streams round tripped bit-exact, "
+			<< numCorruptions << " corrupted index streams decoded safely.";
+	else
+		PLOG_ERROR << "Mesh codec test failed with " << numFailures << " failures.";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Mesh codec test", test_mesh_codec);
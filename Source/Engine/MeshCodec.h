@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include <Common.h>
+
+struct MeshData;
+struct StandardVertexData;
+
+// Dedicated encoding of vertex and index streams for cooked mesh storage. Encoded streams are meant to be
+// compressed further with general purpose compression, the codecs only make them compress well.
+namespace mesh_codec
+{
+	// Reorders triangles of each submesh for post-transform vertex cache efficiency, then reorders vertices in order
+	// of first use, which makes neighbouring vertices similar. Submeshes reference the whole vertex array afterwards.
+	void optimize_mesh(MeshData& mesh_data);
+
+	// Vertices are delta coded per attribute against the previous vertex, and split to byte planes. Output is the same size as input.
+	void encode_vertices(const StandardVertexData* vertices, size_t num_vertices, std::vector<uint8>& out);
+	bool decode_vertices(const uint8* data, size_t size, StandardVertexData* vertices, size_t num_vertices);
+
+	// Triangles are coded relative to a FIFO of recently seen edges and vertices, so triangles sharing an edge with
+	// a recent one usually take a single byte. Decoding fails on indices not below num_vertices.
+	void encode_indices(const uint32* indices, size_t num_indices, std::vector<uint8>& out);
+	bool decode_indices(const uint8* data, size_t size, uint32* indices, size_t num_indices, size_t num_vertices);
+
+	// Sizes encoded streams can have, so sizes read from a file can be checked against the counts before allocating
+	size_t get_encoded_vertices_size(size_t num_vertices);
+	size_t get_min_encoded_indices_size(size_t num_indices); // A code per triangle
+	size_t get_max_encoded_indices_size(size_t num_indices); // Three explicit vertices per triangle
+}
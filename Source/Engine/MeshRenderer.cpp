@@ -1,16 +1,66 @@
 #include "MeshRenderer.h"
 
 #include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
 #include <3rdParty/imgui/imgui.h>
 #include <Util/ImGuiExtensions.h>
 #include <Driver/IBuffer.h>
 #include <Renderer/ConstantBuffers.h>
-#include <Renderer/WorldRenderer.h>
+#include <Renderer/OcclusionBuffer.h>
+#include <Renderer/RenderSnapshot.h>
 
 #include "AssetManager.h"
 #include "VertexData.h"
 #include "Material.h"
 
+// Submeshes with more triangles are detail, not walls
+static constexpr uint32 MAX_OCCLUDER_TRIANGLES = 4096;
+// Of the largest face of the mesh bounds, the largest face of the submesh bounds has to be at least this big
+static constexpr float MIN_OCCLUDER_AREA_FRACTION = 0.01f;
+// Submeshes of meshes with fewer are tested one by one
+static constexpr uint32 MIN_SUBMESHES_FOR_BVH = 16;
+
+static float get_largest_face_area(const BoundingBox& box)
+{
+	const XMFLOAT3& e = box.Extents;
+	return std::max({ e.x * e.y, e.y * e.z, e.z * e.x });
+}
+
+void MeshData::computeBounds()
+{
+	const StandardVertexData* vertices = getVertices();
+	const unsigned int* indices = getIndices();
+	for (SubmeshData& submesh : submeshes)
+	{
+		XMVECTOR minPos = XMVectorReplicate(FLT_MAX);
+		XMVECTOR maxPos = XMVectorReplicate(-FLT_MAX);
+		for (unsigned int i = submesh.startIndex; i < submesh.startIndex + submesh.numIndices; i++)
+		{
+			const XMVECTOR pos = XMLoadFloat3(&vertices[submesh.startVertex + indices[i]].position);
+			minPos = XMVectorMin(minPos, pos);
+			maxPos = XMVectorMax(maxPos, pos);
+		}
+		if (submesh.numIndices == 0)
+			minPos = maxPos = XMVectorZero();
+		BoundingBox::CreateFromPoints(submesh.bounds, minPos, maxPos);
+	}
+	mergeSubmeshBounds();
+}
+
+void MeshData::mergeSubmeshBounds()
+{
+	bounds = BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0));
+	for (size_t i = 0; i < submeshes.size(); i++)
+	{
+		if (i == 0)
+			bounds = submeshes[i].bounds;
+		else
+			BoundingBox::CreateMerged(bounds, bounds, submeshes[i].bounds);
+	}
+}
+
 MeshRenderer::MeshRenderer(const std::string& name_, Material* material_, ResId input_layout_id)
 	: name(name_), material(material_), inputLayoutId(input_layout_id)
 {
@@ -22,108 +72,438 @@ MeshRenderer::MeshRenderer(const std::string& name_, Material* material_, ResId
 	cb.reset(drv->createBuffer(cbDesc));
 }
 
+MeshRenderer::~MeshRenderer()
+{
+	if (sceneBvh != nullptr && bvhProxy != DynamicBvh::NULL_PROXY)
+		sceneBvh->destroyProxy(bvhProxy);
+	if (transformSystem != nullptr)
+		transformSystem->destroy(transformId);
+}
+
 void MeshRenderer::setInputLayout(ResId res_id)
 {
 	inputLayoutId = res_id;
 }
 
-void MeshRenderer::load(const MeshData& mesh_data)
+void MeshRenderer::load(MeshData& mesh_data)
 {
-	assert(mesh_data.vertexData.size() > 0);
-	assert(mesh_data.indexData.size() > 0);
+	assert(mesh_data.getNumVertices() > 0);
+	assert(mesh_data.getNumIndices() > 0);
 
-	BufferDesc vbDesc(name, sizeof(mesh_data.vertexData[0]), (unsigned int)mesh_data.vertexData.size(), ResourceUsage::DEFAULT, BIND_VERTEX_BUFFER);
-	vbDesc.initialData = (void*)mesh_data.vertexData.data();
-	vb.reset(drv->createBuffer(vbDesc));
+	if (mesh_data.vb == nullptr)
+	{
+		BufferDesc vbDesc(name, sizeof(StandardVertexData), (unsigned int)mesh_data.getNumVertices(), ResourceUsage::DEFAULT, BIND_VERTEX_BUFFER);
+		vbDesc.initialData = (void*)mesh_data.getVertices();
+		mesh_data.vb.reset(drv->createBuffer(vbDesc));
 
-	unsigned int indexByteSize = ::get_byte_size_for_texfmt(drv->getIndexFormat());
-	assert(sizeof(mesh_data.indexData[0]) == indexByteSize);
-	BufferDesc ibDesc(name, indexByteSize, (unsigned int)mesh_data.indexData.size(), ResourceUsage::DEFAULT, BIND_INDEX_BUFFER);
-	ibDesc.initialData = (void*)mesh_data.indexData.data();
-	ib.reset(drv->createBuffer(ibDesc));
+		unsigned int indexByteSize = ::get_byte_size_for_texfmt(drv->getIndexFormat());
+		assert(sizeof(unsigned int) == indexByteSize);
+		BufferDesc ibDesc(name, indexByteSize, (unsigned int)mesh_data.getNumIndices(), ResourceUsage::DEFAULT, BIND_INDEX_BUFFER);
+		ibDesc.initialData = (void*)mesh_data.getIndices();
+		mesh_data.ib.reset(drv->createBuffer(ibDesc));
+	}
+	vb = mesh_data.vb;
+	ib = mesh_data.ib;
 
 	submeshes.assign(mesh_data.submeshes.begin(), mesh_data.submeshes.end());
+	localBounds = mesh_data.bounds;
+	buildOccluders(mesh_data);
+
+	submeshBvh.clear();
+	if (submeshes.size() >= MIN_SUBMESHES_FOR_BVH)
+	{
+		for (size_t i = 0; i < submeshes.size(); i++)
+			submeshBvh.createProxy(submeshes[i].bounds, (void*)(uintptr_t)i);
+		submeshBvh.rebuild();
+	}
+	streamedSource = nullptr;
+	bvhLocalBounds = mesh_data.bounds;
+	bvhLocalBoundsFinal = true;
+	bvhProxyBounded = false;
+	updateBvhProxy();
 
 	firstSubmeshToRender = 0;
 	lastSubmeshToRender = (int)submeshes.size() - 1;
 }
 
-void MeshRenderer::render(RenderPass render_pass)
+void MeshRenderer::loadStreamed(const std::shared_ptr<StreamedMeshData>& streamed_mesh_data)
+{
+	vb.reset();
+	ib.reset();
+	submeshes.clear();
+	streamedSubmeshes.clear();
+	occluderParts.clear();
+	occluderVertices.clear();
+	occluderIndices.clear();
+	submeshBvh.clear();
+	streamedMeshData = streamed_mesh_data;
+	streamedSource = streamed_mesh_data.get();
+	bvhLocalBoundsFinal = false;
+	bvhProxyBounded = false;
+
+	firstSubmeshToRender = 0;
+	lastSubmeshToRender = -1;
+
+	// Shared with another renderer that finished streaming it already
+	if (streamed_mesh_data->finished)
+		onStreamingFinished(*streamed_mesh_data);
+}
+
+void MeshRenderer::onStreamingFinished(StreamedMeshData& streamed_mesh_data)
 {
-	if (!enabled)
+	if (&streamed_mesh_data != streamedSource)
 		return;
+	streamedSource = nullptr;
 
-	IBuffer* ibToUse;
-	IBuffer* vbToUse;
-	ResId ilToUse;
-	XMMATRIX tmToUse;
-	bool useDefaultMesh = vb == nullptr || ib == nullptr;
-	if (useDefaultMesh)
+	// The submeshes of the renderer are synced by the frame jobs, so the bounds are merged from the streamed ones
+	std::lock_guard<std::mutex> lock(streamed_mesh_data.mutex);
+	const std::vector<StreamedSubmeshData>& readySubmeshes = streamed_mesh_data.readySubmeshes;
+	for (size_t i = 0; i < readySubmeshes.size(); i++)
 	{
-		ibToUse = am->getDefaultMeshIb();
-		vbToUse = am->getDefaultMeshVb();
-		ilToUse = am->getDefaultInputLayout();
-		tmToUse = XMMatrixScaling(.1f, .1f, .1f) * XMMatrixRotationY(wr->getTime() * 10.f) * XMMatrixTranslationFromVector(transformMatrix.r[3]);
+		if (i == 0)
+			bvhLocalBounds = readySubmeshes[i].submesh.bounds;
+		else
+			BoundingBox::CreateMerged(bvhLocalBounds, bvhLocalBounds, readySubmeshes[i].submesh.bounds);
+	}
+	bvhLocalBoundsFinal = true;
+	updateBvhProxy();
+}
+
+void MeshRenderer::setSceneBvh(DynamicBvh* bvh)
+{
+	if (sceneBvh != nullptr && bvhProxy != DynamicBvh::NULL_PROXY)
+		sceneBvh->destroyProxy(bvhProxy);
+	bvhProxy = DynamicBvh::NULL_PROXY;
+	bvhProxyBounded = false;
+	sceneBvh = bvh;
+	updateBvhProxy();
+}
+
+void MeshRenderer::setTransformSystem(TransformSystem* transform_system)
+{
+	if (transform_system == transformSystem)
+		return;
+	// The transform moves with it
+	const Transform t = getTransform();
+	if (transformSystem != nullptr)
+		transformSystem->destroy(transformId);
+	transformId = TransformSystem::NULL_ID;
+	transformSystem = transform_system;
+	if (transformSystem != nullptr)
+	{
+		transformId = transformSystem->create(t, this);
 	}
 	else
 	{
-		ibToUse = ib.get();
-		vbToUse = vb.get();
-		ilToUse = inputLayoutId;
-		tmToUse = transformMatrix;
+		transform = t;
+		transformMatrix = t.getMatrix();
 	}
+	updateBvhProxy();
+}
 
-	PerObjectConstantBufferData perObjectCbData;
-	perObjectCbData.world = tmToUse;
-	perObjectCbData.objectParams0 = XMFLOAT4(uvScale, 0, 0, 0);
-	cb->updateData(&perObjectCbData);
+void MeshRenderer::setParent(const MeshRenderer* parent)
+{
+	assert(transformSystem != nullptr && (parent == nullptr || parent->transformSystem == transformSystem));
+	transformSystem->setParent(transformId, parent != nullptr ? parent->transformId : TransformSystem::NULL_ID);
+}
+
+void MeshRenderer::onTransformUpdated()
+{
+	moveBvhProxy(transformSystem->getWorldBounds(transformId));
+}
 
-	material->set(render_pass);
-	drv->setConstantBuffer(ShaderStage::VS, PER_OBJECT_CONSTANT_BUFFER_SLOT, cb->getId());
-	drv->setConstantBuffer(ShaderStage::PS, PER_OBJECT_CONSTANT_BUFFER_SLOT, cb->getId());
+Transform MeshRenderer::getTransform() const
+{
+	return transformSystem != nullptr ? transformSystem->getLocal(transformId) : transform;
+}
 
-	drv->setInputLayout(ilToUse);
-	drv->setIndexBuffer(ibToUse->getId());
-	drv->setVertexBuffer(vbToUse->getId());
+void MeshRenderer::setTransform(const Transform& t)
+{
+	if (transformSystem != nullptr)
+	{
+		transformSystem->setLocal(transformId, t);
+		return;
+	}
+	transform = t;
+	transformMatrix = t.getMatrix();
+	updateBvhProxy();
+}
 
-	if (useDefaultMesh)
-		drv->drawIndexed(ibToUse->getDesc().numElements, 0, 0);
+void MeshRenderer::setPosition(XMVECTOR position)
+{
+	if (transformSystem != nullptr)
+	{
+		transformSystem->setPosition(transformId, position);
+		return;
+	}
+	transform.position = position;
+	transformMatrix = transform.getMatrix();
+	updateBvhProxy();
+}
+
+void MeshRenderer::setRotation(XMVECTOR rotation)
+{
+	if (transformSystem != nullptr)
+	{
+		transformSystem->setRotation(transformId, rotation);
+		return;
+	}
+	transform.rotation = rotation;
+	transformMatrix = transform.getMatrix();
+	updateBvhProxy();
+}
+
+void MeshRenderer::setScale(float scale)
+{
+	if (transformSystem != nullptr)
+	{
+		transformSystem->setScale(transformId, scale);
+		return;
+	}
+	transform.scale = scale;
+	transformMatrix = transform.getMatrix();
+	updateBvhProxy();
+}
+
+void MeshRenderer::updateBvhProxy()
+{
+	// The system transforms the bounds in its update, which then moves the proxy
+	if (transformSystem != nullptr)
+		transformSystem->setLocalBounds(transformId, bvhLocalBounds);
 	else
+		moveBvhProxy(culling::transform_box(bvhLocalBounds, transformMatrix));
+}
+
+void MeshRenderer::moveBvhProxy(const BoundingBox& bounds)
+{
+	if (sceneBvh == nullptr)
+		return;
+	if (bvhProxy == DynamicBvh::NULL_PROXY)
+		bvhProxy = sceneBvh->createProxy(bounds, this);
+	else
+		sceneBvh->moveProxy(bvhProxy, bounds);
+	bvhProxyBounded = bvhLocalBoundsFinal;
+}
+
+void MeshRenderer::buildOccluders(const MeshData& mesh_data)
+{
+	occluderParts.clear();
+	occluderVertices.clear();
+	occluderIndices.clear();
+
+	// Vertices of a part are the ones its indices use, remapped to be contiguous
+	const StandardVertexData* vertices = mesh_data.getVertices();
+	const unsigned int* indices = mesh_data.getIndices();
+	std::vector<uint32> remap(mesh_data.getNumVertices(), UINT32_MAX);
+	const float minArea = get_largest_face_area(mesh_data.bounds) * MIN_OCCLUDER_AREA_FRACTION;
+	for (uint32 s = 0; s < (uint32)submeshes.size(); s++)
 	{
-		bool materialOverridden = false;
-		int i = std::max(0, firstSubmeshToRender);
-		int cnt = std::min(lastSubmeshToRender + 1, (int)submeshes.size());
-		for (; i < cnt; i++)
-		{
-			const SubmeshData& submesh = submeshes[i];
-			if (!submesh.enabled)
-				continue;
+		const SubmeshData& submesh = submeshes[s];
+		if (submesh.numIndices / 3 > MAX_OCCLUDER_TRIANGLES || get_largest_face_area(submesh.bounds) < minArea)
+			continue;
+		if (submesh.material != nullptr && submesh.material->hasKeyword("ALPHA_TEST_ON"))
+			continue;
 
-			if (submesh.material != nullptr)
-			{
-				submesh.material->set(render_pass);
-				materialOverridden = true;
-			}
-			else if (materialOverridden)
+		OccluderPart part = { s, (uint32)occluderVertices.size(), 0, (uint32)occluderIndices.size(), submesh.numIndices };
+		for (unsigned int i = submesh.startIndex; i < submesh.startIndex + submesh.numIndices; i++)
+		{
+			const uint32 vertex = submesh.startVertex + indices[i];
+			if (remap[vertex] == UINT32_MAX)
 			{
-				material->set(render_pass);
-				materialOverridden = false;
+				remap[vertex] = part.numVertices++;
+				occluderVertices.push_back(vertices[vertex].position);
 			}
-			drv->drawIndexed(submesh.numIndices, submesh.startIndex, submesh.startVertex);
+			occluderIndices.push_back(remap[vertex]);
+		}
+		for (unsigned int i = submesh.startIndex; i < submesh.startIndex + submesh.numIndices; i++)
+			remap[submesh.startVertex + indices[i]] = UINT32_MAX;
+		occluderParts.push_back(part);
+	}
+}
+
+void MeshRenderer::syncStreamedSubmeshes()
+{
+	std::lock_guard<std::mutex> lock(streamedMeshData->mutex);
+
+	// Submeshes are only pushed under the lock before finished is set, so nothing can be missed after seeing it
+	const bool finished = streamedMeshData->finished;
+	const bool renderingLastSubmesh = lastSubmeshToRender == (int)submeshes.size() - 1;
+	const std::vector<StreamedSubmeshData>& readySubmeshes = streamedMeshData->readySubmeshes;
+	for (size_t i = streamedSubmeshes.size(); i < readySubmeshes.size(); i++)
+	{
+		streamedSubmeshes.push_back(readySubmeshes[i]);
+		submeshes.push_back(readySubmeshes[i].submesh);
+		if (submeshes.size() == 1)
+			localBounds = submeshes[0].bounds;
+		else
+			BoundingBox::CreateMerged(localBounds, localBounds, submeshes.back().bounds);
+	}
+	if (renderingLastSubmesh)
+		lastSubmeshToRender = (int)submeshes.size() - 1;
+
+	if (finished)
+		streamedMeshData.reset();
+}
+
+bool MeshRenderer::prepareForFrame(const ObjectSnapshot& object, uint32 object_index, float time)
+{
+	staticCaster = false;
+	if (!object.enabled)
+		return false;
+
+	if (streamedMeshData != nullptr)
+		syncStreamedSubmeshes();
+
+	ObjectData data;
+	const bool useDefaultMesh = (vb == nullptr || ib == nullptr) && streamedSubmeshes.empty();
+	staticCaster = object.isStatic && !useDefaultMesh && streamedMeshData == nullptr;
+	if (useDefaultMesh)
+		data.world = XMMatrixScaling(.1f, .1f, .1f) * XMMatrixRotationY(time * 10.f) * XMMatrixTranslationFromVector(object.world.r[3]);
+	else
+		data.world = object.world;
+	worldBounds = culling::transform_box(useDefaultMesh ? am->getDefaultMeshBounds() : localBounds, data.world);
+	data.objectParams0 = XMFLOAT4(object.uvScale, 0, 0, 0);
+
+	if (memcmp(&data, &objectData, sizeof(data)) != 0 || object_index != objectIndex)
+	{
+		objectData = data;
+		objectIndex = object_index;
+		objectDataDirty = true;
+	}
+	return objectDataDirty;
+}
+
+void MeshRenderer::uploadConstants()
+{
+	if (objectIndex != uploadedObjectIndex)
+	{
+		const PerObjectConstantBufferData cbData = { XMUINT4(objectIndex, 0, 0, 0) };
+		cb->updateData(&cbData);
+		uploadedObjectIndex = objectIndex;
+	}
+	objectDataDirty = false;
+}
+
+uint32 MeshRenderer::cullSubmeshes(const culling::Frustum& frustum, uint32 view, const OcclusionBuffer* occlusion_buffer)
+{
+	assert(view < MAX_VIEWS);
+	std::vector<uint8>& visible = submeshVisible[view];
+	visible.resize(submeshes.size()); // Keeps its capacity
+
+	// The renderer passed already, a single submesh has the same bounds
+	if (submeshes.size() == 1)
+	{
+		visible[0] = true;
+		return 1;
+	}
+
+	uint32 numVisible = 0;
+	if (submeshBvh.getNumProxies() > 0)
+	{
+		// Many submeshes, e.g. of a whole level, are culled through the tree in mesh space
+		std::fill(visible.begin(), visible.end(), (uint8)false);
+		submeshBvh.queryFrustum(culling::transform_frustum(frustum, objectData.world), [&](void* user_data)
+		{
+			const uint32 i = (uint32)(uintptr_t)user_data;
+			visible[i] = occlusion_buffer == nullptr || occlusion_buffer->isVisible(culling::transform_box(submeshes[i].bounds, objectData.world));
+			numVisible += visible[i];
+		});
+		return numVisible;
+	}
+
+	for (size_t i = 0; i < submeshes.size(); i++)
+	{
+		const BoundingBox bounds = culling::transform_box(submeshes[i].bounds, objectData.world);
+		visible[i] = culling::is_visible(frustum, bounds) && (occlusion_buffer == nullptr || occlusion_buffer->isVisible(bounds));
+		numVisible += visible[i];
+	}
+	return numVisible;
+}
+
+void MeshRenderer::hideSubmeshes(uint32 view)
+{
+	assert(view < MAX_VIEWS);
+	submeshVisible[view].assign(submeshes.size(), false); // Keeps its capacity
+}
+
+uint32 MeshRenderer::addOccluders(OcclusionBuffer& buffer, uint32 chunk, const XMMATRIX& world, const culling::Frustum& frustum, uint32 view) const
+{
+	assert(view < MAX_VIEWS || view == NO_VIEW);
+	const std::vector<uint8>* lastVisible = view != NO_VIEW ? &submeshVisible[view] : nullptr;
+	uint32 numTriangles = 0;
+	for (const OccluderPart& part : occluderParts)
+	{
+		if (lastVisible != nullptr && part.submesh < lastVisible->size() && !(*lastVisible)[part.submesh])
+			continue;
+		const BoundingBox bounds = culling::transform_box(submeshes[part.submesh].bounds, world);
+		if (!culling::is_visible(frustum, bounds) || !buffer.isLargeOnScreen(bounds))
+			continue;
+		numTriangles += buffer.addOccluder(chunk, world, { occluderVertices.data() + part.firstVertex, part.numVertices },
+			{ occluderIndices.data() + part.firstIndex, part.numIndices });
+	}
+	return numTriangles;
+}
+
+void MeshRenderer::buildDrawItems(std::vector<DrawItem>& out_items, uint32 view, FXMVECTOR sort_direction) const
+{
+	DrawItem item;
+	item.material = material;
+	item.objectCb = cb->getId();
+	item.objectIndex = objectIndex;
+
+	const bool streamed = !streamedSubmeshes.empty();
+	if ((vb == nullptr || ib == nullptr) && !streamed)
+	{
+		item.inputLayout = am->getDefaultInputLayout();
+		item.vb = am->getDefaultMeshVb()->getId();
+		item.ib = am->getDefaultMeshIb()->getId();
+		item.numIndices = am->getDefaultMeshIb()->getDesc().numElements;
+		item.startIndex = 0;
+		item.baseVertex = 0;
+		item.depth = XMVectorGetX(XMVector3Dot(objectData.world.r[3], sort_direction));
+		out_items.push_back(item);
+		return;
+	}
+
+	item.inputLayout = inputLayoutId;
+	if (!streamed)
+	{
+		item.vb = vb->getId();
+		item.ib = ib->getId();
+	}
+
+	int i = std::max(0, firstSubmeshToRender);
+	int cnt = std::min(lastSubmeshToRender + 1, (int)submeshes.size());
+	for (; i < cnt; i++)
+	{
+		const SubmeshData& submesh = submeshes[i];
+		if (!submesh.enabled || !submeshVisible[view][i])
+			continue;
+
+		item.material = submesh.material != nullptr ? submesh.material : material;
+		if (streamed)
+		{
+			item.vb = streamedSubmeshes[i].vb->getId();
+			item.ib = streamedSubmeshes[i].ib->getId();
 		}
+		item.numIndices = submesh.numIndices;
+		item.startIndex = submesh.startIndex;
+		item.baseVertex = submesh.startVertex;
+		item.depth = XMVectorGetX(XMVector3Dot(XMVector3Transform(XMLoadFloat3(&submesh.bounds.Center), objectData.world), sort_direction));
+		out_items.push_back(item);
 	}
 }
 
 void MeshRenderer::gui()
 {
-	static std::string buf;
-	buf = "Enabled##" + name;
-	ImGui::Checkbox(buf.c_str(), &enabled);
+	// IDs are pushed instead of appended to the labels, so drawing it doesn't build strings every frame
+	ImGui::PushID(this);
+	ImGui::Checkbox("Enabled", &enabled);
+	ImGui::Checkbox("Static", &isStaticFlag);
 
 	if (submeshes.size() > 0)
 	{
-		buf = "Submesh range to render##" + name;
-		ImGui::DragIntRange2(buf.c_str(), &firstSubmeshToRender, &lastSubmeshToRender, 1.0f, 0, submeshes.size() - 1);
+		ImGui::DragIntRange2("Submesh range to render", &firstSubmeshToRender, &lastSubmeshToRender, 1.0f, 0, submeshes.size() - 1);
 		firstSubmeshToRender = std::clamp(firstSubmeshToRender, 0, (int)submeshes.size() - 1);
 		lastSubmeshToRender = std::clamp(lastSubmeshToRender, 0, (int)submeshes.size() - 1);
 		ImGui::Text("First submesh rendered: %s", submeshes[firstSubmeshToRender].name.c_str());
@@ -132,33 +512,30 @@ void MeshRenderer::gui()
 
 	Transform tr = getTransform();
 	bool changed = false;
-	buf = "Position##" + name;
-	changed |= ImGui::DragFloat3(buf.c_str(), tr.position.m128_f32, 0.1f);
-	buf = "Rotation##" + name;
-	changed |= ImGui::DragAngle3(buf.c_str(), tr.rotation.m128_f32);
-	buf = "Scale##" + name;
-	changed |= ImGui::DragFloat(buf.c_str(), &tr.scale, 0.1f);
+	changed |= ImGui::DragFloat3("Position", tr.position.m128_f32, 0.1f);
+	changed |= ImGui::DragAngle3("Rotation", tr.rotation.m128_f32);
+	changed |= ImGui::DragFloat("Scale", &tr.scale, 0.1f);
 	if (changed)
 		setTransform(tr);
 
-	buf = "Submeshes##" + name;
-	if (ImGui::CollapsingHeader(buf.c_str()))
+	if (ImGui::CollapsingHeader("Submeshes"))
 	{
 		ImGui::Indent();
 		for (int i = 0; i < submeshes.size(); i++)
 		{
 			SubmeshData& submesh = submeshes[i];
-			buf = submesh.name + "##" + std::to_string(i) + name;
-			if (ImGui::CollapsingHeader(buf.c_str()))
+			ImGui::PushID(i);
+			if (ImGui::CollapsingHeader(submesh.name.c_str()))
 			{
-				buf = "Enabled##" + std::to_string(i) + name + submesh.name;
-				ImGui::Checkbox(buf.c_str(), &submesh.enabled);
+				ImGui::Checkbox("Enabled", &submesh.enabled);
 				ImGui::Text("material:    %s", submesh.material != nullptr ? submesh.material->name.c_str() : "-");
 				ImGui::Text("startIndex:  %d", submesh.startIndex);
 				ImGui::Text("numIndices:  %d", submesh.numIndices);
 				ImGui::Text("startVertex: %d", submesh.startVertex);
 			}
+			ImGui::PopID();
 		}
 		ImGui::Unindent();
 	}
+	ImGui::PopID();
 }
@@ -1,16 +1,27 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <Common.h>
 #include <Driver/IDriver.h>
+#include <Renderer/ConstantBuffers.h>
+#include <Renderer/Culling.h>
+#include <Renderer/DrawList.h>
+#include <Renderer/DynamicBvh.h>
+#include <Util/Task.h>
 
 #include "Transform.h"
+#include "TransformSystem.h"
 
 struct StandardVertexData;
+struct ObjectSnapshot;
 class IBuffer;
 class Material;
+class OcclusionBuffer;
 
 struct SubmeshData
 {
@@ -20,6 +31,7 @@ struct SubmeshData
 	unsigned int numIndices;
 	unsigned int startVertex;
 	Material *material;
+	BoundingBox bounds; // Mesh space
 };
 
 struct MeshData
@@ -27,44 +39,171 @@ struct MeshData
 	std::vector<StandardVertexData> vertexData;
 	std::vector<unsigned int> indexData;
 	std::vector<SubmeshData> submeshes;
+	BoundingBox bounds; // Mesh space, of all submeshes
 	std::atomic_bool loaded = false;
+	AsyncEvent loadFinished; // Signaled when loading finished, even if it failed
+
+	// Vertices and indices can also live in external storage (e.g. a mapped file), instead of vertexData and indexData
+	std::shared_ptr<const void> externalStorage;
+	const StandardVertexData* externalVertices = nullptr;
+	size_t numExternalVertices = 0;
+	const unsigned int* externalIndices = nullptr;
+	size_t numExternalIndices = 0;
+
+	// Created by the first renderer the mesh is loaded to and shared by the others, so their draws can be instanced
+	std::shared_ptr<IBuffer> vb;
+	std::shared_ptr<IBuffer> ib;
+
+	const StandardVertexData* getVertices() const { return externalVertices != nullptr ? externalVertices : vertexData.data(); }
+	size_t getNumVertices() const { return externalVertices != nullptr ? numExternalVertices : vertexData.size(); }
+	const unsigned int* getIndices() const { return externalIndices != nullptr ? externalIndices : indexData.data(); }
+	size_t getNumIndices() const { return externalIndices != nullptr ? numExternalIndices : indexData.size(); }
+
+	void computeBounds(); // Of the submeshes from their vertices, then the whole mesh. Done at import.
+	void mergeSubmeshBounds(); // Only the bounds of the whole mesh
+};
+
+// Submesh with its own buffers, so it can be uploaded while the rest of the mesh is still being imported
+struct StreamedSubmeshData
+{
+	SubmeshData submesh;
+	std::shared_ptr<IBuffer> vb;
+	std::shared_ptr<IBuffer> ib;
+};
+
+struct StreamedMeshData
+{
+	std::mutex mutex;
+	std::vector<StreamedSubmeshData> readySubmeshes; // Guarded by mutex
+	std::atomic_bool finished = false;
+	std::atomic_bool cancelled = false;
 };
 
 class MeshRenderer
 {
 public:
 	MeshRenderer(const std::string& name_, Material* material_, ResId input_layout_id = BAD_RESID);
+	~MeshRenderer();
 	void setInputLayout(ResId res_id);
-	void load(const MeshData& mesh_data);
-	void render(RenderPass render_pass);
+	void load(MeshData& mesh_data);
+	void loadStreamed(const std::shared_ptr<StreamedMeshData>& streamed_mesh_data);
+	void onStreamingFinished(StreamedMeshData& streamed_mesh_data); // On the main thread, ignored if it's not the renderer's
 	void gui();
 
-	const Transform& getTransform() const { return transform; }
-	void setTransform(const Transform& t) { transform = t; transformMatrix = t.getMatrix(); }
-	void setPosition(XMVECTOR position) { transform.position = position; transformMatrix = transform.getMatrix(); }
+	static constexpr uint32 MAX_VIEWS = 5; // The main view and the shadow cascades
+	static constexpr uint32 NO_VIEW = MAX_VIEWS;
+
+	// Frame jobs of different renderers run in parallel, from the snapshot of the renderer. prepareForFrame returns true
+	// if the object data or its index in the objects buffer changed, those have to be uploaded on the rendering thread
+	// before drawing. Views are culled after it, each by its own jobs, and draw items of a view only include the
+	// submeshes visible in it.
+	bool prepareForFrame(const ObjectSnapshot& object, uint32 object_index, float time);
+	void uploadConstants(); // The object index, only if it changed, the object data is uploaded with the other objects
+	const ObjectData& getObjectData() const { return objectData; } // Of the frame
+	uint32 getObjectIndex() const { return objectIndex; }
+	const BoundingBox& getWorldBounds() const { return worldBounds; } // Of the frame
+	bool isStaticCaster() const { return staticCaster; } // Of the frame, static and fully loaded
+	uint32 cullSubmeshes(const culling::Frustum& frustum, uint32 view, const OcclusionBuffer* occlusion_buffer = nullptr); // Returns the number of visible submeshes
+	void hideSubmeshes(uint32 view); // E.g. when the whole renderer is occluded
+	uint32 getNumSubmeshes() const { return (uint32)submeshes.size(); }
+	const BoundingBox& getSubmeshBounds(uint32 submesh) const { return submeshes[submesh].bounds; } // Mesh space
+	void buildDrawItems(std::vector<DrawItem>& out_items, uint32 view, FXMVECTOR sort_direction) const; // Depth of the items is along the direction
+
+	// Occluders are the large opaque submeshes, picked when the mesh is loaded. Only the parts in the frustum and large
+	// on screen are added. Unless view is NO_VIEW, parts not visible in it when it was last culled are skipped too, those
+	// are unlikely to hide anything now. Returns the number of triangles binned.
+	uint32 addOccluders(OcclusionBuffer& buffer, uint32 chunk, const XMMATRIX& world, const culling::Frustum& frustum, uint32 view) const;
+
+	bool isEnabled() const { return enabled; }
+
+	// The scene tree has a proxy with the world bounds of the renderer, kept up to date by the transform setters. Main
+	// thread only, jobs of the frame use the snapshot.
+	void setSceneBvh(DynamicBvh* bvh);
+	// False until the proxy has the bounds of the loaded mesh, e.g. while streaming or until the transform system moved it
+	bool isBoundedBySceneBvh() const { return bvhProxyBounded; }
+	// Place in the renderers of the scene, the same as of its object in the snapshots
+	void setSceneIndex(uint32 index) { sceneIndex = index; }
+	uint32 getSceneIndex() const { return sceneIndex; }
+
+	// Renderers in a transform system only mark their transform dirty when it's set, the matrix and the proxy are updated
+	// with the others by the system's update. Others compute them right away. Set it before the scene tree.
+	void setTransformSystem(TransformSystem* transform_system);
+	void setParent(const MeshRenderer* parent); // Both in the same transform system, the transform is then relative to it
+	void onTransformUpdated(); // By the update of the transform system, on the main thread
+
+	// Static renderers are drawn into the cached shadow map, moving them redraws it
+	bool isStatic() const { return isStaticFlag; }
+	void setStatic(bool is_static) { isStaticFlag = is_static; }
+
+	Transform getTransform() const;
+	void setTransform(const Transform& t);
+	void setPosition(XMVECTOR position);
 	void setPosition(XMFLOAT3 position) { setPosition(XMLoadFloat3(&position)); }
 	void setPosition(float x, float y, float z) { setPosition(XMFLOAT3(x, y, z)); }
-	void setRotation(XMVECTOR rotation) { transform.rotation = rotation; transformMatrix = transform.getMatrix(); }
+	void setRotation(XMVECTOR rotation);
 	void setRotation(XMFLOAT3 rotation) { setRotation(XMLoadFloat3(&rotation)); }
 	void setRotation(float pitch, float yaw, float roll) { setRotation(XMFLOAT3(pitch, yaw, roll)); }
-	void setScale(float scale) { transform.scale = scale; transformMatrix = transform.getMatrix(); }
-	const XMMATRIX& getTransformMatrix() const { return transformMatrix; }
+	void setScale(float scale);
+	// World matrix, in a transform system of its last update
+	const XMMATRIX& getTransformMatrix() const { return transformSystem != nullptr ? transformSystem->getWorldMatrix(transformId) : transformMatrix; }
 	void setUvScale(float uv_scale) { uvScale = uv_scale; }
+	float getUvScale() const { return uvScale; }
 
 	std::string name;
 
 private:
+	void syncStreamedSubmeshes();
+	void buildOccluders(const MeshData& mesh_data);
+	void updateBvhProxy();
+	void moveBvhProxy(const BoundingBox& bounds);
+
+	// Positions of the triangles of an occluding submesh, indices are relative to its first vertex
+	struct OccluderPart
+	{
+		uint32 submesh;
+		uint32 firstVertex;
+		uint32 numVertices;
+		uint32 firstIndex;
+		uint32 numIndices;
+	};
+
 	bool enabled = true;
+	bool isStaticFlag = false;
+	bool staticCaster = false;
 	int firstSubmeshToRender = 0;
 	int lastSubmeshToRender = 0;
-	Transform transform;
+	Transform transform; // Unless in a transform system
 	XMMATRIX transformMatrix = XMMatrixIdentity();
 	float uvScale = 1;
+	ObjectData objectData = {};
+	bool objectDataDirty = true;
+	uint32 objectIndex = UINT32_MAX;
+	uint32 uploadedObjectIndex = UINT32_MAX; // In the constant buffer
+	BoundingBox localBounds = BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0));
+	BoundingBox worldBounds;
+	std::vector<uint8> submeshVisible[MAX_VIEWS]; // Parallel to submeshes
 
 	Material* material = nullptr;
 	ResId inputLayoutId = BAD_RESID;
 	std::unique_ptr<IBuffer> cb;
-	std::unique_ptr<IBuffer> vb;
-	std::unique_ptr<IBuffer> ib;
+	std::shared_ptr<IBuffer> vb;
+	std::shared_ptr<IBuffer> ib;
 	std::vector<SubmeshData> submeshes;
+	std::shared_ptr<StreamedMeshData> streamedMeshData; // Released once streaming is finished
+	std::vector<StreamedSubmeshData> streamedSubmeshes; // Parallel to submeshes when streamed
+	std::vector<OccluderPart> occluderParts; // Not of streamed meshes
+	std::vector<XMFLOAT3> occluderVertices;
+	std::vector<uint32> occluderIndices;
+	DynamicBvh submeshBvh{ 0.0f }; // Mesh space, built at load, not of streamed meshes
+
+	// Main thread
+	TransformSystem* transformSystem = nullptr;
+	TransformSystem::Id transformId = TransformSystem::NULL_ID;
+	DynamicBvh* sceneBvh = nullptr;
+	DynamicBvh::ProxyId bvhProxy = DynamicBvh::NULL_PROXY;
+	BoundingBox bvhLocalBounds = BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0));
+	bool bvhLocalBoundsFinal = false; // Of the loaded mesh, not of one being streamed
+	bool bvhProxyBounded = false;
+	uint32 sceneIndex = UINT32_MAX;
+	const StreamedMeshData* streamedSource = nullptr;
 };
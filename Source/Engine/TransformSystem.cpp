@@ -0,0 +1,360 @@
+#include "TransformSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <Renderer/Culling.h>
+#include <Util/AutoImGui.h>
+#include <Util/LinearArena.h>
+#include <Util/ThreadPool.h>
+
+TransformSystem::Id TransformSystem::create(const Transform& local, void* user_data, Id parent)
+{
+	assert(user_data != nullptr);
+	Id id;
+	if (!freeIds.empty())
+	{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else
+	{
+		id = (Id)parents.size();
+		if (id % BATCH_SIZE == 0)
+		{
+			locals.push_back({});
+			dirtyMasks.push_back(0);
+			changedMasks.push_back(0);
+		}
+		localMatrices.push_back(XMMatrixIdentity());
+		worldMatrices.push_back(XMMatrixIdentity());
+		localBounds.emplace_back();
+		worldBounds.emplace_back();
+		parents.push_back(NULL_ID);
+		userData.push_back(nullptr);
+	}
+	userData[id] = user_data;
+	localBounds[id] = worldBounds[id] = BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0));
+	setLocal(id, local);
+	setParent(id, parent);
+	return id;
+}
+
+void TransformSystem::destroy(Id id)
+{
+	assert(userData[id] != nullptr);
+	if (childrenChanged)
+	{
+		sortChildren();
+		childrenChanged = false;
+	}
+	for (Id child : children)
+	{
+		if (parents[child] == id)
+			setParent(child, NULL_ID);
+	}
+	setParent(id, NULL_ID);
+	const uint8 bit = (uint8)(1u << (id % BATCH_SIZE));
+	dirtyMasks[id / BATCH_SIZE] &= ~bit;
+	changedMasks[id / BATCH_SIZE] &= ~bit;
+	userData[id] = nullptr;
+	freeIds.push_back(id);
+}
+
+void TransformSystem::clear()
+{
+	locals.clear();
+	dirtyMasks.clear();
+	changedMasks.clear();
+	localMatrices.clear();
+	worldMatrices.clear();
+	localBounds.clear();
+	worldBounds.clear();
+	parents.clear();
+	userData.clear();
+	freeIds.clear();
+	children.clear();
+	childrenChanged = false;
+	numChanged = 0;
+}
+
+Transform TransformSystem::getLocal(Id id) const
+{
+	const LocalBatch& batch = locals[id / BATCH_SIZE];
+	const uint32 lane = id % BATCH_SIZE;
+	return Transform(
+		XMVectorSet(batch.positionX[lane], batch.positionY[lane], batch.positionZ[lane], 0),
+		XMVectorSet(batch.rotationX[lane], batch.rotationY[lane], batch.rotationZ[lane], 0),
+		batch.scale[lane]);
+}
+
+void TransformSystem::setLocal(Id id, const Transform& local)
+{
+	setPosition(id, local.position);
+	setRotation(id, local.rotation);
+	setScale(id, local.scale);
+}
+
+void TransformSystem::setPosition(Id id, FXMVECTOR position)
+{
+	LocalBatch& batch = locals[id / BATCH_SIZE];
+	const uint32 lane = id % BATCH_SIZE;
+	batch.positionX[lane] = XMVectorGetX(position);
+	batch.positionY[lane] = XMVectorGetY(position);
+	batch.positionZ[lane] = XMVectorGetZ(position);
+	markDirty(id);
+}
+
+void TransformSystem::setRotation(Id id, FXMVECTOR rotation)
+{
+	LocalBatch& batch = locals[id / BATCH_SIZE];
+	const uint32 lane = id % BATCH_SIZE;
+	batch.rotationX[lane] = XMVectorGetX(rotation);
+	batch.rotationY[lane] = XMVectorGetY(rotation);
+	batch.rotationZ[lane] = XMVectorGetZ(rotation);
+	markDirty(id);
+}
+
+void TransformSystem::setScale(Id id, float scale)
+{
+	locals[id / BATCH_SIZE].scale[id % BATCH_SIZE] = scale;
+	markDirty(id);
+}
+
+void TransformSystem::setParent(Id id, Id parent)
+{
+	if (parents[id] == parent)
+		return;
+#ifndef NDEBUG
+	for (Id ancestor = parent; ancestor != NULL_ID; ancestor = parents[ancestor])
+		assert(ancestor != id && "Transforms can't be their own ancestors");
+#endif
+	// Roots store their matrix where children have the local one, so it's recomputed
+	parents[id] = parent;
+	markDirty(id);
+	childrenChanged = true;
+}
+
+void TransformSystem::setLocalBounds(Id id, const BoundingBox& bounds)
+{
+	localBounds[id] = bounds;
+	markDirty(id);
+}
+
+void TransformSystem::sortChildren()
+{
+	LinearArena& scratch = get_thread_scratch_arena();
+	ArenaScope scope(scratch);
+	ScratchVector<uint32> depths(scratch);
+	depths.resize(parents.size());
+	children.clear();
+	for (Id id = 0; id < (Id)parents.size(); id++)
+	{
+		if (parents[id] == NULL_ID)
+			continue;
+		uint32 depth = 0;
+		for (Id ancestor = parents[id]; ancestor != NULL_ID; ancestor = parents[ancestor])
+			depth++;
+		depths[id] = depth;
+		children.push_back(id);
+	}
+	std::stable_sort(children.begin(), children.end(), [&depths](Id a, Id b) { return depths[a] < depths[b]; });
+}
+
+void TransformSystem::computeMatrices(uint32 batch)
+{
+	// Each vector has a component of the four transforms of the batch
+	const LocalBatch& local = locals[batch];
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+	XMVECTOR sp, cp, sy, cy, sr, cr;
+	XMVectorSinCos(&sp, &cp, XMVectorMultiply(XMLoadFloat4A((const XMFLOAT4A*)local.rotationX), half));
+	XMVectorSinCos(&sy, &cy, XMVectorMultiply(XMLoadFloat4A((const XMFLOAT4A*)local.rotationY), half));
+	XMVectorSinCos(&sr, &cr, XMVectorMultiply(XMLoadFloat4A((const XMFLOAT4A*)local.rotationZ), half));
+
+	// Quaternions, as XMQuaternionRotationRollPitchYawFromVector makes them
+	const XMVECTOR cpcy = XMVectorMultiply(cp, cy);
+	const XMVECTOR spsy = XMVectorMultiply(sp, sy);
+	const XMVECTOR spcy = XMVectorMultiply(sp, cy);
+	const XMVECTOR cpsy = XMVectorMultiply(cp, sy);
+	const XMVECTOR qx = XMVectorMultiplyAdd(cr, spcy, XMVectorMultiply(sr, cpsy));
+	const XMVECTOR qy = XMVectorNegativeMultiplySubtract(sr, spcy, XMVectorMultiply(cr, cpsy));
+	const XMVECTOR qz = XMVectorNegativeMultiplySubtract(cr, spsy, XMVectorMultiply(sr, cpcy));
+	const XMVECTOR qw = XMVectorMultiplyAdd(cr, cpcy, XMVectorMultiply(sr, spsy));
+
+	// Scaled rotation matrices, as XMMatrixAffineTransformation makes them without a rotation origin
+	const XMVECTOR s = XMLoadFloat4A((const XMFLOAT4A*)local.scale);
+	const XMVECTOR s2 = XMVectorAdd(s, s);
+	const XMVECTOR xx = XMVectorMultiply(qx, qx);
+	const XMVECTOR yy = XMVectorMultiply(qy, qy);
+	const XMVECTOR zz = XMVectorMultiply(qz, qz);
+	const XMVECTOR xy = XMVectorMultiply(qx, qy);
+	const XMVECTOR xz = XMVectorMultiply(qx, qz);
+	const XMVECTOR yz = XMVectorMultiply(qy, qz);
+	const XMVECTOR xw = XMVectorMultiply(qx, qw);
+	const XMVECTOR yw = XMVectorMultiply(qy, qw);
+	const XMVECTOR zw = XMVectorMultiply(qz, qw);
+	const XMVECTOR m00 = XMVectorNegativeMultiplySubtract(s2, XMVectorAdd(yy, zz), s);
+	const XMVECTOR m01 = XMVectorMultiply(s2, XMVectorAdd(xy, zw));
+	const XMVECTOR m02 = XMVectorMultiply(s2, XMVectorSubtract(xz, yw));
+	const XMVECTOR m10 = XMVectorMultiply(s2, XMVectorSubtract(xy, zw));
+	const XMVECTOR m11 = XMVectorNegativeMultiplySubtract(s2, XMVectorAdd(xx, zz), s);
+	const XMVECTOR m12 = XMVectorMultiply(s2, XMVectorAdd(yz, xw));
+	const XMVECTOR m20 = XMVectorMultiply(s2, XMVectorAdd(xz, yw));
+	const XMVECTOR m21 = XMVectorMultiply(s2, XMVectorSubtract(yz, xw));
+	const XMVECTOR m22 = XMVectorNegativeMultiplySubtract(s2, XMVectorAdd(xx, yy), s);
+
+	// Transposed to the rows of each transform
+	const XMVECTOR zero = XMVectorZero();
+	const XMMATRIX rows0 = XMMatrixTranspose(XMMATRIX(m00, m01, m02, zero));
+	const XMMATRIX rows1 = XMMatrixTranspose(XMMATRIX(m10, m11, m12, zero));
+	const XMMATRIX rows2 = XMMatrixTranspose(XMMATRIX(m20, m21, m22, zero));
+	const XMMATRIX rows3 = XMMatrixTranspose(XMMATRIX(
+		XMLoadFloat4A((const XMFLOAT4A*)local.positionX),
+		XMLoadFloat4A((const XMFLOAT4A*)local.positionY),
+		XMLoadFloat4A((const XMFLOAT4A*)local.positionZ),
+		XMVectorSplatOne()));
+	for (uint32 mask = dirtyMasks[batch]; mask != 0; mask &= mask - 1)
+	{
+		const uint32 lane = std::countr_zero(mask);
+		const Id id = batch * BATCH_SIZE + lane;
+		XMMATRIX& m = parents[id] == NULL_ID ? worldMatrices[id] : localMatrices[id];
+		m.r[0] = rows0.r[lane];
+		m.r[1] = rows1.r[lane];
+		m.r[2] = rows2.r[lane];
+		m.r[3] = rows3.r[lane];
+	}
+}
+
+void TransformSystem::update()
+{
+	if (childrenChanged)
+	{
+		sortChildren();
+		childrenChanged = false;
+	}
+
+	const uint32 numBatches = (uint32)locals.size();
+	tp->parallelFor(0, numBatches, BATCHES_PER_JOB, [this](uint32 begin, uint32 end)
+	{
+		for (uint32 batch = begin; batch < end; batch++)
+		{
+			if (dirtyMasks[batch] != 0)
+				computeMatrices(batch);
+		}
+	});
+	changedMasks.swap(dirtyMasks);
+	std::fill(dirtyMasks.begin(), dirtyMasks.end(), (uint8)0);
+
+	// Parents are updated before their children, so changes propagate down in one pass
+	for (Id id : children)
+	{
+		const Id parent = parents[id];
+		if (!isChanged(id) && !isChanged(parent))
+			continue;
+		worldMatrices[id] = XMMatrixMultiply(localMatrices[id], worldMatrices[parent]);
+		changedMasks[id / BATCH_SIZE] |= (uint8)(1u << (id % BATCH_SIZE));
+	}
+
+	tp->parallelFor(0, numBatches, BATCHES_PER_JOB, [this](uint32 begin, uint32 end)
+	{
+		for (uint32 batch = begin; batch < end; batch++)
+		{
+			for (uint32 mask = changedMasks[batch]; mask != 0; mask &= mask - 1)
+			{
+				const Id id = batch * BATCH_SIZE + std::countr_zero(mask);
+				worldBounds[id] = culling::transform_box(localBounds[id], worldMatrices[id]);
+			}
+		}
+	});
+
+	numChanged = 0;
+	for (uint8 mask : changedMasks)
+		numChanged += std::popcount(mask);
+}
+
+// Random transforms, a tenth of them children of earlier ones, compared with computing each one with Transform
+static void benchmark_transform_system()
+{
+	constexpr uint32 NUM_OBJECTS = 100000;
+	constexpr uint32 NUM_FRAMES = 100;
+	constexpr uint32 NUM_MOVED_PER_FRAME = 1000;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	auto randomTransform = [&]
+	{
+		return Transform(XMVectorSet(position(rng), position(rng), position(rng), 0), XMVectorSet(angle(rng), angle(rng), angle(rng), 0), scale(rng));
+	};
+	auto measure = [](auto&& func)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		func();
+		return (std::chrono::high_resolution_clock::now() - startTime).count() / 1e6;
+	};
+
+	std::vector<Transform> transforms(NUM_OBJECTS);
+	std::vector<TransformSystem::Id> parents(NUM_OBJECTS, TransformSystem::NULL_ID);
+	TransformSystem system;
+	const BoundingBox bounds(XMFLOAT3(0, 1, 0), XMFLOAT3(1, 1, 1));
+	for (uint32 i = 0; i < NUM_OBJECTS; i++)
+	{
+		transforms[i] = randomTransform();
+		if (i > 0 && rng() % 10 == 0)
+			parents[i] = rng() % i;
+		const TransformSystem::Id id = system.create(transforms[i], &transforms[i], parents[i]);
+		assert(id == i);
+		system.setLocalBounds(id, bounds);
+	}
+	const double createdMs = measure([&] { system.update(); });
+
+	std::vector<XMMATRIX> matrices(NUM_OBJECTS);
+	std::vector<BoundingBox> worldBounds(NUM_OBJECTS);
+	const double scalarMs = measure([&]
+	{
+		for (uint32 i = 0; i < NUM_OBJECTS; i++)
+		{
+			matrices[i] = transforms[i].getMatrix();
+			if (parents[i] != TransformSystem::NULL_ID)
+				matrices[i] = matrices[i] * matrices[parents[i]];
+			worldBounds[i] = culling::transform_box(bounds, matrices[i]);
+		}
+	});
+
+	float maxError = 0.0f;
+	for (uint32 i = 0; i < NUM_OBJECTS; i++)
+	{
+		const XMMATRIX& m = system.getWorldMatrix(i);
+		for (int row = 0; row < 4; row++)
+		{
+			const float error = XMVectorGetX(XMVector4Length(XMVectorSubtract(m.r[row], matrices[i].r[row])));
+			maxError = std::max(maxError, error / std::max(1.0f, XMVectorGetX(XMVector4Length(matrices[i].r[row]))));
+		}
+	}
+
+	const double incrementalMs = measure([&]
+	{
+		for (uint32 frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			for (uint32 i = 0; i < NUM_MOVED_PER_FRAME; i++)
+			{
+				const uint32 object = rng() % NUM_OBJECTS;
+				system.setPosition(object, XMVectorSet(position(rng), position(rng), position(rng), 0));
+			}
+			system.update();
+		}
+	}) / NUM_FRAMES;
+
+	PLOG_INFO << "Transforms of " << NUM_OBJECTS << " objects, times in milliseconds. Updating all: " << createdMs
+		<< ", with Transform::getMatrix one by one: " << scalarMs;
+	PLOG_INFO << "\tMoving " << NUM_MOVED_PER_FRAME << " objects and updating per frame: " << incrementalMs
+		<< " (" << system.getNumChanged() << " transforms changed in the last frame)";
+	if (maxError > 1e-4f)
+		PLOG_ERROR << "\tWorld matrices differ from Transform::getMatrix by up to " << maxError;
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Transforms of 100k objects", benchmark_transform_system);
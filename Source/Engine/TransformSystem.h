@@ -0,0 +1,94 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include <DirectXCollision.h>
+
+#include <Common.h>
+
+#include "Transform.h"
+
+// Transforms of scene objects, stored as structures of arrays. Setters only write the local transform and mark it
+// dirty, the world matrices and bounds of the dirty transforms are recomputed together once per frame, by parallel
+// jobs, a batch of four transforms at a time in the lanes of SIMD vectors. Getters return the ones of the last update.
+//
+// A transform can have a parent, its local transform is then in the parent's space. Children are updated after the
+// parallel part, in order of depth, and a parent changing updates its children. Main thread only.
+//
+//	TransformSystem::Id id = transforms.create(transform, renderer);
+//	transforms.setPosition(id, position);
+//	transforms.update(); // Once per frame
+//	transforms.forEachChanged([](void* user_data) { ... });
+class TransformSystem
+{
+public:
+	using Id = uint32;
+	static constexpr Id NULL_ID = UINT32_MAX;
+
+	Id create(const Transform& local, void* user_data, Id parent = NULL_ID);
+	void destroy(Id id); // Its children are left without a parent
+	void clear();
+
+	Transform getLocal(Id id) const;
+	void setLocal(Id id, const Transform& local);
+	void setPosition(Id id, FXMVECTOR position);
+	void setRotation(Id id, FXMVECTOR rotation); // Pitch, yaw and roll, as in Transform
+	void setScale(Id id, float scale);
+	Id getParent(Id id) const { return parents[id]; }
+	void setParent(Id id, Id parent);
+	void setLocalBounds(Id id, const BoundingBox& bounds); // Transformed to the world bounds
+
+	void update(); // Recomputes the world matrices and bounds of the dirty transforms and of their children
+	const XMMATRIX& getWorldMatrix(Id id) const { return worldMatrices[id]; }
+	const BoundingBox& getWorldBounds(Id id) const { return worldBounds[id]; }
+	uint32 getNumTransforms() const { return (uint32)parents.size() - (uint32)freeIds.size(); }
+	uint32 getNumChanged() const { return numChanged; } // By the last update
+	template <typename F> void forEachChanged(F&& callback) const; // With the user data of the ones the last update changed
+
+private:
+	static constexpr uint32 BATCH_SIZE = 4; // Transforms per batch, one per SIMD lane
+	static constexpr uint32 BATCHES_PER_JOB = 256;
+
+	// Local transforms of a batch, an array of each component
+	struct alignas(16) LocalBatch
+	{
+		float positionX[BATCH_SIZE];
+		float positionY[BATCH_SIZE];
+		float positionZ[BATCH_SIZE];
+		float rotationX[BATCH_SIZE];
+		float rotationY[BATCH_SIZE];
+		float rotationZ[BATCH_SIZE];
+		float scale[BATCH_SIZE];
+	};
+
+	void markDirty(Id id) { dirtyMasks[id / BATCH_SIZE] |= (uint8)(1u << (id % BATCH_SIZE)); }
+	bool isChanged(Id id) const { return (changedMasks[id / BATCH_SIZE] & (1u << (id % BATCH_SIZE))) != 0; }
+	void computeMatrices(uint32 batch); // Of the dirty lanes
+	void sortChildren();
+
+	std::vector<LocalBatch> locals;
+	std::vector<uint8> dirtyMasks; // Per batch, a bit per transform set since the last update
+	std::vector<uint8> changedMasks; // Per batch, a bit per transform the last update changed
+	std::vector<XMMATRIX> localMatrices; // Only of children, roots store theirs as the world matrix
+	std::vector<XMMATRIX> worldMatrices;
+	std::vector<BoundingBox> localBounds;
+	std::vector<BoundingBox> worldBounds;
+	std::vector<Id> parents;
+	std::vector<void*> userData; // Null if the id is free
+	std::vector<Id> freeIds;
+	std::vector<Id> children; // Transforms with a parent, in order of depth
+	bool childrenChanged = false; // Since they were sorted
+	uint32 numChanged = 0;
+};
+
+template <typename F>
+void TransformSystem::forEachChanged(F&& callback) const
+{
+	for (uint32 batch = 0; batch < (uint32)changedMasks.size(); batch++)
+	{
+		for (uint32 mask = changedMasks[batch]; mask != 0; mask &= mask - 1)
+			callback(userData[batch * BATCH_SIZE + std::countr_zero(mask)]);
+	}
+}
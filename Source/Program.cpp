@@ -15,10 +15,14 @@
 #include <Engine/AssetManager.h>
 #include <Renderer/WorldRenderer.h>
 #include <Renderer/RenderUtil.h>
+#include <Renderer/RenderThread.h>
 #include <Renderer/Experiments/IFullscreenExperiment.h>
+#include <Util/AllocationCounter.h>
+#include <Util/AsyncLogAppender.h>
 #include <Util/AutoImGui.h>
 #include <Util/ImGuiLogWindow.h>
 #include <Util/FpsLimiter.h>
+#include <Util/IoService.h>
 #include <Util/ThreadPool.h>
 
 #include "Common.h"
@@ -27,6 +31,7 @@ static constexpr int DEFAULT_WINDOWED_POS_X = 100;
 static constexpr int DEFAULT_WINDOWED_POS_Y = 100;
 static constexpr int DEFAULT_WINDOWED_WIDTH = 1600;
 static constexpr int DEFAULT_WINDOWED_HEIGHT = 900;
+static constexpr double MAIN_THREAD_JOB_BUDGET_MS = 2.0;
 
 static int showCmd;
 static HWND hWnd;
@@ -36,12 +41,22 @@ static bool rightMouseButtonHeldDown = false;
 static POINT lastMousePos;
 static bool ctrl = false;
 static std::string log_file_path;
+static RenderThread* renderThread = nullptr;
+
+// Window messages are handled while the previous frame may still be rendering. Changes to what rendering reads are
+// recorded here and applied once it's finished.
+static bool resizePending = false;
+static int pendingWidth = 0;
+static int pendingHeight = 0;
+static bool wireframeTogglePending = false;
+static bool shaderRecompilePending = false;
 
 void* get_hwnd() { return hWnd; }
 const char* get_log_file_path() { return log_file_path.c_str(); }
 
 extern LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+static void render_frame(const RenderSnapshot& snapshot);
 
 static void create_hwnd(HINSTANCE h_instance)
 {
@@ -90,7 +105,10 @@ static void init_logging()
 	_mkdir(".log");
 	static plog::RollingFileAppender<plog::ToyTxtFormatter> fileAppender(log_file_path.c_str(), 100 * 1024 * 1024, 1);
 	static plog::DebugOutputAppender<plog::ToyTxtFormatter> debugOutputAppender;
-	plog::init(logSeverity).addAppender(&fileAppender).addAppender(&debugOutputAppender).addAppender(&plog::imguiLogWindow);
+	// Constructed after the appenders it feeds, so it's destroyed first, writing out what's left
+	static plog::AsyncAppender asyncAppender;
+	asyncAppender.addAppender(&fileAppender).addAppender(&debugOutputAppender).addAppender(&plog::imguiLogWindow);
+	plog::init(logSeverity, &asyncAppender);
 	PLOG_INFO << "Log system initialized. Severity: " << plog::severityToString(logSeverity) <<". Log file : " << log_file_path;
 }
 
@@ -127,6 +145,8 @@ static bool init()
 	PLOG_INFO << "Detected number of processor cores: " << numCores;
 	PLOG_INFO << "Initializing thread pool with " << numWorkerThreads << " threads";
 	tp = new ThreadPool(numWorkerThreads);
+	const std::string& ioBackendOption = get_cmdline_opts()["io-backend"].as<std::string>();
+	io = new IoService(ioBackendOption == "thread" ? IoService::Backend::THREAD : IoService::Backend::OVERLAPPED);
 
 #ifndef D3D12_DEV
 	render_util::init();
@@ -153,12 +173,19 @@ static bool init()
 	}
 	am->loadScene(scenePath);
 
+	renderThread = new RenderThread(render_frame, get_cmdline_opts()["render-thread"].as<bool>());
+	if (renderThread->isThreaded())
+		PLOG_INFO << "Rendering on a dedicated render thread";
+
 	return true;
 }
 
 static void shutdown()
 {
-	delete tp; // delete ThreadPool first, so jobs in flight don't end up working on deleted data
+	SAFE_DELETE(renderThread); // Finishes rendering the last submitted frame
+	io->stop(); // Reads still queued fail, so their coroutines can finish on the thread pool
+	SAFE_DELETE(tp); // delete ThreadPool first, so jobs in flight don't end up working on deleted data
+	SAFE_DELETE(io);
 	delete wr;
 	delete am;
 	SAFE_DELETE(fe);
@@ -173,44 +200,71 @@ static void shutdown()
 	ImGui::DestroyContext();
 }
 
-static void update()
+static float get_delta_time()
 {
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	static auto lastTime = currentTime;
 	float deltaTimeInSeconds = (float)(((double)std::chrono::duration_cast<std::chrono::microseconds>(currentTime - lastTime).count()) * 0.001 * 0.001);
 	lastTime = currentTime;
+	return deltaTimeInSeconds;
+}
 
+// Runs while nothing is being rendered, so gui can change anything rendering reads
+static void update(float delta_time)
+{
 	ImGui_ImplWin32_NewFrame();
 	ImGui::NewFrame();
 	autoimgui::perform();
 
-	drv->update(deltaTimeInSeconds);
+	drv->update(delta_time);
 
 	if (fe != nullptr)
 	{
 		fe->gui();
-		fe->update(deltaTimeInSeconds);
+		fe->update(delta_time);
 	}
+
+	if (autoimgui::is_active)
+		ImGui::Render();
 	else
-		wr->update(deltaTimeInSeconds);
+		ImGui::EndFrame();
+}
+
+// After rendering finished
+static void apply_pending_window_changes()
+{
+	if (resizePending)
+	{
+		if (wr != nullptr)
+			wr->onResize(pendingWidth, pendingHeight);
+		else
+			drv->resize(pendingWidth, pendingHeight);
+		if (fe != nullptr)
+			fe->onResize(pendingWidth, pendingHeight);
+		resizePending = false;
+	}
+	if (wireframeTogglePending && wr != nullptr)
+		wr->toggleWireframe();
+	if (shaderRecompilePending)
+		drv->recompileShaders();
+	wireframeTogglePending = false;
+	shaderRecompilePending = false;
 }
 
-static void render()
+// Runs on the render thread if there is one, on the main thread otherwise
+static void render_frame(const RenderSnapshot& snapshot)
 {
+	drv->beginRender();
+
 	if (fe != nullptr)
 		fe->render(*drv->getBackbufferTexture());
 	else
-	{
-		wr->beforeRender();
-		wr->render();
-	}
+		wr->render(snapshot);
 
 	drv->setRenderTarget(drv->getBackbufferTexture()->getId(), BAD_RESID);
 
-	if (autoimgui::is_active)
-		ImGui::Render();
-	else
-		ImGui::EndFrame();
+	drv->endFrame();
+	drv->present();
 }
 
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd)
@@ -230,6 +284,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 	{
 		FpsLimiter limiter(drv->getSettings().fpsLimit);
 
+		// Messages only change input state, or record changes to apply after rendering, so they overlap rendering
 		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
 		{
 			TranslateMessage(&msg);
@@ -242,12 +297,28 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 			}
 		}
 
+		const float deltaTime = get_delta_time();
+
+		// Main thread jobs (recreating textures, loading meshes to renderers) and gui change what rendering reads, so
+		// the previous frame has to be finished first
+		renderThread->waitIdle();
+		apply_pending_window_changes();
 		drv->beginFrame();
-		update();
-		drv->beginRender();
-		render();
-		drv->endFrame();
-		drv->present();
+		tp->runMainThreadJobs(MAIN_THREAD_JOB_BUDGET_MS); // Finish async loads, e.g. upload decoded textures
+		update(deltaTime);
+		if (fe == nullptr)
+			wr->captureSnapshot(renderThread->getBackSnapshot());
+		renderThread->submit();
+
+		// Simulating the next frame only changes state that is captured to snapshots, so it can overlap rendering.
+		// Transforms set since the last update get their matrices here, the next snapshot captures them.
+		if (fe == nullptr)
+		{
+			am->updateSceneTransforms();
+			wr->update(deltaTime);
+		}
+
+		allocation_counter::end_frame();
 	}
 
 	return 0;
@@ -275,14 +346,9 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 		PLOG_INFO << "WM_SIZE, clientrect: x:" << clientRect.left << ", y:" << clientRect.top << ", w:" << w << ", h:" << h;
 
 		// Minimize sends WM_SIZE requests with 0 size, which is invalid.
-		w = std::max(8, w);
-		h = std::max(8, h);
-		if (wr != nullptr)
-			wr->onResize(w, h);
-		else
-			drv->resize(w, h);
-		if (fe != nullptr)
-			fe->onResize(w, h);
+		resizePending = true;
+		pendingWidth = std::max(8, w);
+		pendingHeight = std::max(8, h);
 	}
 
 	return DefWindowProc(hWnd, message, wParam, lParam);
@@ -369,7 +435,7 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 			break;
 		case 0x52: // R
 			if (ctrl)
-				drv->recompileShaders();
+				shaderRecompilePending = true;
 			break;
 		case VK_SHIFT:
 			if (rightMouseButtonHeldDown) wr->sceneCameraInputState.isSpeeding = true;
@@ -378,7 +444,7 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 			autoimgui::is_active = !autoimgui::is_active;
 			break;
 		case VK_F3:
-			wr->toggleWireframe();
+			wireframeTogglePending = true;
 			break;
 		case VK_CONTROL:
 			ctrl = true;
@@ -421,11 +487,9 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 		PLOG_INFO << "WM_SIZE, clientrect: x:" << clientRect.left << ", y:" << clientRect.top << ", w:" << w << ", h:" << h;
 
 		// Minimize sends WM_SIZE requests with 0 size, which is invalid.
-		w = std::max(8, w);
-		h = std::max(8, h);
-		wr->onResize(w, h);
-		if (fe != nullptr)
-			fe->onResize(w, h);
+		resizePending = true;
+		pendingWidth = std::max(8, w);
+		pendingHeight = std::max(8, h);
 		break;
 	}
 	}
@@ -442,4 +506,5 @@ REGISTER_IMGUI_FUNCTION_EX("App", "Toggle fullscreen", "F11", 100, [] { PostMess
 REGISTER_IMGUI_FUNCTION_EX("App", "Toggle wireframe", "F3", 101, [] { wr->toggleWireframe(); });
 REGISTER_IMGUI_FUNCTION_EX("App", "Recompile shaders", "Ctrl+R", 101, [] { drv->recompileShaders(); });
 REGISTER_IMGUI_FUNCTION_EX("App", "Exit", "Alt+F4", 999, exit_program);
-REGISTER_IMGUI_FUNCTION_EX("ImGui", "Hide ImGui", "F2", 100, []() { autoimgui::is_active = false; });
\ No newline at end of file
+REGISTER_IMGUI_FUNCTION_EX("ImGui", "Hide ImGui", "F2", 100, []() { autoimgui::is_active = false; });
+REGISTER_IMGUI_WINDOW("Render thread", [] { if (renderThread != nullptr) renderThread->gui(); });
\ No newline at end of file
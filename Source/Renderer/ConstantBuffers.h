@@ -6,13 +6,21 @@ static constexpr unsigned int PER_FRAME_CONSTANT_BUFFER_SLOT = 0;
 static constexpr unsigned int PER_CAMERA_CONSTANT_BUFFER_SLOT = 1;
 static constexpr unsigned int PER_OBJECT_CONSTANT_BUFFER_SLOT = 2;
 static constexpr unsigned int PER_MATERIAL_CONSTANT_BUFFER_SLOT = 3;
+static constexpr unsigned int PER_BATCH_CONSTANT_BUFFER_SLOT = 2; // Instead of the per object one, in instanced draws
+static constexpr unsigned int OBJECTS_BUFFER_SLOT = 7;
+static constexpr unsigned int INSTANCES_BUFFER_SLOT = 8;
+static constexpr unsigned int INSTANCE_MATERIALS_BUFFER_SLOT = 9;
+
+static constexpr unsigned int MAX_SHADOW_CASCADES = 4; // Same as in ConstantBuffers.hlsl
 
 struct PerFrameConstantBufferData
 {
 	XMFLOAT4 mainLightColor;
 	XMFLOAT4 mainLightDirection;
-	XMMATRIX mainLightShadowMatrix;
-	XMFLOAT4 mainLightShadowParams;
+	XMMATRIX mainLightShadowMatrices[MAX_SHADOW_CASCADES];
+	XMFLOAT4 mainLightCascadeParams[MAX_SHADOW_CASCADES]; // x: range, y: radius for poisson samples in shadowmap uv, z,w: unused
+	XMFLOAT4 mainLightCascadeSplits; // View depth where each cascade ends
+	XMFLOAT4 mainLightShadowParams; // x: resolution, y: 1/resolution, z: cascade count, w: unused
 	XMFLOAT4 tonemappingParams;
 	XMFLOAT4 timeParams;
 };
@@ -32,6 +40,12 @@ struct PerCameraConstantBufferData
 };
 
 struct PerObjectConstantBufferData
+{
+	XMUINT4 objectParams; // x: object index, y,z,w: unused
+};
+
+// Of the objects of the scene, in a buffer indexed by the object index
+struct ObjectData
 {
 	XMMATRIX world;
 	XMFLOAT4 objectParams0;
@@ -42,4 +56,15 @@ struct PerMaterialConstantBufferData
 	XMFLOAT4 materialColor;
 	XMFLOAT4 materialParams0;
 	XMFLOAT4 materialParams1;
+};
+
+struct PerBatchConstantBufferData
+{
+	XMUINT4 batchParams; // x: first instance, y,z,w: unused
+};
+
+// Of instanced draws, same as in ConstantBuffers.hlsl. Materials are in a buffer of PerMaterialConstantBufferData.
+struct InstanceData
+{
+	XMUINT4 instanceParams; // x: object index, y: material index, z,w: unused
 };
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "Culling.h"
+
+#include <cassert>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace culling
+{
+	Frustum make_frustum(const XMMATRIX& view_projection)
+	{
+		// Gribb-Hartmann: planes are sums of the columns of the matrix, depth is [0, 1] in clip space
+		const XMMATRIX columns = XMMatrixTranspose(view_projection);
+		const XMVECTOR planes[Frustum::NUM_FRUSTUM_PLANES] =
+		{
+			columns.r[3] + columns.r[0],
+			columns.r[3] - columns.r[0],
+			columns.r[3] + columns.r[1],
+			columns.r[3] - columns.r[1],
+			columns.r[2],
+			columns.r[3] - columns.r[2],
+		};
+
+		Frustum frustum;
+		for (const XMVECTOR& plane : planes)
+			add_plane(frustum, XMPlaneNormalize(plane));
+		return frustum;
+	}
+
+	void add_plane(Frustum& frustum, FXMVECTOR plane)
+	{
+		assert(frustum.numPlanes < Frustum::MAX_PLANES);
+		XMStoreFloat4(&frustum.planes[frustum.numPlanes++], plane);
+	}
+
+	void add_caster_planes(Frustum& frustum, const Frustum& receivers, FXMVECTOR light_direction)
+	{
+		// Light going out of the half space of a plane can't shadow anything inside it from outside
+		for (uint32 i = 0; i < receivers.numPlanes; i++)
+		{
+			const XMVECTOR plane = XMLoadFloat4(&receivers.planes[i]);
+			if (XMVectorGetX(XMVector3Dot(plane, light_direction)) <= 0.0f)
+				add_plane(frustum, plane);
+		}
+	}
+
+	Frustum transform_frustum(const Frustum& frustum, const XMMATRIX& world)
+	{
+		// dot(plane, p * world) = dot(plane * transpose(world), p)
+		const XMMATRIX transposedWorld = XMMatrixTranspose(world);
+		Frustum result;
+		for (uint32 i = 0; i < frustum.numPlanes; i++)
+			add_plane(result, XMVector4Transform(XMLoadFloat4(&frustum.planes[i]), transposedWorld));
+		return result;
+	}
+
+	BoundingBox transform_box(const BoundingBox& box, const XMMATRIX& world)
+	{
+		// Arvo: extents of the transformed box are the extents scaled by the absolute values of the matrix
+		const XMVECTOR extents = XMLoadFloat3(&box.Extents);
+		const XMVECTOR center = XMVector3Transform(XMLoadFloat3(&box.Center), world);
+		const XMVECTOR transformedExtents =
+			XMVectorAbs(world.r[0]) * XMVectorSplatX(extents)
+			+ XMVectorAbs(world.r[1]) * XMVectorSplatY(extents)
+			+ XMVectorAbs(world.r[2]) * XMVectorSplatZ(extents);
+
+		BoundingBox result;
+		XMStoreFloat3(&result.Center, center);
+		XMStoreFloat3(&result.Extents, transformedExtents);
+		return result;
+	}
+
+	bool is_visible(const Frustum& frustum, const BoundingBox& box)
+	{
+		const XMVECTOR center = XMVectorSetW(XMLoadFloat3(&box.Center), 1.0f);
+		const XMVECTOR extents = XMLoadFloat3(&box.Extents);
+		for (uint32 i = 0; i < frustum.numPlanes; i++)
+		{
+			// Distance of the center, plus how far the box reaches towards the plane normal
+			const XMVECTOR plane = XMLoadFloat4(&frustum.planes[i]);
+			const XMVECTOR distance = XMVector4Dot(plane, center) + XMVector3Dot(XMVectorAbs(plane), extents);
+			if (XMVectorGetX(distance) < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	Containment classify(const Frustum& frustum, const BoundingBox& box)
+	{
+		const XMVECTOR center = XMVectorSetW(XMLoadFloat3(&box.Center), 1.0f);
+		const XMVECTOR extents = XMLoadFloat3(&box.Extents);
+		Containment containment = Containment::INSIDE;
+		for (uint32 i = 0; i < frustum.numPlanes; i++)
+		{
+			const XMVECTOR plane = XMLoadFloat4(&frustum.planes[i]);
+			const float distance = XMVectorGetX(XMVector4Dot(plane, center));
+			const float reach = XMVectorGetX(XMVector3Dot(XMVectorAbs(plane), extents));
+			if (distance + reach < 0.0f)
+				return Containment::OUTSIDE;
+			if (distance - reach < 0.0f)
+				containment = Containment::INTERSECTS;
+		}
+		return containment;
+	}
+
+	void set_box(BoxBatch* batches, uint32 index, const BoundingBox& box)
+	{
+		BoxBatch& batch = batches[index / BATCH_SIZE];
+		const uint32 lane = index % BATCH_SIZE;
+		batch.centerX[lane] = box.Center.x;
+		batch.centerY[lane] = box.Center.y;
+		batch.centerZ[lane] = box.Center.z;
+		batch.extentX[lane] = box.Extents.x;
+		batch.extentY[lane] = box.Extents.y;
+		batch.extentZ[lane] = box.Extents.z;
+	}
+
+	void clear_box(BoxBatch* batches, uint32 index)
+	{
+		set_box(batches, index, BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0)));
+	}
+
+	void cull_boxes(const Frustum& frustum, const BoxBatch* batches, uint32 num_batches, uint8* out_masks)
+	{
+		static_assert(BATCH_SIZE == 8, "Batches are tested as two groups of four boxes");
+
+		// Planes splatted once, with the absolute normals for the extents
+		__m128 planeX[Frustum::MAX_PLANES], planeY[Frustum::MAX_PLANES], planeZ[Frustum::MAX_PLANES], planeW[Frustum::MAX_PLANES];
+		__m128 absPlaneX[Frustum::MAX_PLANES], absPlaneY[Frustum::MAX_PLANES], absPlaneZ[Frustum::MAX_PLANES];
+		for (uint32 p = 0; p < frustum.numPlanes; p++)
+		{
+			const XMFLOAT4& plane = frustum.planes[p];
+			planeX[p] = _mm_set1_ps(plane.x);
+			planeY[p] = _mm_set1_ps(plane.y);
+			planeZ[p] = _mm_set1_ps(plane.z);
+			planeW[p] = _mm_set1_ps(plane.w);
+			absPlaneX[p] = _mm_set1_ps(fabsf(plane.x));
+			absPlaneY[p] = _mm_set1_ps(fabsf(plane.y));
+			absPlaneZ[p] = _mm_set1_ps(fabsf(plane.z));
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		for (uint32 b = 0; b < num_batches; b++)
+		{
+			const BoxBatch& batch = batches[b];
+			int mask = 0;
+			for (uint32 half = 0; half < BATCH_SIZE; half += 4)
+			{
+				const __m128 cx = _mm_load_ps(batch.centerX + half);
+				const __m128 cy = _mm_load_ps(batch.centerY + half);
+				const __m128 cz = _mm_load_ps(batch.centerZ + half);
+				const __m128 ex = _mm_load_ps(batch.extentX + half);
+				const __m128 ey = _mm_load_ps(batch.extentY + half);
+				const __m128 ez = _mm_load_ps(batch.extentZ + half);
+
+				// A box is outside if it's entirely behind any of the planes
+				__m128 inside = _mm_cmpeq_ps(zero, zero);
+				for (uint32 p = 0; p < frustum.numPlanes; p++)
+				{
+					__m128 distance = _mm_add_ps(_mm_mul_ps(cx, planeX[p]), planeW[p]);
+					distance = _mm_add_ps(distance, _mm_mul_ps(cy, planeY[p]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(cz, planeZ[p]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(ex, absPlaneX[p]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(ey, absPlaneY[p]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(ez, absPlaneZ[p]));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+				}
+				mask |= _mm_movemask_ps(inside) << half;
+			}
+			out_masks[b] = (uint8)mask;
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <DirectXCollision.h>
+
+#include <Common.h>
+
+namespace culling
+{
+	// Convex volume, planes point inwards: a point p is in front of a plane when dot(plane.xyz, p) + plane.w >= 0. View
+	// frustums have their planes in the order below, other volumes can have more.
+	struct Frustum
+	{
+		enum { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, NUM_FRUSTUM_PLANES };
+		static constexpr uint32 MAX_PLANES = 12;
+
+		XMFLOAT4 planes[MAX_PLANES];
+		uint32 numPlanes = 0;
+	};
+
+	Frustum make_frustum(const XMMATRIX& view_projection);
+	void add_plane(Frustum& frustum, FXMVECTOR plane);
+
+	// Adds the planes of the receivers that casters outside of can't shadow into, i.e. the receivers extruded along the
+	// direction light travels in. The rest of the volume should bound the casters from the other sides.
+	void add_caster_planes(Frustum& frustum, const Frustum& receivers, FXMVECTOR light_direction);
+
+	// Planes of the frustum in the space world transforms from, e.g. mesh space. Not normalized, only their signs matter.
+	Frustum transform_frustum(const Frustum& frustum, const XMMATRIX& world);
+
+	BoundingBox transform_box(const BoundingBox& box, const XMMATRIX& world); // Box around the transformed box
+	bool is_visible(const Frustum& frustum, const BoundingBox& box);
+
+	enum class Containment { OUTSIDE, INTERSECTS, INSIDE };
+	Containment classify(const Frustum& frustum, const BoundingBox& box); // INSIDE if in front of all planes
+
+	// Boxes are tested BATCH_SIZE at a time, with a structure of arrays per batch
+	static constexpr uint32 BATCH_SIZE = 8;
+	struct alignas(16) BoxBatch
+	{
+		float centerX[BATCH_SIZE];
+		float centerY[BATCH_SIZE];
+		float centerZ[BATCH_SIZE];
+		float extentX[BATCH_SIZE];
+		float extentY[BATCH_SIZE];
+		float extentZ[BATCH_SIZE];
+	};
+
+	void set_box(BoxBatch* batches, uint32 index, const BoundingBox& box);
+	void clear_box(BoxBatch* batches, uint32 index); // Padding after the last box, so the whole batch is initialized
+
+	// Writes a byte per batch, with a bit per box set if it's at least partly inside the frustum
+	void cull_boxes(const Frustum& frustum, const BoxBatch* batches, uint32 num_batches, uint8* out_masks);
+}
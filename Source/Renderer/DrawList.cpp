@@ -0,0 +1,419 @@
+#include "DrawList.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include <Driver/IBuffer.h>
+#include <Engine/Material.h>
+
+#include "ConstantBuffers.h"
+
+void StateFilter::reset()
+{
+	inputLayout = indexBuffer = vertexBuffer = renderState = shader = UNKNOWN;
+	shaderVariant = 0;
+	std::fill_n(&constantBuffers[0][0], std::size(constantBuffers) * MAX_SLOTS, UNKNOWN);
+	std::fill_n(&textures[0][0], std::size(textures) * MAX_SLOTS, UNKNOWN);
+	std::fill_n(&samplers[0][0], std::size(samplers) * MAX_SLOTS, UNKNOWN);
+}
+
+bool StateFilter::changed(ResId& current, ResId res_id)
+{
+	if (current == res_id)
+	{
+		numRedundantStateChanges++;
+		return false;
+	}
+	current = res_id;
+	numStateChanges++;
+	return true;
+}
+
+bool StateFilter::changed(ResId* slots, unsigned int slot, ResId res_id)
+{
+	if (slot >= MAX_SLOTS)
+	{
+		numStateChanges++;
+		return true;
+	}
+	return changed(slots[slot], res_id);
+}
+
+void StateFilter::setInputLayout(ResId res_id)
+{
+	if (changed(inputLayout, res_id))
+		target.setInputLayout(res_id);
+}
+
+void StateFilter::setIndexBuffer(ResId res_id)
+{
+	if (changed(indexBuffer, res_id))
+		target.setIndexBuffer(res_id);
+}
+
+void StateFilter::setVertexBuffer(ResId res_id)
+{
+	if (changed(vertexBuffer, res_id))
+		target.setVertexBuffer(res_id);
+}
+
+void StateFilter::setConstantBuffer(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	if ((int)stage >= (int)ShaderStage::GRAPHICS_STAGE_COUNT || changed(constantBuffers[(int)stage], slot, res_id))
+		target.setConstantBuffer(stage, slot, res_id);
+}
+
+void StateFilter::setBuffer(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	// Shares the slots with the textures
+	if ((int)stage < (int)ShaderStage::GRAPHICS_STAGE_COUNT && slot < MAX_SLOTS)
+		textures[(int)stage][slot] = UNKNOWN;
+	numStateChanges++;
+	target.setBuffer(stage, slot, res_id);
+}
+
+void StateFilter::setRwBuffer(unsigned int slot, ResId res_id)
+{
+	numStateChanges++;
+	target.setRwBuffer(slot, res_id);
+}
+
+void StateFilter::setTexture(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	if ((int)stage >= (int)ShaderStage::GRAPHICS_STAGE_COUNT || changed(textures[(int)stage], slot, res_id))
+		target.setTexture(stage, slot, res_id);
+}
+
+void StateFilter::setRwTexture(unsigned int slot, ResId res_id)
+{
+	numStateChanges++;
+	target.setRwTexture(slot, res_id);
+}
+
+void StateFilter::setSampler(ShaderStage stage, unsigned int slot, ResId res_id)
+{
+	if ((int)stage >= (int)ShaderStage::GRAPHICS_STAGE_COUNT || changed(samplers[(int)stage], slot, res_id))
+		target.setSampler(stage, slot, res_id);
+}
+
+void StateFilter::setRenderTarget(ResId target_id, ResId depth_id, unsigned int target_slice, unsigned int depth_slice, unsigned int target_mip, unsigned int depth_mip)
+{
+	// Binding a target unbinds the textures it was bound as
+	std::fill_n(&textures[0][0], std::size(textures) * MAX_SLOTS, UNKNOWN);
+	numStateChanges++;
+	target.setRenderTarget(target_id, depth_id, target_slice, depth_slice, target_mip, depth_mip);
+}
+
+void StateFilter::setRenderTargets(unsigned int num_targets, ResId* target_ids, ResId depth_id, unsigned int* target_slices, unsigned int depth_slice,
+	unsigned int* target_mips, unsigned int depth_mip)
+{
+	std::fill_n(&textures[0][0], std::size(textures) * MAX_SLOTS, UNKNOWN);
+	numStateChanges++;
+	target.setRenderTargets(num_targets, target_ids, depth_id, target_slices, depth_slice, target_mips, depth_mip);
+}
+
+void StateFilter::setRenderState(ResId res_id)
+{
+	if (changed(renderState, res_id))
+		target.setRenderState(res_id);
+}
+
+void StateFilter::setShader(ResId res_id, unsigned int variant_index)
+{
+	if (shader == res_id && shaderVariant == variant_index)
+	{
+		numRedundantStateChanges++;
+		return;
+	}
+	shader = res_id;
+	shaderVariant = variant_index;
+	numStateChanges++;
+	numShaderChanges++;
+	target.setShader(res_id, variant_index);
+}
+
+void StateFilter::setView(float x, float y, float w, float h, float z_min, float z_max)
+{
+	numStateChanges++;
+	target.setView(x, y, w, h, z_min, z_max);
+}
+
+void StateFilter::setView(const ViewportParams& vp)
+{
+	numStateChanges++;
+	target.setView(vp);
+}
+
+void StateFilter::draw(unsigned int vertex_count, unsigned int start_vertex)
+{
+	target.draw(vertex_count, start_vertex);
+}
+
+void StateFilter::drawIndexed(unsigned int index_count, unsigned int start_index, int base_vertex)
+{
+	target.drawIndexed(index_count, start_index, base_vertex);
+}
+
+void StateFilter::drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance)
+{
+	target.drawIndexedInstanced(index_count, instance_count, start_index, base_vertex, start_instance);
+}
+
+void StateFilter::dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z)
+{
+	target.dispatch(num_threadgroups_x, num_threadgroups_y, num_threadgroups_z);
+}
+
+void StateFilter::clearRenderTargets(const RenderTargetClearParams clear_params)
+{
+	target.clearRenderTargets(clear_params);
+}
+
+void StateFilter::beginEvent(const char* label)
+{
+	target.beginEvent(label);
+}
+
+void StateFilter::endEvent()
+{
+	target.endEvent();
+}
+
+// Bits of a float as an unsigned integer that orders the same way, negative floats included
+static uint32 get_ordered_bits(float value)
+{
+	uint32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) != 0 ? ~bits : bits | 0x80000000u;
+}
+
+// Fields from the most significant bits. Ids are truncated, items whose ids only differ above the truncated bits are
+// still correct, only not grouped together.
+//	Forward: shader 8 | variant 8 | material 16 | vertex buffer 8 | index buffer 8 | depth 16
+//	Depth:   shader 8 | variant 8 | depth 24 | material 16 | vertex buffer 8
+static uint64 make_sort_key(const DrawItem& item, RenderPass render_pass)
+{
+	const Material& material = *item.material;
+	const uint64 shader = (uint64)(material.getShader(render_pass) & 0xff) << 56 | (uint64)(material.getShaderVariant(render_pass) & 0xff) << 48;
+	const uint64 materialId = material.getSortId() & 0xffff;
+	const uint64 depth = get_ordered_bits(item.depth);
+	if (render_pass == RenderPass::DEPTH)
+		return shader | (depth >> 8) << 24 | materialId << 8 | (uint64)(item.vb & 0xff);
+	return shader | materialId << 32 | (uint64)(item.vb & 0xff) << 24 | (uint64)(item.ib & 0xff) << 16 | depth >> 16;
+}
+
+static bool can_instance(const DrawItem& item, RenderPass render_pass)
+{
+	return item.material->getInstanceIndex() != Material::NO_INSTANCE_INDEX && item.material->supportsInstancing(render_pass);
+}
+
+// Items with the same variant use the same instanced variant, the keywords picking both are the same
+static bool is_same_draw(const DrawItem& a, const DrawItem& b, RenderPass render_pass)
+{
+	return a.inputLayout == b.inputLayout && a.vb == b.vb && a.ib == b.ib && a.numIndices == b.numIndices &&
+		a.startIndex == b.startIndex && a.baseVertex == b.baseVertex &&
+		a.material->getShader(render_pass) == b.material->getShader(render_pass) &&
+		a.material->getShaderVariant(render_pass) == b.material->getShaderVariant(render_pass) &&
+		(a.material == b.material || a.material->hasSameTextures(*b.material));
+}
+
+template <typename T>
+static uint64 hash_value(uint64 hash, const T& value)
+{
+	// FNV-1a
+	const uint8* bytes = (const uint8*)&value;
+	for (size_t i = 0; i < sizeof(value); i++)
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+// Of what is_same_draw compares
+static uint64 hash_draw(const DrawItem& item, RenderPass render_pass)
+{
+	uint64 h = 0xcbf29ce484222325ull;
+	h = hash_value(h, item.inputLayout);
+	h = hash_value(h, item.vb);
+	h = hash_value(h, item.ib);
+	h = hash_value(h, item.numIndices);
+	h = hash_value(h, item.startIndex);
+	h = hash_value(h, item.baseVertex);
+	h = hash_value(h, item.material->getShader(render_pass));
+	h = hash_value(h, item.material->getShaderVariant(render_pass));
+	for (const std::vector<MaterialTexture>& stageTextures : item.material->getTextures())
+		for (const MaterialTexture& texture : stageTextures)
+			h = hash_value(h, texture.tex);
+	return h;
+}
+
+void DrawList::reset(uint32 num_chunks)
+{
+	chunks.resize(num_chunks);
+	for (Chunk& chunk : chunks)
+	{
+		chunk.items.clear();
+		chunk.commands.reset();
+		chunk.stats = {};
+	}
+	sortedItems.clear();
+	batchSizes.clear();
+}
+
+size_t DrawList::getNumItems() const
+{
+	size_t numItems = 0;
+	for (const Chunk& chunk : chunks)
+		numItems += chunk.items.size();
+	return numItems;
+}
+
+void DrawList::setSortKeys(uint32 chunk_index, RenderPass render_pass)
+{
+	for (DrawItem& item : chunks[chunk_index].items)
+		item.sortKey = make_sort_key(item, render_pass);
+}
+
+void DrawList::sort(RenderPass render_pass, bool by_key, std::span<const ResId> batch_cbs)
+{
+	sortedItems.clear();
+	sortedItems.reserve(getNumItems());
+	for (const Chunk& chunk : chunks)
+		for (const DrawItem& item : chunk.items)
+			sortedItems.push_back({ item.sortKey, &item, NO_BATCH });
+	if (by_key)
+		std::sort(sortedItems.begin(), sortedItems.end(), [](const SortedItem& a, const SortedItem& b) { return a.key < b.key; });
+
+	batchCbs = batch_cbs;
+	batchSizes.clear();
+	if (!batchCbs.empty())
+		mergeInstances(render_pass);
+}
+
+void DrawList::mergeInstances(RenderPass render_pass)
+{
+	// The first item of a draw leads a batch once a second one shows up, later ones add their instances to it and are
+	// removed. A full batch stops being looked up, so the next item of the draw leads a new one. Items whose hash collides
+	// with a different draw, or showing up once there are no batches left, are drawn on their own.
+	const auto addInstance = [this](uint32 batch, const DrawItem& item)
+	{
+		InstanceData& instance = instances[(size_t)batch * MAX_BATCH_INSTANCES + batchSizes[batch]++];
+		instance.instanceParams = XMUINT4(item.objectIndex, item.material->getInstanceIndex(), 0, 0);
+	};
+
+	batchLeaders.clear();
+	size_t numKept = 0;
+	for (size_t i = 0; i < sortedItems.size(); i++)
+	{
+		const SortedItem sorted = sortedItems[i];
+		if (can_instance(*sorted.item, render_pass))
+		{
+			// Kept items are never moved again, so the leader's index is where it's kept
+			const auto [leaderIt, inserted] = batchLeaders.try_emplace(hash_draw(*sorted.item, render_pass), (uint32)numKept);
+			SortedItem& leader = sortedItems[leaderIt->second];
+			if (!inserted && is_same_draw(*leader.item, *sorted.item, render_pass))
+			{
+				if (leader.batch == NO_BATCH && batchSizes.size() < batchCbs.size())
+				{
+					leader.batch = (uint32)batchSizes.size();
+					batchSizes.push_back(0);
+					instances.resize(std::max(instances.size(), batchSizes.size() * MAX_BATCH_INSTANCES));
+					addInstance(leader.batch, *leader.item);
+				}
+				if (leader.batch != NO_BATCH)
+				{
+					addInstance(leader.batch, *sorted.item);
+					if (batchSizes[leader.batch] == MAX_BATCH_INSTANCES)
+						batchLeaders.erase(leaderIt);
+					continue;
+				}
+			}
+		}
+		sortedItems[numKept++] = sorted;
+	}
+	sortedItems.resize(numKept);
+}
+
+void DrawList::recordChunk(uint32 chunk_index, RenderPass render_pass)
+{
+	Chunk& chunk = chunks[chunk_index];
+	StateFilter state(chunk.commands);
+	const size_t begin = sortedItems.size() * chunk_index / chunks.size();
+	const size_t end = sortedItems.size() * (chunk_index + 1) / chunks.size();
+	const Material* material = nullptr;
+	bool instanced = false;
+	for (size_t i = begin; i < end; i++)
+	{
+		const SortedItem& sorted = sortedItems[i];
+		const DrawItem& item = *sorted.item;
+		const bool batched = sorted.batch != NO_BATCH;
+		if (item.material != material || batched != instanced)
+		{
+			item.material->set(render_pass, state, batched);
+			material = item.material;
+			instanced = batched;
+			chunk.stats.numMaterialChanges++;
+		}
+		if (batched)
+		{
+			state.setConstantBuffer(ShaderStage::VS, PER_BATCH_CONSTANT_BUFFER_SLOT, batchCbs[sorted.batch]);
+		}
+		else
+		{
+			state.setConstantBuffer(ShaderStage::VS, PER_OBJECT_CONSTANT_BUFFER_SLOT, item.objectCb);
+		}
+		state.setInputLayout(item.inputLayout);
+		state.setIndexBuffer(item.ib);
+		state.setVertexBuffer(item.vb);
+		if (batched)
+		{
+			state.drawIndexedInstanced(item.numIndices, batchSizes[sorted.batch], item.startIndex, item.baseVertex, 0);
+			chunk.stats.numInstancedDraws++;
+			chunk.stats.numInstances += batchSizes[sorted.batch];
+		}
+		else
+		{
+			state.drawIndexed(item.numIndices, item.startIndex, item.baseVertex);
+		}
+	}
+	chunk.stats.numDraws = (uint32)(end - begin);
+	chunk.stats.numShaderChanges = state.numShaderChanges;
+	chunk.stats.numStateChanges = state.numStateChanges;
+	chunk.stats.numRedundantStateChanges = state.numRedundantStateChanges;
+}
+
+void DrawList::uploadInstances()
+{
+	if (batchSizes.empty())
+		return;
+	if (instanceBuffer == nullptr || instanceBuffer->getDesc().numElements != instances.size())
+	{
+		BufferDesc desc("drawListInstances", sizeof(InstanceData), (unsigned int)instances.size(), ResourceUsage::DEFAULT,
+			BIND_SHADER_RESOURCE, 0, RESOURCE_MISC_BUFFER_STRUCTURED);
+		instanceBuffer.reset(drv->createBuffer(desc));
+	}
+	instanceBuffer->updateData(instances.data());
+}
+
+void DrawList::execute(ICommandBuffer& target) const
+{
+	if (!batchSizes.empty())
+		target.setBuffer(ShaderStage::VS, INSTANCES_BUFFER_SLOT, instanceBuffer->getId());
+	for (const Chunk& chunk : chunks)
+		chunk.commands.execute(target);
+}
+
+DrawList::Stats DrawList::getStats() const
+{
+	Stats stats = {};
+	for (const Chunk& chunk : chunks)
+	{
+		stats.numDraws += chunk.stats.numDraws;
+		stats.numInstancedDraws += chunk.stats.numInstancedDraws;
+		stats.numInstances += chunk.stats.numInstances;
+		stats.numMaterialChanges += chunk.stats.numMaterialChanges;
+		stats.numShaderChanges += chunk.stats.numShaderChanges;
+		stats.numStateChanges += chunk.stats.numStateChanges;
+		stats.numRedundantStateChanges += chunk.stats.numRedundantStateChanges;
+	}
+	return stats;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <Common.h>
+#include <Driver/CommandBuffer.h>
+#include <Driver/IBuffer.h>
+#include <Driver/IDriver.h>
+
+#include "ConstantBuffers.h"
+
+class Material;
+
+// Everything needed to submit one draw call. Built and recorded on worker threads, executed on the rendering thread.
+struct DrawItem
+{
+	Material* material;
+	ResId inputLayout;
+	ResId vb;
+	ResId ib;
+	ResId objectCb;
+	uint32 objectIndex; // In the objects buffer, read by instanced draws
+	unsigned int numIndices;
+	unsigned int startIndex;
+	int baseVertex;
+	float depth; // Along the view direction, of the submesh center
+	uint64 sortKey;
+};
+
+// Forwards commands to a command buffer, dropping the ones that set state it already has. Anything not set through it
+// since reset is unknown, so it's set the first time.
+class StateFilter : public ICommandBuffer
+{
+public:
+	explicit StateFilter(ICommandBuffer& target_) : target(target_) { reset(); }
+	void reset();
+
+	uint32 numStateChanges = 0; // Forwarded
+	uint32 numRedundantStateChanges = 0; // Dropped
+	uint32 numShaderChanges = 0; // Forwarded, also counted as state changes
+
+	void setInputLayout(ResId res_id) override;
+	void setIndexBuffer(ResId res_id) override;
+	void setVertexBuffer(ResId res_id) override;
+	void setConstantBuffer(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setBuffer(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setRwBuffer(unsigned int slot, ResId res_id) override;
+	void setTexture(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setRwTexture(unsigned int slot, ResId res_id) override;
+	void setSampler(ShaderStage stage, unsigned int slot, ResId res_id) override;
+	void setRenderTarget(ResId target_id, ResId depth_id,
+		unsigned int target_slice = 0, unsigned int depth_slice = 0, unsigned int target_mip = 0, unsigned int depth_mip = 0) override;
+	void setRenderTargets(unsigned int num_targets, ResId* target_ids, ResId depth_id,
+		unsigned int* target_slices = nullptr, unsigned int depth_slice = 0, unsigned int* target_mips = nullptr, unsigned int depth_mip = 0) override;
+	void setRenderState(ResId res_id) override;
+	void setShader(ResId res_id, unsigned int variant_index) override;
+	void setView(float x, float y, float w, float h, float z_min, float z_max) override;
+	void setView(const ViewportParams& vp) override;
+
+	void draw(unsigned int vertex_count, unsigned int start_vertex) override;
+	void drawIndexed(unsigned int index_count, unsigned int start_index, int base_vertex) override;
+	void drawIndexedInstanced(unsigned int index_count, unsigned int instance_count, unsigned int start_index, int base_vertex, unsigned int start_instance) override;
+	void dispatch(unsigned int num_threadgroups_x, unsigned int num_threadgroups_y, unsigned int num_threadgroups_z) override;
+
+	void clearRenderTargets(const RenderTargetClearParams clear_params) override;
+
+	void beginEvent(const char* label) override;
+	void endEvent() override;
+
+private:
+	static constexpr unsigned int MAX_SLOTS = 16; // Per stage, bindings above are always forwarded
+	static constexpr ResId UNKNOWN = BAD_RESID - 1;
+
+	bool changed(ResId& current, ResId res_id); // Updates current
+	bool changed(ResId* slots, unsigned int slot, ResId res_id);
+
+	ICommandBuffer& target;
+	ResId inputLayout;
+	ResId indexBuffer;
+	ResId vertexBuffer;
+	ResId renderState;
+	ResId shader;
+	unsigned int shaderVariant;
+	ResId constantBuffers[(int)ShaderStage::GRAPHICS_STAGE_COUNT][MAX_SLOTS];
+	ResId textures[(int)ShaderStage::GRAPHICS_STAGE_COUNT][MAX_SLOTS];
+	ResId samplers[(int)ShaderStage::GRAPHICS_STAGE_COUNT][MAX_SLOTS];
+};
+
+// Draw items of a render pass. Built by parallel jobs, each writing only its own chunk, then sorted by their keys and
+// recorded to command buffers by parallel jobs, each recording a slice of the sorted items. Slices are executed in
+// order. Recording only sets state that differs from what the slice set before.
+//
+// Keys group the items by shader variant, then by material and buffers, so those change as rarely as possible. Depth
+// passes sort by depth before the material, front to back, so nearer surfaces reject more of the ones behind them.
+//
+// Items drawing the same submesh with the same shader variant and textures can be merged into instanced draws, taking
+// the place of the first of them. Their object and material indices are written to the instances of the list.
+class DrawList
+{
+public:
+	static constexpr uint32 MAX_BATCH_INSTANCES = 64;
+
+	struct Stats
+	{
+		uint32 numDraws;
+		uint32 numInstancedDraws; // Also counted as draws
+		uint32 numInstances; // Drawn by instanced draws
+		uint32 numMaterialChanges;
+		uint32 numShaderChanges;
+		uint32 numStateChanges;
+		uint32 numRedundantStateChanges; // Not submitted
+	};
+
+	void reset(uint32 num_chunks); // Keeps the allocations of previous frames
+	std::vector<DrawItem>& getChunk(uint32 chunk_index) { return chunks[chunk_index].items; }
+	size_t getNumItems() const;
+
+	void setSortKeys(uint32 chunk_index, RenderPass render_pass); // After the chunk is built
+	// After all chunks are built, otherwise they keep the order they were built in. Items are merged into at most one
+	// batch per constant buffer in batch_cbs, the one of batch i having i * MAX_BATCH_INSTANCES as the first instance.
+	void sort(RenderPass render_pass, bool by_key, std::span<const ResId> batch_cbs = {});
+	void recordChunk(uint32 chunk_index, RenderPass render_pass); // After sorting, records a slice of the items
+	void uploadInstances(); // On the rendering thread, after sorting
+	void execute(ICommandBuffer& target) const;
+	Stats getStats() const; // Of the recorded chunks
+
+private:
+	struct Chunk
+	{
+		std::vector<DrawItem> items;
+		CommandBuffer commands;
+		Stats stats;
+	};
+	struct SortedItem
+	{
+		uint64 key;
+		const DrawItem* item;
+		uint32 batch; // NO_BATCH unless it draws a batch
+	};
+	static constexpr uint32 NO_BATCH = UINT32_MAX;
+
+	void mergeInstances(RenderPass render_pass);
+
+	std::vector<Chunk> chunks;
+	std::vector<SortedItem> sortedItems;
+	std::span<const ResId> batchCbs;
+	std::vector<uint32> batchSizes;
+	std::vector<InstanceData> instances; // Of batch i from i * MAX_BATCH_INSTANCES, only grows
+	std::unordered_map<uint64, uint32> batchLeaders; // While merging, by hash of the draw, index of the first item
+	std::unique_ptr<IBuffer> instanceBuffer;
+};
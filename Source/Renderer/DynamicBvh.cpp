@@ -0,0 +1,492 @@
+#include "DynamicBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <random>
+
+#include <Util/AutoImGui.h>
+#include <Util/LinearArena.h>
+
+static constexpr float MIN_FAT_MARGIN = 0.01f;
+static constexpr float REFIT_MOVED_FRACTION = 0.25f; // Refit instead of reinserting if more of the proxies moved
+static constexpr float REBUILD_COST_RATIO = 1.5f; // Rebuild if the cost grew this much since the last rebuild
+
+// Half of the surface area, only compared
+static float get_area(const BoundingBox& box)
+{
+	const XMFLOAT3& e = box.Extents;
+	return 4.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+static BoundingBox merge(const BoundingBox& a, const BoundingBox& b)
+{
+	BoundingBox result;
+	BoundingBox::CreateMerged(result, a, b);
+	return result;
+}
+
+BoundingBox DynamicBvh::getFatBoxOf(const BoundingBox& box) const
+{
+	const XMFLOAT3& e = box.Extents;
+	const float margin = fatMarginFraction > 0.0f ? std::max(std::max({ e.x, e.y, e.z }) * fatMarginFraction, MIN_FAT_MARGIN) : 0.0f;
+	return BoundingBox(box.Center, XMFLOAT3(e.x + margin, e.y + margin, e.z + margin));
+}
+
+DynamicBvh::ProxyId DynamicBvh::createProxy(const BoundingBox& box, void* user_data)
+{
+	const uint32 leaf = allocateNode();
+	nodes[leaf].box = getFatBoxOf(box);
+	nodes[leaf].userData = user_data;
+	nodes[leaf].height = 0;
+	insertLeaf(leaf);
+	numLeaves++;
+	changed = true;
+	return leaf;
+}
+
+void DynamicBvh::destroyProxy(ProxyId proxy)
+{
+	assert(proxy < nodes.size() && nodes[proxy].isLeaf() && nodes[proxy].height == 0);
+	if (nodes[proxy].moved)
+	{
+		auto it = std::find(movedLeaves.begin(), movedLeaves.end(), proxy);
+		*it = movedLeaves.back();
+		movedLeaves.pop_back();
+	}
+	removeLeaf(proxy);
+	freeNode(proxy);
+	numLeaves--;
+	changed = true;
+}
+
+void DynamicBvh::moveProxy(ProxyId proxy, const BoundingBox& box)
+{
+	assert(proxy < nodes.size() && nodes[proxy].isLeaf() && nodes[proxy].height == 0);
+	if (nodes[proxy].box.Contains(box) == CONTAINS)
+		return;
+
+	// Ancestors grow to contain it right away, the tree is only restructured in update
+	nodes[proxy].box = getFatBoxOf(box);
+	for (uint32 node = nodes[proxy].parent; node != NULL_NODE && nodes[node].box.Contains(nodes[proxy].box) != CONTAINS; node = nodes[node].parent)
+		nodes[node].box = merge(nodes[node].box, nodes[proxy].box);
+	if (!nodes[proxy].moved)
+	{
+		nodes[proxy].moved = true;
+		movedLeaves.push_back(proxy);
+	}
+	changed = true;
+}
+
+void DynamicBvh::clear()
+{
+	nodes.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+	numLeaves = 0;
+	movedLeaves.clear();
+	costAfterRebuild = 0.0f;
+	changed = false;
+}
+
+void DynamicBvh::update()
+{
+	if (!changed)
+		return;
+	changed = false;
+
+	if (movedLeaves.size() > numLeaves * REFIT_MOVED_FRACTION)
+	{
+		refit();
+	}
+	else
+	{
+		for (uint32 leaf : movedLeaves)
+		{
+			removeLeaf(leaf);
+			insertLeaf(leaf);
+		}
+	}
+	for (uint32 leaf : movedLeaves)
+		nodes[leaf].moved = false;
+	movedLeaves.clear();
+
+	if (costAfterRebuild == 0.0f || getCost() > costAfterRebuild * REBUILD_COST_RATIO)
+		rebuild();
+}
+
+void DynamicBvh::rebuild()
+{
+	if (root == NULL_NODE)
+		return;
+
+	LinearArena& scratch = get_thread_scratch_arena();
+	ArenaScope scope(scratch);
+	ScratchVector<uint32> leaves(scratch);
+	leaves.reserve(numLeaves);
+	for (uint32 node = 0; node < (uint32)nodes.size(); node++)
+	{
+		if (nodes[node].height == 0)
+			leaves.push_back(node);
+		else if (nodes[node].height != UINT32_MAX)
+			freeNode(node);
+	}
+	assert(leaves.size() == numLeaves);
+
+	root = buildTopDown(leaves.data(), (uint32)leaves.size());
+	nodes[root].parent = NULL_NODE;
+	costAfterRebuild = std::max(getCost(), FLT_MIN);
+}
+
+void DynamicBvh::refit()
+{
+	if (root != NULL_NODE)
+		refitSubtree(root);
+}
+
+void DynamicBvh::refitSubtree(uint32 node)
+{
+	// Fat boxes of the leaves are kept, the internal nodes are fitted tightly around them
+	Node& n = nodes[node];
+	if (n.isLeaf())
+		return;
+	refitSubtree(n.child1);
+	refitSubtree(n.child2);
+	n.box = merge(nodes[n.child1].box, nodes[n.child2].box);
+	n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+}
+
+float DynamicBvh::getCost() const
+{
+	if (root == NULL_NODE || nodes[root].isLeaf())
+		return 0.0f;
+	float area = 0.0f;
+	for (const Node& node : nodes)
+		if (node.height != 0 && node.height != UINT32_MAX)
+			area += get_area(node.box);
+	const float rootArea = get_area(nodes[root].box);
+	return rootArea > 0.0f ? area / rootArea : 0.0f;
+}
+
+uint32 DynamicBvh::allocateNode()
+{
+	if (freeList == NULL_NODE)
+	{
+		nodes.emplace_back();
+		return (uint32)nodes.size() - 1;
+	}
+	const uint32 node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node] = Node();
+	return node;
+}
+
+void DynamicBvh::freeNode(uint32 node)
+{
+	nodes[node].height = UINT32_MAX;
+	nodes[node].child1 = NULL_NODE;
+	nodes[node].child2 = NULL_NODE;
+	nodes[node].parent = freeList;
+	freeList = node;
+}
+
+void DynamicBvh::insertLeaf(uint32 leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Down to the sibling that adds the least area: a node's cost is the area of it merged with the leaf, and each
+	// node above it grows by the area the leaf adds to it
+	const BoundingBox leafBox = nodes[leaf].box;
+	uint32 sibling = root;
+	while (!nodes[sibling].isLeaf())
+	{
+		const Node& n = nodes[sibling];
+		const float area = get_area(n.box);
+		const float combinedArea = get_area(merge(n.box, leafBox));
+		const float cost = 2.0f * combinedArea; // Of a new parent of this node and the leaf
+		const float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		const uint32 children[2] = { n.child1, n.child2 };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = nodes[children[c]];
+			const float mergedArea = get_area(merge(child.box, leafBox));
+			childCosts[c] = (child.isLeaf() ? mergedArea : mergedArea - get_area(child.box)) + inheritanceCost;
+		}
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		sibling = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	const uint32 oldParent = nodes[sibling].parent;
+	const uint32 newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = merge(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent == NULL_NODE)
+		root = newParent;
+	else if (nodes[oldParent].child1 == sibling)
+		nodes[oldParent].child1 = newParent;
+	else
+		nodes[oldParent].child2 = newParent;
+
+	refitAncestors(oldParent);
+}
+
+void DynamicBvh::removeLeaf(uint32 leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	const uint32 parent = nodes[leaf].parent;
+	const uint32 grandParent = nodes[parent].parent;
+	const uint32 sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+	nodes[sibling].parent = grandParent;
+	if (grandParent == NULL_NODE)
+		root = sibling;
+	else if (nodes[grandParent].child1 == parent)
+		nodes[grandParent].child1 = sibling;
+	else
+		nodes[grandParent].child2 = sibling;
+	freeNode(parent);
+
+	refitAncestors(grandParent);
+}
+
+void DynamicBvh::refitAncestors(uint32 node)
+{
+	while (node != NULL_NODE)
+	{
+		Node& n = nodes[node];
+		n.box = merge(nodes[n.child1].box, nodes[n.child2].box);
+		n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+		rotate(node);
+		node = nodes[node].parent;
+	}
+}
+
+void DynamicBvh::rotate(uint32 a)
+{
+	// Swaps a child of the node with a grandchild under its other child, if that makes the other child smaller. The node
+	// keeps its box, only the child that changes has to be refitted.
+	Node& nodeA = nodes[a];
+	if (nodeA.height < 2)
+		return;
+	const uint32 b = nodeA.child1;
+	const uint32 c = nodeA.child2;
+	const Node& nodeB = nodes[b];
+	const Node& nodeC = nodes[c];
+
+	enum { NONE, B_F, B_G, C_D, C_E } best = NONE;
+	float bestCost = 0.0f; // Change of the area of the internal children
+	if (!nodeC.isLeaf())
+	{
+		const float areaC = get_area(nodeC.box);
+		const float costBF = get_area(merge(nodeB.box, nodes[nodeC.child2].box)) - areaC;
+		const float costBG = get_area(merge(nodeB.box, nodes[nodeC.child1].box)) - areaC;
+		if (costBF < bestCost) { best = B_F; bestCost = costBF; }
+		if (costBG < bestCost) { best = B_G; bestCost = costBG; }
+	}
+	if (!nodeB.isLeaf())
+	{
+		const float areaB = get_area(nodeB.box);
+		const float costCD = get_area(merge(nodeC.box, nodes[nodeB.child2].box)) - areaB;
+		const float costCE = get_area(merge(nodeC.box, nodes[nodeB.child1].box)) - areaB;
+		if (costCD < bestCost) { best = C_D; bestCost = costCD; }
+		if (costCE < bestCost) { best = C_E; bestCost = costCE; }
+	}
+	if (best == NONE)
+		return;
+
+	// The child of A moves down into the other child, in place of the grandchild that moves up
+	const bool swapB = best == B_F || best == B_G;
+	const uint32 moveDown = swapB ? b : c;
+	const uint32 other = swapB ? c : b;
+	const bool firstGrandchild = best == B_F || best == C_D;
+	const uint32 moveUp = firstGrandchild ? nodes[other].child1 : nodes[other].child2;
+
+	if (nodeA.child1 == moveDown)
+		nodeA.child1 = moveUp;
+	else
+		nodeA.child2 = moveUp;
+	if (firstGrandchild)
+		nodes[other].child1 = moveDown;
+	else
+		nodes[other].child2 = moveDown;
+	nodes[moveUp].parent = a;
+	nodes[moveDown].parent = other;
+
+	Node& nodeOther = nodes[other];
+	nodeOther.box = merge(nodes[nodeOther.child1].box, nodes[nodeOther.child2].box);
+	nodeOther.height = 1 + std::max(nodes[nodeOther.child1].height, nodes[nodeOther.child2].height);
+	nodeA.height = 1 + std::max(nodes[nodeA.child1].height, nodes[nodeA.child2].height);
+}
+
+uint32 DynamicBvh::buildTopDown(uint32* leaves, uint32 count)
+{
+	if (count == 1)
+		return leaves[0];
+
+	// Split at the median of the centers along the axis they spread the most on
+	XMVECTOR minCenter = XMVectorReplicate(FLT_MAX);
+	XMVECTOR maxCenter = XMVectorReplicate(-FLT_MAX);
+	for (uint32 i = 0; i < count; i++)
+	{
+		const XMVECTOR center = XMLoadFloat3(&nodes[leaves[i]].box.Center);
+		minCenter = XMVectorMin(minCenter, center);
+		maxCenter = XMVectorMax(maxCenter, center);
+	}
+	XMFLOAT3 spread;
+	XMStoreFloat3(&spread, maxCenter - minCenter);
+	const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+	const uint32 half = count / 2;
+	std::nth_element(leaves, leaves + half, leaves + count, [this, axis](uint32 a, uint32 b)
+	{
+		return (&nodes[a].box.Center.x)[axis] < (&nodes[b].box.Center.x)[axis];
+	});
+
+	const uint32 node = allocateNode();
+	const uint32 child1 = buildTopDown(leaves, half);
+	const uint32 child2 = buildTopDown(leaves + half, count - half);
+	Node& n = nodes[node];
+	n.child1 = child1;
+	n.child2 = child2;
+	n.box = merge(nodes[child1].box, nodes[child2].box);
+	n.height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+	nodes[child1].parent = node;
+	nodes[child2].parent = node;
+	return node;
+}
+
+// Random boxes spread over a large flat area, like objects of an open world. Queries are checked against testing all
+// fat boxes one by one.
+static void benchmark_dynamic_bvh()
+{
+	constexpr uint32 NUM_OBJECTS = 100000;
+	constexpr uint32 NUM_FRAMES = 100;
+	constexpr uint32 NUM_MOVED_PER_FRAME = 1000;
+	constexpr uint32 NUM_QUERIES = 1000;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> horizontal(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> vertical(0.0f, 50.0f);
+	std::uniform_real_distribution<float> size(0.5f, 5.0f);
+	std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+	auto randomBox = [&] { return BoundingBox(XMFLOAT3(horizontal(rng), vertical(rng), horizontal(rng)), XMFLOAT3(size(rng), size(rng), size(rng))); };
+	auto measure = [](auto&& func)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		func();
+		return (std::chrono::high_resolution_clock::now() - startTime).count() / 1e6;
+	};
+
+	std::vector<BoundingBox> boxes(NUM_OBJECTS);
+	std::vector<DynamicBvh::ProxyId> proxies(NUM_OBJECTS);
+	DynamicBvh bvh;
+	const double insertMs = measure([&]
+	{
+		for (uint32 i = 0; i < NUM_OBJECTS; i++)
+		{
+			boxes[i] = randomBox();
+			proxies[i] = bvh.createProxy(boxes[i], (void*)(uintptr_t)i);
+		}
+	});
+	const float insertedCost = bvh.getCost();
+	const uint32 insertedHeight = bvh.getHeight();
+	const double rebuildMs = measure([&] { bvh.rebuild(); });
+
+	// Small moves of a few objects per frame are reinserted, moving most of them at once refits
+	const double incrementalMs = measure([&]
+	{
+		for (uint32 frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			for (uint32 i = 0; i < NUM_MOVED_PER_FRAME; i++)
+			{
+				const uint32 object = rng() % NUM_OBJECTS;
+				boxes[object].Center.x += step(rng);
+				boxes[object].Center.z += step(rng);
+				bvh.moveProxy(proxies[object], boxes[object]);
+			}
+			bvh.update();
+		}
+	}) / NUM_FRAMES;
+	const double refitMs = measure([&]
+	{
+		for (uint32 i = 0; i < NUM_OBJECTS; i += 2)
+		{
+			boxes[i].Center.y += 2.0f;
+			bvh.moveProxy(proxies[i], boxes[i]);
+		}
+		bvh.update();
+	});
+
+	// Queries, each kind with its brute force count of the first query to compare with
+	uint32 numMismatches = 0;
+	auto countBruteForce = [&](auto&& test)
+	{
+		uint32 count = 0;
+		for (uint32 i = 0; i < NUM_OBJECTS; i++)
+			count += test(bvh.getFatBox(proxies[i]));
+		return count;
+	};
+
+	const XMMATRIX viewProjection = XMMatrixLookAtLH(XMVectorSet(0, 20, 0, 1), XMVectorSet(100, 0, 100, 1), XMVectorSet(0, 1, 0, 0))
+		* XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 500.0f);
+	const culling::Frustum frustum = culling::make_frustum(viewProjection);
+	uint32 numInFrustum = 0;
+	const double frustumMs = measure([&] { bvh.queryFrustum(frustum, [&](void*) { numInFrustum++; }); });
+	numMismatches += numInFrustum != countBruteForce([&](const BoundingBox& box) { return culling::is_visible(frustum, box); });
+
+	std::vector<BoundingSphere> spheres(NUM_QUERIES);
+	std::vector<BoundingBox> queryBoxes(NUM_QUERIES);
+	for (uint32 i = 0; i < NUM_QUERIES; i++)
+	{
+		spheres[i] = BoundingSphere(XMFLOAT3(horizontal(rng), vertical(rng), horizontal(rng)), 20.0f);
+		queryBoxes[i] = BoundingBox(XMFLOAT3(horizontal(rng), vertical(rng), horizontal(rng)), XMFLOAT3(20.0f, 20.0f, 20.0f));
+	}
+	uint32 numInSpheres = 0, numInBoxes = 0, numRayHits = 0;
+	const double sphereMs = measure([&] { for (const BoundingSphere& sphere : spheres) bvh.querySphere(sphere, [&](void*) { numInSpheres++; }); }) / NUM_QUERIES;
+	const double boxMs = measure([&] { for (const BoundingBox& box : queryBoxes) bvh.queryBox(box, [&](void*) { numInBoxes++; }); }) / NUM_QUERIES;
+	const double rayMs = measure([&]
+	{
+		for (const BoundingBox& box : queryBoxes)
+			bvh.queryRay(box.Center, XMFLOAT3(1.0f, -0.1f, 0.5f), 500.0f, [&](void*, float) { numRayHits++; return 500.0f; });
+	}) / NUM_QUERIES;
+
+	uint32 numInFirstSphere = 0, numInFirstBox = 0, numFirstRayHits = 0;
+	bvh.querySphere(spheres[0], [&](void*) { numInFirstSphere++; });
+	bvh.queryBox(queryBoxes[0], [&](void*) { numInFirstBox++; });
+	bvh.queryRay(queryBoxes[0].Center, XMFLOAT3(1.0f, -0.1f, 0.5f), 500.0f, [&](void*, float) { numFirstRayHits++; return 500.0f; });
+	const XMVECTOR rayOrigin = XMLoadFloat3(&queryBoxes[0].Center);
+	const XMVECTOR rayDirection = XMVector3Normalize(XMVectorSet(1.0f, -0.1f, 0.5f, 0.0f));
+	numMismatches += numInFirstSphere != countBruteForce([&](const BoundingBox& box) { return spheres[0].Intersects(box); });
+	numMismatches += numInFirstBox != countBruteForce([&](const BoundingBox& box) { return queryBoxes[0].Intersects(box); });
+	numMismatches += numFirstRayHits != countBruteForce([&](const BoundingBox& box)
+	{
+		float distance = 0.0f;
+		return box.Contains(rayOrigin) != DISJOINT || (box.Intersects(rayOrigin, rayDirection, distance) && distance <= 500.0f);
+	});
+
+	PLOG_INFO << "Dynamic BVH of " << NUM_OBJECTS << " objects, times in milliseconds. Inserting: " << insertMs << " (height " << insertedHeight
+		<< ", cost " << insertedCost << "), rebuilding: " << rebuildMs << " (height " << bvh.getHeight() << ", cost " << bvh.getCost() << ")";
+	PLOG_INFO << "\tMoving " << NUM_MOVED_PER_FRAME << " objects and updating per frame: " << incrementalMs << ", moving half of them and refitting: " << refitMs;
+	PLOG_INFO << "\tFrustum query: " << frustumMs << " (" << numInFrustum << " objects). Per query, sphere: " << sphereMs << ", box: " << boxMs
+		<< ", ray: " << rayMs << " (" << numInSpheres / NUM_QUERIES << ", " << numInBoxes / NUM_QUERIES << " and " << numRayHits / NUM_QUERIES << " objects on average)";
+	if (numMismatches > 0)
+		PLOG_ERROR << "\t" << numMismatches << " of the queries found different objects than testing all of them";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Dynamic BVH with 100k objects", benchmark_dynamic_bvh);
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <DirectXCollision.h>
+
+#include <Common.h>
+
+#include "Culling.h"
+
+// Bounding volume hierarchy of boxes that can move, for spatial queries without visiting every box. Leaves store fat
+// boxes, enlarged by a margin, so boxes moving a little don't change the tree. A box leaving its fat box expands the
+// nodes above it right away, so queries are always correct, and is reinserted at the next update. Not thread safe,
+// queries can run in parallel only while nothing changes the tree.
+//
+// Leaves are inserted next to the sibling that grows the total surface area the least. Tree rotations on the way up
+// keep it balanced. Updates refit the whole tree instead when many boxes moved, and rebuild it top down when its cost
+// grew too far beyond the cost after the last rebuild.
+//
+//	DynamicBvh::ProxyId proxy = bvh.createProxy(bounds, renderer);
+//	bvh.moveProxy(proxy, newBounds);
+//	bvh.update(); // Once per frame
+//	bvh.queryFrustum(frustum, [](void* user_data) { ... });
+class DynamicBvh
+{
+public:
+	using ProxyId = uint32;
+	static constexpr ProxyId NULL_PROXY = UINT32_MAX;
+
+	// Of the largest extent of a box. Trees of boxes that don't move can do without.
+	explicit DynamicBvh(float fat_margin_fraction = 0.1f) : fatMarginFraction(fat_margin_fraction) {}
+
+	ProxyId createProxy(const BoundingBox& box, void* user_data);
+	void destroyProxy(ProxyId proxy);
+	void moveProxy(ProxyId proxy, const BoundingBox& box);
+	void* getUserData(ProxyId proxy) const { return nodes[proxy].userData; }
+	const BoundingBox& getFatBox(ProxyId proxy) const { return nodes[proxy].box; }
+	void clear();
+
+	void update(); // Reinserts or refits the moved proxies, rebuilds if needed
+	void rebuild();
+	void refit();
+
+	uint32 getNumProxies() const { return numLeaves; }
+	uint32 getHeight() const { return root != NULL_NODE ? nodes[root].height : 0; }
+	float getCost() const; // Total surface area of the internal nodes over the root's
+
+	// Callbacks are called with the user data of proxies whose fat boxes pass the test
+	template <typename F> void queryFrustum(const culling::Frustum& frustum, F&& callback) const;
+	template <typename F> void querySphere(const BoundingSphere& sphere, F&& callback) const;
+	template <typename F> void queryBox(const BoundingBox& box, F&& callback) const;
+
+	// Along the ray up to max_distance. The callback gets the distance to the fat box, and returns the distance the ray
+	// continues to, e.g. the distance of its hit to only look for closer ones.
+	template <typename F> void queryRay(const XMFLOAT3& origin, const XMFLOAT3& direction, float max_distance, F&& callback) const;
+
+private:
+	static constexpr uint32 NULL_NODE = UINT32_MAX;
+	static constexpr uint32 MAX_QUERY_STACK = 256;
+
+	struct Node
+	{
+		BoundingBox box;
+		void* userData = nullptr;
+		uint32 parent = NULL_NODE; // Next free node if the node is free
+		uint32 child1 = NULL_NODE;
+		uint32 child2 = NULL_NODE;
+		uint32 height = 0; // Leaves are 0, free nodes UINT32_MAX
+		bool moved = false;
+
+		bool isLeaf() const { return child1 == NULL_NODE; }
+	};
+
+	uint32 allocateNode();
+	void freeNode(uint32 node);
+	void insertLeaf(uint32 leaf);
+	void removeLeaf(uint32 leaf);
+	void refitAncestors(uint32 node); // With rotations
+	void rotate(uint32 node);
+	void refitSubtree(uint32 node);
+	uint32 buildTopDown(uint32* leaves, uint32 count);
+	BoundingBox getFatBoxOf(const BoundingBox& box) const;
+	template <typename F> void reportSubtree(uint32 node, F& callback) const;
+
+	std::vector<Node> nodes;
+	uint32 root = NULL_NODE;
+	uint32 freeList = NULL_NODE;
+	uint32 numLeaves = 0;
+	std::vector<uint32> movedLeaves;
+	float costAfterRebuild = 0.0f; // Zero until the first rebuild
+	bool changed = false; // Since the last update
+	float fatMarginFraction;
+};
+
+template <typename F>
+void DynamicBvh::reportSubtree(uint32 node, F& callback) const
+{
+	// Everything under a node inside the query, without testing it
+	uint32 stack[MAX_QUERY_STACK];
+	uint32 count = 0;
+	stack[count++] = node;
+	while (count > 0)
+	{
+		const Node& n = nodes[stack[--count]];
+		if (n.isLeaf())
+		{
+			callback(n.userData);
+			continue;
+		}
+		assert(count + 2 <= MAX_QUERY_STACK);
+		stack[count++] = n.child1;
+		stack[count++] = n.child2;
+	}
+}
+
+template <typename F>
+void DynamicBvh::queryFrustum(const culling::Frustum& frustum, F&& callback) const
+{
+	if (root == NULL_NODE)
+		return;
+	uint32 stack[MAX_QUERY_STACK];
+	uint32 count = 0;
+	stack[count++] = root;
+	while (count > 0)
+	{
+		const uint32 node = stack[--count];
+		const Node& n = nodes[node];
+		const culling::Containment containment = culling::classify(frustum, n.box);
+		if (containment == culling::Containment::OUTSIDE)
+			continue;
+		if (containment == culling::Containment::INSIDE || n.isLeaf())
+		{
+			reportSubtree(node, callback);
+			continue;
+		}
+		assert(count + 2 <= MAX_QUERY_STACK);
+		stack[count++] = n.child1;
+		stack[count++] = n.child2;
+	}
+}
+
+template <typename F>
+void DynamicBvh::querySphere(const BoundingSphere& sphere, F&& callback) const
+{
+	if (root == NULL_NODE)
+		return;
+	uint32 stack[MAX_QUERY_STACK];
+	uint32 count = 0;
+	stack[count++] = root;
+	while (count > 0)
+	{
+		const uint32 node = stack[--count];
+		const Node& n = nodes[node];
+		const ContainmentType containment = sphere.Contains(n.box);
+		if (containment == DISJOINT)
+			continue;
+		if (containment == CONTAINS || n.isLeaf())
+		{
+			reportSubtree(node, callback);
+			continue;
+		}
+		assert(count + 2 <= MAX_QUERY_STACK);
+		stack[count++] = n.child1;
+		stack[count++] = n.child2;
+	}
+}
+
+template <typename F>
+void DynamicBvh::queryBox(const BoundingBox& box, F&& callback) const
+{
+	if (root == NULL_NODE)
+		return;
+	uint32 stack[MAX_QUERY_STACK];
+	uint32 count = 0;
+	stack[count++] = root;
+	while (count > 0)
+	{
+		const uint32 node = stack[--count];
+		const Node& n = nodes[node];
+		const ContainmentType containment = box.Contains(n.box);
+		if (containment == DISJOINT)
+			continue;
+		if (containment == CONTAINS || n.isLeaf())
+		{
+			reportSubtree(node, callback);
+			continue;
+		}
+		assert(count + 2 <= MAX_QUERY_STACK);
+		stack[count++] = n.child1;
+		stack[count++] = n.child2;
+	}
+}
+
+template <typename F>
+void DynamicBvh::queryRay(const XMFLOAT3& origin, const XMFLOAT3& direction, float max_distance, F&& callback) const
+{
+	if (root == NULL_NODE)
+		return;
+	const XMVECTOR rayOrigin = XMLoadFloat3(&origin);
+	const XMVECTOR rayDirection = XMVector3Normalize(XMLoadFloat3(&direction));
+	uint32 stack[MAX_QUERY_STACK];
+	uint32 count = 0;
+	stack[count++] = root;
+	while (count > 0)
+	{
+		const Node& n = nodes[stack[--count]];
+		float distance = 0.0f;
+		if (n.box.Contains(rayOrigin) == DISJOINT && (!n.box.Intersects(rayOrigin, rayDirection, distance) || distance > max_distance))
+			continue;
+		if (n.isLeaf())
+		{
+			max_distance = callback(n.userData, distance);
+			continue;
+		}
+		assert(count + 2 <= MAX_QUERY_STACK);
+		stack[count++] = n.child1;
+		stack[count++] = n.child2;
+	}
+}
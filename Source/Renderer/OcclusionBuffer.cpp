@@ -0,0 +1,486 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <memory>
+#include <xmmintrin.h>
+
+#include <Engine/AssetManager.h>
+#include <Engine/MeshRenderer.h>
+#include <Util/AutoImGui.h>
+#include <Util/LinearArena.h>
+#include <Util/ThreadPool.h>
+
+#include "Camera.h"
+#include "Culling.h"
+#include "WorldRenderer.h"
+
+static_assert(OcclusionBuffer::TILE_SIZE % 4 == 0, "Tiles are rasterized four pixels at a time");
+static_assert(OcclusionBuffer::TILE_SIZE >> (OcclusionBuffer::NUM_LEVELS - 1) == 1, "Tiles are reduced to a texel");
+
+static constexpr float MIN_OCCLUDER_SCREEN_SIZE = 0.1f; // Radius of the bounds over the distance to them
+
+OcclusionBuffer::OcclusionBuffer()
+{
+	levels[0] = depth;
+	size_t offset = 0;
+	for (uint32 level = 1; level < NUM_LEVELS; level++)
+	{
+		levels[level] = pyramid + offset;
+		offset += (size_t)(WIDTH >> level) * (HEIGHT >> level);
+	}
+	assert(offset <= std::size(pyramid));
+
+	// Nothing is hidden until the first tiles are rasterized
+	std::fill_n(depth, WIDTH * HEIGHT, 1.0f);
+	std::fill_n(pyramid, std::size(pyramid), 1.0f);
+}
+
+void OcclusionBuffer::begin(const XMMATRIX& view_projection, const XMVECTOR& eye_, uint32 num_chunks)
+{
+	viewProjection = view_projection;
+	eye = eye_;
+	numChunks = num_chunks;
+	if (chunks.size() < num_chunks)
+		chunks.resize(num_chunks);
+	for (uint32 chunk = 0; chunk < num_chunks; chunk++)
+	{
+		chunks[chunk].triangles.clear();
+		for (std::vector<uint32>& tileTriangles : chunks[chunk].tileTriangles)
+			tileTriangles.clear();
+	}
+}
+
+bool OcclusionBuffer::isLargeOnScreen(const BoundingBox& world_box) const
+{
+	const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&world_box.Extents)));
+	const float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&world_box.Center) - eye));
+	return radius >= distance * MIN_OCCLUDER_SCREEN_SIZE;
+}
+
+uint32 OcclusionBuffer::addOccluder(uint32 chunk, const XMMATRIX& world, std::span<const XMFLOAT3> vertices, std::span<const uint32> indices)
+{
+	assert(chunk < numChunks);
+	ChunkBins& bins = chunks[chunk];
+
+	LinearArena& scratch = get_thread_scratch_arena();
+	ArenaScope scope(scratch);
+	XMFLOAT4* clipVertices = scratch.allocate<XMFLOAT4>(vertices.size());
+	XMVector3TransformStream(clipVertices, sizeof(XMFLOAT4), vertices.data(), sizeof(XMFLOAT3), vertices.size(), world * viewProjection);
+
+	uint32 numBinned = 0;
+	for (size_t i = 0; i + 3 <= indices.size(); i += 3)
+	{
+		const XMFLOAT4* triangle[3] = { &clipVertices[indices[i]], &clipVertices[indices[i + 1]], &clipVertices[indices[i + 2]] };
+		const uint32 numInFront = (triangle[0]->z >= 0.0f) + (triangle[1]->z >= 0.0f) + (triangle[2]->z >= 0.0f);
+		if (numInFront == 0)
+			continue;
+		if (numInFront == 3)
+		{
+			numBinned += addTriangle(bins, *triangle[0], *triangle[1], *triangle[2]);
+			continue;
+		}
+
+		// Clipped by the near plane (z = 0 in clip space) to a triangle or a quad
+		XMFLOAT4 polygon[4];
+		uint32 numPolygonVertices = 0;
+		for (uint32 v = 0; v < 3; v++)
+		{
+			const XMFLOAT4& a = *triangle[v];
+			const XMFLOAT4& b = *triangle[(v + 1) % 3];
+			if (a.z >= 0.0f)
+				polygon[numPolygonVertices++] = a;
+			if ((a.z >= 0.0f) != (b.z >= 0.0f))
+				XMStoreFloat4(&polygon[numPolygonVertices++], XMVectorLerp(XMLoadFloat4(&a), XMLoadFloat4(&b), a.z / (a.z - b.z)));
+		}
+		numBinned += addTriangle(bins, polygon[0], polygon[1], polygon[2]);
+		if (numPolygonVertices == 4)
+			numBinned += addTriangle(bins, polygon[0], polygon[2], polygon[3]);
+	}
+	return numBinned;
+}
+
+bool OcclusionBuffer::addTriangle(ChunkBins& bins, const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2)
+{
+	// To pixels, rows from the top
+	const XMFLOAT4* clip[3] = { &v0, &v1, &v2 };
+	float x[3], y[3], z[3];
+	for (uint32 v = 0; v < 3; v++)
+	{
+		const float invW = 1.0f / clip[v]->w;
+		x[v] = (clip[v]->x * invW * 0.5f + 0.5f) * WIDTH;
+		y[v] = (0.5f - clip[v]->y * invW * 0.5f) * HEIGHT;
+		z[v] = clip[v]->z * invW;
+	}
+
+	// Back facing or degenerate
+	const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area <= 0.0f)
+		return false;
+
+	// Pixel centers within the bounds of the triangle
+	const float minX = std::max(ceilf(std::min({ x[0], x[1], x[2] }) - 0.5f), 0.0f);
+	const float maxX = std::min(floorf(std::max({ x[0], x[1], x[2] }) - 0.5f), WIDTH - 1.0f);
+	const float minY = std::max(ceilf(std::min({ y[0], y[1], y[2] }) - 0.5f), 0.0f);
+	const float maxY = std::min(floorf(std::max({ y[0], y[1], y[2] }) - 0.5f), HEIGHT - 1.0f);
+	if (minX > maxX || minY > maxY)
+		return false;
+
+	// Edge i goes from vertex i to the next one, the vertex opposite of it weighs its depth
+	Triangle triangle;
+	float depthWeightA[3], depthWeightB[3], depthWeightC[3];
+	for (uint32 e = 0; e < 3; e++)
+	{
+		const uint32 next = (e + 1) % 3;
+		triangle.edgeA[e] = y[e] - y[next];
+		triangle.edgeB[e] = x[next] - x[e];
+		triangle.edgeC[e] = x[e] * y[next] - x[next] * y[e];
+		const float opposite = z[(e + 2) % 3] / area;
+		depthWeightA[e] = triangle.edgeA[e] * opposite;
+		depthWeightB[e] = triangle.edgeB[e] * opposite;
+		depthWeightC[e] = triangle.edgeC[e] * opposite;
+	}
+	triangle.depthA = depthWeightA[0] + depthWeightA[1] + depthWeightA[2];
+	triangle.depthB = depthWeightB[0] + depthWeightB[1] + depthWeightB[2];
+	triangle.depthC = depthWeightC[0] + depthWeightC[1] + depthWeightC[2];
+	triangle.minX = (int32)minX;
+	triangle.minY = (int32)minY;
+	triangle.maxX = (int32)maxX;
+	triangle.maxY = (int32)maxY;
+
+	const uint32 index = (uint32)bins.triangles.size();
+	bins.triangles.push_back(triangle);
+	for (int32 tileY = triangle.minY / (int32)TILE_SIZE; tileY <= triangle.maxY / (int32)TILE_SIZE; tileY++)
+		for (int32 tileX = triangle.minX / (int32)TILE_SIZE; tileX <= triangle.maxX / (int32)TILE_SIZE; tileX++)
+			bins.tileTriangles[tileY * NUM_TILES_X + tileX].push_back(index);
+	return true;
+}
+
+void OcclusionBuffer::rasterizeTile(uint32 tile)
+{
+	assert(tile < NUM_TILES);
+	const uint32 tileX = tile % NUM_TILES_X;
+	const uint32 tileY = tile / NUM_TILES_X;
+	const int32 tileMinX = tileX * TILE_SIZE;
+	const int32 tileMinY = tileY * TILE_SIZE;
+	const int32 tileMaxX = tileMinX + TILE_SIZE - 1;
+	const int32 tileMaxY = tileMinY + TILE_SIZE - 1;
+
+	const __m128 farDepth = _mm_set1_ps(1.0f);
+	for (int32 y = tileMinY; y <= tileMaxY; y++)
+		for (int32 x = tileMinX; x <= tileMaxX; x += 4)
+			_mm_store_ps(depth + y * WIDTH + x, farDepth);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 pixelCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	for (uint32 chunk = 0; chunk < numChunks; chunk++)
+	{
+		const ChunkBins& bins = chunks[chunk];
+		for (uint32 index : bins.tileTriangles[tile])
+		{
+			const Triangle& triangle = bins.triangles[index];
+			const int32 minX = std::max(triangle.minX, tileMinX) & ~3;
+			const int32 maxX = std::min(triangle.maxX, tileMaxX);
+			const int32 minY = std::max(triangle.minY, tileMinY);
+			const int32 maxY = std::min(triangle.maxY, tileMaxY);
+
+			const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+			const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+			const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+			const __m128 depthA = _mm_set1_ps(triangle.depthA);
+			for (int32 y = minY; y <= maxY; y++)
+			{
+				// Edges and depth at the start of the row, only x changes along it
+				const float centerY = y + 0.5f;
+				const __m128 rowEdge0 = _mm_set1_ps(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+				const __m128 rowEdge1 = _mm_set1_ps(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+				const __m128 rowEdge2 = _mm_set1_ps(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+				const __m128 rowDepth = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+				float* row = depth + y * WIDTH;
+				for (int32 x = minX; x <= maxX; x += 4)
+				{
+					const __m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), pixelCenters);
+					__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, centerX), rowEdge0), zero);
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, centerX), rowEdge1), zero));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, centerX), rowEdge2), zero));
+					if (_mm_movemask_ps(inside) == 0)
+						continue;
+
+					const __m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthA, centerX), rowDepth);
+					const __m128 oldDepth = _mm_load_ps(row + x);
+					const __m128 newDepth = _mm_min_ps(oldDepth, pixelDepth);
+					_mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, newDepth), _mm_andnot_ps(inside, oldDepth)));
+				}
+			}
+		}
+	}
+
+	buildDepthPyramid(tileX, tileY);
+}
+
+void OcclusionBuffer::buildDepthPyramid(uint32 tile_x, uint32 tile_y)
+{
+	// Tiles are reduced on their own, each texel of a level is the farthest of the four below it
+	for (uint32 level = 1; level < NUM_LEVELS; level++)
+	{
+		const uint32 sourceWidth = WIDTH >> (level - 1);
+		const uint32 width = WIDTH >> level;
+		const uint32 size = TILE_SIZE >> level;
+		const float* source = levels[level - 1];
+		float* destination = levels[level];
+		for (uint32 y = tile_y * size; y < (tile_y + 1) * size; y++)
+		{
+			for (uint32 x = tile_x * size; x < (tile_x + 1) * size; x++)
+			{
+				const float* texels = source + 2 * y * sourceWidth + 2 * x;
+				destination[y * width + x] = std::max(std::max(texels[0], texels[1]), std::max(texels[sourceWidth], texels[sourceWidth + 1]));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::isVisible(const BoundingBox& world_box) const
+{
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	world_box.GetCorners(corners);
+	XMVECTOR minCorner = XMVectorReplicate(FLT_MAX);
+	XMVECTOR maxCorner = XMVectorReplicate(-FLT_MAX);
+	for (const XMFLOAT3& corner : corners)
+	{
+		const XMVECTOR clip = XMVector3Transform(XMLoadFloat3(&corner), viewProjection);
+		if (XMVectorGetZ(clip) < 0.0f)
+			return true;
+		const XMVECTOR projected = clip / XMVectorSplatW(clip);
+		minCorner = XMVectorMin(minCorner, projected);
+		maxCorner = XMVectorMax(maxCorner, projected);
+	}
+
+	// Pixels the rect of the box touches, rows from the top
+	const float minX = (XMVectorGetX(minCorner) * 0.5f + 0.5f) * WIDTH;
+	const float maxX = (XMVectorGetX(maxCorner) * 0.5f + 0.5f) * WIDTH;
+	const float minY = (0.5f - XMVectorGetY(maxCorner) * 0.5f) * HEIGHT;
+	const float maxY = (0.5f - XMVectorGetY(minCorner) * 0.5f) * HEIGHT;
+	if (maxX < 0.0f || minX >= WIDTH || maxY < 0.0f || minY >= HEIGHT)
+		return true;
+	const int32 pixelMinX = (int32)std::max(minX, 0.0f);
+	const int32 pixelMaxX = (int32)std::min(maxX, WIDTH - 1.0f);
+	const int32 pixelMinY = (int32)std::max(minY, 0.0f);
+	const int32 pixelMaxY = (int32)std::min(maxY, HEIGHT - 1.0f);
+
+	// Level where the rect spans at most four texels per side, or the last one
+	uint32 level = 0;
+	while (level < NUM_LEVELS - 1 && ((pixelMaxX >> level) - (pixelMinX >> level) >= 4 || (pixelMaxY >> level) - (pixelMinY >> level) >= 4))
+		level++;
+
+	// Hidden if every texel has an occluder nearer than the nearest point of the box
+	const float boxMinDepth = XMVectorGetZ(minCorner);
+	const uint32 width = WIDTH >> level;
+	const float* texels = levels[level];
+	for (int32 y = pixelMinY >> level; y <= pixelMaxY >> level; y++)
+		for (int32 x = pixelMinX >> level; x <= pixelMaxX >> level; x++)
+			if (texels[y * width + x] >= boxMinDepth)
+				return true;
+	return false;
+}
+
+uint32 OcclusionBuffer::getNumTriangles() const
+{
+	uint32 numTriangles = 0;
+	for (uint32 chunk = 0; chunk < numChunks; chunk++)
+		numTriangles += (uint32)chunks[chunk].triangles.size();
+	return numTriangles;
+}
+
+// Occluders and boxes placed where their pixels are known, so it needs neither a scene nor the driver. The camera looks
+// along z from the origin. At a depth of 12 a unit is 8 pixels, with the center of the view at pixel (160, 96).
+static void test_occlusion_buffer()
+{
+	const XMMATRIX viewProjection = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+		* XMMatrixPerspectiveFovLH(XM_PIDIV2, (float)OcclusionBuffer::WIDTH / OcclusionBuffer::HEIGHT, 0.1f, 100.0f);
+	constexpr float OCCLUDER_Z = 12.0f;
+	const float occluderDepth = XMVectorGetZ(XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, OCCLUDER_Z, 1.0f), viewProjection));
+
+	// Quads facing the camera, a chunk each
+	struct Quad
+	{
+		float minX, minY, maxX, maxY;
+	};
+	static const Quad OCCLUDERS[] =
+	{
+		{ -30.0f, -15.0f, -4.0f, 15.0f }, // Columns 0 to 127 of all rows, the first four columns of tiles
+		{ 4.0f, -3.0f, 9.0f, 2.0f }, // Pixels 192 to 231 by 80 to 119, parts of four tiles
+	};
+	static const uint32 QUAD_INDICES[] = { 0, 1, 2, 0, 2, 3 };
+
+	std::unique_ptr<OcclusionBuffer> buffer = std::make_unique<OcclusionBuffer>();
+	buffer->begin(viewProjection, XMVectorZero(), (uint32)std::size(OCCLUDERS));
+	for (uint32 i = 0; i < (uint32)std::size(OCCLUDERS); i++)
+	{
+		const Quad& quad = OCCLUDERS[i];
+		const XMFLOAT3 vertices[] = { { quad.minX, quad.minY, OCCLUDER_Z }, { quad.minX, quad.maxY, OCCLUDER_Z }, { quad.maxX, quad.maxY, OCCLUDER_Z }, { quad.maxX, quad.minY, OCCLUDER_Z } };
+		buffer->addOccluder(i, XMMatrixIdentity(), vertices, QUAD_INDICES);
+	}
+	for (uint32 tile = 0; tile < OcclusionBuffer::NUM_TILES; tile++)
+		buffer->rasterizeTile(tile);
+
+	int numFailures = 0;
+	auto check = [&numFailures](bool passed, const char* what)
+	{
+		if (passed)
+			return;
+		PLOG_ERROR << "Occlusion buffer test: " << what;
+		numFailures++;
+	};
+	auto texel = [&buffer](uint32 level, uint32 x, uint32 y) { return buffer->getLevel(level)[y * (OcclusionBuffer::WIDTH >> level) + x]; };
+	auto isOccluderDepth = [occluderDepth](float depth) { return fabsf(depth - occluderDepth) < 1e-5f; };
+
+	check(buffer->getNumTriangles() == 4, "All triangles of the occluders are binned");
+	check(isOccluderDepth(texel(0, 0, 0)) && isOccluderDepth(texel(0, 127, 191)) && texel(0, 128, 96) == 1.0f,
+		"The large occluder covers the pixels up to its edge");
+	check(isOccluderDepth(texel(0, 192, 80)) && isOccluderDepth(texel(0, 231, 119)) && texel(0, 191, 100) == 1.0f && texel(0, 232, 100) == 1.0f
+		&& texel(0, 200, 79) == 1.0f && texel(0, 200, 120) == 1.0f, "The small occluder covers its pixels");
+	check(isOccluderDepth(texel(3, 25, 12)), "Texels of a level inside the small occluder have its depth");
+	for (uint32 level = 1; level < OcclusionBuffer::NUM_LEVELS; level++)
+	{
+		bool farthest = true;
+		for (uint32 y = 0; y < OcclusionBuffer::HEIGHT >> level; y++)
+			for (uint32 x = 0; x < OcclusionBuffer::WIDTH >> level; x++)
+				farthest &= texel(level, x, y) == std::max(std::max(texel(level - 1, 2 * x, 2 * y), texel(level - 1, 2 * x + 1, 2 * y)),
+					std::max(texel(level - 1, 2 * x, 2 * y + 1), texel(level - 1, 2 * x + 1, 2 * y + 1)));
+		check(farthest, "Texels of the pyramid are the farthest of the four below them");
+	}
+	bool tilesCovered = true;
+	for (uint32 y = 0; y < OcclusionBuffer::NUM_TILES_Y; y++)
+		for (uint32 x = 0; x < OcclusionBuffer::NUM_TILES_X; x++)
+			tilesCovered &= x < 4 ? isOccluderDepth(texel(OcclusionBuffer::NUM_LEVELS - 1, x, y)) : texel(OcclusionBuffer::NUM_LEVELS - 1, x, y) == 1.0f;
+	check(tilesCovered, "Only tiles covered whole by an occluder are nearer in the last level");
+
+	struct BoxCase
+	{
+		const char* name;
+		XMFLOAT3 center;
+		XMFLOAT3 extents;
+		bool visible;
+	};
+	static const BoxCase BOXES[] =
+	{
+		{ "A box behind the large occluder is hidden", { -16.0f, 0.0f, 30.0f }, { 2.0f, 2.0f, 2.0f }, false },
+		{ "A box in front of the large occluder is visible", { -4.0f, 0.0f, 6.0f }, { 1.0f, 1.0f, 1.0f }, true },
+		{ "A box partly covered by the large occluder is visible", { -10.0f, 0.0f, 30.0f }, { 2.0f, 2.0f, 2.0f }, true },
+		{ "A box behind the small occluder is hidden", { 12.5f, -1.0f, 24.0f }, { 2.5f, 2.0f, 1.0f }, false },
+		{ "A box above the small occluder is visible", { 12.5f, 8.0f, 24.0f }, { 2.5f, 2.0f, 1.0f }, true },
+		{ "A box crossing the near plane is visible", { -12.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, true },
+	};
+	for (const BoxCase& box : BOXES)
+		check(buffer->isVisible(BoundingBox(box.center, box.extents)) == box.visible, box.name);
+
+	if (numFailures == 0)
+		PLOG_INFO << "Occlusion buffer test passed. " << std::size(BOXES) << " boxes tested against " << std::size(OCCLUDERS) << " occluders.";
+	else
+		PLOG_ERROR << "Occlusion buffer test failed with " << numFailures << " failures.";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Occlusion buffer test", test_occlusion_buffer);
+
+// Occlusion culling of the submeshes of the scene from views of sponza, with a buffer of its own. Runs on the main thread,
+// the occluders and submesh bounds of renderers don't change once they're loaded.
+static void benchmark_occlusion_culling()
+{
+	struct BenchmarkView
+	{
+		const char* name;
+		XMFLOAT3 eye;
+		float pitch; // Degrees
+		float yaw;
+	};
+	static const BenchmarkView VIEWS[] =
+	{
+		{ "Scene camera", { -9.0f, 2.0f, -0.5f }, 0.0f, 80.0f },
+		{ "Nave from the east", { 9.0f, 2.0f, -0.5f }, 0.0f, -100.0f },
+		{ "Across the nave", { 0.0f, 1.7f, 0.0f }, 0.0f, 0.0f },
+		{ "Side aisle", { -10.0f, 1.7f, 4.5f }, 0.0f, 90.0f },
+		{ "Gallery", { 0.0f, 6.5f, -4.5f }, 20.0f, 60.0f },
+	};
+	constexpr int NUM_ITERATIONS = 50;
+
+	const std::vector<MeshRenderer*>& renderers = am->getSceneMeshRenderers();
+	const uint32 numRenderers = (uint32)renderers.size();
+	if (numRenderers == 0)
+	{
+		PLOG_WARNING << "Occlusion culling benchmark needs the sponza scene, nothing is loaded";
+		return;
+	}
+	std::unique_ptr<OcclusionBuffer> buffer = std::make_unique<OcclusionBuffer>();
+	Camera camera = wr->getSceneCamera();
+
+	PLOG_INFO << "Occlusion culling of " << numRenderers << " renderers, " << NUM_ITERATIONS << " iterations per view. Times in milliseconds:";
+	for (const BenchmarkView& view : VIEWS)
+	{
+		camera.SetEye(XMLoadFloat3(&view.eye));
+		camera.SetRotation(to_rad(view.pitch), to_rad(view.yaw));
+		const XMMATRIX viewProjection = camera.GetViewMatrix() * camera.GetProjectionMatrix();
+		const culling::Frustum frustum = culling::make_frustum(viewProjection);
+
+		double addMs = 0, rasterizeMs = 0, testMs = 0;
+		std::atomic<uint32> numSubmeshesInFrustum = 0;
+		std::atomic<uint32> numOccludedSubmeshes = 0;
+		for (int i = 0; i < NUM_ITERATIONS; i++)
+		{
+			numSubmeshesInFrustum = 0;
+			numOccludedSubmeshes = 0;
+			auto startTime = std::chrono::high_resolution_clock::now();
+
+			// A chunk per renderer
+			buffer->begin(viewProjection, camera.GetEye(), numRenderers);
+			tp->parallelFor(0, numRenderers, 1, [&](uint32 begin, uint32 end)
+			{
+				for (uint32 r = begin; r < end; r++)
+					if (renderers[r]->isEnabled())
+						renderers[r]->addOccluders(*buffer, r, renderers[r]->getTransformMatrix(), frustum, MeshRenderer::NO_VIEW);
+			});
+			auto addedTime = std::chrono::high_resolution_clock::now();
+
+			tp->parallelFor(0, OcclusionBuffer::NUM_TILES, 1, [&](uint32 begin, uint32 end)
+			{
+				for (uint32 tile = begin; tile < end; tile++)
+					buffer->rasterizeTile(tile);
+			});
+			auto rasterizedTime = std::chrono::high_resolution_clock::now();
+
+			tp->parallelFor(0, numRenderers, 1, [&](uint32 begin, uint32 end)
+			{
+				for (uint32 r = begin; r < end; r++)
+				{
+					const MeshRenderer& mr = *renderers[r];
+					if (!mr.isEnabled())
+						continue;
+					for (uint32 s = 0; s < mr.getNumSubmeshes(); s++)
+					{
+						const BoundingBox bounds = culling::transform_box(mr.getSubmeshBounds(s), mr.getTransformMatrix());
+						if (!culling::is_visible(frustum, bounds))
+							continue;
+						numSubmeshesInFrustum++;
+						if (!buffer->isVisible(bounds))
+							numOccludedSubmeshes++;
+					}
+				}
+			});
+			auto testedTime = std::chrono::high_resolution_clock::now();
+
+			addMs += (addedTime - startTime).count() / 1e6 / NUM_ITERATIONS;
+			rasterizeMs += (rasterizedTime - addedTime).count() / 1e6 / NUM_ITERATIONS;
+			testMs += (testedTime - rasterizedTime).count() / 1e6 / NUM_ITERATIONS;
+		}
+
+		PLOG_INFO << "\t" << view.name << ". " << buffer->getNumTriangles() << " occluder triangles, " << numOccludedSubmeshes << " of "
+			<< numSubmeshesInFrustum << " submeshes in the frustum occluded. Adding occluders: " << addMs << ", rasterizing: "
+			<< rasterizeMs << ", testing submeshes: " << testMs;
+	}
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Occlusion culling of sponza views", benchmark_occlusion_culling);
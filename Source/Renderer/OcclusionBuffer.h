@@ -0,0 +1,87 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <DirectXCollision.h>
+
+#include <Common.h>
+
+// Low resolution depth buffer of the occluders of a view, rasterized on the CPU, to test the bounds of objects against
+// before drawing them. It doesn't use the driver, so it can be run and measured without rendering anything. Big, so it
+// should be allocated on the heap.
+//
+// Occluder triangles are transformed and binned to screen tiles by chunk jobs, then each tile is rasterized by its own
+// job, four pixels at a time, and reduced to the levels of a max depth pyramid. Boxes are tested against the level where
+// they cover a few texels. Occluders only write where their triangles cover pixel centers, so a box is only reported
+// hidden if all of its rect is covered by nearer occluders.
+//
+//	buffer.begin(viewProjection, eye, numChunks);
+//	buffer.addOccluder(chunk, world, vertices, indices);  // Chunk jobs
+//	buffer.rasterizeTile(tile);                           // Tile jobs, after all chunks
+//	buffer.isVisible(worldBounds);                        // After all tiles
+class OcclusionBuffer
+{
+public:
+	static constexpr uint32 WIDTH = 320;
+	static constexpr uint32 HEIGHT = 192;
+	static constexpr uint32 TILE_SIZE = 32;
+	static constexpr uint32 NUM_TILES_X = WIDTH / TILE_SIZE;
+	static constexpr uint32 NUM_TILES_Y = HEIGHT / TILE_SIZE;
+	static constexpr uint32 NUM_TILES = NUM_TILES_X * NUM_TILES_Y;
+	static constexpr uint32 NUM_LEVELS = 6; // Of the depth pyramid, the last one has a texel per tile
+
+	OcclusionBuffer();
+
+	// Before the jobs. Chunks are the ones occluders are added from, each chunk only from one job at a time.
+	void begin(const XMMATRIX& view_projection, const XMVECTOR& eye, uint32 num_chunks);
+
+	// Occluders far away compared to their size cover too few texels to be worth rasterizing
+	bool isLargeOnScreen(const BoundingBox& world_box) const;
+
+	// Triangles of the indices are front facing if they are clockwise on screen, like the rasterizer culls them. Returns
+	// the number of triangles binned, the ones not culled or clipped away.
+	uint32 addOccluder(uint32 chunk, const XMMATRIX& world, std::span<const XMFLOAT3> vertices, std::span<const uint32> indices);
+
+	void rasterizeTile(uint32 tile); // Also builds the depth pyramid of the tile
+	bool isVisible(const BoundingBox& world_box) const; // Conservative, boxes crossing the near plane are visible
+
+	uint32 getNumTriangles() const; // Binned since begin
+	const float* getDepth() const { return levels[0]; } // WIDTH x HEIGHT, rows from the top, 1 where nothing was drawn
+	const float* getLevel(uint32 level) const { return levels[level]; } // Of the depth pyramid, WIDTH >> level wide
+
+private:
+	// Edge functions are positive inside, depth is a plane in screen space. Pixel bounds are inclusive.
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int32 minX;
+		int32 minY;
+		int32 maxX;
+		int32 maxY;
+	};
+
+	// Kept between frames, so the vectors stop allocating once they have grown
+	struct ChunkBins
+	{
+		std::vector<Triangle> triangles;
+		std::vector<uint32> tileTriangles[NUM_TILES];
+	};
+
+	bool addTriangle(ChunkBins& bins, const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2);
+	void buildDepthPyramid(uint32 tile_x, uint32 tile_y);
+
+	XMMATRIX viewProjection = XMMatrixIdentity();
+	XMVECTOR eye = XMVectorZero();
+	std::vector<ChunkBins> chunks;
+	uint32 numChunks = 0;
+
+	alignas(16) float depth[WIDTH * HEIGHT];
+	alignas(16) float pyramid[WIDTH * HEIGHT / 3]; // Levels after the first one, each a quarter of the previous
+	float* levels[NUM_LEVELS] = {};
+};
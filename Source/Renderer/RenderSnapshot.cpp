@@ -0,0 +1,50 @@
+#include "RenderSnapshot.h"
+
+static uint64 hash_bytes(uint64 hash, const void* data, size_t size)
+{
+	// FNV-1a
+	const uint8* bytes = (const uint8*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+template <typename T>
+static uint64 hash_value(uint64 hash, const T& value)
+{
+	return hash_bytes(hash, &value, sizeof(value));
+}
+
+uint64 RenderSnapshot::hash() const
+{
+	uint64 h = 0xcbf29ce484222325ull;
+	h = hash_value(h, frameIndex);
+	h = hash_value(h, time);
+	h = hash_value(h, frameCount);
+	h = hash_value(h, camera.GetViewMatrix());
+	h = hash_value(h, camera.GetProjectionMatrix());
+	h = hash_value(h, mainLight.GetColor());
+	h = hash_value(h, mainLight.GetIntensity());
+	h = hash_value(h, mainLight.GetYaw());
+	h = hash_value(h, mainLight.GetPitch());
+	h = hash_value(h, mainLightEnabled);
+	h = hash_value(h, shadowEnabled);
+	h = hash_value(h, shadowDistance);
+	for (const ObjectSnapshot& object : objects)
+	{
+		h = hash_value(h, object.world);
+		h = hash_value(h, object.uvScale);
+		h = hash_value(h, object.enabled);
+		h = hash_value(h, object.isStatic);
+	}
+	for (const MaterialSnapshot& material : materials)
+		h = hash_value(h, material.constants);
+	h = hash_value(h, objectsCulled);
+	h = hash_value(h, viewObjects.size());
+	for (uint32 index : viewObjects)
+		h = hash_value(h, index);
+	h = hash_value(h, shadowCasterObjects.size());
+	for (uint32 index : shadowCasterObjects)
+		h = hash_value(h, index);
+	return h;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include <Common.h>
+
+#include "Camera.h"
+#include "ConstantBuffers.h"
+#include "Light.h"
+
+class MeshRenderer;
+class Material;
+
+struct ObjectSnapshot
+{
+	MeshRenderer* renderer;
+	XMMATRIX world;
+	float uvScale;
+	bool enabled;
+	bool isStatic;
+};
+
+struct MaterialSnapshot
+{
+	Material* material;
+	PerMaterialConstantBufferData constants;
+};
+
+// Scene state of one frame, captured by the main thread and only read while rendering, so the main thread can simulate
+// the next frame meanwhile. Renderers and materials are only referenced: those are created and deleted by the main
+// thread while nothing is being rendered.
+struct RenderSnapshot
+{
+	uint64 frameIndex = 0;
+	float time = 0;
+	unsigned int frameCount = 0;
+	Camera camera;
+	Light mainLight;
+	bool mainLightEnabled = true;
+	bool shadowEnabled = true;
+	float shadowDistance = 0;
+	std::vector<ObjectSnapshot> objects;
+	std::vector<MaterialSnapshot> materials;
+
+	// Sorted indices of the objects the scene tree found in the camera's view and in the volume of the shadow casters,
+	// if objectsCulled. Otherwise every object is culled one by one.
+	bool objectsCulled = false;
+	std::vector<uint32> viewObjects;
+	std::vector<uint32> shadowCasterObjects;
+
+	// Of the captured values, pointers excluded, so the same scene state hashes the same in any run
+	uint64 hash() const;
+};
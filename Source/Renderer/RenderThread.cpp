@@ -0,0 +1,212 @@
+#include "RenderThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include <3rdParty/imgui/imgui.h>
+#include <Util/AutoImGui.h>
+#include <Util/JobTelemetry.h>
+
+// Weight of the latest frame in the averaged stats
+static constexpr float STATS_SMOOTHING = 0.05f;
+
+RenderThread::RenderThread(RenderFunc render_func, bool threaded) : renderFunc(std::move(render_func))
+{
+	if (threaded)
+		thread = std::thread(&RenderThread::loop, this);
+}
+
+RenderThread::~RenderThread()
+{
+	if (!isThreaded())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	submitted.notify_one();
+	thread.join();
+}
+
+void RenderThread::submit()
+{
+	RenderSnapshot& snapshot = snapshots[backIndex];
+	snapshot.frameIndex = numSubmittedFrames++;
+
+	if (!isThreaded())
+	{
+		backIndex = 1 - backIndex;
+		renderFunc(snapshot);
+		return;
+	}
+
+	// The other snapshot becomes the back one, so it must not be rendered anymore
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		rendered.wait(lock, [this] { return pendingSnapshot == nullptr; });
+		pendingSnapshot = &snapshot;
+	}
+	backIndex = 1 - backIndex;
+	submitted.notify_one();
+	submitNs = job_telemetry::now_ns();
+}
+
+void RenderThread::waitIdle()
+{
+	if (!isThreaded())
+		return;
+
+	const int64 callNs = job_telemetry::now_ns();
+	std::unique_lock<std::mutex> lock(mutex);
+	const bool rendering = pendingSnapshot != nullptr;
+	rendered.wait(lock, [this] { return pendingSnapshot == nullptr; });
+	if (submitNs < 0)
+		return;
+
+	// Main thread work overlapped rendering until it finished or until now, whichever came first
+	const int64 overlapNs = (rendering ? callNs : renderFinishedNs) - submitNs;
+	const int64 waitNs = rendering ? job_telemetry::now_ns() - callNs : 0;
+	overlapMs += (std::max<int64>(overlapNs, 0) / 1e6f - overlapMs) * STATS_SMOOTHING;
+	waitMs += (waitNs / 1e6f - waitMs) * STATS_SMOOTHING;
+	submitNs = -1;
+}
+
+void RenderThread::gui()
+{
+	if (!isThreaded())
+	{
+		ImGui::Text("Rendering inline on the main thread");
+		return;
+	}
+	ImGui::Text("Main thread overlapping rendering: %.2f ms", overlapMs);
+	ImGui::Text("Main thread waiting for rendering: %.2f ms", waitMs);
+}
+
+void RenderThread::loop()
+{
+	job_telemetry::set_thread_name("Render thread");
+	while (true)
+	{
+		const RenderSnapshot* snapshot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			submitted.wait(lock, [this] { return pendingSnapshot != nullptr || quit; });
+			if (pendingSnapshot == nullptr)
+				return; // Quit only once the last submitted snapshot is rendered
+			snapshot = pendingSnapshot;
+		}
+
+		{
+			JOB_SPAN("Render frame");
+			renderFunc(*snapshot);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pendingSnapshot = nullptr;
+			renderFinishedNs = job_telemetry::now_ns();
+		}
+		rendered.notify_all();
+	}
+}
+
+// The main thread simulates a fake scene and submits snapshots of it, capturing the next one while the previous is
+// being rendered. Rendering checks that its snapshot doesn't change meanwhile, and the hashes of all rendered
+// snapshots have to match rendering inline, one frame after the other. Nothing is drawn, so no scene is needed.
+static void test_render_snapshot_handoff()
+{
+	constexpr int NUM_FRAMES = 1000;
+	constexpr int NUM_OBJECTS = 256;
+	constexpr int NUM_MATERIALS = 16;
+
+	struct TestScene
+	{
+		float time = 0;
+		unsigned int frameCount = 0;
+		Camera camera;
+		Light light;
+		std::vector<XMMATRIX> worlds = std::vector<XMMATRIX>(NUM_OBJECTS, XMMatrixIdentity());
+		std::vector<PerMaterialConstantBufferData> materials = std::vector<PerMaterialConstantBufferData>(NUM_MATERIALS);
+
+		void simulate(float delta_time)
+		{
+			time += delta_time;
+			frameCount++;
+			camera.MoveEye(XMVectorSet(0.1f, 0.0f, 0.05f, 0.0f));
+			camera.Rotate(0.01f, 0.02f);
+			light.SetRotation(time * 0.1f, 0.5f + 0.2f * sinf(time));
+			light.SetIntensity(1.0f + sinf(time));
+			for (int i = 0; i < NUM_OBJECTS; i++)
+				worlds[i] = XMMatrixRotationY(time + i) * XMMatrixTranslation((float)i, sinf(time * i), 0.0f);
+			for (int m = 0; m < NUM_MATERIALS; m++)
+			{
+				materials[m].materialColor = XMFLOAT4(sinf(time + m), cosf(time + m), 0.5f, 1.0f);
+				materials[m].materialParams0 = XMFLOAT4(time, (float)m, 0.0f, 1.0f);
+			}
+		}
+
+		void capture(RenderSnapshot& out_snapshot) const
+		{
+			out_snapshot.time = time;
+			out_snapshot.frameCount = frameCount;
+			out_snapshot.camera = camera;
+			out_snapshot.mainLight = light;
+			out_snapshot.mainLightEnabled = frameCount % 3 != 0;
+			out_snapshot.objects.clear();
+			for (int i = 0; i < NUM_OBJECTS; i++)
+				out_snapshot.objects.push_back({ nullptr, worlds[i], 1.0f + i, (frameCount + i) % 5 != 0 });
+			out_snapshot.materials.clear();
+			for (const PerMaterialConstantBufferData& constants : materials)
+				out_snapshot.materials.push_back({ nullptr, constants });
+		}
+	};
+
+	auto run = [](bool threaded, std::vector<uint64>& out_hashes)
+	{
+		int numFailures = 0; // Only written while rendering
+		out_hashes.assign(NUM_FRAMES, 0);
+		std::mt19937 rng(1);
+		{
+			RenderThread renderThread([&](const RenderSnapshot& snapshot)
+			{
+				const uint64 hash = snapshot.hash();
+				if (rng() % 4 == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200));
+				else
+					std::this_thread::yield();
+				if (snapshot.hash() != hash || snapshot.frameIndex >= NUM_FRAMES || out_hashes[snapshot.frameIndex] != 0)
+					numFailures++;
+				else
+					out_hashes[snapshot.frameIndex] = hash;
+			}, threaded);
+
+			TestScene scene;
+			for (int frame = 0; frame < NUM_FRAMES; frame++)
+			{
+				scene.capture(renderThread.getBackSnapshot());
+				renderThread.submit();
+				scene.simulate(1.0f / 60.0f);
+			}
+		}
+		return numFailures;
+	};
+
+	std::vector<uint64> inlineHashes, threadedHashes;
+	int numFailures = run(false, inlineHashes);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	numFailures += run(true, threadedHashes);
+	auto finishTime = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < NUM_FRAMES; frame++)
+		if (threadedHashes[frame] != inlineHashes[frame])
+			numFailures++;
+
+	if (numFailures == 0)
+		PLOG_INFO << "Render snapshot handoff test passed. " << NUM_FRAMES << " snapshots rendered on a separate thread in "
+			<< (finishTime - startTime).count() / 1e6 << " ms matched rendering them inline.";
+	else
+		PLOG_ERROR << "Render snapshot handoff test failed with " << numFailures << " failures.";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Render snapshot handoff test", test_render_snapshot_handoff);
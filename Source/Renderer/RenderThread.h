@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <Common.h>
+
+#include "RenderSnapshot.h"
+
+// Renders snapshots of the scene, either on its own thread or inline on the calling thread. The main thread captures
+// into the back snapshot and submits it, then it's free to work on the next frame while the submitted one renders:
+//
+//	handleInput(); // Overlaps rendering, as long as it only changes what's captured
+//	renderThread.waitIdle(); // Before touching anything rendering reads, apart from the snapshots
+//	capture(renderThread.getBackSnapshot());
+//	renderThread.submit();
+//	simulate(); // Overlaps rendering
+//
+// At most one snapshot is rendered at a time, submit waits for the previous one to finish. How much of the main thread's
+// work overlaps rendering is measured between submit and the next waitIdle.
+class RenderThread
+{
+public:
+	using RenderFunc = std::function<void(const RenderSnapshot& snapshot)>;
+
+	RenderThread(RenderFunc render_func, bool threaded);
+	~RenderThread(); // Waits for the submitted snapshot to be rendered
+
+	RenderSnapshot& getBackSnapshot() { return snapshots[backIndex]; } // Main thread only
+	void submit(); // Renders the back snapshot, and swaps the two snapshots
+	void waitIdle();
+
+	bool isThreaded() const { return thread.joinable(); }
+
+	// Averaged over recent frames, in milliseconds. Overlap is main thread time after submit while the frame was still
+	// rendering, including sleeping for the FPS limit if there is one. Waiting is time blocked in waitIdle.
+	float getOverlapMs() const { return overlapMs; }
+	float getWaitMs() const { return waitMs; }
+	void gui();
+
+private:
+	void loop();
+
+	RenderFunc renderFunc;
+	RenderSnapshot snapshots[2];
+	int backIndex = 0;
+	uint64 numSubmittedFrames = 0;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable submitted;
+	std::condition_variable rendered;
+	const RenderSnapshot* pendingSnapshot = nullptr; // Guarded by mutex, cleared once rendered
+	bool quit = false; // Guarded by mutex
+	int64 renderFinishedNs = 0; // Guarded by mutex
+
+	// Main thread
+	int64 submitNs = -1; // Of the frame not waited for yet
+	float overlapMs = 0.0f;
+	float waitMs = 0.0f;
+};
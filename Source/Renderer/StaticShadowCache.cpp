@@ -0,0 +1,139 @@
+#include "StaticShadowCache.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <Driver/ITexture.h>
+#include <Driver/IBuffer.h>
+
+static constexpr unsigned int STATIC_SHADOW_CACHE_CONSTANT_BUFFER_SLOT = 4;
+
+struct StaticShadowCacheCbData
+{
+	XMINT4 sourceTileRect;
+	XMINT4 sourceOffset;
+};
+
+static TextureDesc get_atlas_desc(const char* name, unsigned int resolution, unsigned int bind_flags)
+{
+	TextureDesc desc(name, resolution, resolution, TexFmt::R32_TYPELESS, 1, ResourceUsage::DEFAULT, bind_flags);
+	desc.srvFormatOverride = TexFmt::R32_FLOAT;
+	desc.dsvFormatOverride = TexFmt::D32_FLOAT;
+	return desc;
+}
+
+StaticShadowCache::StaticShadowCache(unsigned int tile_resolution, unsigned int grid_size)
+	: tileResolution(tile_resolution), gridSize(grid_size)
+{
+	// Same format as the shadow map, so it can be copied to it
+	const unsigned int atlasResolution = tile_resolution * grid_size;
+	texture.reset(drv->createTexture(get_atlas_desc("staticShadowCache", atlasResolution, BIND_SHADER_RESOURCE | BIND_DEPTH_STENCIL)));
+	shiftSourceTexture.reset(drv->createTexture(get_atlas_desc("staticShadowCacheShiftSource", atlasResolution, BIND_SHADER_RESOURCE)));
+
+	ShaderSetDesc shaderDesc("StaticShadowCache", "Source/Shaders/StaticShadowCache.shader");
+	shaderDesc.shaderFuncNames[(int)ShaderStage::VS] = "DefaultPostFxVsFunc";
+	shaderDesc.shaderFuncNames[(int)ShaderStage::PS] = "ShiftStaticShadowCachePS";
+	shader = drv->createShaderSet(shaderDesc);
+
+	RenderStateDesc rsDesc;
+	rsDesc.depthStencilDesc.DepthFunc = ComparisonFunc::ALWAYS;
+	renderState = drv->createRenderState(rsDesc);
+
+	BufferDesc cbDesc;
+	cbDesc.bindFlags = BIND_CONSTANT_BUFFER;
+	cbDesc.numElements = 1;
+	cbDesc.name = "StaticShadowCacheCb";
+	cbDesc.elementByteSize = sizeof(StaticShadowCacheCbData);
+	cb.reset(drv->createBuffer(cbDesc));
+}
+
+StaticShadowCache::~StaticShadowCache()
+{
+}
+
+void StaticShadowCache::beginFrame(bool static_casters_moved)
+{
+	invalidatedThisFrame = invalidated.exchange(false) || static_casters_moved;
+}
+
+const StaticShadowCache::TileUpdate& StaticShadowCache::updateTile(uint32 tile, const TileView& view)
+{
+	TileState& state = tiles[tile];
+	TileUpdate& update = state.update;
+	const int32 resolution = (int32)tileResolution;
+	const int32 shiftX = view.originX - state.view.originX;
+	const int32 shiftY = view.originY - state.view.originY;
+	const bool sameView = state.valid && !invalidatedThisFrame
+		&& view.texelSize == state.view.texelSize && view.nearZ == state.view.nearZ && view.farZ == state.view.farZ
+		&& memcmp(&view.lightRotation, &state.view.lightRotation, sizeof(view.lightRotation)) == 0
+		&& view.staticCastersKey == state.view.staticCastersKey;
+	state.view = view;
+	state.valid = true;
+
+	update = {};
+	if (!sameView || abs(shiftX) >= resolution || abs(shiftY) >= resolution)
+	{
+		update.clear = true;
+		update.rects[update.numRects++] = { 0, 0, resolution, resolution };
+		return update;
+	}
+	if (shiftX == 0 && shiftY == 0)
+		return update;
+
+	// Strips the shifted content doesn't cover, the rows without the columns already in the vertical strip
+	update.shiftX = shiftX;
+	update.shiftY = shiftY;
+	Rect rows = { 0, 0, resolution, resolution };
+	if (shiftX != 0)
+	{
+		const Rect columns = shiftX > 0 ? Rect{ resolution - shiftX, 0, resolution, resolution } : Rect{ 0, 0, -shiftX, resolution };
+		update.rects[update.numRects++] = columns;
+		rows.minX = shiftX > 0 ? 0 : -shiftX;
+		rows.maxX = shiftX > 0 ? resolution - shiftX : resolution;
+	}
+	if (shiftY != 0)
+	{
+		rows.minY = shiftY > 0 ? 0 : resolution + shiftY;
+		rows.maxY = shiftY > 0 ? shiftY : resolution;
+		update.rects[update.numRects++] = rows;
+	}
+	return update;
+}
+
+void StaticShadowCache::prepareTiles(uint32 num_tiles)
+{
+	PROFILE_SCOPE("PrepareStaticShadowCache");
+
+	bool anyShifted = false;
+	for (uint32 tile = 0; tile < num_tiles; tile++)
+		anyShifted |= !tiles[tile].update.clear && (tiles[tile].update.shiftX != 0 || tiles[tile].update.shiftY != 0);
+	if (anyShifted)
+		texture->copyResource(shiftSourceTexture->getId());
+
+	drv->setRenderTarget(BAD_RESID, texture->getId());
+	drv->setShader(shader, 0);
+	drv->setRenderState(renderState);
+	drv->setTexture(ShaderStage::PS, 0, shiftSourceTexture->getId());
+	drv->setConstantBuffer(ShaderStage::PS, STATIC_SHADOW_CACHE_CONSTANT_BUFFER_SLOT, cb->getId());
+	for (uint32 tile = 0; tile < num_tiles; tile++)
+	{
+		const TileUpdate& update = tiles[tile].update;
+		if (update.clear || update.shiftX != 0 || update.shiftY != 0)
+			drawTile(tile, XMINT2(update.shiftX, -update.shiftY), !update.clear);
+	}
+	drv->setTexture(ShaderStage::PS, 0, BAD_RESID);
+}
+
+void StaticShadowCache::drawTile(uint32 tile, const XMINT2& source_offset, bool keep_content)
+{
+	const XMINT2 tileOrigin((tile % gridSize) * tileResolution, (tile / gridSize) * tileResolution);
+	StaticShadowCacheCbData cbData;
+	cbData.sourceTileRect = keep_content
+		? XMINT4(tileOrigin.x, tileOrigin.y, tileOrigin.x + tileResolution, tileOrigin.y + tileResolution)
+		: XMINT4(0, 0, 0, 0);
+	cbData.sourceOffset = XMINT4(source_offset.x, source_offset.y, 0, 0);
+	cb->updateData(&cbData);
+
+	drv->setView((float)tileOrigin.x, (float)tileOrigin.y, (float)tileResolution, (float)tileResolution, 0, 1);
+	drv->draw(3, 0);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <Common.h>
+#include <Util/ResIdHolder.h>
+
+#include "ConstantBuffers.h"
+
+class ITexture;
+class IBuffer;
+
+// Shadow map atlas of the static casters only, kept across frames. Each frame the shadow map starts as a copy of it and
+// only the dynamic casters are drawn on top. A tile is redrawn when the view of its cascade changes. When the cascade
+// only moved by whole texels, the content of the tile is shifted and only the uncovered strips are redrawn.
+class StaticShadowCache
+{
+public:
+	StaticShadowCache(unsigned int tile_resolution, unsigned int grid_size);
+	~StaticShadowCache();
+	ITexture* getTexture() const { return texture.get(); }
+
+	// Everything a tile's static casters were drawn with. The origin is in texels, y up like light space.
+	struct TileView
+	{
+		int32 originX;
+		int32 originY;
+		float texelSize;
+		float nearZ;
+		float farZ;
+		XMFLOAT4 lightRotation;
+		uint64 staticCastersKey; // Changes with the set of static casters and their transforms
+	};
+
+	// Texels of a tile, rows from the top, max exclusive
+	struct Rect
+	{
+		int32 minX;
+		int32 minY;
+		int32 maxX;
+		int32 maxY;
+	};
+
+	// Static casters are drawn into the rects of the tile this frame, after its content is shifted or cleared
+	struct TileUpdate
+	{
+		bool clear;
+		int32 shiftX; // Texels the content moves by, to the left and down in the tile
+		int32 shiftY;
+		uint32 numRects;
+		Rect rects[2];
+	};
+
+	// Any thread, redraws all tiles in the next frame, e.g. when the shadow render state changed
+	void invalidate() { invalidated = true; }
+
+	// Frame job, before the tiles are updated. Static casters moving in place redraws all tiles, the key doesn't change.
+	void beginFrame(bool static_casters_moved);
+	const TileUpdate& updateTile(uint32 tile, const TileView& view); // Tiles can be updated in parallel
+	const TileUpdate& getTileUpdate(uint32 tile) const { return tiles[tile].update; } // Of the frame
+
+	// Rendering thread, shifts and clears the tiles. Static casters are drawn into the rects after it, with the atlas
+	// set as the depth target.
+	void prepareTiles(uint32 num_tiles);
+
+private:
+	void drawTile(uint32 tile, const XMINT2& source_offset, bool keep_content);
+
+	struct TileState
+	{
+		TileView view;
+		bool valid = false;
+		TileUpdate update{};
+	};
+
+	unsigned int tileResolution;
+	unsigned int gridSize;
+	std::unique_ptr<ITexture> texture;
+	std::unique_ptr<ITexture> shiftSourceTexture; // Copy of the atlas, tiles are shifted from it
+	std::unique_ptr<IBuffer> cb;
+	ResIdHolder shader;
+	ResIdHolder renderState;
+	TileState tiles[MAX_SHADOW_CASCADES];
+	std::atomic<bool> invalidated = true;
+	bool invalidatedThisFrame = true;
+};
@@ -4,6 +4,7 @@
 
 #include <3rdParty/ImGui/imgui.h>
 #include <Util/AutoImGui.h>
+#include <Util/LinearArena.h>
 #include <Driver/IBuffer.h>
 #include <Driver/ITexture.h>
 #include <Engine/AssetManager.h>
@@ -68,7 +69,9 @@ Water::Water(const Transform& transform_) : transform(transform_)
 void Water::onGlobalShaderKeywordsChanged()
 {
 	const std::vector<std::string>& globalKeywords = am->getGlobalShaderKeywords();
-	std::vector<const char*> globalKeywordsCstr(globalKeywords.size());
+	LinearArena& scratch = get_thread_scratch_arena();
+	ArenaScope scope(scratch);
+	ScratchVector<const char*> globalKeywordsCstr(globalKeywords.size(), scratch);
 	std::transform(globalKeywords.begin(), globalKeywords.end(), globalKeywordsCstr.begin(), [](const std::string& kw) { return kw.c_str(); });
 
 	currentVariant = drv->getShaderVariantIndexForKeywords(shader, globalKeywordsCstr.data(), globalKeywordsCstr.size());
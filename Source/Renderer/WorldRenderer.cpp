@@ -1,5 +1,11 @@
 #include "WorldRenderer.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
 #include <Driver/ITexture.h>
 #include <Driver/IBuffer.h>
 #include <Engine/AssetManager.h>
@@ -13,6 +19,16 @@
 #include "Sky.h"
 #include "EnvironmentLightingSystem.h"
 #include "VarianceShadowMap.h"
+#include "OcclusionBuffer.h"
+
+static constexpr uint32 FRAME_JOB_GRAIN_SIZE = 64;
+static_assert(FRAME_JOB_GRAIN_SIZE % culling::BATCH_SIZE == 0, "Visibility jobs cull whole batches");
+
+// Shadows are received by what the camera sees up to the shadow distance
+static float get_shadow_far_plane(const Camera& camera, float shadow_distance)
+{
+	return std::max(std::min(camera.GetFarPlane(), shadow_distance), camera.GetNearPlane() * 2.0f);
+}
 
 WorldRenderer::WorldRenderer()
 {
@@ -32,6 +48,24 @@ WorldRenderer::WorldRenderer()
 	cbDesc.elementByteSize = sizeof(PerObjectConstantBufferData);
 	perObjectCb.reset(drv->createBuffer(cbDesc));
 
+	occlusionBuffer = std::make_unique<OcclusionBuffer>();
+
+	// SV_InstanceID starts from 0 whatever the start instance of the draw, so each batch has a constant buffer with its
+	// first instance
+	BufferDesc batchCbDesc("batchCb", sizeof(PerBatchConstantBufferData), 1, ResourceUsage::IMMUTABLE, BIND_CONSTANT_BUFFER);
+	for (uint32 i = 0; i < MAX_INSTANCE_BATCHES; i++)
+	{
+		PerBatchConstantBufferData batchCbData = { XMUINT4(i * DrawList::MAX_BATCH_INSTANCES, 0, 0, 0) };
+		batchCbDesc.initialData = &batchCbData;
+		batchCbs[i].reset(drv->createBuffer(batchCbDesc));
+		batchCbIds[i] = batchCbs[i]->getId();
+	}
+	instanceMaterials.resize(MAX_INSTANCE_MATERIALS);
+	BufferDesc instanceMaterialsDesc("instanceMaterials", sizeof(PerMaterialConstantBufferData), MAX_INSTANCE_MATERIALS,
+		ResourceUsage::DEFAULT, BIND_SHADER_RESOURCE, 0, RESOURCE_MISC_BUFFER_STRUCTURED);
+	instanceMaterialsDesc.initialData = instanceMaterials.data();
+	instanceMaterialsBuffer.reset(drv->createBuffer(instanceMaterialsDesc));
+
 	RenderStateDesc depthPrepassRsDesc;
 	depthPrepassRenderStateId = drv->createRenderState(depthPrepassRsDesc);
 	depthPrepassRsDesc.rasterizerDesc.wireframe = true;
@@ -50,7 +84,8 @@ WorldRenderer::WorldRenderer()
 	shadowSampler = drv->createSampler(SamplerDesc(FILTER_COMPARISON_MIN_MAG_MIP_LINEAR, TexAddr::BORDER, ComparisonFunc::LESS_EQUAL));
 
 	setSoftShadowMode(SoftShadowMode::TENT);
-	setShadowResolution(2048);
+	shadowResolution = 1024;
+	setShadowCascadeCount(MAX_SHADOW_CASCADES);
 	setShadowBias(50000, 1.0f);
 
 	RenderStateDesc shadowRenderStateNoBiasDesc;
@@ -100,6 +135,9 @@ void WorldRenderer::update(float delta_time)
 	// Update scene camera rotation
 	sceneCamera.Rotate(sceneCameraInputState.deltaPitch * sceneCameraTurnSpeed, sceneCameraInputState.deltaYaw * sceneCameraTurnSpeed);
 	sceneCameraInputState.deltaPitch = sceneCameraInputState.deltaYaw = 0;
+
+	// Renderers moved since the last update are reinserted into the scene tree
+	am->getSceneBvh().update();
 }
 
 void WorldRenderer::beforeRender()
@@ -134,52 +172,148 @@ static XMFLOAT4 get_final_light_color(const XMFLOAT4& color, float intensity)
 	return XMFLOAT4(color.x * intensity, color.y * intensity, color.z * intensity, 1.0f);
 }
 
-static XMMATRIX get_shadow_matrix(XMMATRIX& lightView, XMMATRIX& lightProj)
+static XMMATRIX get_shadow_matrix(XMMATRIX& lightView, XMMATRIX& lightProj, float tile_scale, const XMFLOAT2& tile_offset)
 {
 	XMMATRIX worldToLightSpace = XMMatrixMultiply(lightView, lightProj);
 
-	//XMMATRIX textureScaleBias = XMMatrixMultiply(XMMatrixScaling(0.5f, -0.5f, 1.0f), XMMatrixTranslation(0.5f, 0.5f, 0.0f));
+	// To the uv of the tile in the atlas
 	const XMMATRIX textureScaleBias = XMMatrixSet(
-		0.5f, 0.0f, 0.0f, 0.0f,
-		0.0f, -0.5f, 0.0f, 0.0f,
+		0.5f * tile_scale, 0.0f, 0.0f, 0.0f,
+		0.0f, -0.5f * tile_scale, 0.0f, 0.0f,
 		0.0f, 0.0f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.0f, 1.0f);
+		0.5f * tile_scale + tile_offset.x, 0.5f * tile_scale + tile_offset.y, 0.0f, 1.0f);
 
 	return XMMatrixMultiply(worldToLightSpace, textureScaleBias);
 }
 
-void WorldRenderer::render()
+void WorldRenderer::captureSnapshot(RenderSnapshot& out_snapshot) const
 {
-	render(getSceneCamera(), *hdrTarget.get(), drv->getBackbufferTexture(), *depthTex.get(), 0, 0, 0, true, true);
+	out_snapshot.time = time;
+	out_snapshot.frameCount = frameCount;
+	out_snapshot.camera = sceneCamera;
+	out_snapshot.mainLight = *mainLight;
+	out_snapshot.mainLightEnabled = mainLightEnabled;
+	out_snapshot.shadowEnabled = shadowEnabled;
+	out_snapshot.shadowDistance = shadowDistance;
+
+	out_snapshot.objects.clear();
+	for (MeshRenderer* mr : am->getSceneMeshRenderers())
+	{
+		assert(mr->getSceneIndex() == out_snapshot.objects.size());
+		out_snapshot.objects.push_back({ mr, mr->getTransformMatrix(), mr->getUvScale(), mr->isEnabled(), mr->isStatic() });
+	}
+	cullSnapshotObjects(out_snapshot);
+
+	// Materials created by loading jobs after this keep the constants they were created with until the next frame
+	out_snapshot.materials.clear();
+	am->getSceneMaterials().forEach([&out_snapshot](AssetHandle<Material>, Material* material)
+	{
+		out_snapshot.materials.push_back({ material, material->getConstants() });
+	});
+}
+
+void WorldRenderer::cullSnapshotObjects(RenderSnapshot& snapshot) const
+{
+	// The scene tree has the bounds of the transforms the snapshot has the matrices of. Renderers it doesn't bound yet are
+	// culled one by one like the others.
+	snapshot.objectsCulled = sceneTreeCullingEnabled;
+	snapshot.viewObjects.clear();
+	snapshot.shadowCasterObjects.clear();
+	if (!snapshot.objectsCulled)
+		return;
+	for (uint32 i = 0; i < (uint32)snapshot.objects.size(); i++)
+	{
+		if (!snapshot.objects[i].renderer->isBoundedBySceneBvh())
+		{
+			snapshot.viewObjects.push_back(i);
+			snapshot.shadowCasterObjects.push_back(i);
+		}
+	}
+
+	const DynamicBvh& bvh = am->getSceneBvh();
+	const Camera& camera = snapshot.camera;
+	bvh.queryFrustum(culling::make_frustum(camera.GetViewMatrix() * camera.GetProjectionMatrix()), [&snapshot](void* user_data)
+	{
+		const MeshRenderer* mr = (const MeshRenderer*)user_data;
+		if (mr->isBoundedBySceneBvh())
+			snapshot.viewObjects.push_back(mr->getSceneIndex());
+	});
+
+	// A cascade culls its casters with more planes, and its receivers are between planes parallel to those of all the
+	// receivers, with the same sides towards the light. So the casters of all the receivers include those of any cascade.
+	if (snapshot.shadowEnabled)
+	{
+		const XMMATRIX receiversViewProjection = camera.GetViewMatrix() * XMMatrixPerspectiveFovLH(camera.GetFOV(),
+			camera.GetViewportWidth() / camera.GetViewportHeight(), camera.GetNearPlane(), get_shadow_far_plane(camera, snapshot.shadowDistance));
+		const Light& light = snapshot.mainLight;
+		culling::Frustum casterVolume = {};
+		culling::add_caster_planes(casterVolume, culling::make_frustum(receiversViewProjection), XMMatrixRotationRollPitchYaw(light.GetPitch(), light.GetYaw(), 0.0f).r[2]);
+		bvh.queryFrustum(casterVolume, [&snapshot](void* user_data)
+		{
+			const MeshRenderer* mr = (const MeshRenderer*)user_data;
+			if (mr->isBoundedBySceneBvh())
+				snapshot.shadowCasterObjects.push_back(mr->getSceneIndex());
+		});
+	}
+
+	// In the order of the objects, like without the tree
+	std::sort(snapshot.viewObjects.begin(), snapshot.viewObjects.end());
+	std::sort(snapshot.shadowCasterObjects.begin(), snapshot.shadowCasterObjects.end());
+}
+
+void WorldRenderer::render(const RenderSnapshot& snapshot)
+{
+	frameSnapshot = &snapshot;
+	for (const MaterialSnapshot& material : snapshot.materials)
+		material.material->uploadConstants(material.constants);
+	uploadInstanceMaterials(snapshot);
+
+	beforeRender();
+	render(snapshot.camera, *hdrTarget.get(), drv->getBackbufferTexture(), *depthTex.get(), 0, 0, 0, true, true);
+	frameSnapshot = nullptr;
 }
 
 void WorldRenderer::render(const Camera& camera, ITexture& hdr_color_target, ITexture* tonemapped_color_target, ITexture& depth_target,
 	unsigned int hdr_color_slice, unsigned int tonemapped_color_slice, unsigned int depth_slice, bool ssao_enabled, bool antialiasing_enabled)
 {
 	PROFILE_SCOPE("RenderWorld");
+	assert(frameSnapshot != nullptr);
 
+	// Draw lists record the default sampler of materials, so it has to be set before
 	am->setDefaultMaterialSamplerMipBias(antialiasing_enabled ? taa->getMipBias() : 0);
 
+	// Shadow cascades are fitted to the scene bounds, known once the objects are updated
+	startFrameJobs(camera);
+	frameJobs.wait(fitShadowCascadesNode);
+	setupFrame();
+
 	// Set resources for lighting
 	drv->setTexture(ShaderStage::PS, 10, enviLightSystem->getIrradianceCube()->getId());
 	drv->setTexture(ShaderStage::PS, 11, enviLightSystem->getSpecularCube()->getId());
 	drv->setTexture(ShaderStage::PS, 12, enviLightSystem->getBrdfLut()->getId());
 	drv->setSampler(ShaderStage::PS, 10, linearClampSampler);
 
-	XMVECTOR shadowCameraPos;
-	XMMATRIX lightViewMatrix;
-	XMMATRIX lightProjectionMatrix;
-	setupFrame(camera, shadowCameraPos, lightViewMatrix, lightProjectionMatrix);
+	drv->setBuffer(ShaderStage::VS, INSTANCE_MATERIALS_BUFFER_SLOT, instanceMaterialsBuffer->getId());
+	drv->setBuffer(ShaderStage::PS, INSTANCE_MATERIALS_BUFFER_SLOT, instanceMaterialsBuffer->getId());
+	uploadObjectConstants();
+	drv->setBuffer(ShaderStage::VS, OBJECTS_BUFFER_SLOT, objectsBuffer->getId());
 
-	setupShadowPass(shadowCameraPos, lightViewMatrix, lightProjectionMatrix);
-	if (shadowEnabled)
+	if (numFrameShadowCascades > 0)
 	{
 		PROFILE_SCOPE("ShadowPass");
-		performRenderPass(RenderPass::DEPTH);
+		if (frameStaticShadowCache != nullptr)
+			updateStaticShadowCache();
+		setupShadowPass();
+		const StaticShadowCache::Rect tileRect = { 0, 0, (int32)shadowResolution, (int32)shadowResolution };
+		for (uint32 cascade = 0; cascade < numFrameShadowCascades; cascade++)
+		{
+			setupShadowCascade(cascade, tileRect);
+			submitDrawList((FrameDrawList)((int)FrameDrawList::SHADOW_CASCADE_0 + cascade));
+		}
 	}
 	if (softShadowMode == SoftShadowMode::VARIANCE)
 	{
-		if (shadowEnabled)
+		if (numFrameShadowCascades > 0)
 			varianceShadowMap->render(shadowMap.get());
 		else
 			varianceShadowMap->clear();
@@ -192,7 +326,7 @@ void WorldRenderer::render(const Camera& camera, ITexture& hdr_color_target, ITe
 
 	{
 		PROFILE_SCOPE("DepthPrepass");
-		performRenderPass(RenderPass::DEPTH);
+		submitDrawList(FrameDrawList::DEPTH_PREPASS);
 	}
 
 	const bool depthCopyNeeded = water != nullptr;
@@ -217,7 +351,7 @@ void WorldRenderer::render(const Camera& camera, ITexture& hdr_color_target, ITe
 
 	{
 		PROFILE_SCOPE("ForwardPass");
-		performRenderPass(RenderPass::FORWARD);
+		submitDrawList(FrameDrawList::FORWARD);
 	}
 
 	const bool sceneGrabNeeded = water != nullptr;
@@ -256,7 +390,7 @@ void WorldRenderer::render(const Camera& camera, ITexture& hdr_color_target, ITe
 		taaParams.depthTex = depthTex.get();
 		taaParams.viewMatrix = camera.GetViewMatrix();
 		taaParams.projMatrix = camera.GetProjectionMatrix();
-		taaParams.frame = frameCount;
+		taaParams.frame = frameSnapshot->frameCount;
 
 		taa->perform(taaParams);
 	}
@@ -278,6 +412,36 @@ void WorldRenderer::render(const Camera& camera, ITexture& hdr_color_target, ITe
 	}
 
 	currentAntiAliasedTarget = 1 - currentAntiAliasedTarget;
+
+	frameJobs.wait();
+	for (int view = 0; view < (int)FrameView::_COUNT; view++)
+	{
+		CullingStats& stats = cullingStats[view];
+		stats = {};
+		for (uint32 chunk = 0; chunk < visibleObjects[view].numChunks; chunk++)
+		{
+			const CullingStats& chunkStats = chunkCullingStats[view][chunk];
+			stats.numObjects += chunkStats.numObjects;
+			stats.numVisibleObjects += chunkStats.numVisibleObjects;
+			stats.numCachedObjects += chunkStats.numCachedObjects;
+			stats.numOccludedObjects += chunkStats.numOccludedObjects;
+			stats.numSubmeshes += chunkStats.numSubmeshes;
+			stats.numVisibleSubmeshes += chunkStats.numVisibleSubmeshes;
+		}
+	}
+	numOccluderTriangles = frameOcclusionBuffer != nullptr ? frameOcclusionBuffer->getNumTriangles() : 0;
+	drawStats = {};
+	for (const DrawList& drawList : drawLists)
+	{
+		const DrawList::Stats listStats = drawList.getStats();
+		drawStats.numDraws += listStats.numDraws;
+		drawStats.numInstancedDraws += listStats.numInstancedDraws;
+		drawStats.numInstances += listStats.numInstances;
+		drawStats.numMaterialChanges += listStats.numMaterialChanges;
+		drawStats.numShaderChanges += listStats.numShaderChanges;
+		drawStats.numStateChanges += listStats.numStateChanges;
+		drawStats.numRedundantStateChanges += listStats.numRedundantStateChanges;
+	}
 }
 
 void WorldRenderer::setEnvironment(ITexture* panoramic_environment_map, float radiance_cutoff, bool world_probe_enabled, const XMVECTOR& world_probe_pos)
@@ -311,23 +475,40 @@ void WorldRenderer::onGlobalShaderKeywordsChanged()
 		water->onGlobalShaderKeywordsChanged();
 }
 
-unsigned int WorldRenderer::getShadowResolution()
+void WorldRenderer::setShadowResolution(unsigned int shadow_resolution)
 {
-	if (shadowMap == nullptr)
-		return 0;
-	return shadowMap->getDesc().width;
+	shadowResolution = shadow_resolution;
+	createShadowMap();
 }
 
-void WorldRenderer::setShadowResolution(unsigned int shadow_resolution)
+void WorldRenderer::setShadowCascadeCount(unsigned int num_cascades)
 {
-	TextureDesc shadowMapDesc("shadowMap", shadow_resolution, shadow_resolution,
+	numShadowCascades = std::clamp(num_cascades, 1u, MAX_SHADOW_CASCADES);
+	createShadowMap();
+}
+
+void WorldRenderer::createShadowMap()
+{
+	// Cascades are tiles of one texture, so filtering and the variance map work the same for all of them
+	const unsigned int atlasResolution = shadowResolution * getShadowAtlasGridSize();
+	TextureDesc shadowMapDesc("shadowMap", atlasResolution, atlasResolution,
 		TexFmt::R32_TYPELESS, 1, ResourceUsage::DEFAULT, BIND_SHADER_RESOURCE|BIND_DEPTH_STENCIL);
 	shadowMapDesc.srvFormatOverride = TexFmt::R32_FLOAT;
 	shadowMapDesc.dsvFormatOverride = TexFmt::D32_FLOAT;
 	shadowMap.reset(drv->createTexture(shadowMapDesc));
 
 	if (varianceShadowMap != nullptr)
-		varianceShadowMap.reset(new VarianceShadowMap(shadow_resolution));
+		varianceShadowMap.reset(new VarianceShadowMap(atlasResolution));
+
+	staticShadowCache.reset();
+	if (staticShadowCacheEnabled)
+		staticShadowCache = std::make_unique<StaticShadowCache>(shadowResolution, getShadowAtlasGridSize());
+}
+
+void WorldRenderer::setStaticShadowCacheEnabled(bool enabled)
+{
+	staticShadowCacheEnabled = enabled;
+	createShadowMap();
 }
 
 void WorldRenderer::setShadowBias(int depth_bias, float slope_scaled_depth_bias)
@@ -340,6 +521,9 @@ void WorldRenderer::setShadowBias(int depth_bias, float slope_scaled_depth_bias)
 	desc.rasterizerDesc.slopeScaledDepthBias = shadowSlopeScaledDepthBias;
 	desc.rasterizerDesc.depthClipEnable = false;
 	shadowRenderStateId = drv->createRenderState(desc);
+
+	if (staticShadowCache != nullptr)
+		staticShadowCache->invalidate();
 }
 
 void WorldRenderer::setSoftShadowMode(SoftShadowMode soft_shadow_mode)
@@ -350,9 +534,13 @@ void WorldRenderer::setSoftShadowMode(SoftShadowMode soft_shadow_mode)
 		am->setGlobalShaderKeyword(softShadowModeShaderKeywords[i], (SoftShadowMode)i == softShadowMode);
 
 	if (softShadowMode == SoftShadowMode::VARIANCE && varianceShadowMap == nullptr)
-		varianceShadowMap.reset(new VarianceShadowMap(getShadowResolution()));
+		varianceShadowMap.reset(new VarianceShadowMap(shadowMap->getDesc().width));
 	else if (softShadowMode != SoftShadowMode::VARIANCE && varianceShadowMap != nullptr)
 		varianceShadowMap.reset();
+
+	// Variance shadows are drawn without bias
+	if (staticShadowCache != nullptr)
+		staticShadowCache->invalidate();
 }
 
 void WorldRenderer::setWater(const Transform* water_transform)
@@ -373,7 +561,7 @@ void WorldRenderer::setCameraForShaders(const Camera& cam, bool allow_jitter)
 
 	perCameraCbData.projection = cam.GetProjectionMatrix();
 	if (allow_jitter)
-		taa->addJitterToProjectionMatrix(perCameraCbData.projection, frameCount, cam.GetViewportWidth(), cam.GetViewportHeight());
+		taa->addJitterToProjectionMatrix(perCameraCbData.projection, frameSnapshot->frameCount, cam.GetViewportWidth(), cam.GetViewportHeight());
 
 	perCameraCbData.view = cam.GetViewMatrix();
 	perCameraCbData.viewProjection = perCameraCbData.view * perCameraCbData.projection;
@@ -446,37 +634,176 @@ void WorldRenderer::closeResolutionDependentResources()
 	ssao.reset();
 }
 
-XMVECTOR calculate_shadow_camera_pos(const Camera& camera, const XMMATRIX& light_rotation_matrix, float shadow_distance, float shadow_resolution)
+void WorldRenderer::fitShadowCascades(const Camera& camera)
 {
-	XMVECTOR pos = camera.GetEye() + camera.GetForward() * shadow_distance * 0.5f;
+	const Light& light = frameSnapshot->mainLight;
+	const XMMATRIX lightRotation = XMMatrixRotationRollPitchYaw(light.GetPitch(), light.GetYaw(), 0.0f);
 
-	// Align to shadowmap texel
-	XMMATRIX lightViewRotationMatrix = XMMatrixInverse(nullptr, light_rotation_matrix);
-	XMVECTOR viewSpacePos = XMVector3TransformCoord(pos, lightViewRotationMatrix);
-	float shadowTexelSize = shadow_distance / shadow_resolution;
-	viewSpacePos = XMVectorSetX(viewSpacePos, roundf(XMVectorGetX(viewSpacePos) / shadowTexelSize) * shadowTexelSize);
-	viewSpacePos = XMVectorSetY(viewSpacePos, roundf(XMVectorGetY(viewSpacePos) / shadowTexelSize) * shadowTexelSize);
-	pos = XMVector3TransformCoord(viewSpacePos, light_rotation_matrix);
+	// Scene bounds, in light space
+	XMVECTOR sceneMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR sceneMax = XMVectorReplicate(-FLT_MAX);
+	for (uint32 chunk = 0; chunk < dirtyObjects.numChunks; chunk++)
+	{
+		sceneMin = XMVectorMin(sceneMin, XMLoadFloat3(&chunkSceneBounds[chunk].min));
+		sceneMax = XMVectorMax(sceneMax, XMLoadFloat3(&chunkSceneBounds[chunk].max));
+	}
+	BoundingBox lightSpaceSceneBounds;
+	const bool sceneEmpty = !XMVector3LessOrEqual(sceneMin, sceneMax);
+	if (!sceneEmpty)
+	{
+		BoundingBox sceneBounds;
+		BoundingBox::CreateFromPoints(sceneBounds, sceneMin, sceneMax);
+		lightSpaceSceneBounds = culling::transform_box(sceneBounds, XMMatrixTranspose(lightRotation));
+	}
 
-	return pos;
+	// Practical split scheme: logarithmic splits keep the texel to pixel ratio even, but give the near cascades too
+	// little depth, so they are blended with uniform ones
+	const float nearPlane = camera.GetNearPlane();
+	const float farPlane = get_shadow_far_plane(camera, frameSnapshot->shadowDistance);
+	float splitNear = nearPlane;
+	for (uint32 cascade = 0; cascade < numFrameShadowCascades; cascade++)
+	{
+		const float t = (float)(cascade + 1) / numFrameShadowCascades;
+		const float logarithmicSplit = nearPlane * powf(farPlane / nearPlane, t);
+		const float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+		const float splitFar = std::lerp(uniformSplit, logarithmicSplit, shadowCascadeSplitLambda);
+		fitShadowCascade(camera, cascade, splitNear, splitFar, lightRotation, sceneEmpty ? nullptr : &lightSpaceSceneBounds);
+		splitNear = splitFar;
+	}
+
+	if (frameStaticShadowCache == nullptr)
+		return;
+	uint64 staticCastersKey = 0;
+	bool staticCastersMoved = false;
+	for (uint32 chunk = 0; chunk < dirtyObjects.numChunks; chunk++)
+	{
+		staticCastersKey += chunkStaticCasters[chunk].key + chunkStaticCasters[chunk].count;
+		staticCastersMoved |= chunkStaticCasters[chunk].moved;
+	}
+	frameStaticShadowCache->beginFrame(staticCastersMoved);
+	for (uint32 cascade = 0; cascade < numFrameShadowCascades; cascade++)
+	{
+		const ShadowCascade& shadowCascade = shadowCascades[cascade];
+		StaticShadowCache::TileView tileView;
+		tileView.originX = shadowCascade.originX;
+		tileView.originY = shadowCascade.originY;
+		tileView.texelSize = shadowCascade.texelSize;
+		tileView.nearZ = shadowCascade.nearZ;
+		tileView.farZ = shadowCascade.farZ;
+		tileView.lightRotation = XMFLOAT4(light.GetPitch(), light.GetYaw(), 0, 0);
+		tileView.staticCastersKey = staticCastersKey;
+		frameStaticShadowCache->updateTile(cascade, tileView);
+	}
 }
 
-void WorldRenderer::setupFrame(const Camera& camera, XMVECTOR& out_shadow_camera_pos, XMMATRIX& out_light_view_matrix, XMMATRIX& out_light_proj_matrix)
+void WorldRenderer::fitShadowCascade(const Camera& camera, uint32 cascade, float split_near, float split_far, const XMMATRIX& light_rotation, const BoundingBox* light_space_scene_bounds)
 {
-	PerFrameConstantBufferData perFrameCbData;
-	perFrameCbData.mainLightColor = get_final_light_color(mainLight->GetColor(), (mainLightEnabled && !debugShowPureImageBasedLighting) ? mainLight->GetIntensity() : 0.f);
-	const float shadowResolution = (float)shadowMap->getDesc().width;
-	XMMATRIX mainLightRotationMatrix = XMMatrixRotationRollPitchYaw(mainLight->GetPitch(), mainLight->GetYaw(), 0.0f);
-	out_shadow_camera_pos = calculate_shadow_camera_pos(camera, mainLightRotationMatrix, shadowDistance, shadowResolution);
-	XMMATRIX mainLightTranslateMatrix = XMMatrixTranslationFromVector(out_shadow_camera_pos);
-	XMMATRIX inverseLightViewMatrix = mainLightRotationMatrix * mainLightTranslateMatrix;
-	XMStoreFloat4(&perFrameCbData.mainLightDirection, inverseLightViewMatrix.r[2]);
-	out_light_view_matrix = XMMatrixInverse(nullptr, inverseLightViewMatrix);
-	out_light_proj_matrix = XMMatrixOrthographicLH(shadowDistance, shadowDistance, -directionalShadowDistance, directionalShadowDistance);
-	perFrameCbData.mainLightShadowMatrix = get_shadow_matrix(out_light_view_matrix, out_light_proj_matrix);
-	perFrameCbData.mainLightShadowParams = XMFLOAT4(shadowResolution, 1.0f / shadowResolution, 2 * directionalShadowDistance, poissonShadowSoftness);
+	const XMMATRIX lightView = XMMatrixTranspose(light_rotation);
+	const float resolution = (float)shadowResolution;
+
+	// Receivers are what the camera sees between the splits
+	const XMMATRIX receiversViewProjection = camera.GetViewMatrix()
+		* XMMatrixPerspectiveFovLH(camera.GetFOV(), camera.GetViewportWidth() / camera.GetViewportHeight(), split_near, split_far);
+	const XMMATRIX clipToWorld = XMMatrixInverse(nullptr, receiversViewProjection);
+	XMVECTOR corners[8];
+	XMVECTOR receiversMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR receiversMax = XMVectorReplicate(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		corners[i] = XMVector3TransformCoord(XMVectorSet((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : 0.0f, 1.0f), clipToWorld);
+		const XMVECTOR lightSpaceCorner = XMVector3TransformCoord(corners[i], lightView);
+		receiversMin = XMVectorMin(receiversMin, lightSpaceCorner);
+		receiversMax = XMVectorMax(receiversMax, lightSpaceCorner);
+	}
+
+	XMFLOAT3 fitMin, fitMax;
+	XMStoreFloat3(&fitMin, receiversMin);
+	XMStoreFloat3(&fitMax, receiversMax);
+	fitMin.z -= directionalShadowDistance;
+	if (light_space_scene_bounds != nullptr)
+	{
+		XMFLOAT3 sceneMin, sceneMax;
+		XMStoreFloat3(&sceneMin, XMLoadFloat3(&light_space_scene_bounds->Center) - XMLoadFloat3(&light_space_scene_bounds->Extents));
+		XMStoreFloat3(&sceneMax, XMLoadFloat3(&light_space_scene_bounds->Center) + XMLoadFloat3(&light_space_scene_bounds->Extents));
+
+		// Receivers clipped to the scene. Casters can be anywhere towards the light, but only within the directional
+		// distance, casters beyond it are clamped to the near plane. Nothing behind the receivers can cast onto them.
+		const XMFLOAT3 clippedMin(std::max(fitMin.x, sceneMin.x), std::max(fitMin.y, sceneMin.y), std::max(fitMin.z, sceneMin.z));
+		const XMFLOAT3 clippedMax(std::min(fitMax.x, sceneMax.x), std::min(fitMax.y, sceneMax.y), std::min(fitMax.z, sceneMax.z));
+		if (clippedMin.x < clippedMax.x && clippedMin.y < clippedMax.y && clippedMin.z < clippedMax.z)
+		{
+			fitMin = clippedMin;
+			fitMax = clippedMax;
+		}
+	}
+
+	// The width goes up in steps of a fraction of the receivers' size, which doesn't change as the camera turns, and the
+	// corner is snapped to texels. Otherwise the texels would shift relative to the world, making the shadow edges shimmer.
+	// A border is left around the receivers, so filtering doesn't sample the neighbouring tiles of the atlas.
+	static constexpr float BORDER_TEXELS = 8.0f;
+	const float receiversSize = std::max(XMVectorGetX(XMVector3Length(corners[7] - corners[4])), XMVectorGetX(XMVector3Length(corners[7] - corners[0])));
+	const float widthStep = receiversSize / 16.0f;
+	const float minWidth = std::max(fitMax.x - fitMin.x, fitMax.y - fitMin.y) * (1.0f + 2.0f * (BORDER_TEXELS + 1.0f) / resolution);
+	const float width = std::max(ceilf(minWidth / widthStep), 1.0f) * widthStep;
+	const float texelSize = width / resolution;
+	const int32 originX = (int32)floorf(((fitMin.x + fitMax.x) - width) * 0.5f / texelSize);
+	const int32 originY = (int32)floorf(((fitMin.y + fitMax.y) - width) * 0.5f / texelSize);
+	const float minX = originX * texelSize;
+	const float minY = originY * texelSize;
+
+	// Depth goes in the same steps, so the static shadow cache can be kept while the camera moves a little
+	const float nearZ = floorf(fitMin.z / widthStep) * widthStep;
+	const float farZ = ceilf(fitMax.z / widthStep) * widthStep;
+
+	ShadowCascade& shadowCascade = shadowCascades[cascade];
+	shadowCascade.view = lightView;
+	shadowCascade.projection = XMMatrixOrthographicOffCenterLH(minX, minX + width, minY, minY + width, nearZ, farZ);
+	shadowCascade.position = XMVector3TransformCoord(XMVectorSet(minX + width * 0.5f, minY + width * 0.5f, nearZ, 1.0f), light_rotation);
+	shadowCascade.nearZ = nearZ;
+	shadowCascade.farZ = farZ;
+	shadowCascade.width = width;
+	shadowCascade.texelSize = texelSize;
+	shadowCascade.originX = originX;
+	shadowCascade.originY = originY;
+	shadowCascade.splitFar = split_far;
+
+	// Casters are culled against the sides and the far plane of the cascade, and its receivers extruded towards the
+	// light. Casters between the light and the near plane are clamped to it, so they are kept.
+	const culling::Frustum lightFrustum = culling::make_frustum(shadowCascade.view * shadowCascade.projection);
+	culling::Frustum& casterVolume = viewFrustums[(int)FrameView::SHADOW_CASCADE_0 + cascade];
+	casterVolume = {};
+	for (int plane : { culling::Frustum::LEFT, culling::Frustum::RIGHT, culling::Frustum::BOTTOM, culling::Frustum::TOP, culling::Frustum::FAR_PLANE })
+		culling::add_plane(casterVolume, XMLoadFloat4(&lightFrustum.planes[plane]));
+	culling::add_caster_planes(casterVolume, culling::make_frustum(receiversViewProjection), light_rotation.r[2]);
+}
+
+void WorldRenderer::setupFrame()
+{
+	const Light& light = frameSnapshot->mainLight;
+	PerFrameConstantBufferData perFrameCbData{};
+	perFrameCbData.mainLightColor = get_final_light_color(light.GetColor(), (frameSnapshot->mainLightEnabled && !debugShowPureImageBasedLighting) ? light.GetIntensity() : 0.f);
+	XMStoreFloat4(&perFrameCbData.mainLightDirection, XMMatrixRotationRollPitchYaw(light.GetPitch(), light.GetYaw(), 0.0f).r[2]);
+
+	const uint32 gridSize = getShadowAtlasGridSize();
+	const float tileScale = 1.0f / gridSize;
+	float splits[MAX_SHADOW_CASCADES] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+	for (uint32 cascade = 0; cascade < numFrameShadowCascades; cascade++)
+	{
+		ShadowCascade& shadowCascade = shadowCascades[cascade];
+		const XMFLOAT2 tileOffset((cascade % gridSize) * tileScale, (cascade / gridSize) * tileScale);
+		perFrameCbData.mainLightShadowMatrices[cascade] = get_shadow_matrix(shadowCascade.view, shadowCascade.projection, tileScale, tileOffset);
+
+		// Softness is set for a shadow map covering the shadow distance, so the penumbra has the same size in all cascades
+		const float poissonRadius = poissonShadowSoftness * frameSnapshot->shadowDistance / shadowCascade.width * tileScale;
+		perFrameCbData.mainLightCascadeParams[cascade] = XMFLOAT4(shadowCascade.farZ - shadowCascade.nearZ, poissonRadius, 0, 0);
+		splits[cascade] = shadowCascade.splitFar;
+	}
+	static_assert(MAX_SHADOW_CASCADES == 4, "Splits are packed in a float4");
+	perFrameCbData.mainLightCascadeSplits = XMFLOAT4(splits);
+	const float atlasResolution = (float)shadowMap->getDesc().width;
+	perFrameCbData.mainLightShadowParams = XMFLOAT4(atlasResolution, 1.0f / atlasResolution, (float)numFrameShadowCascades, 0);
 	perFrameCbData.tonemappingParams = XMFLOAT4(exposure, 0, 0, 0);
-	perFrameCbData.timeParams = XMFLOAT4(time, 0, 0, 0);
+	perFrameCbData.timeParams = XMFLOAT4(frameSnapshot->time, 0, 0, 0);
 	perFrameCb->updateData(&perFrameCbData);
 
 	drv->setConstantBuffer(ShaderStage::VS, PER_FRAME_CONSTANT_BUFFER_SLOT, perFrameCb->getId());
@@ -484,28 +811,64 @@ void WorldRenderer::setupFrame(const Camera& camera, XMVECTOR& out_shadow_camera
 	drv->setConstantBuffer(ShaderStage::CS, PER_FRAME_CONSTANT_BUFFER_SLOT, perFrameCb->getId());
 }
 
-void WorldRenderer::setupShadowPass(const XMVECTOR& shadow_camera_pos, const XMMATRIX& light_view_matrix, const XMMATRIX& light_proj_matrix)
+void WorldRenderer::updateStaticShadowCache()
+{
+	PROFILE_SCOPE("StaticShadowCache");
+	frameStaticShadowCache->prepareTiles(numFrameShadowCascades);
+
+	drv->setRenderState(softShadowMode == SoftShadowMode::VARIANCE ? shadowRenderStateNoBiasId : shadowRenderStateId);
+	drv->setRenderTarget(BAD_RESID, frameStaticShadowCache->getTexture()->getId());
+	for (uint32 cascade = 0; cascade < numFrameShadowCascades; cascade++)
+	{
+		const StaticShadowCache::TileUpdate& update = frameStaticShadowCache->getTileUpdate(cascade);
+		for (uint32 i = 0; i < update.numRects; i++)
+		{
+			setupShadowCascade(cascade, update.rects[i]);
+			submitDrawList((FrameDrawList)((int)FrameDrawList::STATIC_SHADOW_CASCADE_0 + cascade));
+		}
+	}
+}
+
+void WorldRenderer::setupShadowPass()
 {
-	// Shadow camera
+	// The shadow map starts with the static casters, or cleared. All tiles of the atlas at once.
+	if (frameStaticShadowCache != nullptr)
+		frameStaticShadowCache->getTexture()->copyResource(shadowMap->getId());
+	drv->setRenderState(softShadowMode == SoftShadowMode::VARIANCE ? shadowRenderStateNoBiasId : shadowRenderStateId);
+	drv->setRenderTarget(BAD_RESID, shadowMap->getId());
+	if (frameStaticShadowCache == nullptr)
+	{
+		RenderTargetClearParams clearParams(CLEAR_FLAG_DEPTH, 0, 1.0f);
+		drv->clearRenderTargets(clearParams);
+	}
+}
+
+void WorldRenderer::setupShadowCascade(uint32 cascade, const StaticShadowCache::Rect& rect)
+{
+	// Shadow camera, the projection only covers the rect of the tile. Rows of the tile go down from its max y.
+	const ShadowCascade& shadowCascade = shadowCascades[cascade];
+	const float texelSize = shadowCascade.texelSize;
+	const int32 maxY = shadowCascade.originY + (int32)shadowResolution;
 	PerCameraConstantBufferData perCameraCbData{};
-	perCameraCbData.view = light_view_matrix;
-	perCameraCbData.projection = light_proj_matrix;
-	perCameraCbData.viewProjection = light_view_matrix * light_proj_matrix;
-	perCameraCbData.projectionParams = get_projection_params(-directionalShadowDistance, directionalShadowDistance, false);
-	XMStoreFloat4(&perCameraCbData.cameraWorldPosition, shadow_camera_pos);
-	float shadowResolution = getShadowResolution();
-	perCameraCbData.viewportResolution = XMFLOAT4(shadowResolution, shadowResolution, 1.f / shadowResolution, 1.f / shadowResolution);
+	perCameraCbData.view = shadowCascade.view;
+	perCameraCbData.projection = XMMatrixOrthographicOffCenterLH(
+		(shadowCascade.originX + rect.minX) * texelSize, (shadowCascade.originX + rect.maxX) * texelSize,
+		(maxY - rect.maxY) * texelSize, (maxY - rect.minY) * texelSize, shadowCascade.nearZ, shadowCascade.farZ);
+	perCameraCbData.viewProjection = shadowCascade.view * perCameraCbData.projection;
+	perCameraCbData.projectionParams = get_projection_params(shadowCascade.nearZ, shadowCascade.farZ, false);
+	XMStoreFloat4(&perCameraCbData.cameraWorldPosition, shadowCascade.position);
+	const float resolution = (float)shadowResolution;
+	perCameraCbData.viewportResolution = XMFLOAT4(resolution, resolution, 1.f / resolution, 1.f / resolution);
 	perCameraCb->updateData(&perCameraCbData);
 	drv->setConstantBuffer(ShaderStage::VS, PER_CAMERA_CONSTANT_BUFFER_SLOT, perCameraCb->getId());
 	drv->setConstantBuffer(ShaderStage::PS, PER_CAMERA_CONSTANT_BUFFER_SLOT, perCameraCb->getId());
 	drv->setConstantBuffer(ShaderStage::CS, PER_CAMERA_CONSTANT_BUFFER_SLOT, perCameraCb->getId());
 
-	// Setup state and render target
-	drv->setRenderState(softShadowMode == SoftShadowMode::VARIANCE ? shadowRenderStateNoBiasId : shadowRenderStateId);
-	drv->setRenderTarget(BAD_RESID, shadowMap->getId());
-	drv->setView(0, 0, (float)shadowMap->getDesc().width, (float)shadowMap->getDesc().height, 0, 1);
-	RenderTargetClearParams clearParams(CLEAR_FLAG_DEPTH, 0, 1.0f);
-	drv->clearRenderTargets(clearParams);
+	// Rect of the cascade's tile
+	const uint32 gridSize = getShadowAtlasGridSize();
+	const float tileX = (float)((cascade % gridSize) * shadowResolution);
+	const float tileY = (float)((cascade / gridSize) * shadowResolution);
+	drv->setView(tileX + rect.minX, tileY + rect.minY, (float)(rect.maxX - rect.minX), (float)(rect.maxY - rect.minY), 0, 1);
 }
 
 void WorldRenderer::setupDepthAndForwardPasses(const Camera& camera, ITexture& hdr_color_target, ITexture& depth_target, unsigned int hdr_color_slice, unsigned int depth_slice)
@@ -520,8 +883,277 @@ void WorldRenderer::setupDepthAndForwardPasses(const Camera& camera, ITexture& h
 	drv->clearRenderTargets(RenderTargetClearParams::clear_all(0.0f, 0.2f, 0.4f, 1.0f, 1.0f));
 }
 
-void WorldRenderer::performRenderPass(RenderPass pass)
+void WorldRenderer::startFrameJobs(const Camera& camera)
 {
-	for (MeshRenderer* mr : am->getSceneMeshRenderers())
-		mr->render(pass);
+	static_assert((uint32)FrameView::_COUNT <= MeshRenderer::MAX_VIEWS, "Renderers keep submesh visibility per view");
+
+	frameJobs.clear();
+	frameArena.reset();
+
+	const std::vector<ObjectSnapshot>& objects = frameSnapshot->objects;
+	const float frameTime = frameSnapshot->time;
+	const uint32 numObjects = (uint32)objects.size();
+	const uint32 numChunks = JobGraph::get_num_chunks(numObjects, FRAME_JOB_GRAIN_SIZE);
+	dirtyObjects.allocate(frameArena, numChunks, FRAME_JOB_GRAIN_SIZE);
+	chunkSceneBounds = frameArena.allocate<ChunkBounds>(numChunks);
+	chunkStaticCasters = frameArena.allocate<ChunkStaticCasters>(numChunks);
+	for (int view = 0; view < (int)FrameView::_COUNT; view++)
+	{
+		visibleObjects[view].allocate(frameArena, numChunks, FRAME_JOB_GRAIN_SIZE);
+		chunkCullingStats[view] = frameArena.allocate<CullingStats>(numChunks);
+		std::fill_n(chunkCullingStats[view], numChunks, CullingStats{});
+	}
+	for (ChunkedObjects& staticCasters : visibleStaticCasters)
+		staticCasters.allocate(frameArena, numChunks, FRAME_JOB_GRAIN_SIZE);
+
+	// Shadow cascades are culled against the volumes of fitShadowCascade
+	numFrameShadowCascades = frameSnapshot->shadowEnabled ? numShadowCascades : 0;
+	frameStaticShadowCache = numFrameShadowCascades > 0 ? staticShadowCache.get() : nullptr;
+	const XMMATRIX viewProjection = camera.GetViewMatrix() * camera.GetProjectionMatrix();
+	viewFrustums[(int)FrameView::MAIN] = culling::make_frustum(viewProjection);
+
+	// Views of the snapshot's camera only cull the objects the scene tree found for them, by their indices. Views of other
+	// cameras, e.g. of the probes, cull all objects.
+	const bool treeCulled = frameSnapshot->objectsCulled && &camera == &frameSnapshot->camera;
+	const uint32* viewCandidates = treeCulled ? frameSnapshot->viewObjects.data() : nullptr;
+	const uint32* casterCandidates = treeCulled ? frameSnapshot->shadowCasterObjects.data() : nullptr;
+	const uint32 numViewCandidates = treeCulled ? (uint32)frameSnapshot->viewObjects.size() : numObjects;
+	const uint32 numCasterCandidates = treeCulled ? (uint32)frameSnapshot->shadowCasterObjects.size() : numObjects;
+	if (treeCulled)
+	{
+		numTreeViewObjects = numViewCandidates;
+		numTreeShadowCasters = numFrameShadowCascades > 0 ? numCasterCandidates : 0;
+	}
+
+	frameOcclusionBuffer = occlusionCullingEnabled ? occlusionBuffer.get() : nullptr;
+	if (frameOcclusionBuffer != nullptr)
+		frameOcclusionBuffer->begin(viewProjection, camera.GetEye(), numChunks);
+
+	for (DrawList& drawList : drawLists)
+		drawList.reset(numChunks);
+
+	updateObjectsNode = frameJobs.addParallelNode("UpdateObjects", numObjects, FRAME_JOB_GRAIN_SIZE,
+		[this, &objects, frameTime](uint32 chunk, uint32 begin, uint32 end)
+		{
+			XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+			XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+			ChunkStaticCasters& staticCasters = chunkStaticCasters[chunk];
+			staticCasters = {};
+			for (uint32 i = begin; i < end; i++)
+			{
+				MeshRenderer* mr = objects[i].renderer;
+				const bool dirty = mr->prepareForFrame(objects[i], i, frameTime);
+				if (dirty)
+					dirtyObjects.add(chunk, mr);
+				if (!objects[i].enabled)
+					continue;
+				if (mr->isStaticCaster())
+				{
+					staticCasters.count++;
+					staticCasters.key += (uint64)(uintptr_t)mr * 0x9e3779b97f4a7c15ull;
+					staticCasters.moved |= dirty;
+				}
+				const BoundingBox& bounds = mr->getWorldBounds();
+				boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&bounds.Extents));
+				boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&bounds.Center) + XMLoadFloat3(&bounds.Extents));
+			}
+			XMStoreFloat3(&chunkSceneBounds[chunk].min, boundsMin);
+			XMStoreFloat3(&chunkSceneBounds[chunk].max, boundsMax);
+		});
+
+	fitShadowCascadesNode = frameJobs.addNode("FitShadowCascades", [this, &camera] { fitShadowCascades(camera); }, { updateObjectsNode });
+
+	// Occluders of the main view are binned by chunks of objects, then rasterized by tiles before the view is culled
+	const JobGraph::NodeId addOccludersNode = frameJobs.addParallelNode("AddOccluders", frameOcclusionBuffer != nullptr ? numViewCandidates : 0, FRAME_JOB_GRAIN_SIZE,
+		[this, &objects, viewCandidates](uint32 chunk, uint32 begin, uint32 end)
+		{
+			for (uint32 i = begin; i < end; i++)
+			{
+				const ObjectSnapshot& object = objects[viewCandidates != nullptr ? viewCandidates[i] : i];
+				if (object.enabled)
+					object.renderer->addOccluders(*frameOcclusionBuffer, chunk, object.world, viewFrustums[(int)FrameView::MAIN], (uint32)FrameView::MAIN);
+			}
+		}, { updateObjectsNode });
+	const JobGraph::NodeId rasterizeOcclusionNode = frameJobs.addParallelNode("RasterizeOcclusion", frameOcclusionBuffer != nullptr ? OcclusionBuffer::NUM_TILES : 0, 1,
+		[this](uint32 tile, uint32, uint32) { frameOcclusionBuffer->rasterizeTile(tile); }, { addOccludersNode });
+
+	JobGraph::NodeId visibilityNodes[(int)FrameView::_COUNT];
+	for (int view = 0; view < (int)FrameView::_COUNT; view++)
+	{
+		const bool isShadowView = view >= (int)FrameView::SHADOW_CASCADE_0;
+		const bool viewNeeded = !isShadowView || (uint32)(view - (int)FrameView::SHADOW_CASCADE_0) < numFrameShadowCascades;
+		const uint32* candidates = isShadowView ? casterCandidates : viewCandidates;
+		const uint32 numCandidates = isShadowView ? numCasterCandidates : numViewCandidates;
+		visibilityNodes[view] = frameJobs.addParallelNode("Visibility", viewNeeded ? numCandidates : 0, FRAME_JOB_GRAIN_SIZE,
+			[this, &objects, view, isShadowView, candidates](uint32 chunk, uint32 begin, uint32 end)
+			{
+				// Static casters of a cascade go to their own list, only if its static layer is redrawn
+				const uint32 cascade = view - (int)FrameView::SHADOW_CASCADE_0;
+				const bool separateStaticCasters = isShadowView && frameStaticShadowCache != nullptr;
+				const bool drawStaticCasters = separateStaticCasters && frameStaticShadowCache->getTileUpdate(cascade).numRects > 0;
+				const OcclusionBuffer* occlusion = view == (int)FrameView::MAIN ? frameOcclusionBuffer : nullptr;
+
+				// Bounds of the chunk are culled a batch at a time, then the submeshes of the visible objects
+				culling::BoxBatch batches[FRAME_JOB_GRAIN_SIZE / culling::BATCH_SIZE];
+				uint8 visibleMasks[FRAME_JOB_GRAIN_SIZE / culling::BATCH_SIZE];
+				const uint32 count = end - begin;
+				const uint32 numBatches = JobGraph::get_num_chunks(count, culling::BATCH_SIZE);
+				uint32 objectIndices[FRAME_JOB_GRAIN_SIZE];
+				for (uint32 i = 0; i < count; i++)
+					objectIndices[i] = candidates != nullptr ? candidates[begin + i] : begin + i;
+				for (uint32 i = 0; i < count; i++)
+					culling::set_box(batches, i, objects[objectIndices[i]].renderer->getWorldBounds());
+				for (uint32 i = count; i < numBatches * culling::BATCH_SIZE; i++)
+					culling::clear_box(batches, i);
+				culling::cull_boxes(viewFrustums[view], batches, numBatches, visibleMasks);
+
+				CullingStats& stats = chunkCullingStats[view][chunk];
+				for (uint32 i = 0; i < count; i++)
+				{
+					const ObjectSnapshot& object = objects[objectIndices[i]];
+					if (!object.enabled)
+						continue;
+					stats.numObjects++;
+					if ((visibleMasks[i / culling::BATCH_SIZE] & (1 << (i % culling::BATCH_SIZE))) == 0)
+						continue;
+					const bool isStaticCaster = separateStaticCasters && object.renderer->isStaticCaster();
+					if (isStaticCaster && !drawStaticCasters)
+					{
+						stats.numCachedObjects++;
+						continue;
+					}
+					if (occlusion != nullptr && !occlusion->isVisible(object.renderer->getWorldBounds()))
+					{
+						stats.numOccludedObjects++;
+						object.renderer->hideSubmeshes(view);
+						continue;
+					}
+					stats.numVisibleObjects++;
+					stats.numSubmeshes += object.renderer->getNumSubmeshes();
+					stats.numVisibleSubmeshes += object.renderer->cullSubmeshes(viewFrustums[view], view, occlusion);
+					if (isStaticCaster)
+						visibleStaticCasters[cascade].add(chunk, object.renderer);
+					else
+						visibleObjects[view].add(chunk, object.renderer);
+				}
+			}, { isShadowView ? fitShadowCascadesNode : rasterizeOcclusionNode });
+	}
+
+	// Two shadow map draw lists per cascade from its own casters, the dynamic and the static ones
+	for (int list = 0; list < (int)FrameDrawList::_COUNT; list++)
+	{
+		const bool isStaticShadowList = list >= (int)FrameDrawList::STATIC_SHADOW_CASCADE_0;
+		const bool isShadowList = list >= (int)FrameDrawList::SHADOW_CASCADE_0;
+		const uint32 cascade = isStaticShadowList ? list - (int)FrameDrawList::STATIC_SHADOW_CASCADE_0 : list - (int)FrameDrawList::SHADOW_CASCADE_0;
+		const int view = isShadowList ? (int)FrameView::SHADOW_CASCADE_0 + cascade : (int)FrameView::MAIN;
+		const ChunkedObjects* listObjects = isStaticShadowList ? &visibleStaticCasters[cascade] : &visibleObjects[view];
+		const RenderPass pass = list == (int)FrameDrawList::FORWARD ? RenderPass::FORWARD : RenderPass::DEPTH;
+		const bool listNeeded = !isShadowList || (cascade < numFrameShadowCascades && (!isStaticShadowList || frameStaticShadowCache != nullptr));
+		XMFLOAT3 sortDirection;
+		XMStoreFloat3(&sortDirection, isShadowList ? frameSnapshot->mainLight.GetDirection() : camera.GetForward());
+		const JobGraph::NodeId buildNode = frameJobs.addParallelNode("BuildDrawList", listNeeded ? numChunks : 0, 1,
+			[this, view, list, pass, listObjects, sortDirection](uint32 chunk, uint32, uint32)
+			{
+				for (MeshRenderer* mr : listObjects->get(chunk))
+					mr->buildDrawItems(drawLists[list].getChunk(chunk), view, XMLoadFloat3(&sortDirection));
+				drawLists[list].setSortKeys(chunk, pass);
+			}, { visibilityNodes[view] });
+		const std::span<const ResId> batchCbsOfList = instancingEnabled ? std::span<const ResId>(batchCbIds) : std::span<const ResId>();
+		const JobGraph::NodeId sortNode = frameJobs.addNode("SortDrawList",
+			[this, list, pass, sortItems = drawListSortingEnabled, batchCbsOfList] { drawLists[list].sort(pass, sortItems, batchCbsOfList); }, { buildNode });
+		drawListNodes[list] = frameJobs.addParallelNode("RecordDrawList", listNeeded ? numChunks : 0, 1,
+			[this, list, pass](uint32 chunk, uint32, uint32) { drawLists[list].recordChunk(chunk, pass); }, { sortNode });
+	}
+
+	frameJobs.execute();
+}
+
+void WorldRenderer::uploadObjectConstants()
+{
+	frameJobs.wait(updateObjectsNode);
+
+	// Objects are indexed by their place in the snapshot, the buffer only grows
+	const uint32 numObjects = (uint32)frameSnapshot->objects.size();
+	const bool resized = objectsBuffer == nullptr || objectsBuffer->getDesc().numElements < numObjects;
+	if (resized)
+	{
+		uint32 capacity = 1024;
+		while (capacity < numObjects)
+			capacity *= 2;
+		objectData.resize(capacity);
+		BufferDesc objectsDesc("objects", sizeof(ObjectData), capacity, ResourceUsage::DEFAULT, BIND_SHADER_RESOURCE, 0,
+			RESOURCE_MISC_BUFFER_STRUCTURED);
+		objectsBuffer.reset(drv->createBuffer(objectsDesc));
+	}
+
+	// Dirty objects are in index order, those close to each other are uploaded together with the ones between them. A
+	// new buffer is uploaded whole, the objects that didn't change keep their data from the previous frames.
+	static constexpr uint32 MAX_UPLOAD_GAP = 16;
+	uint32 runBegin = 0;
+	uint32 runEnd = 0;
+	const auto uploadRun = [&]
+	{
+		if (runEnd > runBegin && !resized)
+			objectsBuffer->updateData(&objectData[runBegin], runBegin, runEnd - runBegin);
+	};
+	numObjectUpdates = 0;
+	for (uint32 chunk = 0; chunk < dirtyObjects.numChunks; chunk++)
+	{
+		for (MeshRenderer* mr : dirtyObjects.get(chunk))
+		{
+			const uint32 index = mr->getObjectIndex();
+			objectData[index] = mr->getObjectData();
+			mr->uploadConstants();
+			numObjectUpdates++;
+			if (runEnd == runBegin || index < runBegin || index > runEnd + MAX_UPLOAD_GAP)
+			{
+				uploadRun();
+				runBegin = index;
+			}
+			runEnd = index + 1;
+		}
+	}
+	uploadRun();
+	if (resized)
+		objectsBuffer->updateData(objectData.data());
+}
+
+void WorldRenderer::ChunkedObjects::allocate(LinearArena& arena, uint32 num_chunks, uint32 chunk_size)
+{
+	objects = arena.allocate<MeshRenderer*>((size_t)num_chunks * chunk_size);
+	counts = arena.allocate<uint32>(num_chunks);
+	std::fill_n(counts, num_chunks, 0u);
+	numChunks = num_chunks;
+	chunkSize = chunk_size;
+}
+
+void WorldRenderer::uploadInstanceMaterials(const RenderSnapshot& snapshot)
+{
+	// Before the frame jobs, which read the indices while merging instances
+	bool changed = false;
+	for (size_t i = 0; i < snapshot.materials.size(); i++)
+	{
+		const MaterialSnapshot& material = snapshot.materials[i];
+		if (i >= MAX_INSTANCE_MATERIALS)
+		{
+			material.material->setInstanceIndex(Material::NO_INSTANCE_INDEX);
+			continue;
+		}
+		material.material->setInstanceIndex((uint32)i);
+		if (memcmp(&instanceMaterials[i], &material.constants, sizeof(material.constants)) != 0)
+		{
+			instanceMaterials[i] = material.constants;
+			changed = true;
+		}
+	}
+	if (changed)
+		instanceMaterialsBuffer->updateData(instanceMaterials.data());
+}
+
+void WorldRenderer::submitDrawList(FrameDrawList draw_list)
+{
+	frameJobs.wait(drawListNodes[(int)draw_list]);
+	DrawList& drawList = drawLists[(int)draw_list];
+	drawList.uploadInstances();
+	drawList.execute(*drv);
 }
\ No newline at end of file
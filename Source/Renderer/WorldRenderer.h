@@ -3,13 +3,21 @@
 #include <Common.h>
 
 #include <memory>
+#include <span>
 #include <vector>
 #include <string>
 
+#include <Util/JobGraph.h>
+#include <Util/LinearArena.h>
 #include <Util/ResIdHolder.h>
 
 #include "Camera.h"
+#include "ConstantBuffers.h"
+#include "Culling.h"
+#include "DrawList.h"
 #include "PostFx.h"
+#include "RenderSnapshot.h"
+#include "StaticShadowCache.h"
 
 class ITexture;
 class IBuffer;
@@ -23,6 +31,7 @@ class Water;
 class Sky;
 class EnvironmentLightingSystem;
 class VarianceShadowMap;
+class OcclusionBuffer;
 class IFullscreenExperiment;
 
 struct Transform;
@@ -39,8 +48,8 @@ public:
 
 	void onResize(int display_width, int display_height);
 	void update(float delta_time);
-	void beforeRender();
-	void render();
+	void captureSnapshot(RenderSnapshot& out_snapshot) const; // Main thread, while nothing is being rendered
+	void render(const RenderSnapshot& snapshot);
 	void render(const Camera& camera, ITexture& hdr_color_target, ITexture* tonemapped_color_target, ITexture& depth_target,
 		unsigned int hdr_color_slice, unsigned int tonemapped_color_slice, unsigned int depth_slice, bool ssao_enabled, bool antialiasing_enabled);
 
@@ -50,8 +59,12 @@ public:
 	void onMeshLoaded();
 	void onMaterialTexturesLoaded();
 	void onGlobalShaderKeywordsChanged();
-	unsigned int getShadowResolution();
+	unsigned int getShadowResolution() const { return shadowResolution; } // Of a cascade
 	void setShadowResolution(unsigned int shadow_resolution);
+	unsigned int getShadowCascadeCount() const { return numShadowCascades; }
+	void setShadowCascadeCount(unsigned int num_cascades);
+	bool isStaticShadowCacheEnabled() const { return staticShadowCacheEnabled; }
+	void setStaticShadowCacheEnabled(bool enabled);
 	void setShadowBias(int depth_bias, float slope_scaled_depth_bias);
 	void setSoftShadowMode(SoftShadowMode soft_shadow_mode);
 	void setWater(const Transform* water_transform);
@@ -67,6 +80,7 @@ public:
 	void lightingGui();
 	void shadowMapGui();
 	void ssaoTexGui();
+	void statsGui();
 
 	struct CameraInputState
 	{
@@ -89,18 +103,102 @@ public:
 	bool shadowEnabled = true;
 	int shadowDepthBias = 0;
 	float shadowSlopeScaledDepthBias = 0.0f;
-	float shadowDistance = 30.0f;
+	float shadowDistance = 80.0f;
 	float directionalShadowDistance = 20.0f;
+	float shadowCascadeSplitLambda = 0.75f; // Blends the cascade splits from uniform (0) to logarithmic (1)
 	float poissonShadowSoftness = 0.003f;
+	bool occlusionCullingEnabled = true;
+	bool sceneTreeCullingEnabled = true;
+	bool drawListSortingEnabled = true;
+	bool instancingEnabled = true;
 
 private:
 	void initResolutionDependentResources();
 	void closeResolutionDependentResources();
 
-	void setupFrame(const Camera& camera, XMVECTOR& out_shadow_camera_pos, XMMATRIX& out_light_view_matrix, XMMATRIX& out_light_proj_matrix);
-	void setupShadowPass(const XMVECTOR& shadow_camera_pos, const XMMATRIX& light_view_matrix, const XMMATRIX& light_proj_matrix);
+	void beforeRender();
+
+	void createShadowMap();
+	void setupFrame();
+	void updateStaticShadowCache();
+	void setupShadowPass();
+	void setupShadowCascade(uint32 cascade, const StaticShadowCache::Rect& rect);
 	void setupDepthAndForwardPasses(const Camera& camera, ITexture& hdr_color_target, ITexture& depth_target, unsigned int hdr_color_slice, unsigned int depth_slice);
-	void performRenderPass(RenderPass pass);
+
+	enum class FrameView { MAIN, SHADOW_CASCADE_0, _COUNT = SHADOW_CASCADE_0 + MAX_SHADOW_CASCADES };
+	enum class FrameDrawList
+	{
+		DEPTH_PREPASS, FORWARD,
+		SHADOW_CASCADE_0, // Dynamic casters, drawn each frame
+		STATIC_SHADOW_CASCADE_0 = SHADOW_CASCADE_0 + MAX_SHADOW_CASCADES, // Drawn into the static shadow cache when it's redrawn
+		_COUNT = STATIC_SHADOW_CASCADE_0 + MAX_SHADOW_CASCADES
+	};
+
+	// Objects picked by the chunks of a frame job, allocated from the frame arena. Each chunk has room for all objects of
+	// its range, so chunks append without locking or growing.
+	struct ChunkedObjects
+	{
+		MeshRenderer** objects = nullptr;
+		uint32* counts = nullptr;
+		uint32 numChunks = 0;
+		uint32 chunkSize = 0;
+
+		void allocate(LinearArena& arena, uint32 num_chunks, uint32 chunk_size);
+		void add(uint32 chunk, MeshRenderer* mr) { objects[chunk * chunkSize + counts[chunk]++] = mr; }
+		std::span<MeshRenderer* const> get(uint32 chunk) const { return { objects + chunk * chunkSize, counts[chunk] }; }
+	};
+
+	// Objects and submeshes of a view, the submeshes only of the visible objects. Visible static casters are cached if
+	// the static shadow cache doesn't need to redraw them. Objects in the main view can be occluded.
+	struct CullingStats
+	{
+		uint32 numObjects;
+		uint32 numVisibleObjects;
+		uint32 numCachedObjects;
+		uint32 numOccludedObjects;
+		uint32 numSubmeshes;
+		uint32 numVisibleSubmeshes;
+	};
+
+	// World bounds of the enabled objects of a chunk, min is above max if there are none
+	struct ChunkBounds
+	{
+		XMFLOAT3 min;
+		XMFLOAT3 max;
+	};
+
+	// Static casters of a chunk, to find out if the static shadow cache has to be redrawn
+	struct ChunkStaticCasters
+	{
+		uint32 count;
+		uint64 key; // Sum of hashes of the renderers
+		bool moved; // Any of them, their constants changed
+	};
+
+	// Orthographic view of the main light, fitted around the receivers of a cascade (what the camera sees between two
+	// splits) clipped to the scene bounds. Each cascade has a tile of the shadow map atlas.
+	struct ShadowCascade
+	{
+		XMMATRIX view;
+		XMMATRIX projection;
+		XMVECTOR position; // Center of the near plane
+		float nearZ;
+		float farZ;
+		float width;
+		float texelSize;
+		int32 originX; // Of the min corner, in texels
+		int32 originY;
+		float splitFar; // View depth
+	};
+
+	void cullSnapshotObjects(RenderSnapshot& snapshot) const;
+	void startFrameJobs(const Camera& camera);
+	void fitShadowCascades(const Camera& camera);
+	void fitShadowCascade(const Camera& camera, uint32 cascade, float split_near, float split_far, const XMMATRIX& light_rotation, const BoundingBox* light_space_scene_bounds);
+	uint32 getShadowAtlasGridSize() const { return numShadowCascades > 1 ? 2 : 1; } // Tiles per side
+	void uploadObjectConstants();
+	void uploadInstanceMaterials(const RenderSnapshot& snapshot);
+	void submitDrawList(FrameDrawList draw_list);
 
 	float time = 0.f;
 	unsigned int frameCount = 0;
@@ -117,7 +215,11 @@ private:
 	ResIdHolder depthPrepassWireframeRenderStateId = BAD_RESID;
 	ResIdHolder forwardRenderStateId = BAD_RESID;
 	ResIdHolder forwardWireframeRenderStateId = BAD_RESID;
-	std::unique_ptr<ITexture> shadowMap;
+	std::unique_ptr<ITexture> shadowMap; // Atlas of the cascades
+	unsigned int shadowResolution = 0;
+	unsigned int numShadowCascades = 0;
+	std::unique_ptr<StaticShadowCache> staticShadowCache;
+	bool staticShadowCacheEnabled = true;
 	ResIdHolder shadowSampler = BAD_RESID;
 	ResIdHolder shadowRenderStateId = BAD_RESID;
 	ResIdHolder shadowRenderStateNoBiasId = BAD_RESID;
@@ -126,6 +228,47 @@ private:
 	std::unique_ptr<IBuffer> perCameraCb;
 	std::unique_ptr<IBuffer> perObjectCb;
 
+	// Scene state rendered in the current frame. The members above it was captured from may already be simulating the
+	// next frame meanwhile.
+	const RenderSnapshot* frameSnapshot = nullptr;
+
+	// CPU work of rendering the scene, run on the thread pool: updating objects -> visibility per view -> draw list per
+	// pass, sorted and recorded to command buffers. Lists are executed on the rendering thread as soon as they are recorded. The
+	// depth prepass and forward lists are both built from the visibility of the main view, which waits for its
+	// occluders to be rasterized.
+	JobGraph frameJobs{ JobPriority::CRITICAL };
+	JobGraph::NodeId updateObjectsNode = 0;
+	JobGraph::NodeId fitShadowCascadesNode = 0;
+	JobGraph::NodeId drawListNodes[(int)FrameDrawList::_COUNT] = {};
+	LinearArena frameArena; // Reset when the frame jobs start
+	ChunkedObjects dirtyObjects;
+	ChunkBounds* chunkSceneBounds = nullptr; // Per chunk of snapshot objects, in the frame arena
+	ChunkStaticCasters* chunkStaticCasters = nullptr; // Per chunk of snapshot objects, in the frame arena
+	ChunkedObjects visibleStaticCasters[MAX_SHADOW_CASCADES]; // Only if the cascade's static layer is redrawn
+	StaticShadowCache* frameStaticShadowCache = nullptr; // Null if not used in the frame
+	ShadowCascade shadowCascades[MAX_SHADOW_CASCADES];
+	uint32 numFrameShadowCascades = 0; // Cascades rendered in the frame, none if shadows are off
+	std::unique_ptr<OcclusionBuffer> occlusionBuffer; // Of the main view
+	OcclusionBuffer* frameOcclusionBuffer = nullptr; // Null if not used in the frame
+	uint32 numOccluderTriangles = 0; // Of the last frame
+	uint32 numTreeViewObjects = 0; // Of the last frame, found by the scene tree
+	uint32 numTreeShadowCasters = 0;
+	ChunkedObjects visibleObjects[(int)FrameView::_COUNT];
+	culling::Frustum viewFrustums[(int)FrameView::_COUNT];
+	CullingStats* chunkCullingStats[(int)FrameView::_COUNT] = {}; // Per chunk of the culled objects, in the frame arena
+	CullingStats cullingStats[(int)FrameView::_COUNT] = {}; // Of the last frame
+	DrawList drawLists[(int)FrameDrawList::_COUNT];
+	DrawList::Stats drawStats = {}; // Of the last frame, all lists together
+	static constexpr uint32 MAX_INSTANCE_BATCHES = 64; // Per draw list
+	static constexpr uint32 MAX_INSTANCE_MATERIALS = 1024; // Materials past it are drawn without instancing
+	std::unique_ptr<IBuffer> batchCbs[MAX_INSTANCE_BATCHES]; // Of batch i, i * DrawList::MAX_BATCH_INSTANCES
+	ResId batchCbIds[MAX_INSTANCE_BATCHES];
+	std::unique_ptr<IBuffer> instanceMaterialsBuffer;
+	std::unique_ptr<IBuffer> objectsBuffer; // Of the snapshot objects, by their index
+	std::vector<ObjectData> objectData; // Uploaded to the objects buffer, as large as it
+	uint32 numObjectUpdates = 0; // Of the last frame
+	std::vector<PerMaterialConstantBufferData> instanceMaterials; // Uploaded to the buffer
+
 	std::unique_ptr<TemporalAntiAliasing> taa;
 	std::unique_ptr<ITexture> antialiasedHdrTargets[2];
 	int currentAntiAliasedTarget = 0;
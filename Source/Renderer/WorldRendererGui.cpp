@@ -97,12 +97,31 @@ void WorldRenderer::lightingGui()
 						ImGui::SetTooltip("Radius for poisson samples in shadowmap uv");
 				}
 
-				ImGui::SliderFloat("Shadow distance", &shadowDistance, 1.0f, 100.0f);
+				ImGui::SliderFloat("Shadow distance", &shadowDistance, 1.0f, 200.0f);
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Distance from the camera up to which shadows are received");
 				ImGui::SliderFloat("Directional distance", &directionalShadowDistance, 1.0f, 100.0f);
-
-				int shadowResolution = getShadowResolution();
-				if (ImGui::InputInt("Resolution", &shadowResolution, 512, 1024))
-					setShadowResolution((int)fmaxf((float)shadowResolution, 128));
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Distance towards the light before the receivers, beyond which casters are clamped to the near plane");
+
+				int numCascades = getShadowCascadeCount();
+				if (ImGui::SliderInt("Cascades", &numCascades, 1, MAX_SHADOW_CASCADES))
+					setShadowCascadeCount(numCascades);
+				ImGui::SliderFloat("Cascade split lambda", &shadowCascadeSplitLambda, 0.0f, 1.0f);
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("0: uniform splits, 1: logarithmic splits");
+
+				bool cacheEnabled = isStaticShadowCacheEnabled();
+				if (ImGui::Checkbox("Static shadow cache", &cacheEnabled))
+					setStaticShadowCacheEnabled(cacheEnabled);
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Static objects are only redrawn into the shadow map when the light, they or the cascades move");
+
+				int resolution = getShadowResolution();
+				if (ImGui::InputInt("Resolution", &resolution, 512, 1024))
+					setShadowResolution((int)fmaxf((float)resolution, 128));
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Of a cascade");
 
 				bool shadowBiasChanged = false;
 				shadowBiasChanged |= ImGui::DragInt("Depth bias", &shadowDepthBias, 100.0f);
@@ -127,10 +146,10 @@ void WorldRenderer::lightingGui()
 
 void WorldRenderer::shadowMapGui()
 {
-	const unsigned int shadowResolution = getShadowResolution();
-	static float zoom = 512.0f / shadowResolution;
+	const unsigned int atlasResolution = shadowMap->getDesc().width;
+	static float zoom = 512.0f / atlasResolution;
 	ImGui::SliderFloat("Zoom", &zoom, 0.1f, 5.0f);
-	ImGui::Image(shadowMap->getViewHandle(), ImVec2(zoom * shadowResolution, zoom * shadowResolution));
+	ImGui::Image(shadowMap->getViewHandle(), ImVec2(zoom * atlasResolution, zoom * atlasResolution));
 }
 
 void WorldRenderer::ssaoTexGui()
@@ -142,6 +161,45 @@ void WorldRenderer::ssaoTexGui()
 	ImGui::Image(ssaoTex->getViewHandle(), ImVec2(zoom * ssaoTexRes.x, zoom * ssaoTexRes.y));
 }
 
+void WorldRenderer::statsGui()
+{
+	const char* viewNames[(int)FrameView::_COUNT] = { "Main", "CSM 0", "CSM 1", "CSM 2", "CSM 3" };
+	static_assert(MAX_SHADOW_CASCADES == 4, "A name per cascade view");
+	ImGui::Checkbox("Scene tree culling", &sceneTreeCullingEnabled);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Views only cull the objects found in the scene tree, shadow cascades those in the volume of the casters of all cascades");
+	if (sceneTreeCullingEnabled)
+		ImGui::Text("Scene tree: %u view objects, %u shadow casters", numTreeViewObjects, numTreeShadowCasters);
+	ImGui::Checkbox("Occlusion culling", &occlusionCullingEnabled);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Objects and submeshes of the main view behind large opaque submeshes are not drawn");
+	if (occlusionCullingEnabled)
+		ImGui::Text("Occluder triangles: %u", numOccluderTriangles);
+	for (int view = 0; view < (int)FrameView::_COUNT; view++)
+	{
+		const CullingStats& stats = cullingStats[view];
+		ImGui::Text("%-6s objects:        %u culled / %u", viewNames[view], stats.numObjects - stats.numVisibleObjects - stats.numCachedObjects - stats.numOccludedObjects, stats.numObjects);
+		if (stats.numCachedObjects > 0)
+			ImGui::Text("%-6s cached objects: %u", viewNames[view], stats.numCachedObjects);
+		if (stats.numOccludedObjects > 0)
+			ImGui::Text("%-6s occluded objects: %u", viewNames[view], stats.numOccludedObjects);
+		ImGui::Text("%-6s submeshes:      %u culled / %u", viewNames[view], stats.numSubmeshes - stats.numVisibleSubmeshes, stats.numSubmeshes);
+	}
+
+	ImGui::Checkbox("Sort draw lists", &drawListSortingEnabled);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Draws are grouped by shader and material, depth passes are drawn front to back");
+	ImGui::Checkbox("Instancing", &instancingEnabled);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Draws of the same submesh, shader variant and textures are merged into instanced draws");
+	ImGui::Text("Draws:            %u", drawStats.numDraws);
+	ImGui::Text("Instanced draws:  %u, %u instances", drawStats.numInstancedDraws, drawStats.numInstances);
+	ImGui::Text("Material changes: %u", drawStats.numMaterialChanges);
+	ImGui::Text("Shader changes:   %u", drawStats.numShaderChanges);
+	ImGui::Text("State changes:    %u, %u redundant skipped", drawStats.numStateChanges, drawStats.numRedundantStateChanges);
+	ImGui::Text("Object updates:   %u", numObjectUpdates);
+}
+
 REGISTER_IMGUI_WINDOW("Lighting settings", []() { if (wr != nullptr) wr->lightingGui(); });
 REGISTER_IMGUI_WINDOW_EX("Shadowmap debug", nullptr, 200, ImGuiWindowFlags_HorizontalScrollbar, []() { if (wr != nullptr) wr->shadowMapGui(); });
 REGISTER_IMGUI_WINDOW_EX("SSAO tex debug", nullptr, 201, ImGuiWindowFlags_HorizontalScrollbar, []() { if (wr != nullptr) wr->ssaoTexGui(); });
\ No newline at end of file
@@ -1,12 +1,16 @@
 #ifndef CONSTANT_BUFFERS_INCLUDED
 #define CONSTANT_BUFFERS_INCLUDED
 
+#define MAX_SHADOW_CASCADES 4 // Same as in ConstantBuffers.h
+
 cbuffer PerFrameConstantBuffer : register(b0)
 {
 	float4 _MainLightColor;
 	float4 _MainLightDirection;
-	float4x4 _MainLightShadowMatrix;
-	float4 _MainLightShadowParams; // x: resolution, y: 1/resolution, z: range, w: radius for poisson samples in shadowmap uv
+	float4x4 _MainLightShadowMatrices[MAX_SHADOW_CASCADES]; // To the cascade's tile of the shadowmap atlas
+	float4 _MainLightCascadeParams[MAX_SHADOW_CASCADES]; // x: range, y: radius for poisson samples in shadowmap uv, z,w: unused
+	float4 _MainLightCascadeSplits; // View depth where each cascade ends
+	float4 _MainLightShadowParams; // x: resolution, y: 1/resolution, z: cascade count, w: unused
 	float4 _TonemappingParams; // x: exposure, y,z,w: unused
 	float4 _TimeParams; // x: elapsed seconds, y,z,w: unused
 }
@@ -25,13 +29,80 @@ cbuffer PerCameraConstantBuffer : register(b1)
 	float4 _ViewVecRB;
 }
 
+// Objects of the scene, updated once per frame for the ones that changed. Vertex shaders call SetupObject, or
+// SetupInstance in instanced draws, to read the one they draw into _World and _ObjectParams0.
+struct ObjectData
+{
+	column_major float4x4 world;
+	float4 objectParams0;
+};
+
+StructuredBuffer<ObjectData> _Objects : register(t7);
+
+static float4x4 _World;
+static float4 _ObjectParams0;
+
+void SetupObject(uint object_index)
+{
+	ObjectData object = _Objects[object_index];
+	_World = object.world;
+	_ObjectParams0 = object.objectParams0;
+}
+
+#if INSTANCING_ON
+
+// Instanced draws read the object and material of each instance from buffers, into the globals the constant buffers
+// have otherwise. SV_InstanceID starts from 0 whatever the start instance is, so the batch constant buffer has the
+// first instance of the draw.
+struct InstanceData
+{
+	uint4 instanceParams; // x: object index, y: material index, z,w: unused
+};
+
+struct InstanceMaterialData
+{
+	float4 materialColor;
+	float4 materialParams0;
+	float4 materialParams1;
+};
+
+StructuredBuffer<InstanceData> _Instances : register(t8);
+StructuredBuffer<InstanceMaterialData> _InstanceMaterials : register(t9);
+
+cbuffer PerBatchConstantBuffer : register(b2)
+{
+	uint4 _BatchParams; // x: first instance, y,z,w: unused
+}
+
+static float4 _MaterialColor;
+static float4 _MaterialParams0;
+static float4 _MaterialParams1;
+
+void SetupInstanceMaterial(uint material_index)
+{
+	InstanceMaterialData material = _InstanceMaterials[material_index];
+	_MaterialColor = material.materialColor;
+	_MaterialParams0 = material.materialParams0;
+	_MaterialParams1 = material.materialParams1;
+}
+
+// At the start of the vertex shader. Returns the material index, to pass to SetupInstanceMaterial in the pixel shader.
+uint SetupInstance(uint instance_id)
+{
+	InstanceData instance = _Instances[_BatchParams.x + instance_id];
+	SetupObject(instance.instanceParams.x);
+	SetupInstanceMaterial(instance.instanceParams.y);
+	return instance.instanceParams.y;
+}
+
+#else
+
 cbuffer PerObjectConstantBuffer : register(b2)
 {
-	float4x4 _World;
-	float4 _ObjectParams0;
+	uint4 _ObjectIndexParams; // x: object index, y,z,w: unused
 }
 
-#define _ObjectUvScale _ObjectParams0.x
+#define _ObjectIndex _ObjectIndexParams.x
 
 cbuffer PerMaterialConstantBuffer : register(b3)
 {
@@ -40,6 +111,10 @@ cbuffer PerMaterialConstantBuffer : register(b3)
 	float4 _MaterialParams1;
 }
 
+#endif
+
+#define _ObjectUvScale _ObjectParams0.x
+
 #define _MaterialMetalnessScale _MaterialParams0.x
 #define _MaterialMetalnessBias _MaterialParams0.y
 #define _MaterialRoughnessScale _MaterialParams0.z
@@ -2,6 +2,7 @@
 
 float4 ErrorVS(float4 pos : POSITION) : SV_POSITION
 {
+	SetupObject(_ObjectIndex);
 	float4 worldPos = mul(_World, pos);
 	return mul(_ViewProjection, worldPos);
 }
@@ -32,7 +32,7 @@
 
 	#if SOFT_SHADOW_POISSON_VARIABLE_PENUMBRA
 		#define MAX_PENUMBRA_DISTANCE 5
-		float get_shadow_blocker_distance(float2 shadowmap_uv, float pixel_depth)
+		float get_shadow_blocker_distance(float2 shadowmap_uv, float pixel_depth, float range)
 		{
 			int2 shadowmapPos = shadowmap_uv * _MainLightShadowParams.x - 0.5;
 			float blockerDepth = 1;
@@ -40,7 +40,7 @@
 			[unroll] for (int j = -extent; j <= extent; j++)
 				[unroll] for (int i = -extent; i <= extent; i++)
 					blockerDepth = min(blockerDepth, _MainLightShadowmap[shadowmapPos + int2(i, j)]);
-			float blockerDistance = (pixel_depth - blockerDepth) * _MainLightShadowParams.z;
+			float blockerDistance = (pixel_depth - blockerDepth) * range;
 			return blockerDistance;
 		}
 	#endif
@@ -71,8 +71,16 @@
 	#define SOFT_SHADOW_SAMPLES_FUNC SampleShadow_ComputeSamples_Tent_5x5
 #endif
 
-float SampleMainLightShadow(float4 shadow_coords, float2 screen_uv)
+float SampleMainLightShadow(float3 world_pos, float2 screen_uv)
 {
+	// Cascades are picked by view depth, nothing is shadowed beyond the last one
+	float viewDepth = mul(_View, float4(world_pos, 1)).z;
+	uint cascade = (uint)dot(float4(viewDepth >= _MainLightCascadeSplits), 1);
+	if (cascade >= (uint)_MainLightShadowParams.z)
+		return 1;
+	float4 cascadeParams = _MainLightCascadeParams[cascade];
+
+	float4 shadow_coords = mul(_MainLightShadowMatrices[cascade], float4(world_pos, 1));
 	float2 shadowmapUv = shadow_coords.xy / shadow_coords.w;
 	float pixelDepth = shadow_coords.z / shadow_coords.w;
 
@@ -88,10 +96,10 @@ float SampleMainLightShadow(float4 shadow_coords, float2 screen_uv)
 	                            -sinA, cosA };
 
 	#if SOFT_SHADOW_POISSON_VARIABLE_PENUMBRA
-		float blockerDistance = get_shadow_blocker_distance(shadowmapUv, pixelDepth);
-		rotationMatrix *= remap_clamped(0, MAX_PENUMBRA_DISTANCE, 0, _MainLightShadowParams.w, blockerDistance);
+		float blockerDistance = get_shadow_blocker_distance(shadowmapUv, pixelDepth, cascadeParams.x);
+		rotationMatrix *= remap_clamped(0, MAX_PENUMBRA_DISTANCE, 0, cascadeParams.y, blockerDistance);
 	#else
-		rotationMatrix *= _MainLightShadowParams.w;
+		rotationMatrix *= cascadeParams.y;
 	#endif
 
 	float result = 0;
@@ -103,7 +111,7 @@ float SampleMainLightShadow(float4 shadow_coords, float2 screen_uv)
 	result /= SOFT_SHADOW_POISSON_SAMPLES;
 
 	// Multiply shadow result with (1 + something) to bias self shadowing due to big sampling disk in UV space
-	result = saturate(result * (1 + 1000 * _MainLightShadowParams.w));
+	result = saturate(result * (1 + 1000 * cascadeParams.y));
 	return result;
 #elif SOFT_SHADOWS_VARIANCE
 	float2 moments = _MainLightVarianceShadowmap.Sample(_LinearSampler, shadowmapUv);
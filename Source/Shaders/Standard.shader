@@ -1,6 +1,7 @@
 #pragma warning(disable:3568) // warning X3568 : 'multi_compile' : unknown pragma ignored
 #pragma multi_compile ALPHA_TEST_OFF ALPHA_TEST_ON
 #pragma multi_compile SOFT_SHADOWS_OFF SOFT_SHADOWS_TENT SOFT_SHADOWS_VARIANCE SOFT_SHADOWS_POISSON
+#pragma multi_compile INSTANCING_OFF INSTANCING_ON
 
 //--------------------------------------------------------------------------------------
 // Includes
@@ -26,6 +27,9 @@ struct VSInputStandard
 	float3 normal : NORMAL;
 	float4 color : COLOR;
 	float2 uv : TEXCOORD;
+#if INSTANCING_ON
+	uint instanceId : SV_InstanceID;
+#endif
 };
 
 struct VSOutputStandardForward
@@ -35,7 +39,9 @@ struct VSOutputStandardForward
 	float4 color : COLOR;
 	float2 uv : TEXCOORD0;
 	float3 worldPos : TEXCOORD1;
-	float4 shadowCoords : TEXCOORD2;
+#if INSTANCING_ON
+	nointerpolation uint materialIndex : MATERIAL_INDEX;
+#endif
 };
 
 struct VSOutputStandardShadow
@@ -55,6 +61,11 @@ struct VSOutputStandardShadow
 VSOutputStandardForward StandardForwardVS(VSInputStandard v)
 {
 	VSOutputStandardForward o;
+#if INSTANCING_ON
+	o.materialIndex = SetupInstance(v.instanceId);
+#else
+	SetupObject(_ObjectIndex);
+#endif
 
 	float4 worldPos = mul(_World, v.position);
 	o.position = mul(_ViewProjection, worldPos);
@@ -63,20 +74,22 @@ VSOutputStandardForward StandardForwardVS(VSInputStandard v)
 	o.color = v.color;
 	o.uv = v.uv * _MaterialUvScale * _ObjectUvScale;
 	o.worldPos = worldPos.xyz;
-	o.shadowCoords = mul(_MainLightShadowMatrix, worldPos);
 
 	return o;
 }
 
 float4 StandardOpaqueForwardPS(VSOutputStandardForward i) : SV_TARGET
 {
+#if INSTANCING_ON
+	SetupInstanceMaterial(i.materialIndex);
+#endif
 	float4 c = 1;
 	float2 screenUv = i.position.xy * _ViewportResolution.zw;
 
 	float3 pointToEye = _CameraWorldPosition.xyz - i.worldPos;
 	SurfaceOutput s = Surface(pointToEye, i.normal, i.uv, i.color);
 
-	float mainLightShadowAttenuation = SampleMainLightShadow(i.shadowCoords, screenUv);
+	float mainLightShadowAttenuation = SampleMainLightShadow(i.worldPos, screenUv);
 	float ssao = _SsaoTex.Sample(_SsaoTexSampler, screenUv);
 	c.rgb = Lighting(s, pointToEye, mainLightShadowAttenuation, ssao);
 
@@ -88,6 +101,11 @@ float4 StandardOpaqueForwardPS(VSOutputStandardForward i) : SV_TARGET
 VSOutputStandardShadow StandardDepthOnlyVS(VSInputStandard v)
 {
 	VSOutputStandardShadow o;
+#if INSTANCING_ON
+	SetupInstance(v.instanceId);
+#else
+	SetupObject(_ObjectIndex);
+#endif
 
 	float4 worldPos = mul(_World, v.position);
 	o.position = mul(_ViewProjection, worldPos);
@@ -0,0 +1,17 @@
+#include "PostFxCommon.hlsl"
+
+Texture2D<float> _SourceShadowMap : register(t0);
+
+cbuffer StaticShadowCacheConstantBuffer : register(b4)
+{
+	int4 _SourceTileRect; // Texels of the atlas, max exclusive. Empty to clear the tile.
+	int4 _SourceOffset; // xy: from the target texel to the source texel, zw: unused
+}
+
+float ShiftStaticShadowCachePS(DefaultPostFxVsOutput i) : SV_DEPTH
+{
+	int2 sourceTexel = int2(i.position.xy) + _SourceOffset.xy;
+	if (any(sourceTexel < _SourceTileRect.xy) || any(sourceTexel >= _SourceTileRect.zw))
+		return 1;
+	return _SourceShadowMap[sourceTexel];
+}
@@ -53,7 +53,6 @@ struct VSOutputStandardForward
 	float3 normal : NORMAL;
 	float4 normalUvs : TEXCOORD0;
 	float3 worldPos : TEXCOORD1;
-	float4 shadowCoords : TEXCOORD2;
 };
 
 //--------------------------------------------------------------------------------------
@@ -83,13 +82,12 @@ VSOutputStandardForward WaterVS(uint vertex_id : SV_VertexID)
 	float4 worldPos = mul(_WaterWorldTransform, objPos);
 	o.position = mul(_ViewProjection, worldPos);
 
-	o.normal = normalize(mul(_World, float4(0, 1, 0, 0)).xyz);
+	o.normal = normalize(mul(_WaterWorldTransform, float4(0, 1, 0, 0)).xyz);
 
 	o.normalUvs.xy = (worldPos.xz + _NormalAnimSpeed1 * _TimeParams.x) * _NormalTiling1;
 	o.normalUvs.zw = (worldPos.xz + _NormalAnimSpeed2 * _TimeParams.x) * _NormalTiling2;
 
 	o.worldPos = worldPos.xyz;
-	o.shadowCoords = mul(_MainLightShadowMatrix, worldPos);
 
 	return o;
 }
@@ -217,7 +215,7 @@ float4 WaterPS(VSOutputStandardForward i) : SV_TARGET
 	float3 pointToEye = _CameraWorldPosition.xyz - i.worldPos;
 	WaterSurfaceOutput s = WaterSurface(pointToEye, i.normal, i.normalUvs, screenUv);
 
-	float mainLightShadowAttenuation = SampleMainLightShadow(i.shadowCoords, screenUv);
+	float mainLightShadowAttenuation = SampleMainLightShadow(i.worldPos, screenUv);
 	float ssao = 1;
 	c.rgb = WaterLighting(s, pointToEye, mainLightShadowAttenuation, ssao);
 
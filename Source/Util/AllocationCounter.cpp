@@ -0,0 +1,155 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <Util/AutoImGui.h>
+
+namespace allocation_counter
+{
+	static constexpr uint32 NUM_STRIPES = 16;
+
+	// Threads are spread over the stripes, so they don't fight over one cache line
+	struct alignas(64) Stripe
+	{
+		std::atomic<uint64> numAllocations;
+		std::atomic<uint64> numBytes;
+	};
+
+	// Constant initialized, allocations can happen before any dynamic initialization
+	static Stripe stripes[NUM_STRIPES];
+	static std::atomic<uint32> next_stripe_index = 0;
+	static thread_local uint32 tls_stripe_index = NUM_STRIPES;
+
+	// Main thread only
+	static uint64 num_allocations_at_frame_start = 0;
+	static uint64 num_allocations_last_frame = 0;
+	static uint32 num_frames_to_check = 0;
+	static uint32 num_checked_frames = 0;
+	static uint32 num_allocating_frames = 0;
+	static uint64 num_checked_allocations = 0;
+	static uint64 max_allocations_per_frame = 0;
+
+	static void count(size_t size)
+	{
+		if (tls_stripe_index == NUM_STRIPES)
+			tls_stripe_index = next_stripe_index.fetch_add(1, std::memory_order_relaxed) % NUM_STRIPES;
+		Stripe& stripe = stripes[tls_stripe_index];
+		stripe.numAllocations.fetch_add(1, std::memory_order_relaxed);
+		stripe.numBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	static void* allocate(size_t size)
+	{
+		count(size);
+		return malloc(size != 0 ? size : 1);
+	}
+
+	static void* allocate_aligned(size_t size, std::align_val_t alignment)
+	{
+		count(size);
+		return _aligned_malloc(size != 0 ? size : 1, (size_t)alignment);
+	}
+
+	uint64 get_num_allocations()
+	{
+		uint64 numAllocations = 0;
+		for (const Stripe& stripe : stripes)
+			numAllocations += stripe.numAllocations.load(std::memory_order_relaxed);
+		return numAllocations;
+	}
+
+	uint64 get_num_allocated_bytes()
+	{
+		uint64 numBytes = 0;
+		for (const Stripe& stripe : stripes)
+			numBytes += stripe.numBytes.load(std::memory_order_relaxed);
+		return numBytes;
+	}
+
+	void end_frame()
+	{
+		const uint64 numAllocations = get_num_allocations();
+		num_allocations_last_frame = numAllocations - num_allocations_at_frame_start;
+		num_allocations_at_frame_start = numAllocations;
+
+		if (num_checked_frames >= num_frames_to_check)
+			return;
+		if (num_allocations_last_frame > 0)
+			num_allocating_frames++;
+		num_checked_allocations += num_allocations_last_frame;
+		max_allocations_per_frame = std::max(max_allocations_per_frame, num_allocations_last_frame);
+		if (++num_checked_frames < num_frames_to_check)
+			return;
+
+		if (num_allocating_frames == 0)
+			PLOG_INFO << "Frame allocation check passed, none of the " << num_checked_frames << " frames allocated from the heap.";
+		else
+			PLOG_WARNING << "Frame allocation check failed, " << num_allocating_frames << " of " << num_checked_frames << " frames allocated from the heap. "
+				<< num_checked_allocations << " allocations in total, at most " << max_allocations_per_frame << " in a frame.";
+	}
+
+	uint64 get_num_allocations_last_frame()
+	{
+		return num_allocations_last_frame;
+	}
+
+	void check_frames(uint32 num_frames)
+	{
+		num_frames_to_check = num_frames;
+		num_checked_frames = 0;
+		num_allocating_frames = 0;
+		num_checked_allocations = 0;
+		max_allocations_per_frame = 0;
+	}
+}
+
+void* operator new(size_t size)
+{
+	if (void* ptr = allocation_counter::allocate(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	if (void* ptr = allocation_counter::allocate(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocation_counter::allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocation_counter::allocate(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	if (void* ptr = allocation_counter::allocate_aligned(size, alignment))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	if (void* ptr = allocation_counter::allocate_aligned(size, alignment))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocation_counter::allocate_aligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocation_counter::allocate_aligned(size, alignment); }
+void operator delete(void* ptr, std::align_val_t) noexcept { _aligned_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { _aligned_free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { _aligned_free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { _aligned_free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { _aligned_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { _aligned_free(ptr); }
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Frame allocation check", [] { allocation_counter::check_frames(300); });
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Common.h>
+
+// Counts heap allocations made through operator new on all threads, to check that hot paths don't allocate. The
+// global operator new is replaced, every allocation bumps a relaxed counter picked by the allocating thread.
+namespace allocation_counter
+{
+	uint64 get_num_allocations();
+	uint64 get_num_allocated_bytes();
+
+	// Main thread, once per frame. Allocations of any thread since the previous call count to the frame.
+	void end_frame();
+	uint64 get_num_allocations_last_frame();
+
+	// Logs how many of the next num_frames frames allocated, a steady state frame shouldn't
+	void check_frames(uint32 num_frames);
+}
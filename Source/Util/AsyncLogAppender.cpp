@@ -0,0 +1,238 @@
+#include "AsyncLogAppender.h"
+
+#include <3rdParty/plog/Appenders/RollingFileAppender.h>
+#include <3rdParty/plog/Log.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <Util/AutoImGui.h>
+#include <Util/ImGuiLogWindow.h>
+#include <Util/JobTelemetry.h>
+using namespace plog;
+
+static constexpr int NUM_IDLE_SPINS_BEFORE_SLEEP = 64;
+
+// Record as it was logged, the base record is constructed on the logger thread so it has the wrong time and thread
+class AsyncAppender::QueuedRecord : public Record
+{
+public:
+	QueuedRecord(const Slot& s) : Record(s.severity, nullptr, s.line, s.file, s.object, s.instanceId), slot(s) {}
+
+	const util::Time& getTime() const override { return slot.time; }
+	unsigned int getTid() const override { return slot.tid; }
+	const util::nchar* getMessage() const override { return slot.message.c_str(); }
+	const char* getFunc() const override { return slot.func.c_str(); }
+
+private:
+	const Slot& slot;
+};
+
+AsyncAppender::AsyncAppender() : slots(std::make_unique<Slot[]>(CAPACITY))
+{
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Ring positions are masked");
+	for (uint32 i = 0; i < CAPACITY; i++)
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+	thread = std::thread(&AsyncAppender::loop, this);
+}
+
+AsyncAppender::~AsyncAppender()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	sleepCondition.notify_one();
+	thread.join();
+}
+
+AsyncAppender& AsyncAppender::addAppender(IAppender* appender)
+{
+	appenders.push_back(appender);
+	return *this;
+}
+
+void AsyncAppender::write(const Record& record)
+{
+	// Bounded MPSC ring, writers claim positions, and publish them once the slot is filled
+	uint64 position = enqueuePosition.load(std::memory_order_relaxed);
+	bool waitedForFullRing = false;
+	Slot* slot;
+	for (;;)
+	{
+		slot = &slots[position & (CAPACITY - 1)];
+		const int64 diff = (int64)(slot->sequence.load(std::memory_order_acquire) - position);
+		if (diff == 0)
+		{
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// The logger hasn't written the record from a lap ago yet
+			if (!waitedForFullRing)
+				numFullWaits.fetch_add(1, std::memory_order_relaxed);
+			waitedForFullRing = true;
+			wakeLogger();
+			std::this_thread::yield();
+			position = enqueuePosition.load(std::memory_order_relaxed);
+		}
+		else
+			position = enqueuePosition.load(std::memory_order_relaxed);
+	}
+
+	const Severity severity = record.getSeverity(); // The slot can't be touched once it's published
+	slot->severity = severity;
+	slot->time = record.getTime();
+	slot->tid = record.getTid();
+	slot->object = record.getObject();
+	slot->line = record.getLine();
+	slot->func.assign(record.getFunc());
+	slot->file = record.getFile();
+	slot->instanceId = record.getInstanceId();
+	slot->message.assign(record.getMessage());
+	slot->sequence.store(position + 1, std::memory_order_seq_cst);
+
+	// The logger checks the ring after announcing it's going to sleep, so one of them sees the other
+	if (loggerSleeping.load(std::memory_order_seq_cst))
+		wakeLogger();
+
+	if (severity == fatal)
+		flush();
+}
+
+void AsyncAppender::flush()
+{
+	assert(std::this_thread::get_id() != thread.get_id());
+
+	const uint64 position = enqueuePosition.load(std::memory_order_acquire);
+	while (numWritten.load(std::memory_order_acquire) < position)
+	{
+		wakeLogger();
+		std::this_thread::yield();
+	}
+}
+
+void AsyncAppender::wakeLogger()
+{
+	std::lock_guard<std::mutex> lock(sleepMutex);
+	sleepCondition.notify_one();
+}
+
+void AsyncAppender::loop()
+{
+	job_telemetry::set_thread_name("Logger");
+
+	uint64 position = 0;
+	int numIdleSpins = 0;
+	for (;;)
+	{
+		Slot& slot = slots[position & (CAPACITY - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) == position + 1)
+		{
+			{
+				QueuedRecord record(slot);
+				for (IAppender* appender : appenders)
+					appender->write(record);
+			}
+			slot.sequence.store(position + CAPACITY, std::memory_order_release); // Free for the next lap
+			numWritten.store(++position, std::memory_order_release);
+			numIdleSpins = 0;
+			continue;
+		}
+
+		if (++numIdleSpins < NUM_IDLE_SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		loggerSleeping.store(true, std::memory_order_seq_cst);
+		const auto isReady = [&] { return slot.sequence.load(std::memory_order_seq_cst) == position + 1; };
+		sleepCondition.wait(lock, [&] { return stop || isReady(); });
+		loggerSleeping.store(false, std::memory_order_relaxed);
+		if (stop && !isReady())
+			return; // Writers are done by the time the appender is destroyed, so nothing is left behind
+		numIdleSpins = 0;
+	}
+}
+
+// Logs from 12 threads at once through a separate logger instance, to a file and a log window that isn't shown,
+// first with the appenders called on the logging threads, then through the async front end
+static void benchmark_logging()
+{
+	constexpr int BENCHMARK_INSTANCE = 1;
+	constexpr int NUM_THREADS = 12;
+	constexpr int NUM_LINES_PER_THREAD = 5000;
+	const char* filePath = ".log/logging_benchmark.log";
+
+	struct Result
+	{
+		double avgCallNs = 0; // As seen by the logging threads
+		double maxCallNs = 0;
+		double totalMs = 0; // Until everything is written
+		uint64 numFullWaits = 0;
+	};
+	auto run = [&](bool async)
+	{
+		Result result;
+		{
+			RollingFileAppender<ToyTxtFormatter> fileAppender(filePath, 100 * 1024 * 1024, 1);
+			ImGuiLogWindow logWindow;
+			AsyncAppender asyncAppender;
+			Logger<BENCHMARK_INSTANCE> logger(info);
+			if (async)
+			{
+				asyncAppender.addAppender(&fileAppender).addAppender(&logWindow);
+				logger.addAppender(&asyncAppender);
+			}
+			else
+				logger.addAppender(&fileAppender).addAppender(&logWindow);
+
+			std::vector<double> avgNs(NUM_THREADS), maxNs(NUM_THREADS);
+			std::vector<std::thread> threads;
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (int t = 0; t < NUM_THREADS; t++)
+			{
+				threads.emplace_back([&, t]
+				{
+					int64 totalNs = 0, longestNs = 0;
+					for (int i = 0; i < NUM_LINES_PER_THREAD; i++)
+					{
+						const int64 callStartNs = job_telemetry::now_ns();
+						PLOG_(BENCHMARK_INSTANCE, info) << "Loaded texture " << i << " of worker " << t << ", " << i * 4096 << " bytes";
+						const int64 callNs = job_telemetry::now_ns() - callStartNs;
+						totalNs += callNs;
+						longestNs = std::max(longestNs, callNs);
+					}
+					avgNs[t] = (double)totalNs / NUM_LINES_PER_THREAD;
+					maxNs[t] = (double)longestNs;
+				});
+			}
+			for (std::thread& thread : threads)
+				thread.join();
+			asyncAppender.flush();
+			result.totalMs = (std::chrono::high_resolution_clock::now() - startTime).count() / 1e6;
+			for (int t = 0; t < NUM_THREADS; t++)
+			{
+				result.avgCallNs += avgNs[t] / NUM_THREADS;
+				result.maxCallNs = std::max(result.maxCallNs, maxNs[t]);
+			}
+			result.numFullWaits = asyncAppender.getNumFullWaits();
+		}
+		std::error_code ec;
+		std::filesystem::remove(filePath, ec);
+		return result;
+	};
+
+	PLOG_INFO << "Logging benchmark, " << NUM_THREADS << " threads logging " << NUM_LINES_PER_THREAD << " lines each to a file and a log window:";
+	const Result sync = run(false);
+	const Result async = run(true);
+	PLOG_INFO << "\tSynchronous: " << sync.avgCallNs << " ns per call on average, " << sync.maxCallNs / 1e3 << " us at most, "
+		<< sync.totalMs << " ms until everything was written.";
+	PLOG_INFO << "\tAsync front end: " << async.avgCallNs << " ns per call on average, " << async.maxCallNs / 1e3 << " us at most, "
+		<< async.totalMs << " ms until everything was written. Writers found the ring full " << async.numFullWaits << " times.";
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Logging throughput", benchmark_logging);
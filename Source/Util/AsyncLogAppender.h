@@ -0,0 +1,64 @@
+#pragma once
+
+#include <3rdParty/plog/Appenders/IAppender.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Common.h>
+
+namespace plog
+{
+	// Front end of the other appenders. Writing only copies the record to a ring, the logger thread formats it and
+	// passes it on to the appenders added here, so threads logging at the same time don't wait for each other, or for
+	// the file and the log window. Fatal records are waited for, so they make it to the file before a crash.
+	class AsyncAppender : public IAppender
+	{
+	public:
+		static constexpr uint32 CAPACITY = 4096; // Records, writers wait when the ring is full
+
+		AsyncAppender();
+		~AsyncAppender(); // Writes the remaining records first
+
+		AsyncAppender& addAppender(IAppender* appender); // Before anything is logged
+		void write(const Record& record) override;
+		void flush(); // Waits until everything logged so far is written to the appenders
+
+		uint64 getNumFullWaits() const { return numFullWaits.load(std::memory_order_relaxed); }
+
+	private:
+		struct alignas(64) Slot
+		{
+			std::atomic<uint64> sequence = 0; // Ring position the slot can be written at, plus one once it's written
+			Severity severity = none;
+			util::Time time = {};
+			unsigned int tid = 0;
+			const void* object = nullptr;
+			size_t line = 0;
+			const char* file = nullptr;
+			int instanceId = 0;
+			std::string func; // Strings keep their capacity, so they don't allocate once the ring is warmed up
+			util::nstring message;
+		};
+		class QueuedRecord;
+
+		void loop();
+		void wakeLogger();
+
+		std::unique_ptr<Slot[]> slots;
+		alignas(64) std::atomic<uint64> enqueuePosition = 0;
+		alignas(64) std::atomic<uint64> numWritten = 0; // Only the logger thread advances it
+		std::atomic<uint64> numFullWaits = 0;
+
+		std::vector<IAppender*> appenders;
+		std::thread thread;
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+		std::atomic_bool loggerSleeping = false;
+		bool stop = false; // Guarded by sleepMutex
+	};
+}
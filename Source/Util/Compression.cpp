@@ -0,0 +1,300 @@
+#include "Compression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <Util/ThreadPool.h>
+
+namespace compression
+{
+	static constexpr uint32 CHUNKED_BLOB_MAGIC = 0x435a4c54; // "TLZC"
+	static constexpr uint32 STORED_CHUNK_FLAG = 0x80000000u; // Chunk didn't compress, it is stored as is
+
+	static constexpr int MIN_MATCH = 4;
+	static constexpr int MAX_OFFSET = 0xFFFF;
+	static constexpr int HASH_BITS = 14;
+
+	struct ChunkedBlobHeader
+	{
+		uint32 magic;
+		uint32 chunkSize;
+		uint64 rawSize;
+		uint32 numChunks;
+		uint32 reserved;
+		// Followed by numChunks uint32 compressed chunk sizes, then the chunk data
+	};
+
+	static inline uint32 read_u32(const uint8* p)
+	{
+		uint32 v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static inline uint32 hash4(uint32 v)
+	{
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	static inline uint8* write_length(uint8* op, size_t len)
+	{
+		while (len >= 255)
+		{
+			*op++ = 255;
+			len -= 255;
+		}
+		*op++ = (uint8)len;
+		return op;
+	}
+
+	size_t get_max_compressed_block_size(size_t src_size)
+	{
+		return src_size + src_size / 255 + 16;
+	}
+
+	// Block format is a sequence of: token (4 bit literal length | 4 bit match length - MIN_MATCH),
+	// optional literal length bytes, literals, 16 bit offset, optional match length bytes.
+	// The last sequence only has literals.
+	size_t compress_block(const uint8* src, size_t src_size, uint8* dst, size_t dst_capacity)
+	{
+		if (dst_capacity < get_max_compressed_block_size(src_size))
+			return 0;
+
+		std::unique_ptr<uint32[]> hashTable(new uint32[1 << HASH_BITS]);
+		std::fill(hashTable.get(), hashTable.get() + (1 << HASH_BITS), 0xFFFFFFFFu);
+
+		const uint8* ip = src;
+		const uint8* anchor = src;
+		const uint8* const iend = src + src_size;
+		const uint8* const matchLimit = src_size >= MIN_MATCH ? iend - MIN_MATCH : src;
+		uint8* op = dst;
+
+		auto emitSequence = [&](const uint8* literals, size_t num_literals, size_t offset, size_t match_len)
+		{
+			uint8* token = op++;
+			*token = (uint8)((num_literals >= 15 ? 15 : num_literals) << 4);
+			if (num_literals >= 15)
+				op = write_length(op, num_literals - 15);
+			memcpy(op, literals, num_literals);
+			op += num_literals;
+			if (match_len == 0)
+				return;
+			*op++ = (uint8)(offset & 0xFF);
+			*op++ = (uint8)(offset >> 8);
+			size_t ml = match_len - MIN_MATCH;
+			*token |= (uint8)(ml >= 15 ? 15 : ml);
+			if (ml >= 15)
+				op = write_length(op, ml - 15);
+		};
+
+		while (ip < matchLimit)
+		{
+			uint32 seq = read_u32(ip);
+			uint32 h = hash4(seq);
+			uint32 candidatePos = hashTable[h];
+			hashTable[h] = (uint32)(ip - src);
+
+			if (candidatePos != 0xFFFFFFFFu)
+			{
+				const uint8* candidate = src + candidatePos;
+				size_t offset = ip - candidate;
+				if (offset <= MAX_OFFSET && read_u32(candidate) == seq)
+				{
+					const uint8* matchEnd = ip + MIN_MATCH;
+					const uint8* ref = candidate + MIN_MATCH;
+					while (matchEnd < iend && *matchEnd == *ref)
+					{
+						matchEnd++;
+						ref++;
+					}
+					emitSequence(anchor, ip - anchor, offset, matchEnd - ip);
+					ip = matchEnd;
+					anchor = ip;
+					continue;
+				}
+			}
+			ip++;
+		}
+
+		emitSequence(anchor, iend - anchor, 0, 0);
+		return op - dst;
+	}
+
+	bool decompress_block(const uint8* src, size_t src_size, uint8* dst, size_t dst_size)
+	{
+		const uint8* ip = src;
+		const uint8* const iend = src + src_size;
+		uint8* op = dst;
+		uint8* const oend = dst + dst_size;
+
+		auto readLength = [&](size_t& len)
+		{
+			uint8 b;
+			do
+			{
+				if (ip >= iend)
+					return false;
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+			return true;
+		};
+
+		while (ip < iend)
+		{
+			const uint8 token = *ip++;
+
+			size_t numLiterals = token >> 4;
+			if (numLiterals == 15 && !readLength(numLiterals))
+				return false;
+			if (numLiterals > (size_t)(iend - ip) || numLiterals > (size_t)(oend - op))
+				return false;
+			memcpy(op, ip, numLiterals);
+			ip += numLiterals;
+			op += numLiterals;
+
+			if (ip == iend)
+				break; // Last sequence
+
+			if (iend - ip < 2)
+				return false;
+			size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			size_t matchLen = token & 0xF;
+			if (matchLen == 15 && !readLength(matchLen))
+				return false;
+			matchLen += MIN_MATCH;
+
+			if (offset == 0 || offset > (size_t)(op - dst) || matchLen > (size_t)(oend - op))
+				return false;
+
+			const uint8* ref = op - offset;
+			if (offset >= matchLen)
+			{
+				memcpy(op, ref, matchLen);
+				op += matchLen;
+			}
+			else
+			{
+				// Overlapping match, repeats a pattern
+				for (size_t i = 0; i < matchLen; i++)
+					*op++ = *ref++;
+			}
+		}
+
+		return op == oend;
+	}
+
+	size_t compress_chunked(const void* src, size_t src_size, std::vector<uint8>& out, uint32 chunk_size)
+	{
+		assert(chunk_size > 0);
+		const uint8* srcBytes = (const uint8*)src;
+		const uint32 numChunks = (uint32)((src_size + chunk_size - 1) / chunk_size);
+
+		const size_t blobStart = out.size();
+		const size_t chunkTableStart = blobStart + sizeof(ChunkedBlobHeader);
+		out.resize(chunkTableStart + numChunks * sizeof(uint32));
+
+		ChunkedBlobHeader header = {};
+		header.magic = CHUNKED_BLOB_MAGIC;
+		header.chunkSize = chunk_size;
+		header.rawSize = src_size;
+		header.numChunks = numChunks;
+		memcpy(out.data() + blobStart, &header, sizeof(header));
+
+		std::vector<uint8> scratch(get_max_compressed_block_size(chunk_size));
+		for (uint32 i = 0; i < numChunks; i++)
+		{
+			const size_t offset = (size_t)i * chunk_size;
+			const size_t rawChunkSize = std::min<size_t>(chunk_size, src_size - offset);
+			size_t compressedSize = compress_block(srcBytes + offset, rawChunkSize, scratch.data(), scratch.size());
+
+			uint32 entry;
+			if (compressedSize == 0 || compressedSize >= rawChunkSize)
+			{
+				out.insert(out.end(), srcBytes + offset, srcBytes + offset + rawChunkSize);
+				entry = (uint32)rawChunkSize | STORED_CHUNK_FLAG;
+			}
+			else
+			{
+				out.insert(out.end(), scratch.data(), scratch.data() + compressedSize);
+				entry = (uint32)compressedSize;
+			}
+			memcpy(out.data() + chunkTableStart + i * sizeof(uint32), &entry, sizeof(entry));
+		}
+
+		return out.size() - blobStart;
+	}
+
+	static const ChunkedBlobHeader* get_header(const uint8* blob, size_t blob_size)
+	{
+		if (blob_size < sizeof(ChunkedBlobHeader))
+			return nullptr;
+		const ChunkedBlobHeader* header = (const ChunkedBlobHeader*)blob;
+		if (header->magic != CHUNKED_BLOB_MAGIC || header->chunkSize == 0)
+			return nullptr;
+		// Chunks past the end would be written out of bounds, missing ones would leave the end unwritten
+		const uint64 expectedNumChunks = header->rawSize / header->chunkSize + (header->rawSize % header->chunkSize != 0);
+		if ((uint64)header->numChunks != expectedNumChunks)
+			return nullptr;
+		if ((uint64)blob_size < (uint64)sizeof(ChunkedBlobHeader) + (uint64)header->numChunks * sizeof(uint32))
+			return nullptr;
+		return header;
+	}
+
+	uint64 get_decompressed_size(const uint8* blob, size_t blob_size)
+	{
+		const ChunkedBlobHeader* header = get_header(blob, blob_size);
+		return header != nullptr ? header->rawSize : 0;
+	}
+
+	bool decompress_chunked(const uint8* blob, size_t blob_size, void* dst, size_t dst_size, bool parallel)
+	{
+		const ChunkedBlobHeader* header = get_header(blob, blob_size);
+		if (header == nullptr || header->rawSize != dst_size)
+			return false;
+
+		const uint32 numChunks = header->numChunks;
+		const uint32* chunkTable = (const uint32*)(blob + sizeof(ChunkedBlobHeader));
+
+		// Offsets of chunks in the blob
+		std::vector<size_t> chunkOffsets(numChunks + 1);
+		chunkOffsets[0] = sizeof(ChunkedBlobHeader) + numChunks * sizeof(uint32);
+		for (uint32 i = 0; i < numChunks; i++)
+			chunkOffsets[i + 1] = chunkOffsets[i] + (chunkTable[i] & ~STORED_CHUNK_FLAG);
+		if (chunkOffsets[numChunks] > blob_size)
+			return false;
+
+		std::atomic_bool failed = false;
+		auto decompressChunks = [&](uint32 chunk_begin, uint32 chunk_end)
+		{
+			for (uint32 i = chunk_begin; i < chunk_end; i++)
+			{
+				const size_t dstOffset = (size_t)i * header->chunkSize;
+				const size_t rawChunkSize = std::min<size_t>(header->chunkSize, dst_size - dstOffset);
+				const uint8* chunkData = blob + chunkOffsets[i];
+				const size_t chunkDataSize = chunkOffsets[i + 1] - chunkOffsets[i];
+				bool success;
+				if (chunkTable[i] & STORED_CHUNK_FLAG)
+				{
+					success = chunkDataSize == rawChunkSize;
+					if (success)
+						memcpy((uint8*)dst + dstOffset, chunkData, rawChunkSize);
+				}
+				else
+					success = decompress_block(chunkData, chunkDataSize, (uint8*)dst + dstOffset, rawChunkSize);
+				if (!success)
+					failed = true;
+			}
+		};
+
+		// Waiting in parallelFor runs other jobs, so this is fine to call from worker threads too
+		if (parallel && tp != nullptr && numChunks > 1)
+			tp->parallelFor(0, numChunks, 1, decompressChunks);
+		else
+			decompressChunks(0, numChunks);
+
+		return !failed;
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include <Common.h>
+
+// LZ-style compression of binary blobs. Blobs are split to fixed-size chunks which are compressed independently,
+// so they can be decompressed in parallel, straight to their final location (e.g. the initial data of a GPU buffer).
+namespace compression
+{
+	constexpr uint32 DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+	// Single LZ block, no framing
+	size_t get_max_compressed_block_size(size_t src_size);
+	size_t compress_block(const uint8* src, size_t src_size, uint8* dst, size_t dst_capacity);
+	bool decompress_block(const uint8* src, size_t src_size, uint8* dst, size_t dst_size);
+
+	// Chunked blob. Appends to out, returns the size of the compressed blob.
+	size_t compress_chunked(const void* src, size_t src_size, std::vector<uint8>& out, uint32 chunk_size = DEFAULT_CHUNK_SIZE);
+	uint64 get_decompressed_size(const uint8* blob, size_t blob_size);
+	bool decompress_chunked(const uint8* blob, size_t blob_size, void* dst, size_t dst_size, bool parallel = true);
+}
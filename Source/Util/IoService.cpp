@@ -0,0 +1,418 @@
+#include "IoService.h"
+
+#define NOMINMAX
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <malloc.h>
+
+#include "JobTelemetry.h"
+
+static constexpr uint32 MAX_READS_IN_FLIGHT = 32;
+static constexpr uint32 MAX_COMPLETIONS_PER_WAIT = 64;
+static constexpr uint64 READ_CHUNK_SIZE = 8 * 1024 * 1024;
+static constexpr uint64 UNCACHED_ALIGNMENT = 4096; // Covers the sector size of any disk in practice
+static constexpr uint64 PREFETCH_BUDGET = 1024ull * 1024 * 1024;
+
+struct IoService::OverlappedRead
+{
+	OVERLAPPED overlapped = {};
+	Request* request = nullptr;
+	HANDLE file = INVALID_HANDLE_VALUE;
+	uint8* buffer = nullptr;
+	uint8* alignedBuffer = nullptr; // Only for uncached reads, those need sector aligned buffers
+	uint64 size = 0;
+	uint64 offset = 0;
+};
+
+using job_telemetry::now_ns; // Same clock as the job spans, so reads line up with them in traces
+
+static uint64 align_up(uint64 value, uint64 alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static HANDLE open_file_for_reading(const std::string& path, bool overlapped, bool uncached, uint64& out_size)
+{
+	wchar_t wPath[MAX_PATH];
+	if (utf8_to_wcs(path.c_str(), wPath, MAX_PATH) == nullptr)
+		return INVALID_HANDLE_VALUE;
+
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+	if (overlapped)
+		flags |= FILE_FLAG_OVERLAPPED;
+	if (uncached)
+		flags |= FILE_FLAG_NO_BUFFERING;
+	HANDLE file = CreateFileW(wPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return INVALID_HANDLE_VALUE;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return INVALID_HANDLE_VALUE;
+	}
+	out_size = (uint64)size.QuadPart;
+	return file;
+}
+
+IoService::IoService(Backend preferred_backend) : backend(preferred_backend)
+{
+	if (backend == Backend::OVERLAPPED)
+	{
+		completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+		if (completionPort == nullptr)
+		{
+			PLOG_WARNING << "Couldn't create IO completion port, error: " << GetLastError() << ". Falling back to blocking reads.";
+			backend = Backend::THREAD;
+		}
+	}
+	thread = std::thread([this]
+	{
+		job_telemetry::set_thread_name("IO");
+		backend == Backend::OVERLAPPED ? overlappedLoop() : threadLoop();
+	});
+}
+
+IoService::~IoService()
+{
+	stop();
+	if (completionPort != nullptr)
+		CloseHandle(completionPort);
+}
+
+void IoService::stop()
+{
+	std::deque<Request*> unfinished;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopped)
+			return;
+		stopped = true;
+		unfinished.swap(queue);
+	}
+	wakeThread();
+	thread.join(); // Reads in flight are finished first
+
+	for (Request* request : unfinished)
+		complete(request);
+}
+
+IoService::Stats IoService::getStats() const
+{
+	Stats stats;
+	stats.numReads = numReads.load(std::memory_order_relaxed);
+	stats.numBytesRead = numBytesRead.load(std::memory_order_relaxed);
+	stats.busyNs = busyNs.load(std::memory_order_relaxed);
+	stats.numPrefetchHits = numPrefetchHits.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void IoService::prefetch(const std::string& path)
+{
+	std::error_code ec;
+	const uint64 size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return;
+
+	PrefetchedFile* prefetchedFile;
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		if (prefetchedFiles.count(path) > 0 || numPrefetchedBytes + size > PREFETCH_BUDGET)
+			return;
+		std::unique_ptr<PrefetchedFile>& entry = prefetchedFiles[path];
+		entry = std::make_unique<PrefetchedFile>();
+		prefetchedFile = entry.get();
+		prefetchedFile->size = size;
+		prefetchedFile->request.path = path;
+		prefetchedFile->request.priority = JobPriority::BACKGROUND;
+		prefetchedFile->request.prefetch = prefetchedFile;
+		numPrefetchedBytes += size;
+	}
+	enqueue(&prefetchedFile->request);
+}
+
+void IoService::clearPrefetched()
+{
+	std::lock_guard<std::mutex> lock(prefetchMutex);
+	for (auto it = prefetchedFiles.begin(); it != prefetchedFiles.end();)
+	{
+		PrefetchedFile& prefetchedFile = *it->second;
+		if (prefetchedFile.waiter != nullptr)
+			++it;
+		else if (!prefetchedFile.finished)
+		{
+			prefetchedFile.abandoned = true; // IO thread still uses it, it's removed when the read finishes
+			++it;
+		}
+		else
+		{
+			numPrefetchedBytes -= prefetchedFile.size;
+			it = prefetchedFiles.erase(it);
+		}
+	}
+}
+
+bool IoService::submitRead(Request* request)
+{
+	if (!request->uncached)
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		auto it = prefetchedFiles.find(request->path);
+		if (it != prefetchedFiles.end() && !it->second->abandoned && it->second->waiter == nullptr)
+		{
+			numPrefetchHits.fetch_add(1, std::memory_order_relaxed);
+			PrefetchedFile& prefetchedFile = *it->second;
+			if (!prefetchedFile.finished)
+			{
+				prefetchedFile.waiter = request;
+				return true;
+			}
+			request->result = std::move(prefetchedFile.request.result);
+			numPrefetchedBytes -= prefetchedFile.size;
+			prefetchedFiles.erase(it);
+			return false;
+		}
+	}
+	enqueue(request);
+	return true;
+}
+
+void IoService::enqueue(Request* request)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!stopped)
+		{
+			queue.push_back(request);
+			request = nullptr;
+		}
+	}
+	if (request != nullptr)
+		complete(request);
+	else
+		wakeThread();
+}
+
+void IoService::wakeThread()
+{
+	if (backend == Backend::OVERLAPPED)
+		PostQueuedCompletionStatus(completionPort, 0, 0, nullptr);
+	else
+		condition.notify_one();
+}
+
+void IoService::complete(Request* request)
+{
+	if (request->prefetch != nullptr)
+	{
+		completePrefetch(request->prefetch);
+		return;
+	}
+	// Request lives in the coroutine frame, it's gone as soon as the coroutine continues
+	std::coroutine_handle<> continuation = request->continuation;
+	tp->schedule([continuation] { continuation.resume(); }, nullptr, request->priority, "IO continuation");
+}
+
+void IoService::completePrefetch(PrefetchedFile* prefetched_file)
+{
+	Request* waiter;
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetched_file->finished = true;
+		waiter = prefetched_file->waiter;
+		if (waiter != nullptr)
+			waiter->result = std::move(prefetched_file->request.result);
+		if (waiter != nullptr || prefetched_file->abandoned)
+		{
+			numPrefetchedBytes -= prefetched_file->size;
+			prefetchedFiles.erase(std::string(prefetched_file->request.path));
+		}
+	}
+	if (waiter != nullptr)
+		complete(waiter);
+}
+
+void IoService::beginBusy()
+{
+	if (numReadsInFlight++ == 0)
+		busyStartNs = now_ns();
+}
+
+void IoService::endBusy()
+{
+	if (--numReadsInFlight == 0)
+	{
+		const int64 endNs = now_ns();
+		busyNs.fetch_add(endNs - busyStartNs, std::memory_order_relaxed);
+		job_telemetry::record_span("Reading files", busyStartNs, endNs);
+	}
+}
+
+void IoService::threadLoop()
+{
+	for (;;)
+	{
+		Request* request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] { return stopped || !queue.empty(); });
+			if (stopped)
+				return;
+			request = queue.front();
+			queue.pop_front();
+		}
+		readBlocking(request);
+		complete(request);
+	}
+}
+
+void IoService::readBlocking(Request* request)
+{
+	beginBusy();
+
+	FileReadResult& result = request->result;
+	uint64 size = 0;
+	HANDLE file = open_file_for_reading(request->path, false, request->uncached, size);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		uint8* alignedBuffer = request->uncached ? (uint8*)_aligned_malloc(align_up(std::max<uint64>(size, 1), UNCACHED_ALIGNMENT), UNCACHED_ALIGNMENT) : nullptr;
+		if (!request->uncached)
+			result.data.resize(size);
+		uint8* buffer = request->uncached ? alignedBuffer : result.data.data();
+
+		result.success = buffer != nullptr || size == 0;
+		for (uint64 offset = 0; offset < size && result.success;)
+		{
+			const uint64 chunkSize = std::min(READ_CHUNK_SIZE, request->uncached ? align_up(size - offset, UNCACHED_ALIGNMENT) : size - offset);
+			DWORD bytesRead = 0;
+			result.success = ReadFile(file, buffer + offset, (DWORD)chunkSize, &bytesRead, nullptr) && bytesRead > 0;
+			offset += bytesRead;
+		}
+
+		if (request->uncached && result.success)
+			result.data.assign(alignedBuffer, alignedBuffer + size);
+		if (alignedBuffer != nullptr)
+			_aligned_free(alignedBuffer);
+		CloseHandle(file);
+	}
+	if (!result.success)
+		result.data.clear();
+
+	numReads.fetch_add(1, std::memory_order_relaxed);
+	numBytesRead.fetch_add(result.data.size(), std::memory_order_relaxed);
+	endBusy();
+}
+
+void IoService::overlappedLoop()
+{
+	OVERLAPPED_ENTRY entries[MAX_COMPLETIONS_PER_WAIT];
+	for (;;)
+	{
+		// Start everything queued meanwhile in one go, so the disk gets a deep queue to reorder
+		std::vector<Request*> batch;
+		bool stopping;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (!queue.empty() && numReadsInFlight + batch.size() < MAX_READS_IN_FLIGHT)
+			{
+				batch.push_back(queue.front());
+				queue.pop_front();
+			}
+			stopping = stopped;
+		}
+		for (Request* request : batch)
+			startOverlappedRead(request);
+
+		if (stopping && numReadsInFlight == 0)
+			return;
+
+		ULONG numEntries = 0;
+		if (!GetQueuedCompletionStatusEx((HANDLE)completionPort, entries, MAX_COMPLETIONS_PER_WAIT, &numEntries, INFINITE, FALSE))
+			continue;
+		for (ULONG i = 0; i < numEntries; i++)
+		{
+			if (entries[i].lpOverlapped == nullptr)
+				continue; // Wake up to start queued reads or stop
+
+			OverlappedRead* read = CONTAINING_RECORD(entries[i].lpOverlapped, OverlappedRead, overlapped);
+			DWORD bytesRead = 0;
+			if (!GetOverlappedResult(read->file, &read->overlapped, &bytesRead, FALSE) || bytesRead == 0)
+			{
+				finishOverlappedRead(read, false);
+				continue;
+			}
+			read->offset += bytesRead;
+			if (read->offset >= read->size)
+				finishOverlappedRead(read, true);
+			else if (!issueOverlappedChunk(read))
+				finishOverlappedRead(read, false);
+		}
+	}
+}
+
+void IoService::startOverlappedRead(Request* request)
+{
+	beginBusy();
+
+	OverlappedRead* read = new OverlappedRead;
+	read->request = request;
+	read->file = open_file_for_reading(request->path, true, request->uncached, read->size);
+	if (read->file == INVALID_HANDLE_VALUE || CreateIoCompletionPort(read->file, (HANDLE)completionPort, 0, 0) == nullptr)
+	{
+		finishOverlappedRead(read, false);
+		return;
+	}
+
+	if (request->uncached)
+	{
+		read->alignedBuffer = (uint8*)_aligned_malloc(align_up(std::max<uint64>(read->size, 1), UNCACHED_ALIGNMENT), UNCACHED_ALIGNMENT);
+		read->buffer = read->alignedBuffer;
+	}
+	else
+	{
+		request->result.data.resize(read->size);
+		read->buffer = request->result.data.data();
+	}
+
+	if (read->size == 0)
+		finishOverlappedRead(read, true);
+	else if (read->buffer == nullptr || !issueOverlappedChunk(read))
+		finishOverlappedRead(read, false);
+}
+
+bool IoService::issueOverlappedChunk(OverlappedRead* read)
+{
+	const uint64 remaining = read->size - read->offset;
+	const uint64 chunkSize = std::min(READ_CHUNK_SIZE, read->request->uncached ? align_up(remaining, UNCACHED_ALIGNMENT) : remaining);
+	read->overlapped = {};
+	read->overlapped.Offset = (DWORD)read->offset;
+	read->overlapped.OffsetHigh = (DWORD)(read->offset >> 32);
+	// Completion is posted to the port even if the read finishes right away
+	return ReadFile(read->file, read->buffer + read->offset, (DWORD)chunkSize, nullptr, &read->overlapped) || GetLastError() == ERROR_IO_PENDING;
+}
+
+void IoService::finishOverlappedRead(OverlappedRead* read, bool success)
+{
+	Request* request = read->request;
+	FileReadResult& result = request->result;
+	result.success = success;
+	if (success && request->uncached)
+		result.data.assign(read->alignedBuffer, read->alignedBuffer + read->size);
+	if (!success)
+		result.data.clear();
+
+	if (read->alignedBuffer != nullptr)
+		_aligned_free(read->alignedBuffer);
+	if (read->file != INVALID_HANDLE_VALUE)
+		CloseHandle(read->file);
+	delete read;
+
+	numReads.fetch_add(1, std::memory_order_relaxed);
+	numBytesRead.fetch_add(result.data.size(), std::memory_order_relaxed);
+	endBusy();
+
+	complete(request);
+}
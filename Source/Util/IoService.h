@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <Common.h>
+
+#include "ThreadPool.h"
+
+struct FileReadResult
+{
+	bool success = false;
+	std::vector<uint8> data;
+};
+
+// Reads files on a dedicated thread, so workers never block on the disk. Reads are awaited from coroutines, which are
+// continued on the thread pool with the priority of the read once the whole file is in memory.
+//
+// The overlapped backend keeps many reads in flight through an IO completion port, and queued reads are started in
+// batches. The thread backend reads one file at a time with blocking reads, it's the fallback if the completion
+// port can't be created. Files can be prefetched ahead of the loads needing them, e.g. everything a scene refers to.
+class IoService
+{
+	struct PrefetchedFile;
+
+	struct Request
+	{
+		std::string path;
+		JobPriority priority = JobPriority::NORMAL;
+		bool uncached = false;
+		FileReadResult result;
+		std::coroutine_handle<> continuation;
+		PrefetchedFile* prefetch = nullptr; // Set for prefetch reads, which have no continuation
+	};
+
+public:
+	enum class Backend
+	{
+		OVERLAPPED,
+		THREAD
+	};
+
+	struct Stats
+	{
+		uint64 numReads = 0;
+		uint64 numBytesRead = 0;
+		uint64 busyNs = 0; // Time while at least one read was in progress
+		uint64 numPrefetchHits = 0;
+	};
+
+	class ReadFileAwaiter
+	{
+	public:
+		ReadFileAwaiter(IoService& s, const std::string& p, JobPriority pr, bool uncached) : service(s)
+		{
+			request.path = p;
+			request.priority = pr;
+			request.uncached = uncached;
+		}
+
+		bool await_ready() noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> handle) { request.continuation = handle; return service.submitRead(&request); }
+		FileReadResult await_resume() { return std::move(request.result); }
+
+	private:
+		IoService& service;
+		Request request;
+	};
+
+	IoService(Backend preferred_backend = Backend::OVERLAPPED);
+	~IoService();
+
+	// Reads still in the queue fail, so their coroutines can finish. Later reads fail right away.
+	void stop();
+
+	// Uncached reads bypass the file cache of the OS, only meant for measuring cold reads
+	ReadFileAwaiter readFile(const std::string& path, JobPriority priority = JobPriority::NORMAL, bool uncached = false)
+	{
+		return ReadFileAwaiter(*this, path, priority, uncached);
+	}
+
+	// Starts reading the file in the background, and keeps it until the first readFile of the same path takes it.
+	// Ignored if the file is already prefetched, or the prefetched files would take too much memory.
+	void prefetch(const std::string& path);
+	void clearPrefetched(); // Drops prefetched files nobody asked for
+
+	Backend getBackend() const { return backend; }
+	Stats getStats() const;
+
+private:
+	struct PrefetchedFile
+	{
+		Request request;
+		uint64 size = 0;
+		bool finished = false; // Guarded by prefetchMutex, as well as the rest
+		bool abandoned = false;
+		Request* waiter = nullptr;
+	};
+
+	struct OverlappedRead;
+
+	bool submitRead(Request* request); // False if the result is already available
+	void enqueue(Request* request);
+	void complete(Request* request);
+	void completePrefetch(PrefetchedFile* prefetched_file);
+	void wakeThread();
+
+	void threadLoop();
+	void overlappedLoop();
+	void readBlocking(Request* request);
+	void startOverlappedRead(Request* request);
+	bool issueOverlappedChunk(OverlappedRead* read);
+	void finishOverlappedRead(OverlappedRead* read, bool success);
+	void beginBusy();
+	void endBusy();
+
+	Backend backend;
+	void* completionPort = nullptr;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<Request*> queue; // Guarded by mutex
+	bool stopped = false; // Guarded by mutex
+	uint32 numReadsInFlight = 0; // Only used by the IO thread
+	int64 busyStartNs = 0; // Only used by the IO thread
+
+	std::mutex prefetchMutex;
+	std::unordered_map<std::string, std::unique_ptr<PrefetchedFile>> prefetchedFiles;
+	uint64 numPrefetchedBytes = 0; // Guarded by prefetchMutex
+
+	std::atomic<uint64> numReads = 0;
+	std::atomic<uint64> numBytesRead = 0;
+	std::atomic<uint64> busyNs = 0;
+	std::atomic<uint64> numPrefetchHits = 0;
+};
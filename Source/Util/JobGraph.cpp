@@ -0,0 +1,119 @@
+#include "JobGraph.h"
+
+JobGraph::NodeId JobGraph::addNode(const char* name, std::function<void()> func, std::initializer_list<NodeId> dependencies)
+{
+	Node& node = add(name, 1, 1, dependencies);
+	node.singleFunc = std::move(func);
+	return numNodes - 1;
+}
+
+JobGraph::NodeId JobGraph::addParallelNode(const char* name, uint32 count, uint32 grain_size, ChunkFunc func, std::initializer_list<NodeId> dependencies)
+{
+	Node& node = add(name, count, grain_size, dependencies);
+	node.func = std::move(func);
+	return numNodes - 1;
+}
+
+JobGraph::Node& JobGraph::add(const char* name, uint32 count, uint32 grain_size, std::initializer_list<NodeId> dependencies)
+{
+	assert(!executing);
+
+	const NodeId id = numNodes++;
+	if (id == nodes.size())
+		nodes.push_back(std::make_unique<Node>());
+	Node& node = *nodes[id];
+	node.name = name;
+	node.count = count;
+	node.grainSize = std::max(grain_size, 1u);
+	node.numDependencies = 0;
+	node.successors.clear(); // Keeps its capacity
+	for (NodeId dependency : dependencies)
+	{
+		assert(dependency < id);
+		nodes[dependency]->successors.push_back(id);
+		node.numDependencies++;
+	}
+	return node;
+}
+
+void JobGraph::execute()
+{
+	assert(!executing);
+	executing = true;
+
+	// Everything is reset before the first job starts, a finishing node may schedule any of its successors
+	for (uint32 i = 0; i < numNodes; i++)
+	{
+		nodes[i]->numPendingDependencies.store(nodes[i]->numDependencies, std::memory_order_relaxed);
+		nodes[i]->done.store(false, std::memory_order_relaxed);
+	}
+	for (uint32 i = 0; i < numNodes; i++)
+		if (nodes[i]->numDependencies == 0)
+			schedule(*nodes[i]);
+}
+
+void JobGraph::wait(NodeId node)
+{
+	if (!executing)
+		return;
+	const Node& n = *nodes[node];
+	tp->waitUntil([&n] { return n.done.load(std::memory_order_acquire); }, priority);
+}
+
+void JobGraph::wait()
+{
+	if (!executing)
+		return;
+	tp->wait(counter, priority);
+	executing = false;
+}
+
+void JobGraph::clear()
+{
+	wait();
+	for (uint32 i = 0; i < numNodes; i++)
+	{
+		// Releases what the functions captured, the nodes themselves are kept
+		nodes[i]->func = nullptr;
+		nodes[i]->singleFunc = nullptr;
+	}
+	numNodes = 0;
+}
+
+void JobGraph::schedule(Node& node)
+{
+	const uint32 numChunks = get_num_chunks(node.count, node.grainSize);
+	if (numChunks == 0)
+	{
+		finish(node);
+		return;
+	}
+
+	node.numPendingChunks.store(numChunks, std::memory_order_relaxed);
+	for (uint32 c = 0; c < numChunks; c++)
+	{
+		tp->schedule([this, &node, c]
+		{
+			const uint32 begin = c * node.grainSize;
+			const uint32 end = std::min(begin + node.grainSize, node.count);
+			if (node.singleFunc)
+				node.singleFunc();
+			else
+				node.func(c, begin, end);
+			if (node.numPendingChunks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				finish(node);
+		}, &counter, priority, node.name);
+	}
+}
+
+void JobGraph::finish(Node& node)
+{
+	// Successors are scheduled before this job is counted as finished, so the counter can't reach zero in between
+	node.done.store(true, std::memory_order_release);
+	for (NodeId successor : node.successors)
+	{
+		Node& s = *nodes[successor];
+		if (s.numPendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			schedule(s);
+	}
+}
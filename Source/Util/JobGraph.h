@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include <Common.h>
+
+#include "ThreadPool.h"
+
+// Jobs with dependencies between them, run on the thread pool. Nodes are added first, then the whole graph is
+// executed: a node is scheduled as soon as all of its dependencies are done. Nodes can be waited for one by one, so
+// the results of early nodes can be used while the rest are still running.
+//
+//	JobGraph::NodeId update = graph.addParallelNode("Update", numObjects, 64, updateChunk);
+//	JobGraph::NodeId cull = graph.addParallelNode("Cull", numObjects, 64, cullChunk, { update });
+//	graph.execute();
+//	graph.wait(cull);
+class JobGraph
+{
+public:
+	using NodeId = uint32;
+	using ChunkFunc = std::function<void(uint32 chunk_index, uint32 begin, uint32 end)>;
+
+	JobGraph(JobPriority job_priority = JobPriority::HIGH) : priority(job_priority) {}
+	~JobGraph() { wait(); }
+
+	NodeId addNode(const char* name, std::function<void()> func, std::initializer_list<NodeId> dependencies = {});
+
+	// Calls func for chunks of [0, count) as separate jobs, the node is done when all chunks are. There are
+	// get_num_chunks(count, grain_size) chunks, indexed from zero, so chunks can write their own outputs.
+	NodeId addParallelNode(const char* name, uint32 count, uint32 grain_size, ChunkFunc func, std::initializer_list<NodeId> dependencies = {});
+
+	void execute(); // Schedules nodes without dependencies, doesn't block
+	void wait(NodeId node); // Runs other jobs of the same or higher priority meanwhile
+	void wait(); // Waits for all nodes
+	void clear(); // Removes all nodes, waits for them first. Nodes are reused by the next ones added.
+
+	bool isExecuting() const { return executing; }
+	const char* getNodeName(NodeId node) const { assert(node < numNodes); return nodes[node]->name; }
+
+	static uint32 get_num_chunks(uint32 count, uint32 grain_size) { return count == 0 ? 0 : (count - 1) / grain_size + 1; }
+
+private:
+	struct Node
+	{
+		const char* name;
+		ChunkFunc func;
+		std::function<void()> singleFunc; // Of nodes added with addNode, instead of wrapping it in a ChunkFunc
+		uint32 count;
+		uint32 grainSize;
+		uint32 numDependencies = 0;
+		std::vector<NodeId> successors;
+		std::atomic<uint32> numPendingDependencies = 0;
+		std::atomic<uint32> numPendingChunks = 0;
+		std::atomic_bool done = false;
+	};
+
+	Node& add(const char* name, uint32 count, uint32 grain_size, std::initializer_list<NodeId> dependencies);
+	void schedule(Node& node);
+	void finish(Node& node);
+
+	JobPriority priority;
+	std::vector<std::unique_ptr<Node>> nodes; // Only the first numNodes are in the graph, the rest are kept for reuse
+	uint32 numNodes = 0;
+	JobCounter counter;
+	bool executing = false;
+};
@@ -0,0 +1,216 @@
+#include "JobTelemetry.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace job_telemetry
+{
+	struct Event
+	{
+		const char* name;
+		int64 timeNs;
+		int64 durationNs;
+		int64 value;
+		bool counter;
+	};
+
+	// Written by its owner thread only. Kept after the thread exits, until the next capture begins, so the events of
+	// short lived threads can still be exported.
+	struct ThreadBuffer
+	{
+		uint32 threadIndex = 0;
+		std::string name; // Guarded by registry_mutex
+		std::vector<Event> events;
+		std::atomic<uint32> numEvents = 0; // Events below this are complete
+		std::atomic<uint32> numDropped = 0;
+		std::atomic<uint32> generation = 0; // Capture the events belong to
+		std::atomic_bool exited = false;
+	};
+
+	struct ThreadBufferOwner
+	{
+		ThreadBuffer* buffer = nullptr;
+		~ThreadBufferOwner()
+		{
+			if (buffer != nullptr)
+				buffer->exited.store(true, std::memory_order_release);
+		}
+	};
+
+	static std::mutex registry_mutex;
+	static std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers; // Guarded by registry_mutex
+	static uint32 next_thread_index = 0; // Guarded by registry_mutex
+	static uint32 num_captures = 0; // Guarded by registry_mutex
+	static int64 capture_begin_ns = 0; // Guarded by registry_mutex
+	static std::atomic<uint32> capture_generation = 0; // Zero while not capturing
+	static thread_local ThreadBufferOwner tls_buffer_owner;
+
+	static ThreadBuffer& get_thread_buffer()
+	{
+		if (tls_buffer_owner.buffer == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(registry_mutex);
+			std::unique_ptr<ThreadBuffer> buffer = std::make_unique<ThreadBuffer>();
+			buffer->threadIndex = next_thread_index++;
+			buffer->name = "Thread " + std::to_string(buffer->threadIndex);
+			tls_buffer_owner.buffer = buffer.get();
+			thread_buffers.push_back(std::move(buffer));
+		}
+		return *tls_buffer_owner.buffer;
+	}
+
+	static void record(const Event& event)
+	{
+		const uint32 generation = capture_generation.load(std::memory_order_acquire);
+		if (generation == 0)
+			return;
+
+		ThreadBuffer& buffer = get_thread_buffer();
+		if (buffer.generation.load(std::memory_order_relaxed) != generation)
+		{
+			// First event of this capture on this thread
+			if (buffer.events.empty())
+				buffer.events.resize(MAX_EVENTS_PER_THREAD);
+			buffer.numEvents.store(0, std::memory_order_relaxed);
+			buffer.numDropped.store(0, std::memory_order_relaxed);
+			buffer.generation.store(generation, std::memory_order_release);
+		}
+
+		const uint32 numEvents = buffer.numEvents.load(std::memory_order_relaxed);
+		if (numEvents >= MAX_EVENTS_PER_THREAD)
+		{
+			buffer.numDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		buffer.events[numEvents] = event;
+		buffer.numEvents.store(numEvents + 1, std::memory_order_release); // Publishes the event to the exporter
+	}
+
+	static void write_json_string(std::ostream& out, const char* str)
+	{
+		out << '"';
+		for (const char* c = str; *c != '\0'; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				out << '\\';
+			out << *c;
+		}
+		out << '"';
+	}
+
+	int64 now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	void set_thread_name(const std::string& name)
+	{
+		ThreadBuffer& buffer = get_thread_buffer();
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		buffer.name = name;
+	}
+
+	void begin_capture()
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		// Exited threads can't record anymore, their buffers were only kept for the previous capture
+		std::erase_if(thread_buffers, [](const std::unique_ptr<ThreadBuffer>& buffer) { return buffer->exited.load(std::memory_order_acquire); });
+		capture_begin_ns = now_ns();
+		capture_generation.store(++num_captures, std::memory_order_release);
+	}
+
+	void end_capture()
+	{
+		capture_generation.store(0, std::memory_order_release);
+	}
+
+	bool is_capturing()
+	{
+		return capture_generation.load(std::memory_order_relaxed) != 0;
+	}
+
+	void record_span(const char* name, int64 begin_ns, int64 end_ns)
+	{
+		record({ name, begin_ns, end_ns - begin_ns, 0, false });
+	}
+
+	void record_counter(const char* name, int64 value)
+	{
+		record({ name, now_ns(), 0, value, true });
+	}
+
+	bool export_chrome_trace(const std::string& path)
+	{
+		assert(!is_capturing());
+
+		std::ofstream file(path);
+		if (!file)
+		{
+			PLOG_ERROR << "Couldn't open " << path << " for exporting the job trace.";
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		uint64 numExported = 0;
+		file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+		file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ToyEngine\"}}";
+		for (const std::unique_ptr<ThreadBuffer>& buffer : thread_buffers)
+		{
+			if (buffer->generation.load(std::memory_order_acquire) != num_captures)
+				continue;
+
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadIndex << ",\"args\":{\"name\":";
+			write_json_string(file, buffer->name.c_str());
+			file << "}}";
+
+			const uint32 numEvents = buffer->numEvents.load(std::memory_order_acquire);
+			for (uint32 i = 0; i < numEvents; i++)
+			{
+				const Event& event = buffer->events[i];
+				file << ",\n{\"name\":";
+				write_json_string(file, event.name);
+				file << ",\"pid\":1,\"tid\":" << buffer->threadIndex << ",\"ts\":" << (event.timeNs - capture_begin_ns) / 1e3;
+				if (event.counter)
+					file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+				else
+					file << ",\"ph\":\"X\",\"dur\":" << event.durationNs / 1e3 << "}";
+			}
+			numExported += numEvents;
+		}
+		file << "\n]}\n";
+
+		if (!file)
+		{
+			PLOG_ERROR << "Couldn't write the job trace to " << path;
+			return false;
+		}
+		PLOG_INFO << "Exported " << numExported << " job telemetry events to " << path;
+		return true;
+	}
+
+	uint64 get_num_captured_events()
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		uint64 numEvents = 0;
+		for (const std::unique_ptr<ThreadBuffer>& buffer : thread_buffers)
+			if (buffer->generation.load(std::memory_order_acquire) == num_captures)
+				numEvents += buffer->numEvents.load(std::memory_order_acquire);
+		return numEvents;
+	}
+
+	uint64 get_num_dropped_events()
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		uint64 numDropped = 0;
+		for (const std::unique_ptr<ThreadBuffer>& buffer : thread_buffers)
+			if (buffer->generation.load(std::memory_order_acquire) == num_captures)
+				numDropped += buffer->numDropped.load(std::memory_order_relaxed);
+		return numDropped;
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include <Common.h>
+
+// Timed spans of jobs, and of the code running in them, for finding out what the threads spend their time on. Spans
+// are only recorded while capturing. Each thread appends to its own buffer, so recording never locks. A capture can be
+// exported in the Chrome trace event format, to be opened in chrome://tracing or ui.perfetto.dev.
+namespace job_telemetry
+{
+	constexpr uint32 MAX_EVENTS_PER_THREAD = 64 * 1024; // Later events of a capture are dropped
+
+	int64 now_ns(); // Clock of all spans, and of the thread pool counters
+
+	void set_thread_name(const std::string& name); // Track name of the calling thread in exported traces
+
+	void begin_capture(); // Drops the previous capture
+	void end_capture();
+	bool is_capturing();
+
+	// Names are kept by pointer, they must be string literals
+	void record_span(const char* name, int64 begin_ns, int64 end_ns);
+	void record_counter(const char* name, int64 value);
+
+	// Exports the last capture, call between captures
+	bool export_chrome_trace(const std::string& path);
+	uint64 get_num_captured_events();
+	uint64 get_num_dropped_events();
+
+	struct ScopedSpan
+	{
+		ScopedSpan(const char* span_name) : name(span_name), beginNs(is_capturing() ? now_ns() : -1) {}
+		~ScopedSpan() { if (beginNs >= 0) record_span(name, beginNs, now_ns()); }
+
+		const char* name;
+		int64 beginNs;
+	};
+}
+
+#define TOY_JS_CC0(a, b) a##b
+#define TOY_JS_CC1(a, b) TOY_JS_CC0(a, b)
+#define JOB_SPAN(name) job_telemetry::ScopedSpan TOY_JS_CC1(jobSpan, __LINE__)(name)
@@ -0,0 +1,308 @@
+#include "Json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace json
+{
+	static const Value NULL_VALUE;
+
+	bool Value::has(const char* key) const
+	{
+		return !(*this)[key].isNull();
+	}
+
+	const Value& Value::operator[](const char* key) const
+	{
+		if (type != Type::OBJECT)
+			return NULL_VALUE;
+		for (const auto& kv : object)
+			if (kv.first == key)
+				return kv.second;
+		return NULL_VALUE;
+	}
+
+	const Value& Value::operator[](size_t index) const
+	{
+		if (type != Type::ARRAY || index >= array.size())
+			return NULL_VALUE;
+		return array[index];
+	}
+
+	bool Value::asUint64(uint64_t& out, uint64_t default_value) const
+	{
+		if (isNull())
+		{
+			out = default_value;
+			return true;
+		}
+		if (type != Type::NUMBER || !(number >= 0.0 && number <= 9007199254740992.0) || (double)(uint64_t)number != number)
+			return false;
+		out = (uint64_t)number;
+		return true;
+	}
+
+	struct Parser
+	{
+		const char* p;
+		const char* end;
+		std::string error;
+		int depth = 0;
+
+		static constexpr int MAX_DEPTH = 256;
+
+		bool fail(const char* message)
+		{
+			if (error.empty())
+				error = message;
+			return false;
+		}
+
+		void skipWhitespace()
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+				p++;
+		}
+
+		bool match(const char* literal)
+		{
+			size_t len = strlen(literal);
+			if ((size_t)(end - p) < len || memcmp(p, literal, len) != 0)
+				return false;
+			p += len;
+			return true;
+		}
+
+		static void appendUtf8(std::string& s, unsigned int cp)
+		{
+			if (cp < 0x80)
+				s += (char)cp;
+			else if (cp < 0x800)
+			{
+				s += (char)(0xC0 | (cp >> 6));
+				s += (char)(0x80 | (cp & 0x3F));
+			}
+			else if (cp < 0x10000)
+			{
+				s += (char)(0xE0 | (cp >> 12));
+				s += (char)(0x80 | ((cp >> 6) & 0x3F));
+				s += (char)(0x80 | (cp & 0x3F));
+			}
+			else
+			{
+				s += (char)(0xF0 | (cp >> 18));
+				s += (char)(0x80 | ((cp >> 12) & 0x3F));
+				s += (char)(0x80 | ((cp >> 6) & 0x3F));
+				s += (char)(0x80 | (cp & 0x3F));
+			}
+		}
+
+		bool parseHex4(unsigned int& out)
+		{
+			if (end - p < 4)
+				return fail("Truncated unicode escape");
+			out = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				char c = *p++;
+				out <<= 4;
+				if (c >= '0' && c <= '9') out |= c - '0';
+				else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+				else return fail("Invalid unicode escape");
+			}
+			return true;
+		}
+
+		bool parseString(std::string& out)
+		{
+			p++; // Opening quote
+			while (p < end && *p != '"')
+			{
+				char c = *p++;
+				if (c != '\\')
+				{
+					out += c;
+					continue;
+				}
+				if (p >= end)
+					return fail("Truncated escape sequence");
+				c = *p++;
+				switch (c)
+				{
+				case '"': out += '"'; break;
+				case '\\': out += '\\'; break;
+				case '/': out += '/'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u':
+				{
+					unsigned int cp;
+					if (!parseHex4(cp))
+						return false;
+					if (cp >= 0xD800 && cp < 0xDC00 && match("\\u"))
+					{
+						unsigned int low;
+						if (!parseHex4(low))
+							return false;
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					}
+					appendUtf8(out, cp);
+					break;
+				}
+				default:
+					return fail("Invalid escape sequence");
+				}
+			}
+			if (p >= end)
+				return fail("Unterminated string");
+			p++; // Closing quote
+			return true;
+		}
+
+		bool parseNumber(Value& out)
+		{
+			// Input isn't necessarily null terminated, copy number to a local buffer for strtod
+			char buf[64];
+			size_t len = 0;
+			while (p < end && len < sizeof(buf) - 1 && (strchr("+-0123456789.eE", *p) != nullptr))
+				buf[len++] = *p++;
+			buf[len] = '\0';
+			char* numberEnd;
+			out.type = Type::NUMBER;
+			out.number = strtod(buf, &numberEnd);
+			if (len == 0 || numberEnd != buf + len)
+				return fail("Invalid number");
+			return true;
+		}
+
+		bool parseValue(Value& out)
+		{
+			if (++depth > MAX_DEPTH)
+				return fail("Nesting too deep");
+
+			skipWhitespace();
+			if (p >= end)
+				return fail("Unexpected end of input");
+
+			bool success = true;
+			switch (*p)
+			{
+			case '{':
+			{
+				out.type = Type::OBJECT;
+				p++;
+				skipWhitespace();
+				if (p < end && *p == '}')
+				{
+					p++;
+					break;
+				}
+				while (success)
+				{
+					skipWhitespace();
+					if (p >= end || *p != '"')
+					{
+						success = fail("Expected object key");
+						break;
+					}
+					out.object.emplace_back();
+					success = parseString(out.object.back().first);
+					skipWhitespace();
+					if (!success || p >= end || *p++ != ':')
+					{
+						success = fail("Expected ':'");
+						break;
+					}
+					success = parseValue(out.object.back().second);
+					skipWhitespace();
+					if (!success || p >= end)
+					{
+						success = fail("Unterminated object");
+						break;
+					}
+					if (*p == '}')
+					{
+						p++;
+						break;
+					}
+					if (*p++ != ',')
+						success = fail("Expected ',' or '}'");
+				}
+				break;
+			}
+			case '[':
+			{
+				out.type = Type::ARRAY;
+				p++;
+				skipWhitespace();
+				if (p < end && *p == ']')
+				{
+					p++;
+					break;
+				}
+				while (success)
+				{
+					out.array.emplace_back();
+					success = parseValue(out.array.back());
+					skipWhitespace();
+					if (!success || p >= end)
+					{
+						success = fail("Unterminated array");
+						break;
+					}
+					if (*p == ']')
+					{
+						p++;
+						break;
+					}
+					if (*p++ != ',')
+						success = fail("Expected ',' or ']'");
+				}
+				break;
+			}
+			case '"':
+				out.type = Type::STRING;
+				success = parseString(out.string);
+				break;
+			case 't':
+			case 'f':
+				out.type = Type::BOOL;
+				out.boolean = *p == 't';
+				success = match(out.boolean ? "true" : "false") || fail("Invalid literal");
+				break;
+			case 'n':
+				out.type = Type::NUL;
+				success = match("null") || fail("Invalid literal");
+				break;
+			default:
+				success = parseNumber(out);
+				break;
+			}
+
+			depth--;
+			return success;
+		}
+	};
+
+	bool parse(const char* text, size_t length, Value& out, std::string& error)
+	{
+		Parser parser{ text, text + length };
+		out = Value();
+		bool success = parser.parseValue(out);
+		if (success)
+		{
+			parser.skipWhitespace();
+			// Trailing null characters are allowed, some containers pad with them
+			while (parser.p < parser.end && *parser.p == '\0')
+				parser.p++;
+			if (parser.p != parser.end)
+				success = parser.fail("Unexpected data after root value");
+		}
+		error = parser.error;
+		return success;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON DOM, enough for reading asset metadata (e.g. glTF)
+namespace json
+{
+	enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+	struct Value
+	{
+		Type type = Type::NUL;
+		bool boolean = false;
+		double number = 0;
+		std::string string;
+		std::vector<Value> array;
+		std::vector<std::pair<std::string, Value>> object;
+
+		bool has(const char* key) const; // Key exists and its value isn't null
+		const Value& operator[](const char* key) const; // Null value if key is missing
+		const Value& operator[](size_t index) const; // Null value if index is out of bounds
+		size_t size() const { return type == Type::ARRAY ? array.size() : (type == Type::OBJECT ? object.size() : 0); }
+		bool isNull() const { return type == Type::NUL; }
+
+		int asInt(int default_value = 0) const { return type == Type::NUMBER ? (int)number : default_value; }
+		float asFloat(float default_value = 0) const { return type == Type::NUMBER ? (float)number : default_value; }
+		bool asBool(bool default_value = false) const { return type == Type::BOOL ? boolean : default_value; }
+		// Whole numbers from 0 to 2^53, which doubles hold exactly, e.g. sizes and offsets. A null value is the default,
+		// false if the value is anything else.
+		bool asUint64(uint64_t& out, uint64_t default_value = 0) const;
+		const std::string& asString() const { return string; }
+	};
+
+	bool parse(const char* text, size_t length, Value& out, std::string& error);
+}
@@ -0,0 +1,65 @@
+#include "LinearArena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+LinearArena::~LinearArena()
+{
+	for (Block& block : blocks)
+		::operator delete(block.memory);
+}
+
+void* LinearArena::allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	for (;;)
+	{
+		if (blockIndex < blocks.size())
+		{
+			Block& block = blocks[blockIndex];
+			const uintptr_t address = (uintptr_t)block.memory + offset;
+			const size_t alignedOffset = offset + ((alignment - address % alignment) % alignment);
+			if (alignedOffset + size <= block.size)
+			{
+				offset = alignedOffset + size;
+				return block.memory + alignedOffset;
+			}
+			if (blockIndex + 1 < blocks.size())
+			{
+				// Blocks too small for this are skipped until the arena is rewound
+				blockIndex++;
+				offset = 0;
+				continue;
+			}
+		}
+
+		// Out of blocks, blocks are allocated with the default alignment and padded for larger ones
+		const size_t newBlockSize = std::max(blockSize, size + alignment);
+		blocks.push_back({ (uint8*)::operator new(newBlockSize), newBlockSize });
+		blockIndex = blocks.size() - 1;
+		offset = 0;
+	}
+}
+
+void LinearArena::rewind(const Marker& marker)
+{
+	assert(marker.blockIndex < blockIndex || (marker.blockIndex == blockIndex && marker.offset <= offset));
+	blockIndex = marker.blockIndex;
+	offset = marker.offset;
+}
+
+size_t LinearArena::getCapacity() const
+{
+	size_t capacity = 0;
+	for (const Block& block : blocks)
+		capacity += block.size;
+	return capacity;
+}
+
+LinearArena& get_thread_scratch_arena()
+{
+	static thread_local LinearArena arena;
+	return arena;
+}
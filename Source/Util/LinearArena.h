@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Common.h>
+
+// Bump allocator for short lived memory, e.g. the data of a frame, or scratch memory of a function. Everything is
+// freed at once by resetting or rewinding it. Blocks are kept, so it stops allocating from the heap once it has
+// grown to the peak usage. Not thread safe, each thread uses its own arenas.
+class LinearArena
+{
+public:
+	static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+	struct Marker
+	{
+		size_t blockIndex;
+		size_t offset;
+	};
+
+	explicit LinearArena(size_t block_size = DEFAULT_BLOCK_SIZE) : blockSize(block_size) {}
+	~LinearArena();
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	template <typename T>
+	T* allocate(size_t count) { return (T*)allocate(sizeof(T) * count, alignof(T)); } // Not constructed
+
+	void reset() { rewind({ 0, 0 }); }
+	Marker getMarker() const { return { blockIndex, offset }; }
+	void rewind(const Marker& marker); // Frees everything allocated since the marker was taken
+
+	size_t getCapacity() const;
+
+private:
+	struct Block
+	{
+		uint8* memory;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockIndex = 0;
+	size_t offset = 0;
+	const size_t blockSize;
+};
+
+// Rewinds the arena when the scope ends
+class ArenaScope
+{
+public:
+	ArenaScope(LinearArena& a) : arena(a), marker(a.getMarker()) {}
+	~ArenaScope() { arena.rewind(marker); }
+
+private:
+	LinearArena& arena;
+	LinearArena::Marker marker;
+};
+
+// Lets std containers allocate from an arena. Memory is only freed with the arena, so reserve up front.
+template <typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	ArenaAllocator(LinearArena& a) : arena(&a) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t count) { return arena->allocate<T>(count); }
+	void deallocate(T*, size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+
+	LinearArena* arena;
+};
+
+template <typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+// Scratch memory of the calling thread, for temporaries that don't outlive a function. Take it with an ArenaScope:
+//
+//	LinearArena& scratch = get_thread_scratch_arena();
+//	ArenaScope scope(scratch);
+//	ScratchVector<const char*> names(scratch);
+LinearArena& get_thread_scratch_arena();
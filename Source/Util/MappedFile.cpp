@@ -0,0 +1,65 @@
+#include "MappedFile.h"
+
+#include <Windows.h>
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	wchar_t wPath[MAX_PATH];
+	utf8_to_wcs(path.c_str(), wPath, MAX_PATH);
+
+	HANDLE file = CreateFileW(wPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		PLOG_ERROR << "Couldn't open file for mapping: " << path;
+		return false;
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		PLOG_ERROR << "Couldn't map empty file: " << path;
+		close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle == nullptr)
+	{
+		PLOG_ERROR << "CreateFileMapping failed for file: " << path << ", error: " << GetLastError();
+		close();
+		return false;
+	}
+
+	data = (const uint8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		PLOG_ERROR << "MapViewOfFile failed for file: " << path << ", error: " << GetLastError();
+		close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+	if (fileHandle != nullptr)
+		CloseHandle(fileHandle);
+	data = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	size = 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include <Common.h>
+
+// Read-only memory mapped file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	const uint8* getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+	const uint8* data = nullptr;
+	size_t size = 0;
+};
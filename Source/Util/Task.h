@@ -0,0 +1,324 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <Common.h>
+
+#include "ThreadPool.h"
+
+// Coroutines running on the thread pool. A task starts suspended, it runs when it's awaited by another task, spawned,
+// or waited for with sync_wait. Awaiting never blocks the thread, the coroutine is continued by whoever finishes the
+// awaited work: a worker, the IO thread, or the main thread.
+//
+//	Task<bool> loadSomething(std::string path)
+//	{
+//		FileReadResult file = co_await io->readFile(path, JobPriority::BACKGROUND); // Worker is free while reading
+//		Decoded decoded = decode(file.data); // Continues on a worker
+//		co_await resume_on_main_thread();
+//		upload(decoded);
+//		co_return true;
+//	}
+
+template <typename T = void>
+class Task;
+
+template <typename T>
+void spawn(Task<T> task, JobPriority priority = JobPriority::NORMAL);
+
+template <typename T>
+T sync_wait(Task<T> task);
+
+namespace task_detail
+{
+	struct PromiseBase
+	{
+		std::coroutine_handle<> continuation;
+		std::atomic<uint32>* remaining = nullptr; // Shared by a group of tasks, only the last one finishing continues
+		bool detached = false;
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+
+			template <typename P>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+			{
+				PromiseBase& promise = handle.promise();
+				std::coroutine_handle<> continuation = promise.continuation;
+				const bool detached = promise.detached;
+				// Waiters can destroy the frame as soon as remaining reaches zero, it must not be touched after this
+				if (promise.remaining != nullptr && promise.remaining->fetch_sub(1, std::memory_order_acq_rel) != 1)
+					return std::noop_coroutine();
+				if (detached)
+					handle.destroy();
+				return continuation ? continuation : std::noop_coroutine();
+			}
+
+			void await_resume() noexcept {}
+		};
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	template <typename T>
+	struct Promise : PromiseBase
+	{
+		std::optional<T> result;
+
+		void return_value(T value) { result.emplace(std::move(value)); }
+		T takeResult() { return std::move(*result); }
+	};
+
+	template <>
+	struct Promise<void> : PromiseBase
+	{
+		void return_void() {}
+		void takeResult() {}
+	};
+}
+
+template <typename T>
+class [[nodiscard]] Task
+{
+public:
+	struct promise_type : task_detail::Promise<T>
+	{
+		Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+	};
+
+	Task() = default;
+	Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			destroy();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task() { destroy(); }
+
+	bool isValid() const { return (bool)handle; }
+	bool isDone() const { return handle && handle.done(); }
+
+	// Only valid once the task is done, e.g. after awaiting it with when_all
+	T result() { assert(isDone()); return handle.promise().takeResult(); }
+
+	// Awaiting a task starts it on the current thread, and continues the awaiting coroutine where the task finishes
+	auto operator co_await() && noexcept
+	{
+		struct Awaiter
+		{
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() noexcept { return !handle || handle.done(); }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+			{
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+			T await_resume() { return handle.promise().takeResult(); }
+		};
+		return Awaiter{ handle };
+	}
+
+private:
+	template <typename U> friend void spawn(Task<U> task, JobPriority priority);
+	template <typename U> friend U sync_wait(Task<U> task);
+	template <typename U> friend class WhenAllAwaiter;
+
+	explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+	void destroy()
+	{
+		if (handle)
+			handle.destroy();
+		handle = nullptr;
+	}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+// Starts the task as a job, and lets it run to completion on its own. The result is discarded.
+template <typename T>
+void spawn(Task<T> task, JobPriority priority)
+{
+	std::coroutine_handle<typename Task<T>::promise_type> handle = std::exchange(task.handle, nullptr);
+	handle.promise().detached = true;
+	tp->schedule([handle] { handle.resume(); }, nullptr, priority, "Task");
+}
+
+// Runs the task, and blocks until it's done. Other jobs are run meanwhile, and main thread jobs too when called on
+// the main thread, so the task can hop there.
+template <typename T>
+T sync_wait(Task<T> task)
+{
+	std::atomic<uint32> remaining = 1;
+	task.handle.promise().remaining = &remaining;
+	task.handle.resume();
+	tp->waitUntil([&remaining] { return remaining.load(std::memory_order_acquire) == 0; });
+	return task.handle.promise().takeResult();
+}
+
+// Continues the coroutine as a job on the thread pool
+struct ResumeOnPoolAwaiter
+{
+	JobPriority priority;
+
+	bool await_ready() noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> handle) { tp->schedule([handle] { handle.resume(); }, nullptr, priority, "Resume on pool"); }
+	void await_resume() noexcept {}
+};
+
+inline ResumeOnPoolAwaiter resume_on_pool(JobPriority priority = JobPriority::NORMAL) { return ResumeOnPoolAwaiter{ priority }; }
+
+// Continues the coroutine on the main thread, at the point of the frame where main thread jobs are run. No-op if
+// already on the main thread.
+struct ResumeOnMainThreadAwaiter
+{
+	bool await_ready() noexcept { return tp->isMainThread(); }
+	void await_suspend(std::coroutine_handle<> handle) { tp->scheduleOnMainThread([handle] { handle.resume(); }, nullptr, "Resume on main thread"); }
+	void await_resume() noexcept {}
+};
+
+inline ResumeOnMainThreadAwaiter resume_on_main_thread() { return ResumeOnMainThreadAwaiter{}; }
+
+// Runs func as a separate job with the given priority, and continues the coroutine with its result on that job
+template <typename F>
+class RunOnPoolAwaiter
+{
+public:
+	using Result = std::invoke_result_t<F&>;
+
+	RunOnPoolAwaiter(F&& f, JobPriority p) : func(std::move(f)), priority(p) {}
+
+	bool await_ready() noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		tp->schedule([this, handle]
+		{
+			if constexpr (std::is_void_v<Result>)
+				func();
+			else
+				result.emplace(func());
+			handle.resume();
+		}, nullptr, priority, "Run on pool");
+	}
+	Result await_resume()
+	{
+		if constexpr (!std::is_void_v<Result>)
+			return std::move(*result);
+	}
+
+private:
+	struct Empty {};
+	F func;
+	JobPriority priority;
+	std::optional<std::conditional_t<std::is_void_v<Result>, Empty, Result>> result;
+};
+
+template <typename F>
+RunOnPoolAwaiter<std::decay_t<F>> run_on_pool(F&& func, JobPriority priority = JobPriority::NORMAL)
+{
+	return RunOnPoolAwaiter<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(func)), priority);
+}
+
+// Starts all tasks as separate jobs, and continues the coroutine where the last one finishes. Results can be
+// taken with Task::result afterwards.
+template <typename T>
+class WhenAllAwaiter
+{
+public:
+	WhenAllAwaiter(std::vector<Task<T>>& t, JobPriority p) : tasks(t), priority(p) {}
+
+	bool await_ready() noexcept { return tasks.empty(); }
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		// The awaiting coroutine and the tasks vector may be gone as soon as the last task is scheduled
+		std::vector<std::coroutine_handle<typename Task<T>::promise_type>> handles;
+		handles.reserve(tasks.size());
+		remaining.store((uint32)tasks.size(), std::memory_order_relaxed);
+		for (Task<T>& task : tasks)
+		{
+			task.handle.promise().continuation = handle;
+			task.handle.promise().remaining = &remaining;
+			handles.push_back(task.handle);
+		}
+		const JobPriority jobPriority = priority;
+		for (auto taskHandle : handles)
+			tp->schedule([taskHandle] { taskHandle.resume(); }, nullptr, jobPriority, "when_all task");
+	}
+	void await_resume() noexcept {}
+
+private:
+	std::vector<Task<T>>& tasks;
+	JobPriority priority;
+	std::atomic<uint32> remaining = 0;
+};
+
+template <typename T>
+WhenAllAwaiter<T> when_all(std::vector<Task<T>>& tasks, JobPriority priority = JobPriority::NORMAL)
+{
+	return WhenAllAwaiter<T>(tasks, priority);
+}
+
+// One-shot event that coroutines can wait for without blocking. Waiters are continued on the thread pool.
+class AsyncEvent
+{
+public:
+	AsyncEvent() = default;
+	AsyncEvent(const AsyncEvent&) = delete;
+	AsyncEvent& operator=(const AsyncEvent&) = delete;
+
+	bool isSet() const { return set.load(std::memory_order_acquire); }
+
+	void signal(JobPriority priority = JobPriority::NORMAL)
+	{
+		std::vector<std::coroutine_handle<>> waitersToResume;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			set.store(true, std::memory_order_release);
+			waitersToResume.swap(waiters);
+		}
+		for (std::coroutine_handle<> waiter : waitersToResume)
+			tp->schedule([waiter] { waiter.resume(); }, nullptr, priority, "Event waiter");
+	}
+
+	auto operator co_await() noexcept
+	{
+		struct Awaiter
+		{
+			AsyncEvent& event;
+
+			bool await_ready() noexcept { return event.isSet(); }
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				std::lock_guard<std::mutex> lock(event.mutex);
+				if (event.set.load(std::memory_order_relaxed))
+					return false;
+				event.waiters.push_back(handle);
+				return true;
+			}
+			void await_resume() noexcept {}
+		};
+		return Awaiter{ *this };
+	}
+
+private:
+	std::mutex mutex;
+	std::atomic_bool set = false;
+	std::vector<std::coroutine_handle<>> waiters; // Guarded by mutex
+};
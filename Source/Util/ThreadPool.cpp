@@ -0,0 +1,774 @@
+#include "ThreadPool.h"
+
+#include <chrono>
+
+#include <3rdParty/ImGui/imgui.h>
+#include <Util/AutoImGui.h>
+#include <Util/JobTelemetry.h>
+#include <Util/SimpleThreadPool.h>
+
+static constexpr int NUM_IDLE_SPINS_BEFORE_SLEEP = 64;
+
+static std::atomic<uint32> next_pool_id = 1;
+
+// Pool ids are never reused, so these can't match a pool that has been destroyed since
+static thread_local uint32 tls_worker_pool_id = 0;
+static thread_local int tls_worker_index = -1;
+static thread_local uint32 tls_external_pool_id = 0;
+static thread_local JobAllocator* tls_external_allocator = nullptr;
+static thread_local int tls_job_depth = 0; // Jobs run while waiting inside jobs are nested
+
+static uint32 random_victim_seed()
+{
+	static thread_local uint32 state = (uint32)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+bool WorkStealingDeque::push(Job* job)
+{
+	const int64 b = bottom.load(std::memory_order_relaxed);
+	const int64 t = top.load(std::memory_order_acquire);
+	if (b - t >= CAPACITY)
+		return false;
+	buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release); // Publishes the job to thieves
+	return true;
+}
+
+Job* WorkStealingDeque::pop()
+{
+	const int64 b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 t = top.load(std::memory_order_relaxed);
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed); // Empty
+		return nullptr;
+	}
+
+	Job* job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job, race against thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkStealingDeque::steal()
+{
+	int64 t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64 b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return nullptr;
+
+	Job* job = buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr; // Lost the race against another thief or the owner
+	return job;
+}
+
+Job* JobAllocator::allocate()
+{
+	// Jobs finish roughly in allocation order, so if the next few are still in flight, the ring is probably full
+	for (uint32 i = 0; i < MAX_PROBES; i++)
+	{
+		Job& job = jobs[cursor];
+		cursor = (cursor + 1) % SIZE;
+		if (!job.inUse.load(std::memory_order_acquire))
+		{
+			// Reused jobs keep the fields of the previous one
+			job.name = nullptr;
+			job.counter = nullptr;
+			job.priority = JobPriority::NORMAL;
+			job.holdsBackgroundSlot = false;
+			job.inUse.store(true, std::memory_order_relaxed);
+			return &job;
+		}
+	}
+
+	Job* job = new Job;
+	job->heapAllocated = true;
+	job->inUse.store(true, std::memory_order_relaxed);
+	return job;
+}
+
+void JobAllocator::free(Job* job)
+{
+	if (job->heapAllocated)
+		delete job;
+	else
+		job->inUse.store(false, std::memory_order_release);
+}
+
+void JobQueue::push(Job* job)
+{
+	if (count == ring.size())
+	{
+		std::vector<Job*> grown(std::max<size_t>(ring.size() * 2, 64));
+		for (size_t i = 0; i < count; i++)
+			grown[i] = ring[(head + i) & (ring.size() - 1)];
+		ring.swap(grown);
+		head = 0;
+	}
+	ring[(head + count) & (ring.size() - 1)] = job;
+	count++;
+}
+
+Job* JobQueue::pop()
+{
+	if (count == 0)
+		return nullptr;
+	Job* job = ring[head];
+	head = (head + 1) & (ring.size() - 1);
+	count--;
+	return job;
+}
+
+ThreadPool::ThreadStats& ThreadPool::ThreadStats::operator+=(const ThreadStats& other)
+{
+	numJobs += other.numJobs;
+	busyNs += other.busyNs;
+	queuedNs += other.queuedNs;
+	idleNs += other.idleNs;
+	sleepNs += other.sleepNs;
+	waitNs += other.waitNs;
+	numSteals += other.numSteals;
+	numInjectedJobs += other.numInjectedJobs;
+	numContendedLocks += other.numContendedLocks;
+	lockWaitNs += other.lockWaitNs;
+	return *this;
+}
+
+ThreadPool::ThreadStats ThreadPool::ThreadCounters::load() const
+{
+	ThreadStats stats;
+	stats.numJobs = numJobs.load(std::memory_order_relaxed);
+	stats.busyNs = busyNs.load(std::memory_order_relaxed);
+	stats.queuedNs = queuedNs.load(std::memory_order_relaxed);
+	stats.idleNs = idleNs.load(std::memory_order_relaxed);
+	stats.sleepNs = sleepNs.load(std::memory_order_relaxed);
+	stats.waitNs = waitNs.load(std::memory_order_relaxed);
+	stats.numSteals = numSteals.load(std::memory_order_relaxed);
+	stats.numInjectedJobs = numInjectedJobs.load(std::memory_order_relaxed);
+	stats.numContendedLocks = numContendedLocks.load(std::memory_order_relaxed);
+	stats.lockWaitNs = lockWaitNs.load(std::memory_order_relaxed);
+	return stats;
+}
+
+ThreadPool::ThreadPool(size_t num_threads) : poolId(next_pool_id++), mainThreadId(std::this_thread::get_id()),
+	maxRunningBackgroundJobs(std::max((int)num_threads - 1, 1))
+{
+	job_telemetry::set_thread_name("Main thread");
+	workers.reserve(num_threads);
+	for (size_t i = 0; i < num_threads; i++)
+		workers.push_back(std::make_unique<Worker>());
+	// Start threads only after all workers exist, they steal from each other right away
+	for (size_t i = 0; i < num_threads; i++)
+		workers[i]->thread = std::thread([this, i] { workerLoop((int)i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	sleepCondition.notify_all();
+	for (std::unique_ptr<Worker>& worker : workers)
+		worker->thread.join();
+	// Workers may have left jobs for the main thread before they finished
+	runMainThreadJobs();
+}
+
+bool ThreadPool::isWorkerThread() const
+{
+	return getCurrentWorkerIndex() >= 0;
+}
+
+int ThreadPool::getCurrentWorkerIndex() const
+{
+	return tls_worker_pool_id == poolId ? tls_worker_index : -1;
+}
+
+ThreadPool::ThreadCounters& ThreadPool::getCurrentCounters()
+{
+	const int workerIndex = getCurrentWorkerIndex();
+	if (workerIndex >= 0)
+		return workers[workerIndex]->counters;
+	return isMainThread() ? mainThreadCounters : otherThreadCounters;
+}
+
+ThreadPool::ThreadStats ThreadPool::getThreadStats(size_t slot) const
+{
+	assert(slot < getNumStatSlots());
+	if (slot < workers.size())
+		return workers[slot]->counters.load();
+	return slot == workers.size() ? mainThreadCounters.load() : otherThreadCounters.load();
+}
+
+ThreadPool::ThreadStats ThreadPool::getTotalStats() const
+{
+	ThreadStats total;
+	for (size_t slot = 0; slot < getNumStatSlots(); slot++)
+		total += getThreadStats(slot);
+	return total;
+}
+
+size_t ThreadPool::getNumMainThreadJobs()
+{
+	std::lock_guard<std::mutex> lock(mainThreadQueueMutex);
+	return mainThreadQueue.size();
+}
+
+void ThreadPool::lockQueue(std::mutex& mutex)
+{
+	if (mutex.try_lock())
+		return;
+
+	const int64 startNs = job_telemetry::now_ns();
+	mutex.lock();
+	const int64 endNs = job_telemetry::now_ns();
+	ThreadCounters& counters = getCurrentCounters();
+	counters.numContendedLocks.fetch_add(1, std::memory_order_relaxed);
+	counters.lockWaitNs.fetch_add(endNs - startNs, std::memory_order_relaxed);
+	job_telemetry::record_span("Queue lock wait", startNs, endNs);
+}
+
+Job* ThreadPool::allocateJob()
+{
+	const int workerIndex = getCurrentWorkerIndex();
+	if (workerIndex >= 0)
+		return workers[workerIndex]->allocator.allocate();
+
+	if (tls_external_pool_id != poolId)
+	{
+		std::lock_guard<std::mutex> lock(externalAllocatorsMutex);
+		std::unique_ptr<JobAllocator>& allocator = externalAllocators[std::this_thread::get_id()];
+		if (allocator == nullptr)
+			allocator = std::make_unique<JobAllocator>();
+		tls_external_pool_id = poolId;
+		tls_external_allocator = allocator.get();
+	}
+	return tls_external_allocator->allocate();
+}
+
+void ThreadPool::submit(Job* job, JobCounter* counter)
+{
+	assert(!stop || isWorkerThread()); // Workers keep running until no jobs are queued
+
+	job->counter = counter;
+	job->submitTimeNs = job_telemetry::now_ns();
+	job->holdsBackgroundSlot = false;
+	if (counter != nullptr)
+		counter->count.fetch_add(1, std::memory_order_relaxed);
+
+	const int priority = (int)job->priority;
+	const int workerIndex = getCurrentWorkerIndex();
+	if (workerIndex < 0 || !workers[workerIndex]->deques[priority].push(job))
+	{
+		InjectionQueue& queue = injectionQueues[priority];
+		lockQueue(queue.mutex);
+		std::lock_guard<std::mutex> lock(queue.mutex, std::adopt_lock);
+		queue.jobs.push(job);
+		queue.size.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Sleeping workers check the queued counts under sleepMutex, so the notification can't be missed
+	numQueuedJobs[priority].fetch_add(1, std::memory_order_seq_cst);
+	if (numSleepingWorkers.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		sleepCondition.notify_one();
+	}
+}
+
+void ThreadPool::submitToMainThread(Job* job, JobCounter* counter)
+{
+	// The main thread doesn't take background slots, whatever the priority
+	job->counter = counter;
+	job->submitTimeNs = job_telemetry::now_ns();
+	job->holdsBackgroundSlot = false;
+	if (counter != nullptr)
+		counter->count.fetch_add(1, std::memory_order_relaxed);
+
+	lockQueue(mainThreadQueueMutex);
+	std::lock_guard<std::mutex> lock(mainThreadQueueMutex, std::adopt_lock);
+	mainThreadQueue.push(job);
+}
+
+void ThreadPool::runMainThreadJobs(double budget_ms)
+{
+	assert(isMainThread());
+
+	if (job_telemetry::is_capturing())
+	{
+		// Sampled once a frame
+		int64 numQueued = 0;
+		for (const std::atomic<int64>& n : numQueuedJobs)
+			numQueued += n.load(std::memory_order_relaxed);
+		job_telemetry::record_counter("Queued jobs", numQueued);
+		job_telemetry::record_counter("Main thread jobs", getNumMainThreadJobs());
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (;;)
+	{
+		Job* job;
+		{
+			lockQueue(mainThreadQueueMutex);
+			std::lock_guard<std::mutex> lock(mainThreadQueueMutex, std::adopt_lock);
+			job = mainThreadQueue.pop();
+			if (job == nullptr)
+				return;
+		}
+		execute(job);
+
+		const double elapsedMs = (std::chrono::high_resolution_clock::now() - startTime).count() / 1e6;
+		if (elapsedMs >= budget_ms)
+			return;
+	}
+}
+
+Job* ThreadPool::takeJob(int worker_index, int priority)
+{
+	Job* job = nullptr;
+	if (worker_index >= 0)
+		job = workers[worker_index]->deques[priority].pop();
+
+	InjectionQueue& queue = injectionQueues[priority];
+	if (job == nullptr && queue.size.load(std::memory_order_relaxed) > 0)
+	{
+		lockQueue(queue.mutex);
+		std::lock_guard<std::mutex> lock(queue.mutex, std::adopt_lock);
+		job = queue.jobs.pop();
+		if (job != nullptr)
+		{
+			queue.size.fetch_sub(1, std::memory_order_relaxed);
+			getCurrentCounters().numInjectedJobs.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	if (job == nullptr)
+	{
+		const size_t numWorkers = workers.size();
+		const size_t start = random_victim_seed() % numWorkers;
+		for (size_t i = 0; i < numWorkers && job == nullptr; i++)
+		{
+			const size_t victim = (start + i) % numWorkers;
+			if ((int)victim != worker_index)
+				job = workers[victim]->deques[priority].steal();
+		}
+		if (job != nullptr)
+			getCurrentCounters().numSteals.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* ThreadPool::findJob(int worker_index, JobPriority lowest_priority)
+{
+	for (int priority = 0; priority <= (int)lowest_priority; priority++)
+	{
+		if (numQueuedJobs[priority].load(std::memory_order_relaxed) <= 0)
+			continue;
+
+		const bool background = priority == (int)JobPriority::BACKGROUND;
+		if (background)
+		{
+			// Reserve a background slot first, so the limit can't be overshot by workers racing for jobs
+			int numRunning = numRunningBackgroundJobs.load(std::memory_order_relaxed);
+			do
+			{
+				if (numRunning >= maxRunningBackgroundJobs)
+					return nullptr;
+			} while (!numRunningBackgroundJobs.compare_exchange_weak(numRunning, numRunning + 1, std::memory_order_seq_cst));
+		}
+
+		if (Job* job = takeJob(worker_index, priority))
+		{
+			numQueuedJobs[priority].fetch_sub(1, std::memory_order_relaxed);
+			job->holdsBackgroundSlot = background;
+			return job;
+		}
+
+		if (background)
+			numRunningBackgroundJobs.fetch_sub(1, std::memory_order_seq_cst);
+	}
+	return nullptr;
+}
+
+bool ThreadPool::hasRunnableJobs() const
+{
+	for (int priority = 0; priority < (int)JobPriority::BACKGROUND; priority++)
+		if (numQueuedJobs[priority].load(std::memory_order_seq_cst) > 0)
+			return true;
+	return numQueuedJobs[(int)JobPriority::BACKGROUND].load(std::memory_order_seq_cst) > 0
+		&& numRunningBackgroundJobs.load(std::memory_order_seq_cst) < maxRunningBackgroundJobs;
+}
+
+void ThreadPool::execute(Job* job)
+{
+	JobCounter* counter = job->counter;
+	const bool background = job->holdsBackgroundSlot; // Released once the job is done
+	const char* name = job->name;
+	ThreadCounters& counters = getCurrentCounters();
+	const int64 startNs = job_telemetry::now_ns();
+	counters.queuedNs.fetch_add(startNs - job->submitTimeNs, std::memory_order_relaxed);
+
+	tls_job_depth++;
+	job->run();
+	JobAllocator::free(job);
+	tls_job_depth--;
+
+	const int64 endNs = job_telemetry::now_ns();
+	counters.numJobs.fetch_add(1, std::memory_order_relaxed);
+	if (tls_job_depth == 0)
+		counters.busyNs.fetch_add(endNs - startNs, std::memory_order_relaxed);
+	job_telemetry::record_span(name, startNs, endNs);
+
+	if (background)
+	{
+		// Queued background jobs might have been held back by this one, workers could have gone to sleep meanwhile
+		numRunningBackgroundJobs.fetch_sub(1, std::memory_order_seq_cst);
+		if (numQueuedJobs[(int)JobPriority::BACKGROUND].load(std::memory_order_seq_cst) > 0 && numSleepingWorkers.load(std::memory_order_seq_cst) > 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			sleepCondition.notify_one();
+		}
+	}
+
+	// Waiter can destroy the counter as soon as it reaches zero, it must not be touched after this
+	if (counter != nullptr)
+		counter->count.fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::wait(JobCounter& counter, JobPriority lowest_priority)
+{
+	waitUntil([&counter] { return counter.isDone(); }, lowest_priority);
+}
+
+void ThreadPool::waitUntil(const std::function<bool()>& is_done, JobPriority lowest_priority)
+{
+	const int workerIndex = getCurrentWorkerIndex();
+	const bool allowMainThreadJobs = isMainThread() && lowest_priority >= JobPriority::NORMAL;
+	lowest_priority = std::min(lowest_priority, JobPriority::NORMAL);
+	while (!is_done())
+	{
+		if (Job* job = findJob(workerIndex, lowest_priority))
+			execute(job);
+		else if (allowMainThreadJobs)
+		{
+			// The awaited jobs might be waiting for the main thread themselves
+			Job* mainThreadJob = nullptr;
+			{
+				lockQueue(mainThreadQueueMutex);
+				std::lock_guard<std::mutex> lock(mainThreadQueueMutex, std::adopt_lock);
+				mainThreadJob = mainThreadQueue.pop();
+			}
+			if (mainThreadJob != nullptr)
+				execute(mainThreadJob);
+			else
+				yieldWhileWaiting();
+		}
+		else
+			yieldWhileWaiting();
+	}
+}
+
+void ThreadPool::yieldWhileWaiting()
+{
+	const int64 startNs = job_telemetry::now_ns();
+	std::this_thread::yield();
+	getCurrentCounters().waitNs.fetch_add(job_telemetry::now_ns() - startNs, std::memory_order_relaxed);
+}
+
+void ThreadPool::workerLoop(int worker_index)
+{
+	tls_worker_pool_id = poolId;
+	tls_worker_index = worker_index;
+	job_telemetry::set_thread_name("Worker " + std::to_string(worker_index));
+
+	ThreadCounters& counters = workers[worker_index]->counters;
+	int64 idleStartNs = -1; // Since the last job finished, if no job has been found since
+	int numIdleSpins = 0;
+	for (;;)
+	{
+		if (Job* job = findJob(worker_index, JobPriority::BACKGROUND))
+		{
+			if (idleStartNs >= 0)
+			{
+				const int64 nowNs = job_telemetry::now_ns();
+				counters.idleNs.fetch_add(nowNs - idleStartNs, std::memory_order_relaxed);
+				job_telemetry::record_span("Idle", idleStartNs, nowNs);
+				idleStartNs = -1;
+			}
+			execute(job);
+			numIdleSpins = 0;
+			continue;
+		}
+		if (idleStartNs < 0)
+			idleStartNs = job_telemetry::now_ns();
+
+		if (stop)
+		{
+			int64 numQueued = 0;
+			for (const std::atomic<int64>& n : numQueuedJobs)
+				numQueued += n.load();
+			if (numQueued <= 0)
+				return;
+		}
+
+		if (++numIdleSpins < NUM_IDLE_SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		numSleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+		const int64 sleepStartNs = job_telemetry::now_ns();
+		sleepCondition.wait(lock, [this] { return stop || hasRunnableJobs(); });
+		counters.sleepNs.fetch_add(job_telemetry::now_ns() - sleepStartNs, std::memory_order_relaxed);
+		numSleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+		numIdleSpins = 0;
+	}
+}
+
+// Utilization of the threads over the last update interval, and queue depths
+static void thread_pool_window()
+{
+	constexpr double UPDATE_INTERVAL_NS = 0.5e9;
+	constexpr int HISTORY_SIZE = 256;
+	static std::vector<ThreadPool::ThreadStats> prevStats, intervalStats;
+	static int64 prevNs = 0, intervalNs = 0;
+	static float queuedHistory[HISTORY_SIZE] = {};
+	static int historyOffset = 0;
+	static char exportPath[256] = "job_trace.json";
+
+	if (tp == nullptr)
+		return;
+
+	const size_t numSlots = tp->getNumStatSlots();
+	const int64 nowNs = job_telemetry::now_ns();
+	if (prevStats.size() != numSlots)
+	{
+		prevStats.assign(numSlots, {});
+		intervalStats.assign(numSlots, {});
+	}
+	if (nowNs - prevNs >= UPDATE_INTERVAL_NS)
+	{
+		for (size_t slot = 0; slot < numSlots; slot++)
+		{
+			const ThreadPool::ThreadStats stats = tp->getThreadStats(slot);
+			const ThreadPool::ThreadStats& prev = prevStats[slot];
+			ThreadPool::ThreadStats& delta = intervalStats[slot];
+			delta.numJobs = stats.numJobs - prev.numJobs;
+			delta.busyNs = stats.busyNs - prev.busyNs;
+			delta.queuedNs = stats.queuedNs - prev.queuedNs;
+			delta.idleNs = stats.idleNs - prev.idleNs;
+			delta.sleepNs = stats.sleepNs - prev.sleepNs;
+			delta.waitNs = stats.waitNs - prev.waitNs;
+			delta.numSteals = stats.numSteals - prev.numSteals;
+			delta.numInjectedJobs = stats.numInjectedJobs - prev.numInjectedJobs;
+			delta.numContendedLocks = stats.numContendedLocks - prev.numContendedLocks;
+			delta.lockWaitNs = stats.lockWaitNs - prev.lockWaitNs;
+			prevStats[slot] = stats;
+		}
+		intervalNs = nowNs - prevNs;
+		prevNs = nowNs;
+	}
+
+	static const char* priorityNames[] = { "Critical", "High", "Normal", "Background" };
+	int64 numQueued = 0;
+	ImGui::Text("Queued jobs:");
+	for (int priority = 0; priority < (int)JobPriority::_COUNT; priority++)
+	{
+		const int64 n = tp->getNumQueuedJobs((JobPriority)priority);
+		numQueued += n;
+		ImGui::SameLine();
+		ImGui::Text("%s %lld", priorityNames[priority], n);
+	}
+	ImGui::SameLine();
+	ImGui::Text("Main thread %zu", tp->getNumMainThreadJobs());
+	queuedHistory[historyOffset] = (float)numQueued;
+	historyOffset = (historyOffset + 1) % HISTORY_SIZE;
+	ImGui::PlotLines("##QueuedJobs", queuedHistory, HISTORY_SIZE, historyOffset, "Queued jobs per frame", 0.0f, FLT_MAX, ImVec2(0, 60));
+
+	const double seconds = std::max(intervalNs, (int64)1) / 1e9;
+	auto percent = [&](uint64 ns) { return 100.0 * ns / std::max(intervalNs, (int64)1); };
+	if (ImGui::BeginTable("Threads", 10, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+	{
+		const char* columns[] = { "Thread", "Jobs/s", "Busy %", "Idle %", "Sleep %", "Wait %", "Avg queued ms", "Steals/s", "Injected/s", "Lock wait %" };
+		for (const char* column : columns)
+			ImGui::TableSetupColumn(column);
+		ImGui::TableHeadersRow();
+		for (size_t slot = 0; slot < numSlots; slot++)
+		{
+			const ThreadPool::ThreadStats& s = intervalStats[slot];
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			if (slot < tp->getNumWorkers())
+				ImGui::Text("Worker %zu", slot);
+			else
+				ImGui::TextUnformatted(slot == tp->getNumWorkers() ? "Main thread" : "Other threads");
+			ImGui::TableNextColumn(); ImGui::Text("%.0f", s.numJobs / seconds);
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", percent(s.busyNs));
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", percent(s.idleNs));
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", percent(s.sleepNs));
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", percent(s.waitNs));
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", s.numJobs > 0 ? s.queuedNs / 1e6 / s.numJobs : 0.0);
+			ImGui::TableNextColumn(); ImGui::Text("%.0f", s.numSteals / seconds);
+			ImGui::TableNextColumn(); ImGui::Text("%.0f", s.numInjectedJobs / seconds);
+			ImGui::TableNextColumn(); ImGui::Text("%.2f", percent(s.lockWaitNs));
+		}
+		ImGui::EndTable();
+	}
+
+	ImGui::Separator();
+	if (job_telemetry::is_capturing())
+	{
+		if (ImGui::Button("End capture"))
+			job_telemetry::end_capture();
+	}
+	else
+	{
+		if (ImGui::Button("Begin capture"))
+			job_telemetry::begin_capture();
+		ImGui::SameLine();
+		if (ImGui::Button("Export"))
+			job_telemetry::export_chrome_trace(exportPath);
+		ImGui::SameLine();
+		ImGui::InputText("##ExportPath", exportPath, sizeof(exportPath));
+	}
+	ImGui::Text("Captured spans: %llu, dropped: %llu", job_telemetry::get_num_captured_events(), job_telemetry::get_num_dropped_events());
+}
+
+REGISTER_IMGUI_WINDOW("Thread pool", thread_pool_window);
+
+static void benchmark_thread_pools()
+{
+	constexpr uint32 NUM_JOBS = 200000;
+	const size_t workerCounts[] = { 3, 6, 9, 12 };
+
+	std::atomic<uint32> numExecuted = 0;
+	auto tinyJob = [&numExecuted] { numExecuted.fetch_add(1, std::memory_order_relaxed); };
+	auto waitForAll = [&numExecuted]
+	{
+		while (numExecuted.load() < NUM_JOBS)
+			std::this_thread::yield();
+	};
+	auto measure = [&](auto func)
+	{
+		numExecuted = 0;
+		auto startTime = std::chrono::high_resolution_clock::now();
+		func();
+		auto finishTime = std::chrono::high_resolution_clock::now();
+		return NUM_JOBS / ((finishTime - startTime).count() / 1e9) / 1e6;
+	};
+
+	PLOG_INFO << "Thread pool benchmark, " << NUM_JOBS << " tiny jobs, enqueue and execute throughput in million jobs per second:";
+	for (size_t numWorkers : workerCounts)
+	{
+		double simpleEnqueue;
+		{
+			SimpleThreadPool pool(numWorkers);
+			simpleEnqueue = measure([&]
+			{
+				for (uint32 i = 0; i < NUM_JOBS; i++)
+					pool.enqueue(tinyJob);
+				waitForAll();
+			});
+		}
+
+		double enqueue, schedule, scheduleFromWorker, parallelFor;
+		{
+			ThreadPool pool(numWorkers);
+			enqueue = measure([&]
+			{
+				for (uint32 i = 0; i < NUM_JOBS; i++)
+					pool.enqueue(tinyJob);
+				waitForAll();
+			});
+			schedule = measure([&]
+			{
+				JobCounter counter;
+				for (uint32 i = 0; i < NUM_JOBS; i++)
+					pool.schedule(tinyJob, &counter);
+				pool.wait(counter);
+			});
+			scheduleFromWorker = measure([&]
+			{
+				JobCounter rootCounter;
+				pool.schedule([&]
+				{
+					JobCounter counter;
+					for (uint32 i = 0; i < NUM_JOBS; i++)
+						pool.schedule(tinyJob, &counter);
+					pool.wait(counter);
+				}, &rootCounter);
+				pool.wait(rootCounter);
+			});
+			parallelFor = measure([&]
+			{
+				pool.parallelFor(0, NUM_JOBS, 1, [&](uint32, uint32) { tinyJob(); });
+			});
+		}
+
+		PLOG_INFO << "\t" << numWorkers << " workers. SimpleThreadPool enqueue: " << simpleEnqueue << ", ThreadPool enqueue: " << enqueue
+			<< ", schedule: " << schedule << ", schedule from worker: " << scheduleFromWorker << ", parallelFor: " << parallelFor;
+	}
+
+	// Latency of short jobs while the pool is flooded with long bulk jobs, either in the same lane or in the background lane
+	constexpr int NUM_BULK_JOBS_PER_WORKER = 20;
+	constexpr int NUM_PROBES = 50;
+	constexpr auto BULK_JOB_DURATION = std::chrono::milliseconds(2);
+	auto measureLatency = [&](size_t num_workers, JobPriority bulk_priority, JobPriority probe_priority, double& out_avg_ms, double& out_max_ms)
+	{
+		ThreadPool pool(num_workers);
+		JobCounter counter;
+		auto bulkJob = [BULK_JOB_DURATION]
+		{
+			auto endTime = std::chrono::high_resolution_clock::now() + BULK_JOB_DURATION;
+			while (std::chrono::high_resolution_clock::now() < endTime)
+				;
+		};
+		for (size_t i = 0; i < num_workers * NUM_BULK_JOBS_PER_WORKER; i++)
+			pool.schedule(bulkJob, &counter, bulk_priority);
+
+		out_avg_ms = 0;
+		out_max_ms = 0;
+		for (int i = 0; i < NUM_PROBES; i++)
+		{
+			std::atomic<int64> latencyNs = -1;
+			auto scheduleTime = std::chrono::high_resolution_clock::now();
+			pool.schedule([&latencyNs, scheduleTime] { latencyNs = (std::chrono::high_resolution_clock::now() - scheduleTime).count(); }, nullptr, probe_priority);
+			while (latencyNs.load() < 0)
+				std::this_thread::yield();
+			const double latencyMs = latencyNs / 1e6;
+			out_avg_ms += latencyMs / NUM_PROBES;
+			out_max_ms = std::max(out_max_ms, latencyMs);
+		}
+		pool.wait(counter);
+	};
+
+	PLOG_INFO << "Job latency in milliseconds while flooded with " << NUM_BULK_JOBS_PER_WORKER << " jobs per worker taking "
+		<< BULK_JOB_DURATION.count() << "ms each:";
+	for (size_t numWorkers : workerCounts)
+	{
+		double sameLaneAvg, sameLaneMax, criticalAvg, criticalMax;
+		measureLatency(numWorkers, JobPriority::NORMAL, JobPriority::NORMAL, sameLaneAvg, sameLaneMax);
+		measureLatency(numWorkers, JobPriority::BACKGROUND, JobPriority::CRITICAL, criticalAvg, criticalMax);
+		PLOG_INFO << "\t" << numWorkers << " workers. Same lane average: " << sameLaneAvg << ", max: " << sameLaneMax
+			<< ". Critical over background average: " << criticalAvg << ", max: " << criticalMax;
+	}
+}
+
+REGISTER_IMGUI_FUNCTION("Benchmarks", "Thread pool throughput", benchmark_thread_pools);
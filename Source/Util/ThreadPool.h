@@ -1,123 +1,316 @@
-// Source: https://github.com/progschj/ThreadPool
-// With the following modification, to avoid usage of deprecated std::result_of:
-// https://github.com/progschj/ThreadPool/pull/81
-//
-// Copyright (c) 2012 Jakob Progsch, Václav Zeman
-// 
-// This software is provided 'as-is', without any express or implied
-// warranty. In no event will the authors be held liable for any damages
-// arising from the use of this software.
-// 
-// Permission is granted to anyone to use this software for any purpose,
-// including commercial applications, and to alter it and redistribute it
-// freely, subject to the following restrictions:
-// 
-//    1. The origin of this software must not be misrepresented; you must not
-//    claim that you wrote the original software. If you use this software
-//    in a product, an acknowledgment in the product documentation would be
-//    appreciated but is not required.
-// 
-//    2. Altered source versions must be plainly marked as such, and must not be
-//    misrepresented as being the original software.
-// 
-//    3. This notice may not be removed or altered from any source
-//    distribution.
-
-#ifndef THREAD_POOL_H
-#define THREAD_POOL_H
+#pragma once
 
-#include <vector>
-#include <queue>
-#include <memory>
-#include <thread>
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <condition_variable>
-#include <future>
+#include <cstddef>
+#include <cstring>
 #include <functional>
-#include <stdexcept>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <Common.h>
+
+// Workers always pick the most important job available. Background jobs (bulk decoding, importing) never occupy
+// all workers, so more important jobs don't have to wait for them to finish.
+enum class JobPriority
+{
+	CRITICAL,
+	HIGH,
+	NORMAL,
+	BACKGROUND,
+	_COUNT
+};
 
-class ThreadPool {
+// Counts unfinished jobs scheduled with it. Waiting on it with ThreadPool::wait runs other jobs meanwhile.
+class JobCounter
+{
 public:
-    ThreadPool(size_t);
-    template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) 
-        -> std::future<decltype(f(args...))>;
-    ~ThreadPool();
+	bool isDone() const { return count.load(std::memory_order_acquire) == 0; }
+
 private:
-    // need to keep track of threads so we can join them
-    std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
-    
-    // synchronization
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop;
+	friend class ThreadPool;
+	std::atomic<uint32> count = 0;
 };
- 
-// the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads)
-    :   stop(false)
+
+// Type erased callable with inline storage, so typical lambdas don't need a heap allocation
+class Job
 {
-    for(size_t i = 0;i<threads;++i)
-        workers.emplace_back(
-            [this]
-            {
-                for(;;)
-                {
-                    std::function<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock,
-                            [this]{ return this->stop || !this->tasks.empty(); });
-                        if(this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-
-                    task();
-                }
-            }
-        );
-}
-
-// add new work item to the pool
-template<class F, class... Args>
-auto ThreadPool::enqueue(F&& f, Args&&... args) 
-    -> std::future<decltype(f(args...))>
+public:
+	static constexpr size_t STORAGE_SIZE = 96;
+
+	template <class F>
+	void set(F&& f)
+	{
+		using Func = std::decay_t<F>;
+		if constexpr (sizeof(Func) <= STORAGE_SIZE && alignof(Func) <= alignof(std::max_align_t))
+		{
+			new (storage) Func(std::forward<F>(f));
+			runFunc = [](Job& job)
+			{
+				Func* func = std::launder(reinterpret_cast<Func*>(job.storage));
+				(*func)();
+				func->~Func();
+			};
+		}
+		else
+		{
+			Func* func = new Func(std::forward<F>(f));
+			memcpy(storage, &func, sizeof(func));
+			runFunc = [](Job& job)
+			{
+				Func* func;
+				memcpy(&func, job.storage, sizeof(func));
+				(*func)();
+				delete func;
+			};
+		}
+	}
+
+	void run() { runFunc(*this); }
+
+private:
+	friend class ThreadPool;
+	friend class JobAllocator;
+
+	alignas(std::max_align_t) uint8 storage[STORAGE_SIZE];
+	void (*runFunc)(Job&) = nullptr;
+	const char* name = nullptr; // Literal, shown in job telemetry
+	int64 submitTimeNs = 0;
+	JobCounter* counter = nullptr;
+	JobPriority priority = JobPriority::NORMAL;
+	bool holdsBackgroundSlot = false; // Set when a worker took it with a background slot, freed after it ran
+	std::atomic_bool inUse = false;
+	bool heapAllocated = false;
+};
+
+// Fixed size Chase-Lev deque. The owner thread pushes and pops at the bottom, any thread can steal from the top.
+class WorkStealingDeque
 {
-    using return_type = decltype(f(args...));
-
-    auto task = std::make_shared< std::packaged_task<return_type()> >(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-        );
-        
-    std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-
-        // don't allow enqueueing after stopping the pool
-        if(stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
-
-        tasks.emplace([task](){ (*task)(); });
-    }
-    condition.notify_one();
-    return res;
-}
-
-// the destructor joins all threads
-inline ThreadPool::~ThreadPool()
+public:
+	static constexpr int64 CAPACITY = 4096;
+
+	bool push(Job* job);
+	Job* pop();
+	Job* steal();
+
+private:
+	alignas(64) std::atomic<int64> top = 0;
+	alignas(64) std::atomic<int64> bottom = 0;
+	std::atomic<Job*> buffer[CAPACITY] = {};
+};
+
+// Ring of reusable jobs, only its owner thread allocates from it. Jobs are freed by whoever ran them.
+class JobAllocator
 {
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        stop = true;
-    }
-    condition.notify_all();
-    for(std::thread &worker: workers)
-        worker.join();
-}
-
-#endif
\ No newline at end of file
+public:
+	static constexpr uint32 SIZE = 1024;
+	static constexpr uint32 MAX_PROBES = 16;
+
+	Job* allocate();
+	static void free(Job* job);
+
+private:
+	Job jobs[SIZE];
+	uint32 cursor = 0;
+};
+
+// FIFO of jobs, guarded by its owner. Unlike std::deque it keeps its memory, so it stops allocating once it has grown to
+// the most jobs queued at once.
+class JobQueue
+{
+public:
+	void push(Job* job);
+	Job* pop(); // nullptr if empty
+	bool empty() const { return count == 0; }
+	size_t size() const { return count; }
+
+private:
+	std::vector<Job*> ring; // Power of two sized
+	size_t head = 0;
+	size_t count = 0;
+};
+
+// Work-stealing thread pool. Each worker has its own deques and steals from the others when it runs out of work.
+// Jobs scheduled from other threads go through shared injection queues. There is a separate queue for jobs that must
+// run on the main thread (e.g. using the immediate context), drained at a fixed point of the frame.
+class ThreadPool
+{
+public:
+	ThreadPool(size_t num_threads); // The constructing thread is considered the main thread
+	~ThreadPool();
+
+	// Compatible with the previous simple thread pool. Prefer schedule when the result isn't needed, it doesn't allocate.
+	template <class F, class... Args>
+	auto enqueue(F&& f, Args&&... args) -> std::future<decltype(f(args...))>
+	{
+		using return_type = decltype(f(args...));
+		std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		std::future<return_type> res = task.get_future();
+		schedule([task = std::move(task)]() mutable { task(); });
+		return res;
+	}
+
+	// Name must be a string literal, jobs are told apart by it in the telemetry
+	template <class F>
+	void schedule(F&& f, JobCounter* counter = nullptr, JobPriority priority = JobPriority::NORMAL, const char* name = "Job")
+	{
+		Job* job = allocateJob();
+		job->set(std::forward<F>(f));
+		job->priority = priority;
+		job->name = name;
+		submit(job, counter);
+	}
+
+	template <class F>
+	void scheduleOnMainThread(F&& f, JobCounter* counter = nullptr, const char* name = "Main thread job")
+	{
+		Job* job = allocateJob();
+		job->set(std::forward<F>(f));
+		job->priority = JobPriority::NORMAL;
+		job->name = name;
+		submitToMainThread(job, counter);
+	}
+
+	// Runs main thread jobs in order until the queue is empty or the budget is spent. At least one job runs if
+	// there is any, so the queue always makes progress.
+	void runMainThreadJobs(double budget_ms = std::numeric_limits<double>::max());
+
+	// Runs other jobs while waiting, so it's safe to call from jobs as well. Only jobs at least as important as
+	// lowest_priority are picked up, others could take much longer than what's being waited for. Background jobs are
+	// never picked up, so background jobs shouldn't wait for other background jobs, they might not get a free
+	// background slot. Main thread jobs are run too when waiting on the main thread, unless waiting for high
+	// priority work only (e.g. frame jobs, that shouldn't be held up by uploads).
+	void wait(JobCounter& counter, JobPriority lowest_priority = JobPriority::NORMAL);
+
+	// Same as wait, until is_done returns true
+	void waitUntil(const std::function<bool()>& is_done, JobPriority lowest_priority = JobPriority::NORMAL);
+
+	// Calls func(chunk_begin, chunk_end) for chunks of [begin, end) in parallel. The calling thread takes part.
+	template <class F>
+	void parallelFor(uint32 begin, uint32 end, uint32 grain_size, F&& func, JobPriority priority = JobPriority::NORMAL)
+	{
+		if (end <= begin)
+			return;
+		grain_size = std::max(grain_size, 1u);
+		const uint32 numChunks = (end - begin - 1) / grain_size + 1;
+		JobCounter counter;
+		for (uint32 c = 1; c < numChunks; c++)
+		{
+			const uint32 chunkBegin = begin + c * grain_size;
+			const uint32 chunkEnd = end - chunkBegin > grain_size ? chunkBegin + grain_size : end;
+			schedule([&func, chunkBegin, chunkEnd] { func(chunkBegin, chunkEnd); }, &counter, priority, "parallelFor");
+		}
+		func(begin, end - begin > grain_size ? begin + grain_size : end);
+		wait(counter, (JobPriority)std::min((int)priority, (int)JobPriority::NORMAL));
+	}
+
+	size_t getNumWorkers() const { return workers.size(); }
+	bool isWorkerThread() const;
+	bool isMainThread() const { return std::this_thread::get_id() == mainThreadId; }
+
+	// Counters of a thread since the pool was created, times are in nanoseconds. Only the outermost job counts as
+	// busy time when jobs are run while waiting inside other jobs.
+	struct ThreadStats
+	{
+		uint64 numJobs = 0;
+		uint64 busyNs = 0;
+		uint64 queuedNs = 0; // Total time the jobs run by the thread spent queued
+		uint64 idleNs = 0; // Workers only, looking for jobs or sleeping
+		uint64 sleepNs = 0; // Part of idleNs
+		uint64 waitNs = 0; // Waiting for jobs of other threads to finish, with nothing else to run
+		uint64 numSteals = 0;
+		uint64 numInjectedJobs = 0; // Taken from the shared queues
+		uint64 numContendedLocks = 0; // Queue locks held by another thread
+		uint64 lockWaitNs = 0;
+
+		ThreadStats& operator+=(const ThreadStats& other);
+	};
+
+	// Workers first, then the main thread, then all other threads together
+	size_t getNumStatSlots() const { return workers.size() + 2; }
+	ThreadStats getThreadStats(size_t slot) const;
+	ThreadStats getTotalStats() const;
+	int64 getNumQueuedJobs(JobPriority priority) const { return numQueuedJobs[(int)priority].load(std::memory_order_relaxed); }
+	size_t getNumMainThreadJobs();
+
+private:
+	static constexpr int NUM_PRIORITIES = (int)JobPriority::_COUNT;
+
+	// Only the owner thread updates the counters of a worker, others read them. Relaxed atomics, each on its own
+	// cache line, so counting is about as cheap as plain increments.
+	struct alignas(64) ThreadCounters
+	{
+		std::atomic<uint64> numJobs = 0;
+		std::atomic<uint64> busyNs = 0;
+		std::atomic<uint64> queuedNs = 0;
+		std::atomic<uint64> idleNs = 0;
+		std::atomic<uint64> sleepNs = 0;
+		std::atomic<uint64> waitNs = 0;
+		std::atomic<uint64> numSteals = 0;
+		std::atomic<uint64> numInjectedJobs = 0;
+		std::atomic<uint64> numContendedLocks = 0;
+		std::atomic<uint64> lockWaitNs = 0;
+
+		ThreadStats load() const;
+	};
+
+	struct Worker
+	{
+		WorkStealingDeque deques[NUM_PRIORITIES];
+		JobAllocator allocator;
+		std::thread thread;
+		ThreadCounters counters;
+	};
+
+	Job* allocateJob();
+	void submit(Job* job, JobCounter* counter);
+	void submitToMainThread(Job* job, JobCounter* counter);
+	Job* findJob(int worker_index, JobPriority lowest_priority);
+	Job* takeJob(int worker_index, int priority);
+	bool hasRunnableJobs() const;
+	void execute(Job* job);
+	void yieldWhileWaiting();
+	void workerLoop(int worker_index);
+	int getCurrentWorkerIndex() const;
+	ThreadCounters& getCurrentCounters();
+	void lockQueue(std::mutex& mutex); // Counts contention, release with a lock_guard adopting the lock
+
+	const uint32 poolId;
+	const std::thread::id mainThreadId;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	struct InjectionQueue
+	{
+		std::mutex mutex;
+		JobQueue jobs;
+		std::atomic<uint32> size = 0;
+	};
+	InjectionQueue injectionQueues[NUM_PRIORITIES];
+
+	std::mutex mainThreadQueueMutex;
+	JobQueue mainThreadQueue;
+
+	// Allocators of threads that aren't workers of this pool
+	std::mutex externalAllocatorsMutex;
+	std::unordered_map<std::thread::id, std::unique_ptr<JobAllocator>> externalAllocators;
+
+	ThreadCounters mainThreadCounters;
+	ThreadCounters otherThreadCounters;
+
+	std::atomic<int64> numQueuedJobs[NUM_PRIORITIES] = {};
+	std::atomic<int> numRunningBackgroundJobs = 0;
+	const int maxRunningBackgroundJobs;
+	std::atomic<int> numSleepingWorkers = 0;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	std::atomic_bool stop = false;
+};